@@ -33,9 +33,10 @@ uniform sampler2D uColormap;
 uniform bool uHasColormap = false;
 
 #include "include/light.inc.glsl"
+#include "include/light-tiles.inc.glsl"
 
-uniform PointLight light[3];
 uniform float lightPowerScale = 1.0;
+uniform bool uLightCulling = true;
 
 // Global switches
 uniform bool uIsShadowMapEnabled = true;
@@ -77,25 +78,43 @@ void pbrShading(const in GFragment fragment, out OutputFragment out_fragment)
 
 	out_fragment.radiance = vec4(0.0, 0.0, 0.0, 1.0);
 
-	for (int k = 0 ; k < 3 ; ++k) {
+	// When culling is on, iterate over unbounded lights (first in the buffer)
+	// then over the bounded ones listed for this tile, unless it overflowed
+	uint lightListOffset = 0;
+	uint lightListCount = uLightCount;
+	bool useTileList = false;
+	if (uLightCulling) {
+		uvec2 tile = uvec2(gl_FragCoord.xy - uBlitOffset) / LIGHT_TILE_SIZE;
+		lightListOffset = lightTileOffset(tile);
+		uint tileLightCount = lightTiles[lightListOffset];
+		if (tileLightCount != LIGHT_TILE_OVERFLOW) {
+			lightListCount = uUnboundedLightCount + tileLightCount;
+			useTileList = true;
+		}
+	}
+
+	for (uint i = 0 ; i < lightListCount ; ++i) {
+		uint k = useTileList && i >= uUnboundedLightCount ? lightTiles[lightListOffset + 1 + i - uUnboundedLightCount] : i;
+		PointLight light = lights[k];
+
+		float attenuation = lightAttenuation(light, fragment.ws_coord);
+		if (attenuation <= 0.0) continue;
+
 		float shadow = 0;
 		if (uIsShadowMapEnabled) {
-			float shadowBias = shadowBiasFromNormal(light[k], fragment.normal);
-			shadowBias = 0.0001; // hardcoded hack
-			//shadowBias = 0.00005;
-			shadow = shadowAt(light[k], fragment.ws_coord, uShadowMapBias);
+			shadow = shadowAt(light, fragment.ws_coord, uShadowMapBias);
 			shadow = clamp(shadow, 0.0, 1.0);
 			//shadow *= .8;
 		}
 		
-		vec3 toLight = normalize(light[k].position_ws - fragment.ws_coord);
+		vec3 toLight = normalize(light.position_ws - fragment.ws_coord);
 		vec3 f = vec3(0.0);
 #ifdef OLD_BRDF
 		f = bsdfPbrMetallicRoughness(toCam, toLight, fragment.normal, surface.baseColor, surface.roughness, surface.metallic);
 #else // OLD_BRDF
 		f = brdf(toCam, fragment.normal, toLight, surface);
 #endif // OLD_BRDF
-		out_fragment.radiance.rgb += f * light[k].color * lightPowerScale * (1. - shadow);
+		out_fragment.radiance.rgb += f * light.color * lightPowerScale * attenuation * (1. - shadow);
 	}
 	out_fragment.radiance += vec4(fragment.emission, 0.0);
 }
@@ -188,7 +207,7 @@ void main() {
 
 	/*/ Minimap Shadow Depth
 	if (gl_FragCoord.x < 256 && gl_FragCoord.y < 256) {
-		float depth = texelFetch(light[0].shadowMap, ivec2(gl_FragCoord.xy * 4.0), 0).r;
+		float depth = texelFetch(uShadowMaps[0], ivec2(gl_FragCoord.xy * 4.0), 0).r;
 		out_fragment.radiance = vec4(vec3(pow(1. - depth, 0.1)), 1.0);
 	}
 	//*/
@@ -235,6 +254,7 @@ void main() {
 		out_fragment.radiance.a = 1.0;
 		//out_fragment.radiance.rgb = 0.5 + 0.5 * cos(2.*3.1416 * (clamp(1.-out_fragment.radiance.r, 0.0, 1.0) * .5 + vec3(.0,.33,.67)));
 		break;
+#ifndef COMPACT_GBUFFER // no third buffer in compact layout
 	case 9: // RAW_GBUFFER3
 		out_fragment.radiance.rgb = texelFetch(gbuffer2, ivec2(gl_FragCoord.xy), 0).rgb;
 		if (uHasColormap) {
@@ -242,6 +262,7 @@ void main() {
 		}
 		out_fragment.radiance.a = 1.0;
 		break;
+#endif // COMPACT_GBUFFER
 	}
 
 	if (uTransparentFilm) {
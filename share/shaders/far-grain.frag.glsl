@@ -5,6 +5,9 @@
 #pragma opt SHELL_CULLING
 #pragma opt NO_DISCARD_IN_PASS_EPSILON_DEPTH
 #pragma opt PSEUDO_LEAN
+#pragma opt COMPUTE_SPLATTING
+#pragma opt TEMPORAL_REPROJECTION
+#pragma varopt DEPTH_ONLY_POINTS DEPTH_ONLY_SPHERES
 
 const int cDebugShapeNone = -1;
 const int cDebugShapeRaytracedSphere = 0; // directly lit sphere, not using ad-hoc lighting
@@ -65,7 +68,9 @@ float computeWeight(vec2 uv, float sqDistToCenter) {
 ///////////////////////////////////////////////////////////////////////////////
 #if defined(PASS_BLIT_TO_MAIN_FBO)
 
-#ifdef PSEUDO_LEAN
+#if defined(COMPUTE_SPLATTING)
+// accumulated by grain/far-grain-splat.comp.glsl in buffers rather than in a secondary fbo
+#elif defined(PSEUDO_LEAN)
 #define IN_LEAN_LINEAR_GBUFFER
 #else // PSEUDO_LEAN
 #define IN_LINEAR_GBUFFER
@@ -73,6 +78,49 @@ float computeWeight(vec2 uv, float sqDistToCenter) {
 #define OUT_GBUFFER
 #include "include/gbuffer2.inc.glsl"
 
+#ifdef COMPUTE_SPLATTING
+#include "grain/far-grain-splat.inc.glsl"
+
+void autoUnpackGFragment(inout GFragment fragment) {
+    uint i = splatPixelIndex(ivec2(gl_FragCoord.xy));
+    fragment.baseColor.r = splatChannel(i, SPLAT_CHANNEL_BASECOLOR + 0);
+    fragment.baseColor.g = splatChannel(i, SPLAT_CHANNEL_BASECOLOR + 1);
+    fragment.baseColor.b = splatChannel(i, SPLAT_CHANNEL_BASECOLOR + 2);
+    fragment.alpha = splatChannel(i, SPLAT_CHANNEL_ALPHA);
+    fragment.normal.x = splatChannel(i, SPLAT_CHANNEL_NORMAL + 0);
+    fragment.normal.y = splatChannel(i, SPLAT_CHANNEL_NORMAL + 1);
+    fragment.normal.z = splatChannel(i, SPLAT_CHANNEL_NORMAL + 2);
+    fragment.roughness = splatChannel(i, SPLAT_CHANNEL_ROUGHNESS);
+}
+#endif // COMPUTE_SPLATTING
+
+#ifdef TEMPORAL_REPROJECTION
+// Resolved far grains of the previous frame (ping-pong buffers, see FarGrainRenderer)
+// history0 = (baseColor, depth), history1 = (normal, roughness), depth is 1 for empty pixels
+uniform sampler2D uHistory0;
+uniform sampler2D uHistory1;
+layout (binding = 0, rgba32f) uniform writeonly image2D uNextHistory0;
+layout (binding = 1, rgba32f) uniform writeonly image2D uNextHistory1;
+uniform bool uHasHistory = false;
+uniform mat4 uViewProjectionMatrix;
+uniform mat4 uInverseViewProjectionMatrix;
+uniform mat4 uPreviousViewProjectionMatrix;
+uniform mat4 uInversePreviousViewProjectionMatrix;
+uniform float uTemporalSubsetFraction = 0.25; // weight of the current frame
+uniform float uMaxReprojectionMotion = 8.0; // in pixels
+
+vec3 unprojectFragment(vec2 fragCoord, float depth, mat4 inverseViewProjection) {
+    vec4 p = inverseViewProjection * vec4(fragCoord / resolution.xy * 2.0 - 1.0, depth * 2.0 - 1.0, 1.0);
+    return p.xyz / p.w;
+}
+
+// Returns (fragCoord.xy, depth)
+vec3 projectFragment(vec3 position_ws, mat4 viewProjection) {
+    vec4 p = viewProjection * vec4(position_ws, 1.0);
+    return vec3((p.xy / p.w * 0.5 + 0.5) * resolution.xy, p.z / p.w * 0.5 + 0.5);
+}
+#endif // TEMPORAL_REPROJECTION
+
 // depth attachement of the target fbo
 // (roughly safe to use despite feedback loops because we know that there is
 // exactly one fragment per pixel)
@@ -90,7 +138,13 @@ uniform sampler2D uFboDepthTexture;
 
 // This stage gathers additive measures and turn them into regular g-buffer fragments
 void main() {
+#ifdef COMPUTE_SPLATTING
+    uint rawDepth = splatDepth[splatPixelIndex(ivec2(gl_FragCoord.xy))];
+    if (rawDepth == SPLAT_EMPTY_DEPTH) discard;
+    float d = uintBitsToFloat(rawDepth);
+#else // COMPUTE_SPLATTING
     float d = texelFetch(uFboDepthTexture, ivec2(gl_FragCoord.xy), 0).x;
+#endif // COMPUTE_SPLATTING
     gl_FragDepth = d;
     // add back uEpsilon here -- benchmark-me
     //gl_FragDepth = unlinearizeDepth(linearizeDepth(d) - uEpsilon);
@@ -98,9 +152,9 @@ void main() {
     GFragment fragment;
     autoUnpackGFragment(fragment);
 
-#ifdef NO_DISCARD_IN_PASS_EPSILON_DEPTH
+#if (defined(NO_DISCARD_IN_PASS_EPSILON_DEPTH) || defined(COMPUTE_SPLATTING)) && !defined(TEMPORAL_REPROJECTION)
     if (fragment.alpha < 0.00001) discard;
-#endif // NO_DISCARD_IN_PASS_EPSILON_DEPTH
+#endif // (NO_DISCARD_IN_PASS_EPSILON_DEPTH || COMPUTE_SPLATTING) && !TEMPORAL_REPROJECTION
     float weightNormalization = 1.0 / fragment.alpha; // inverse sum of integration weights
 
     fragment.baseColor *= weightNormalization;
@@ -128,6 +182,56 @@ void main() {
     fragment.roughness = mix(fragment.roughness, 1.0, dev);
 #endif // PSEUDO_LEAN
 
+#ifdef TEMPORAL_REPROJECTION
+    // Blend with the previous frame, in which other subsets of grains were splatted
+    bool hasCurrent = fragment.alpha > 0.00001 && d < 1.0;
+    bool hasHistory = false;
+    vec4 history0, history1;
+    vec3 historyFragCoord;
+    if (uHasHistory) {
+        // Reproject current sample if any, otherwise look for a history sample that stays in this pixel
+        vec2 previousFragCoord = gl_FragCoord.xy;
+        if (hasCurrent) {
+            vec3 position_ws = unprojectFragment(gl_FragCoord.xy, d, uInverseViewProjectionMatrix);
+            previousFragCoord = projectFragment(position_ws, uPreviousViewProjectionMatrix).xy;
+        }
+        ivec2 pp = ivec2(floor(previousFragCoord));
+        if (all(greaterThanEqual(pp, ivec2(0))) && all(lessThan(pp, ivec2(resolution.xy)))) {
+            history0 = texelFetch(uHistory0, pp, 0);
+            history1 = texelFetch(uHistory1, pp, 0);
+            if (history0.a < 1.0) {
+                vec3 historyPosition_ws = unprojectFragment(vec2(pp) + 0.5, history0.a, uInversePreviousViewProjectionMatrix);
+                historyFragCoord = projectFragment(historyPosition_ws, uViewProjectionMatrix);
+                float motion = length(historyFragCoord.xy - gl_FragCoord.xy);
+                if (hasCurrent) {
+                    // reject by motion and depth
+                    float depthDelta = abs(linearizeDepth(historyFragCoord.z) - linearizeDepth(d));
+                    hasHistory = motion < uMaxReprojectionMotion && depthDelta < uEpsilon;
+                } else {
+                    hasHistory = motion < 1.0;
+                }
+            }
+        }
+    }
+
+    if (hasCurrent && hasHistory) {
+        fragment.baseColor = mix(history0.rgb, fragment.baseColor, uTemporalSubsetFraction);
+        fragment.normal = mix(history1.xyz, fragment.normal, uTemporalSubsetFraction);
+        fragment.roughness = mix(history1.w, fragment.roughness, uTemporalSubsetFraction);
+    } else if (hasHistory) {
+        fragment.baseColor = history0.rgb;
+        fragment.normal = history1.xyz;
+        fragment.roughness = history1.w;
+        d = historyFragCoord.z;
+        gl_FragDepth = d;
+    }
+
+    bool isValid = hasCurrent || hasHistory;
+    imageStore(uNextHistory0, ivec2(gl_FragCoord.xy), vec4(fragment.baseColor, isValid ? d : 1.0));
+    imageStore(uNextHistory1, ivec2(gl_FragCoord.xy), vec4(fragment.normal, fragment.roughness));
+    if (!isValid) discard;
+#endif // TEMPORAL_REPROJECTION
+
     // Fix depth
     Ray ray_cs = fragmentRay(gl_FragCoord, projectionMatrix);
     vec3 cs_coord = (linearizeDepth(d) - uEpsilon) * ray_cs.direction;
@@ -160,6 +264,46 @@ void main() {
 #endif // not NO_DISCARD_IN_PASS_EPSILON_DEPTH
 }
 
+///////////////////////////////////////////////////////////////////////////////
+#elif defined(PASS_DEPTH) && (defined(DEPTH_ONLY_POINTS) || defined(DEPTH_ONLY_SPHERES))
+// Cheap shadow casters (see PointCloudSplitter::ShadowCasterModel), no g-buffer
+
+in FragmentData {
+    vec3 position_ws;
+    vec3 baseColor;
+    float radius;
+    float screenSpaceDiameter;
+    float diameterOvershot;
+    float metallic;
+    float roughness;
+} inData;
+
+#ifdef DEPTH_ONLY_SPHERES
+layout (depth_less) out float gl_FragDepth;
+
+#include "include/utils.inc.glsl"
+#include "include/raytracing.inc.glsl"
+#include "include/depth.inc.glsl"
+#endif // DEPTH_ONLY_SPHERES
+
+void main() {
+    vec2 uv = gl_PointCoord * 2.0 - 1.0;
+    if (dot(uv, uv) > 1.0) {
+        discard;
+    }
+
+#ifdef DEPTH_ONLY_SPHERES
+    // Sprite depth is the one of the grain center, move it to the sphere's front
+    Ray ray_cs = fragmentRay(gl_FragCoord, projectionMatrix);
+    vec3 center_cs = (viewMatrix * vec4(inData.position_ws, 1.0)).xyz;
+    vec3 hitPosition_cs;
+    if (!intersectRaySphere(hitPosition_cs, ray_cs, center_cs, inData.radius)) {
+        discard;
+    }
+    setFragmentDepth(hitPosition_cs);
+#endif // DEPTH_ONLY_SPHERES
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 #else // DEFAULT PASS
 
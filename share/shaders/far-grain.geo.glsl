@@ -43,6 +43,7 @@ out FragmentData {
 #include "include/gbuffer2.inc.glsl"
 #include "include/impostor.inc.glsl"
 uniform SphericalImpostor uImpostor[3];
+#include "grain/far-grain-appearance.inc.glsl"
 
 uniform bool uUseShellCulling = true;
 uniform sampler2D uDepthTexture;
@@ -53,6 +54,16 @@ uniform float uEpsilon;
 
 uniform bool uUseEarlyDepthTest;
 
+// Temporal reprojection only re-splats one subset of grains per frame
+uniform uint uTemporalSubsetCount = 1;
+uniform uint uTemporalSubsetIndex = 0;
+
+bool inTemporalSubset(uint animPointId) {
+	if (uTemporalSubsetCount <= 1) return true;
+	// hash to avoid spatial patterns if points are sorted
+	return ((animPointId * 2654435761u) >> 16) % uTemporalSubsetCount == uTemporalSubsetIndex;
+}
+
 bool inBBox(vec3 pos) {
 	if (!uUseBbox) return true;
 	else return (
@@ -80,7 +91,7 @@ bool depthTest(vec4 position_clipspace) {
 }
 
 void main() {
-	if (!inBBox(inData[0].position_ws)) {
+	if (!inBBox(inData[0].position_ws) || !inTemporalSubset(inData[0].vertexId)) {
 		return;
 	}
 
@@ -100,53 +111,7 @@ void main() {
 	}
 
 	gl_Position = position_clipspace;
-#ifdef USING_PRECEDURAL_COLOR
-	outData.baseColor = proceduralColor(inData[0].originalPosition_ws, inData[0].vertexId);
-#else // USING_PRECEDURAL_COLOR
-	mat4 gs_from_ws = randomGrainMatrix(int(inData[0].vertexId), outData.position_ws);
-	vec3 ray_ws_origin = (inverseViewMatrix * vec4(0, 0, 0, 1)).xyz;
-	vec3 ray_ws_direction = outData.position_ws - ray_ws_origin;
-	vec3 ray_gs_direction = normalize(mat3(gs_from_ws) * ray_ws_direction);
-
-	uint n = uImpostor[0].viewCount;
-	uvec4 i;
-	vec2 alpha;
-	DirectionToViewIndices(-ray_gs_direction, n, i, alpha);
-	vec2 calpha = vec2(1.) - alpha;
-
-	// base color
-	if (uImpostor[0].hasBaseColorMap) {
-		int level = textureQueryLevels(uImpostor[0].baseColorTexture);
-		mat4 colors = mat4(
-			texelFetch(uImpostor[0].baseColorTexture, ivec3(0, 0, int(i.x)), level - 1),
-			texelFetch(uImpostor[0].baseColorTexture, ivec3(0, 0, int(i.y)), level - 1),
-			texelFetch(uImpostor[0].baseColorTexture, ivec3(0, 0, int(i.z)), level - 1),
-			texelFetch(uImpostor[0].baseColorTexture, ivec3(0, 0, int(i.w)), level - 1)
-		);
-		vec4 c = colors * vec4(vec2(calpha.x, alpha.x) * calpha.y, vec2(calpha.x, alpha.x) * alpha.y);
-		outData.baseColor = c.rgb;// * 1.8;
-	} else {
-		outData.baseColor = uImpostor[0].baseColor;
-	}
-
-	// metallic/roughness
-	if (uImpostor[0].hasMetallicRoughnessMap) {
-		int level = textureQueryLevels(uImpostor[0].metallicRoughnessTexture);
-		mat4 colors = mat4(
-			texelFetch(uImpostor[0].metallicRoughnessTexture, ivec3(0, 0, int(i.x)), level - 1),
-			texelFetch(uImpostor[0].metallicRoughnessTexture, ivec3(0, 0, int(i.y)), level - 1),
-			texelFetch(uImpostor[0].metallicRoughnessTexture, ivec3(0, 0, int(i.z)), level - 1),
-			texelFetch(uImpostor[0].metallicRoughnessTexture, ivec3(0, 0, int(i.w)), level - 1)
-		);
-		vec4 c = colors * vec4(vec2(calpha.x, alpha.x) * calpha.y, vec2(calpha.x, alpha.x) * alpha.y);
-		outData.metallic = c.x;
-		outData.roughness = c.y;
-	} else {
-		outData.metallic = uImpostor[0].metallic;
-		outData.roughness = uImpostor[0].roughness;
-	}
-
-#endif // USING_PRECEDURAL_COLOR
+	FarGrainAppearance(outData.position_ws, inData[0].originalPosition_ws, inData[0].vertexId, outData.baseColor, outData.metallic, outData.roughness);
 	outData.radius = inData[0].radius;
 	outData.screenSpaceDiameter = SpriteSize_Botsch03(outData.radius, position_cs);
 	//outData.screenSpaceDiameter = SpriteSize(outData.radius, gl_Position);
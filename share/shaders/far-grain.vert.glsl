@@ -69,8 +69,7 @@ void main() {
 	outData.radius = uGrainRadius;
 	outData.position_ws = (modelMatrix * vec4(p, 1.0)).xyz;
 	outData.originalPosition_ws = (modelMatrix * vec4(p, 1.0)).xyz;
-	outData.vertexId = pointId;
-	outData.vertexId = animPointId%20; // WTF?
+	outData.vertexId = animPointId;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
@@ -0,0 +1,53 @@
+// Material of a far grain, either procedural or read from the last mip level
+// of its impostor atlas. Shared by far-grain.geo.glsl and far-grain-splat.comp.glsl
+// requires procedural-color.inc.glsl, impostor.inc.glsl and a uImpostor uniform
+
+void FarGrainAppearance(vec3 position_ws, vec3 originalPosition_ws, uint animPointId, out vec3 baseColor, out float metallic, out float roughness) {
+	uint vertexId = animPointId%20; // WTF?
+	metallic = uImpostor[0].metallic;
+	roughness = uImpostor[0].roughness;
+
+#ifdef USING_PRECEDURAL_COLOR
+	baseColor = proceduralColor(originalPosition_ws, vertexId);
+#else // USING_PRECEDURAL_COLOR
+	mat4 gs_from_ws = grainMatrix(animPointId, position_ws);
+	vec3 ray_ws_origin = (inverseViewMatrix * vec4(0, 0, 0, 1)).xyz;
+	vec3 ray_ws_direction = position_ws - ray_ws_origin;
+	vec3 ray_gs_direction = normalize(mat3(gs_from_ws) * ray_ws_direction);
+
+	uint n = uImpostor[0].viewCount;
+	uvec4 i;
+	vec2 alpha;
+	DirectionToViewIndices(-ray_gs_direction, n, i, alpha);
+	vec2 calpha = vec2(1.) - alpha;
+
+	// base color
+	if (uImpostor[0].hasBaseColorMap) {
+		int level = textureQueryLevels(uImpostor[0].baseColorTexture);
+		mat4 colors = mat4(
+			texelFetch(uImpostor[0].baseColorTexture, ivec3(0, 0, int(i.x)), level - 1),
+			texelFetch(uImpostor[0].baseColorTexture, ivec3(0, 0, int(i.y)), level - 1),
+			texelFetch(uImpostor[0].baseColorTexture, ivec3(0, 0, int(i.z)), level - 1),
+			texelFetch(uImpostor[0].baseColorTexture, ivec3(0, 0, int(i.w)), level - 1)
+		);
+		vec4 c = colors * vec4(vec2(calpha.x, alpha.x) * calpha.y, vec2(calpha.x, alpha.x) * alpha.y);
+		baseColor = c.rgb;// * 1.8;
+	} else {
+		baseColor = uImpostor[0].baseColor;
+	}
+
+	// metallic/roughness
+	if (uImpostor[0].hasMetallicRoughnessMap) {
+		int level = textureQueryLevels(uImpostor[0].metallicRoughnessTexture);
+		mat4 colors = mat4(
+			texelFetch(uImpostor[0].metallicRoughnessTexture, ivec3(0, 0, int(i.x)), level - 1),
+			texelFetch(uImpostor[0].metallicRoughnessTexture, ivec3(0, 0, int(i.y)), level - 1),
+			texelFetch(uImpostor[0].metallicRoughnessTexture, ivec3(0, 0, int(i.z)), level - 1),
+			texelFetch(uImpostor[0].metallicRoughnessTexture, ivec3(0, 0, int(i.w)), level - 1)
+		);
+		vec4 c = colors * vec4(vec2(calpha.x, alpha.x) * calpha.y, vec2(calpha.x, alpha.x) * alpha.y);
+		metallic = c.x;
+		roughness = c.y;
+	}
+#endif // USING_PRECEDURAL_COLOR
+}
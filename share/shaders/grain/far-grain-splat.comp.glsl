@@ -0,0 +1,174 @@
+#version 450 core
+#include "sys:defines"
+
+// Compute shader counterpart of the epsilon depth and accumulation passes of
+// far-grain.*.glsl, for sub-pixel grains. The resolve is done by the
+// PASS_BLIT_TO_MAIN_FBO pass of far-grain.frag.glsl with COMPUTE_SPLATTING.
+#pragma varopt SPLAT_PASS_DEPTH SPLAT_PASS_ACCUMULATE
+
+#define LOCAL_SIZE_X 128
+layout (local_size_x = LOCAL_SIZE_X, local_size_y = 1, local_size_z = 1) in;
+
+struct PointCloundVboEntry {
+    vec4 position;
+};
+layout(std430, binding = 0) restrict readonly buffer pointsSsbo {
+    PointCloundVboEntry pointVertexAttributes[];
+};
+layout (std430, binding = 1) restrict readonly buffer pointElementsSsbo {
+    uint pointElements[];
+};
+
+uniform mat4 modelMatrix;
+
+uniform float uGrainRadius = 0.005;
+
+uniform uint uFrameCount;
+uniform uint uPointCount;
+uniform float uFps = 25.0;
+uniform float uTime;
+uniform bool uUseAnimation = true;
+uniform bool uUsePointElements = true;
+
+uniform uint uElementOffset = 0;
+uniform uint uElementCount;
+
+uniform bool uUseBbox = false;
+uniform vec3 uBboxMin;
+uniform vec3 uBboxMax;
+uniform float uEpsilon;
+
+const int cDebugShapeSquare = 2;
+uniform int uDebugShape = 1;
+
+const int cWeightLinear = 0;
+uniform int uWeightMode = -1;
+uniform bool uShellDepthFalloff = false;
+
+// Grains larger than this (in pixels) are clamped, this mode is meant for tiny grains
+uniform int uMaxSplatRadius = 2;
+
+#include "../include/uniform/camera.inc.glsl"
+#include "../include/utils.inc.glsl"
+#include "../include/sprite.inc.glsl"
+#include "../include/random.inc.glsl"
+#include "../include/zbuffer.inc.glsl"
+#include "../include/anim.inc.glsl"
+#include "procedural-color.inc.glsl"
+
+#include "../include/raytracing.inc.glsl"
+#include "../include/gbuffer2.inc.glsl"
+#include "../include/impostor.inc.glsl"
+uniform SphericalImpostor uImpostor[3];
+#include "far-grain-appearance.inc.glsl"
+
+#include "far-grain-splat.inc.glsl"
+
+bool inBBox(vec3 pos) {
+	if (!uUseBbox) return true;
+	else return (
+		pos.x >= uBboxMin.x && pos.x <= uBboxMax.x &&
+		pos.y >= uBboxMin.y && pos.y <= uBboxMax.y &&
+		pos.z >= uBboxMin.z && pos.z <= uBboxMax.z
+	);
+}
+
+float windowDepth(vec4 position_clipspace) {
+	float ndc = position_clipspace.z / position_clipspace.w;
+	return uDepthRangeMin + (ndc * 0.5 + 0.5) * (uDepthRangeMax - uDepthRangeMin);
+}
+
+void main() {
+	if (gl_GlobalInvocationID.x >= uElementCount) return;
+	uint elementId = uElementOffset + gl_GlobalInvocationID.x;
+
+	uint pointId =
+		uUsePointElements
+		? pointElements[elementId]
+		: elementId;
+
+	uint animPointId =
+		uUseAnimation
+		? AnimatedPointId2(pointId, uFrameCount, uPointCount, uTime, uFps)
+		: pointId;
+
+	vec3 position_ws = (modelMatrix * vec4(pointVertexAttributes[animPointId].position.xyz, 1.0)).xyz;
+	if (!inBBox(position_ws)) return;
+
+	vec4 position_cs = viewMatrix * vec4(position_ws, 1.0);
+#ifdef SPLAT_PASS_DEPTH
+	// Move away to let a shell of thickness uEpsilon
+	position_cs.xyz += uEpsilon * normalize(position_cs.xyz);
+#endif // SPLAT_PASS_DEPTH
+	vec4 position_clipspace = projectionMatrix * position_cs;
+	if (position_clipspace.w <= 0.0) return;
+
+	float depth = windowDepth(position_clipspace);
+	if (depth < uDepthRangeMin || depth > uDepthRangeMax) return;
+
+	// Footprint, in pixels
+	vec2 center = resolution.xy * (position_clipspace.xy / position_clipspace.w * 0.5 + 0.5);
+	float diameter = SpriteSize_Botsch03(uGrainRadius, position_cs);
+	float r = min(0.5 * diameter, float(uMaxSplatRadius));
+	ivec2 pmin = max(ivec2(floor(center - r)), ivec2(0));
+	ivec2 pmax = min(ivec2(floor(center + r)), ivec2(resolution.xy) - 1);
+	if (any(greaterThan(pmin, pmax))) return;
+
+#ifdef SPLAT_PASS_ACCUMULATE
+	vec3 baseColor;
+	float metallic, roughness;
+	FarGrainAppearance(position_ws, position_ws, animPointId, baseColor, metallic, roughness);
+	vec3 toCamera_ws = normalize((inverseViewMatrix * vec4(0, 0, 0, 1)).xyz - position_ws);
+#endif // SPLAT_PASS_ACCUMULATE
+
+	for (int y = pmin.y; y <= pmax.y; ++y) {
+		for (int x = pmin.x; x <= pmax.x; ++x) {
+			// Sub-pixel grains hit their pixel in its center
+			vec2 uv = r > 0.5 ? (vec2(x, y) + 0.5 - center) / r : vec2(0.0);
+			float sqDistToCenter = dot(uv, uv);
+			if (uDebugShape != cDebugShapeSquare && sqDistToCenter > 1.0) continue;
+
+			uint pixelIndex = splatPixelIndex(ivec2(x, y));
+
+#if defined(SPLAT_PASS_DEPTH)
+			atomicMin(splatDepth[pixelIndex], floatBitsToUint(depth));
+#elif defined(SPLAT_PASS_ACCUMULATE)
+			float limitDepth = uintBitsToFloat(splatDepth[pixelIndex]);
+			if (depth > limitDepth) continue;
+
+			float weight = 1.0;
+			if (uShellDepthFalloff) {
+				weight = (linearizeDepth(limitDepth) - linearizeDepth(depth)) / uEpsilon;
+			}
+			if (uWeightMode == cWeightLinear) {
+				weight *= uDebugShape == cDebugShapeSquare
+					? 1.0 - max(abs(uv.x), abs(uv.y))
+					: 1.0 - sqrt(sqDistToCenter);
+			}
+			float antialiasing = 1.0;
+			if (uDebugShape != cDebugShapeSquare) {
+				antialiasing = smoothstep(1.0, 1.0 - 5.0 / diameter, sqDistToCenter);
+			}
+			if (r <= 0.5) {
+				weight = max(weight, 1e-3);
+			}
+			// (at most 1 so that fixed point contributions are bounded)
+			weight = min(weight * antialiasing, 1.0);
+			if (weight <= 0.0) continue;
+
+			vec3 n = mat3(inverseViewMatrix) * vec3(uv, sqrt(max(0.0, 1.0 - sqDistToCenter)));
+			n = mix(toCamera_ws, n, antialiasing);
+
+			uint base = SPLAT_CHANNEL_COUNT * pixelIndex;
+			atomicAdd(splatAccumulation[base + SPLAT_CHANNEL_BASECOLOR + 0], toSplatFixedPoint(baseColor.r * weight));
+			atomicAdd(splatAccumulation[base + SPLAT_CHANNEL_BASECOLOR + 1], toSplatFixedPoint(baseColor.g * weight));
+			atomicAdd(splatAccumulation[base + SPLAT_CHANNEL_BASECOLOR + 2], toSplatFixedPoint(baseColor.b * weight));
+			atomicAdd(splatAccumulation[base + SPLAT_CHANNEL_ALPHA], toSplatFixedPoint(weight));
+			atomicAdd(splatAccumulation[base + SPLAT_CHANNEL_NORMAL + 0], toSplatFixedPoint(n.x * weight));
+			atomicAdd(splatAccumulation[base + SPLAT_CHANNEL_NORMAL + 1], toSplatFixedPoint(n.y * weight));
+			atomicAdd(splatAccumulation[base + SPLAT_CHANNEL_NORMAL + 2], toSplatFixedPoint(n.z * weight));
+			atomicAdd(splatAccumulation[base + SPLAT_CHANNEL_ROUGHNESS], toSplatFixedPoint(roughness * weight));
+#endif // SPLAT_PASS
+		}
+	}
+}
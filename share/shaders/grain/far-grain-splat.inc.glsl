@@ -0,0 +1,44 @@
+// Buffers of the ComputeSplatting render mode of FarGrainRenderer, written by
+// grain/far-grain-splat.comp.glsl and resolved by the blit pass of far-grain.frag.glsl
+// Requires "include/uniform/camera.inc.glsl"
+
+// Accumulated attributes are stored as fixed point integers so that they
+// can be summed with atomicAdd. Each contribution is clamped to [-1,1], and
+// 12 bits of fractional part leave room for more than 500k of them per pixel
+// before the 32 bit sum overflows (dense piles of far grains did overflow
+// with 16 bits).
+#define SPLAT_FIXED_POINT_SCALE 4096.0
+
+// Layout of splatAccumulation, per pixel
+#define SPLAT_CHANNEL_COUNT 8
+#define SPLAT_CHANNEL_BASECOLOR 0 // rgb
+#define SPLAT_CHANNEL_ALPHA 3
+#define SPLAT_CHANNEL_NORMAL 4 // xyz
+#define SPLAT_CHANNEL_ROUGHNESS 7
+
+// Depth of the front-most grain (with epsilon offset), as the bits of a
+// positive float, which preserves order for atomicMin
+#define SPLAT_EMPTY_DEPTH 0xFFFFFFFFu
+layout (std430, binding = 2) buffer splatDepthSsbo {
+	uint splatDepth[];
+};
+
+layout (std430, binding = 3) buffer splatAccumulationSsbo {
+	int splatAccumulation[];
+};
+
+int toSplatFixedPoint(float x) {
+	return int(round(clamp(x, -1.0, 1.0) * SPLAT_FIXED_POINT_SCALE));
+}
+
+float fromSplatFixedPoint(int x) {
+	return float(x) / SPLAT_FIXED_POINT_SCALE;
+}
+
+uint splatPixelIndex(ivec2 pixel) {
+	return uint(pixel.y) * uint(resolution.x) + uint(pixel.x);
+}
+
+float splatChannel(uint pixelIndex, int channel) {
+	return fromSplatFixedPoint(splatAccumulation[SPLAT_CHANNEL_COUNT * pixelIndex + channel]);
+}
@@ -0,0 +1,142 @@
+// Per grain setup of impostor grains, shared by the geometry shader path
+// (impostor-grain.geo.glsl), the vertex pulling path (impostor-grain.vert.glsl)
+// and the view selection pre-pass (grain/impostor-view-selection.comp.glsl).
+// Requires "include/uniform/camera.inc.glsl"
+
+struct PointCloundVboEntry {
+    vec4 position;
+};
+layout(std430, binding = 0) restrict readonly buffer pointsSsbo {
+    PointCloundVboEntry pointVertexAttributes[];
+};
+layout (std430, binding = 1) restrict readonly buffer pointElementsSsbo {
+    uint pointElements[];
+};
+
+uniform uint uFrameCount = 1;
+uniform uint uPointCount;
+uniform float uFps = 25.0;
+uniform float uTime;
+
+uniform mat4 modelMatrix;
+uniform mat4 viewModelMatrix;
+
+uniform bool uUseAnimation = true;
+uniform bool uUsePointElements = true;
+
+uniform float uGrainRadius;
+
+uniform sampler2D uOcclusionMap;
+uniform bool uUseOcclusionMap = false;
+
+uniform int uPrerenderSurfaceStep = 0; // 0: prerender, 1: render remaining
+uniform bool uPrerenderSurface = false;
+
+#include "../include/anim.inc.glsl"
+#include "../include/utils.inc.glsl"
+#include "../include/random.inc.glsl"
+#include "../include/sprite.inc.glsl"
+#include "random-grains.inc.glsl"
+
+#ifdef PRECOMPUTE_IN_VERTEX
+#include "../include/raytracing.inc.glsl"
+#include "../include/gbuffer2.inc.glsl"
+#include "../include/impostor.inc.glsl"
+#include "../include/zbuffer.inc.glsl"
+uniform SphericalImpostor uImpostor[3];
+#endif // PRECOMPUTE_IN_VERTEX
+
+// Output of the view selection pre-pass
+struct ImpostorViewSelection {
+	uvec4 i;
+	vec4 alpha; // only xy are used
+};
+#ifdef PRECOMPUTED_VIEW_SELECTION
+layout (std430, binding = 5) restrict readonly buffer viewSelectionSsbo {
+	ImpostorViewSelection viewSelection[];
+};
+#endif // PRECOMPUTED_VIEW_SELECTION
+
+struct ImpostorGrain {
+	uint id;
+	float radius;
+	vec3 position_ws;
+	vec4 position_cs;
+	vec4 position_clipspace;
+	mat4 gs_from_ws;
+};
+
+/**
+ * Fetch grain from element index and compute its world/camera/clip position.
+ */
+ImpostorGrain LoadImpostorGrain(uint elementId) {
+	ImpostorGrain grain;
+	grain.id =
+        uUsePointElements
+        ? pointElements[elementId]
+        : elementId;
+
+    uint animPointId =
+        uUseAnimation
+        ? AnimatedPointId2(grain.id, uFrameCount, uPointCount, uTime, uFps)
+        : grain.id;
+
+	vec3 p = pointVertexAttributes[animPointId].position.xyz;
+
+    grain.radius = uGrainRadius;
+
+    grain.position_ws = (modelMatrix * vec4(p, 1.0)).xyz;
+    grain.position_cs = viewMatrix * vec4(grain.position_ws, 1.0);
+    grain.position_clipspace = projectionMatrix * grain.position_cs;
+
+    grain.id = animPointId%20; // WTF?
+    grain.gs_from_ws = grainMatrix(animPointId, grain.position_ws);
+    return grain;
+}
+
+/**
+ * Return false if the grain must be skipped in the current prerender step.
+ */
+bool IsInPrerenderStep(const in ImpostorGrain grain) {
+    #if defined(PASS_SHADOW_MAP)
+    #else
+	if (uPrerenderSurface && uUseOcclusionMap) {
+		vec4 clip = grain.position_clipspace;
+		vec2 fragCoord = resolution.xy * (clip.xy / clip.w * 0.5 + 0.5);
+		fragCoord = clamp(fragCoord, vec2(0.5), resolution.xy - vec2(0.5));
+		vec3 closerGrain_cs = texelFetch(uOcclusionMap, ivec2(fragCoord.xy), 0).xyz;
+		//bool isSurface = linearizeDepth(position_cs.z) < linearizeDepth(closerGrain_cs.z) - grain.radius * 0.01;
+		bool isSurface = grain.position_cs.z < closerGrain_cs.z;
+		if (uPrerenderSurfaceStep == 0 && isSurface) return false;
+		if (uPrerenderSurfaceStep == 1 && !isSurface) return false;
+	}
+	#endif // PASS_SHADOW_MAP
+	return true;
+}
+
+#ifdef PRECOMPUTE_IN_VERTEX
+/**
+ * Select the impostor views (and interpolation weights) used to render the
+ * grain. Does not depend on the pixel, so it is done once per grain.
+ */
+ImpostorViewSelection SelectImpostorViews(const in ImpostorGrain grain) {
+	ImpostorViewSelection sel;
+	sel.i = uvec4(0);
+	sel.alpha = vec4(0.0);
+
+	Ray ray_ws;
+	ray_ws.origin = (inverseViewMatrix * vec4(0, 0, 0, 1)).xyz;
+	ray_ws.direction = normalize(grain.position_ws - ray_ws.origin);
+    Ray ray_gs = TransformRay(ray_ws, grain.gs_from_ws);
+
+    uint n = uImpostor[0].viewCount;
+#  ifdef NO_INTERPOLATION
+	sel.i.x = DirectionToViewIndex(-ray_gs.direction, n);
+#  else // NO_INTERPOLATION
+	vec2 alpha;
+	DirectionToViewIndices(-ray_gs.direction, n, sel.i, alpha);
+	sel.alpha.xy = alpha;
+#  endif // NO_INTERPOLATION
+	return sel;
+}
+#endif // PRECOMPUTE_IN_VERTEX
@@ -0,0 +1,29 @@
+#version 450 core
+#include "sys:defines"
+
+// Pre-pass of the vertex pulling path of ImpostorGrainRenderer when grains
+// are expanded as quads: select impostor views once per grain rather than
+// once per quad vertex.
+
+#define LOCAL_SIZE_X 128
+layout (local_size_x = LOCAL_SIZE_X, local_size_y = 1, local_size_z = 1) in;
+
+#define PRECOMPUTE_IN_VERTEX
+#include "../include/uniform/camera.inc.glsl"
+#include "impostor-grain-common.inc.glsl"
+
+layout (std430, binding = 5) restrict writeonly buffer viewSelectionSsbo {
+	ImpostorViewSelection viewSelection[];
+};
+
+uniform uint uElementOffset = 0;
+uniform uint uElementCount;
+
+void main() {
+	uint i = gl_GlobalInvocationID.x;
+	if (i >= uElementCount) return;
+	uint elementId = uElementOffset + i;
+
+	ImpostorGrain grain = LoadImpostorGrain(elementId);
+	viewSelection[elementId] = SelectImpostorViews(grain);
+}
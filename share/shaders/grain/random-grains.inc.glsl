@@ -1,6 +1,10 @@
 // requires random.inc.glsl
 #pragma variant NO_GRAIN_ROTATION
 
+// (guarded because it is reached both from impostor-grain-common and procedural-color)
+#ifndef RANDOM_GRAINS_INC
+#define RANDOM_GRAINS_INC
+
 mat3 randomGrainOrientation(int id) {
     vec3 vx = normalize(randVec(vec3(id, id, id)));
     vec3 vy = normalize(cross(vec3(0,0,sign(-vx) * 1 + .001), vx));
@@ -9,11 +13,45 @@ mat3 randomGrainOrientation(int id) {
     return mat3(vx, vy * cos(t) - vz * sin(t), vy * sin(t) + vz * cos(t));
 }
 
-mat4 randomGrainMatrix(int id, vec3 position_ws) {
+// Per grain orientation (e.g. from DEM simulation), indexed like point
+// positions (i.e. by animated point id), as quaternions packed in snorm16x4.
+// Bound by renderers when the point cloud has orientations, see
+// PointCloudDataBehavior and bindGrainOrientations() in behaviorutils.h
+layout (std430, binding = 6) restrict readonly buffer grainOrientationsSsbo {
+    uvec2 grainOrientations[];
+};
+uniform bool uUseGrainOrientations = false;
+
+// Rotation matrix of a unit quaternion q = (x, y, z, w)
+mat3 quatToMat3(vec4 q) {
+    vec3 q2 = q.xyz * 2.0;
+    vec3 qq = q.xyz * q2;
+    vec3 qw = q.w * q2;
+    float xy = q.x * q2.y, xz = q.x * q2.z, yz = q.y * q2.z;
+    return mat3(
+        1.0 - qq.y - qq.z, xy + qw.z, xz - qw.y,
+        xy - qw.z, 1.0 - qq.x - qq.z, yz + qw.x,
+        xz + qw.y, yz - qw.x, 1.0 - qq.x - qq.y
+    );
+}
+
+/**
+ * World to grain space matrix. Uses the orientation buffer if available,
+ * and falls back to a hash of the point id otherwise.
+ */
+mat4 grainMatrix(uint animPointId, vec3 position_ws) {
 #ifdef NO_GRAIN_ROTATION
     mat3 rot = mat3(1.0);
 #else // NO_GRAIN_ROTATION
-    mat3 rot = randomGrainOrientation(id);
+    mat3 rot;
+    if (uUseGrainOrientations) {
+        uvec2 packedQuat = grainOrientations[animPointId];
+        vec4 q = normalize(vec4(unpackSnorm2x16(packedQuat.x), unpackSnorm2x16(packedQuat.y)));
+        // quaternion rotates from grain to world space
+        rot = transpose(quatToMat3(q));
+    } else {
+        rot = randomGrainOrientation(int(animPointId % 20));
+    }
 #endif // NO_GRAIN_ROTATION
     return mat4(
         vec4(rot[0], 0.0),
@@ -29,3 +67,5 @@ float randomGrainColorFactor(int id) {
     return fract(dot(vec2(id*.01, id*.213) ,vec2(12.9898,78.233))*.01);
     return randv2(vec2(id*.01, id*.213));
 }
+
+#endif // RANDOM_GRAINS_INC
@@ -1,7 +1,7 @@
 #version 450 core
 #include "sys:defines"
 
-#pragma varopt PASS_BLIT_TO_MAIN_FBO PASS_SHADOW_MAP
+#pragma varopt PASS_BLIT_TO_MAIN_FBO PASS_SHADOW_MAP PASS_VISIBILITY PASS_RESOLVE_VISIBILITY
 #pragma opt PROCEDURAL_BASECOLOR
 #pragma opt SET_DEPTH
 #pragma opt NO_DISCARD
@@ -58,6 +58,20 @@ void main() {
 ///////////////////////////////////////////////////////////////////////////////
 #else // PASS
 
+#if defined(PASS_RESOLVE_VISIBILITY)
+// Full screen pass, grains are fetched back from the visibility buffer rather
+// than received from the geometry stages (so no PRECOMPUTE_IN_VERTEX here)
+
+#define OUT_GBUFFER
+#define IN_VISIBILITY
+#include "include/gbuffer2.inc.glsl"
+#include "include/visibility-buffer.inc.glsl"
+
+#include "include/uniform/camera.inc.glsl"
+#include "grain/impostor-grain-common.inc.glsl"
+
+#else // PASS_RESOLVE_VISIBILITY
+
 in GeometryData {
 	flat uint id;
 	float radius;
@@ -67,28 +81,39 @@ in GeometryData {
 	flat uvec4 i;
 	vec2 alpha;
 #endif // PRECOMPUTE_IN_VERTEX
+#ifdef PASS_VISIBILITY
+	flat uint elementId;
+#endif // PASS_VISIBILITY
 } geo;
 
 // If noDiscard option is on, we write output in linear g-buffer because it is accumulated
-#ifdef NO_DISCARD
+// The visibility pass only needs coverage, so it skips color fetches.
+#if defined(PASS_VISIBILITY)
+#define OUT_VISIBILITY
+#define IMPOSTOR_ALPHA_ONLY
+#include "include/visibility-buffer.inc.glsl"
+#elif defined(NO_DISCARD)
 #define OUT_LINEAR_GBUFFER
-#else // NO_DISCARD
+#else // PASS_VISIBILITY
 #define OUT_GBUFFER
-#endif // NO_DISCARD
+#endif // PASS_VISIBILITY
 #include "include/gbuffer2.inc.glsl"
 
-#ifdef SET_DEPTH
-layout (depth_less) out float gl_FragDepth;
-#endif // SET_DEPTH
-
 uniform mat4 modelMatrix;
 uniform mat4 viewModelMatrix;
 #include "include/uniform/camera.inc.glsl"
 
 #include "include/utils.inc.glsl"
+#include "include/random.inc.glsl"
+
+#endif // PASS_RESOLVE_VISIBILITY
+
+#if defined(SET_DEPTH) && !defined(PASS_RESOLVE_VISIBILITY)
+layout (depth_less) out float gl_FragDepth;
+#endif // SET_DEPTH
+
 #include "include/raytracing.inc.glsl"
 #include "include/impostor.inc.glsl"
-#include "include/random.inc.glsl"
 #include "include/depth.inc.glsl"
 #include "grain/procedural-color.inc.glsl"
 
@@ -140,62 +165,37 @@ GFragment SampleImpostor(const in SphericalImpostor impostor, const in Ray ray_g
 }
 
 /**
- * Pack the G-fragment depending on target type and options
+ * Shade the pixel covered by a grain. Shared by the regular passes and the
+ * visibility buffer resolve, alpha tells whether the grain is actually hit.
  */
-void pack(const in GFragment fragment) {
-#ifdef SET_DEPTH
-	vec3 p = (viewMatrix * vec4(fragment.ws_coord, 1.0)).xyz;
-	setFragmentDepth(p);
-#endif // SET_DEPTH
-
-#ifdef NO_DISCARD
-	autoPackLinearGFragment(fragment);
-#else // NO_DISCARD
-	autoPackGFragment(fragment);
-#endif // NO_DISCARD
-}
-
-void main() {
+GFragment ShadeImpostorGrain(uint id, float radius, vec3 position_ws, mat4 gs_from_ws) {
 	GFragment fragment;
 	initGFragment(fragment);
 
 	Ray ray_cs = fragmentRay(gl_FragCoord, projectionMatrix);
 	Ray ray_ws = TransformRay(ray_cs, inverseViewMatrix);
-	Ray ray_gs = TransformRay(ray_ws, geo.gs_from_ws);
-
-#if defined(PASS_SHADOW_MAP) && !defined(SET_DEPTH)
-	// Early quit for shadow maps unless we alter fragment depth
-	vec3 v;
-	if (!intersectRaySphere(v, ray_ws, geo.position_ws.xyz, geo.radius)) {
-		discard;
-	}
-	return;
-#endif
+	Ray ray_gs = TransformRay(ray_ws, gs_from_ws);
 
 	vec3 outerSphereHitPosition_ws;
-	intersectRaySphere(outerSphereHitPosition_ws, ray_ws, geo.position_ws.xyz, geo.radius);
+	intersectRaySphere(outerSphereHitPosition_ws, ray_ws, position_ws.xyz, radius);
 
 	switch (uDebugShape) {
 	case 0: // DEBUG_SPHERE
-		fragment = IntersectRaySphere(ray_ws, geo.position_ws, geo.radius);
+		fragment = IntersectRaySphere(ray_ws, position_ws, radius);
 		break;
 	case 1: // DEBUG_INNER_SPHERE
-		fragment = IntersectRaySphere(ray_ws, geo.position_ws, geo.radius * uGrainInnerRadiusRatio);
+		fragment = IntersectRaySphere(ray_ws, position_ws, radius * uGrainInnerRadiusRatio);
 		break;
 	case 2: // DEBUG_CUBE
-		fragment = IntersectRayCube(ray_ws, geo.position_ws, geo.radius);
+		fragment = IntersectRayCube(ray_ws, position_ws, radius);
 		break;
 	default: // IMPOSTOR
-		fragment = SampleImpostor(uImpostor[0], ray_gs, geo.radius);
-		mat3 ws_from_gs_rot = transpose(mat3(geo.gs_from_ws));
+		fragment = SampleImpostor(uImpostor[0], ray_gs, radius);
+		mat3 ws_from_gs_rot = transpose(mat3(gs_from_ws));
 		fragment.normal = ws_from_gs_rot * fragment.normal;
 		break;
 	}
 
-#ifndef NO_DISCARD
-	if (fragment.alpha < 0.5) discard;
-#endif // not NO_DISCARD
-
 	fragment.material_id = pbrMaterial;
 	fragment.ws_coord = outerSphereHitPosition_ws; // for shadow maps
 
@@ -204,14 +204,74 @@ void main() {
 		fragment.baseColor = uDebugRenderColor;
 	}
 	else if (isUsingProceduralColor()) {
-		fragment.baseColor = proceduralColor(geo.position_ws.xyz, geo.id);
-		//float r = randomGrainColorFactor(int(geo.id));
-		//float s = randomGrainColorFactor(int(geo.id) + 436);
+		fragment.baseColor = proceduralColor(position_ws.xyz, id);
+		//float r = randomGrainColorFactor(int(id));
+		//float s = randomGrainColorFactor(int(id) + 436);
 		//fragment.baseColor += vec3(r - 0.1, s - 0.5, 0.0) * 0.05;
 	}
 
+	return fragment;
+}
+
+#if defined(PASS_RESOLVE_VISIBILITY)
+
+void main() {
+	uint elementId, viewId;
+	float depth;
+	if (!unpackVisibility(ivec2(gl_FragCoord.xy), elementId, viewId, depth)) {
+		discard;
+	}
+	gl_FragDepth = depth;
+
+	ImpostorGrain grain = LoadImpostorGrain(elementId);
+	GFragment fragment = ShadeImpostorGrain(grain.id, grain.radius, grain.position_ws, grain.gs_from_ws);
+	fragment.alpha = 1.0; // coverage was already decided by the visibility pass
+
+	autoPackGFragment(fragment);
+}
+
+#else // PASS_RESOLVE_VISIBILITY
+
+/**
+ * Pack the G-fragment depending on target type and options
+ */
+void pack(const in GFragment fragment) {
+#ifdef SET_DEPTH
+	vec3 p = (viewMatrix * vec4(fragment.ws_coord, 1.0)).xyz;
+	setFragmentDepth(p);
+#endif // SET_DEPTH
+
+#if defined(PASS_VISIBILITY)
+	packVisibility(geo.elementId, 0u);
+#elif defined(NO_DISCARD)
+	autoPackLinearGFragment(fragment);
+#else // PASS_VISIBILITY
+	autoPackGFragment(fragment);
+#endif // PASS_VISIBILITY
+}
+
+void main() {
+#if defined(PASS_SHADOW_MAP) && !defined(SET_DEPTH)
+	// Early quit for shadow maps unless we alter fragment depth
+	Ray ray_cs = fragmentRay(gl_FragCoord, projectionMatrix);
+	Ray ray_ws = TransformRay(ray_cs, inverseViewMatrix);
+	vec3 v;
+	if (!intersectRaySphere(v, ray_ws, geo.position_ws.xyz, geo.radius)) {
+		discard;
+	}
+	return;
+#endif
+
+	GFragment fragment = ShadeImpostorGrain(geo.id, geo.radius, geo.position_ws, geo.gs_from_ws);
+
+#ifndef NO_DISCARD
+	if (fragment.alpha < 0.5) discard;
+#endif // not NO_DISCARD
+
 	pack(fragment);
 }
 
+#endif // PASS_RESOLVE_VISIBILITY
+
 ///////////////////////////////////////////////////////////////////////////////
 #endif // PASS
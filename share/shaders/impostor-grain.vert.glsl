@@ -1,13 +1,89 @@
 #version 430 core
 #include "sys:defines"
 
-#pragma varopt PASS_BLIT_TO_MAIN_FBO
+#pragma varopt PASS_BLIT_TO_MAIN_FBO PASS_SHADOW_MAP PASS_VISIBILITY PASS_RESOLVE_VISIBILITY
+#pragma opt VERTEX_PULLING
+#pragma opt VERTEX_PULLING_QUADS
+#pragma opt PRECOMPUTE_IN_VERTEX
+#pragma opt PRECOMPUTED_VIEW_SELECTION
 
 ///////////////////////////////////////////////////////////////////////////////
-#ifdef PASS_BLIT_TO_MAIN_FBO
+#if defined(PASS_BLIT_TO_MAIN_FBO) || defined(PASS_RESOLVE_VISIBILITY)
 
 #include "include/standard-posteffect.vert.inc.glsl"
 
+///////////////////////////////////////////////////////////////////////////////
+#elif defined(VERTEX_PULLING)
+// No geometry shader in this case (see NO_GEOMETRY_SHADER in ShaderProgram),
+// grains are expanded either to point sprites or to quads (6 vertices each)
+
+out GeometryData {
+	flat uint id;
+	float radius;
+	vec3 position_ws;
+	mat4 gs_from_ws;
+#ifdef PRECOMPUTE_IN_VERTEX
+	flat uvec4 i;
+	vec2 alpha;
+#endif // PRECOMPUTE_IN_VERTEX
+#ifdef PASS_VISIBILITY
+	flat uint elementId;
+#endif // PASS_VISIBILITY
+} geo;
+
+#include "include/uniform/camera.inc.glsl"
+#include "grain/impostor-grain-common.inc.glsl"
+
+#ifdef VERTEX_PULLING_QUADS
+const vec2 quadCorners[6] = vec2[](
+	vec2(-1, -1), vec2(1, -1), vec2(1, 1),
+	vec2(-1, -1), vec2(1, 1), vec2(-1, 1)
+);
+#endif // VERTEX_PULLING_QUADS
+
+void main() {
+#ifdef VERTEX_PULLING_QUADS
+	uint elementId = uint(gl_VertexID) / 6;
+#else // VERTEX_PULLING_QUADS
+	uint elementId = uint(gl_VertexID);
+#endif // VERTEX_PULLING_QUADS
+
+	ImpostorGrain grain = LoadImpostorGrain(elementId);
+	if (!IsInPrerenderStep(grain)) {
+		// Out of the clip volume, so that the primitive gets discarded
+		gl_Position = vec4(2.0, 2.0, 2.0, 1.0);
+		return;
+	}
+
+	geo.id = grain.id;
+	geo.radius = grain.radius;
+	geo.position_ws = grain.position_ws;
+	geo.gs_from_ws = grain.gs_from_ws;
+#ifdef PASS_VISIBILITY
+	geo.elementId = elementId;
+#endif // PASS_VISIBILITY
+
+	gl_Position = grain.position_clipspace;
+	float spriteSize = SpriteSize(geo.radius, gl_Position);
+#ifdef VERTEX_PULLING_QUADS
+	// spriteSize is a diameter in pixels, clip space spans 2 units per resolution
+	vec2 corner = quadCorners[uint(gl_VertexID) % 6];
+	gl_Position.xy += corner * spriteSize / resolution.xy * gl_Position.w;
+#else // VERTEX_PULLING_QUADS
+	gl_PointSize = spriteSize;
+#endif // VERTEX_PULLING_QUADS
+
+#ifdef PRECOMPUTE_IN_VERTEX
+#  ifdef PRECOMPUTED_VIEW_SELECTION
+	ImpostorViewSelection sel = viewSelection[elementId];
+#  else // PRECOMPUTED_VIEW_SELECTION
+	ImpostorViewSelection sel = SelectImpostorViews(grain);
+#  endif // PRECOMPUTED_VIEW_SELECTION
+	geo.i = sel.i;
+	geo.alpha = sel.alpha.xy;
+#endif // PRECOMPUTE_IN_VERTEX
+}
+
 ///////////////////////////////////////////////////////////////////////////////
 #else // PASS_BLIT_TO_MAIN_FBO
 
@@ -0,0 +1,86 @@
+//////////////////////////////////////////////////////
+// Compact G-Buffer layout, used when COMPACT_GBUFFER is defined
+// (see "gbufferLayout" option of the deferred shader)
+//
+// Included by gbuffer.inc.glsl and gbuffer2.inc.glsl once GFragment is
+// defined. 12 bytes per pixel instead of 48:
+//   gbuffer0 (RGBA8):    sqrt(baseColor), metallic
+//   gbuffer1 (RGBA16UI): octahedral normal (2 x unorm16), roughness (unorm16), material_id
+// World position is not stored but reconstructed from the depth buffer.
+// Emission, lean2 and count are dropped.
+
+vec2 encodeOctahedralNormal(vec3 n) {
+	n /= abs(n.x) + abs(n.y) + abs(n.z);
+	vec2 e = n.xy;
+	if (n.z < 0.0) {
+		e = (1.0 - abs(n.yx)) * vec2(n.x >= 0.0 ? 1.0 : -1.0, n.y >= 0.0 ? 1.0 : -1.0);
+	}
+	return e;
+}
+
+vec3 decodeOctahedralNormal(vec2 e) {
+	vec3 n = vec3(e, 1.0 - abs(e.x) - abs(e.y));
+	float t = max(-n.z, 0.0);
+	n.x += n.x >= 0.0 ? -t : t;
+	n.y += n.y >= 0.0 ? -t : t;
+	return normalize(n);
+}
+
+uint packUnorm16(float x) {
+	return uint(round(clamp(x, 0.0, 1.0) * 65535.0));
+}
+
+float unpackUnorm16(uint x) {
+	return float(x) / 65535.0;
+}
+
+void packCompactGFragment(
+	in GFragment fragment,
+	out vec4 gbuffer_color0,
+	out uvec4 gbuffer_color1)
+{
+	// sqrt is a cheap gamma that keeps 8 bits enough for dark base colors
+	gbuffer_color0 = vec4(sqrt(clamp(fragment.baseColor, 0.0, 1.0)), fragment.metallic);
+
+	// NaN normals would break the encoding, they come from empty fragments anyway
+	vec3 n = fragment.normal;
+	if (any(isnan(n)) || dot(n, n) == 0.0) n = vec3(0.0, 0.0, 1.0);
+	vec2 e = encodeOctahedralNormal(n) * 0.5 + 0.5;
+
+	gbuffer_color1 = uvec4(
+		packUnorm16(e.x),
+		packUnorm16(e.y),
+		packUnorm16(fragment.roughness),
+		min(fragment.material_id, 0xFFFFu)
+	);
+}
+
+/**
+ * inverseViewProjection is used to reconstruct ws_coord from the depth buffer
+ */
+void unpackCompactGFragment(
+	in sampler2D gbuffer0,
+	in usampler2D gbuffer1,
+	in sampler2D gbufferDepth,
+	in mat4 inverseViewProjection,
+	in ivec2 coords,
+	out GFragment fragment)
+{
+	vec4 data0 = texelFetch(gbuffer0, coords, 0);
+	uvec4 data1 = texelFetch(gbuffer1, coords, 0);
+	float depth = texelFetch(gbufferDepth, coords, 0).r;
+
+	fragment.baseColor = data0.rgb * data0.rgb;
+	fragment.metallic = data0.a;
+	fragment.normal = decodeOctahedralNormal(vec2(unpackUnorm16(data1.x), unpackUnorm16(data1.y)) * 2.0 - 1.0);
+	fragment.roughness = unpackUnorm16(data1.z);
+	fragment.material_id = data1.w;
+
+	vec2 ndc = (vec2(coords) + 0.5) / vec2(textureSize(gbufferDepth, 0)) * 2.0 - 1.0;
+	vec4 position_ws = inverseViewProjection * vec4(ndc, depth * 2.0 - 1.0, 1.0);
+	fragment.ws_coord = position_ws.xyz / position_ws.w;
+
+	fragment.emission = vec3(0.0);
+	fragment.lean2 = vec4(0.0);
+	fragment.count = 0;
+}
@@ -51,6 +51,10 @@ GFragment LerpGFragment(GFragment ga, GFragment gb, float t) {
 	return g;
 }
 
+#ifdef COMPACT_GBUFFER
+#include "gbuffer-compact.inc.glsl"
+#endif // COMPACT_GBUFFER
+
 void unpackGFragment(
 	in sampler2D gbuffer0,
 	in usampler2D gbuffer1,
@@ -82,6 +86,10 @@ void packGFragment(
 	out uvec4 gbuffer_color1,
 	out uvec4 gbuffer_color2)
 {
+#ifdef COMPACT_GBUFFER
+	packCompactGFragment(fragment, gbuffer_color0, gbuffer_color1);
+	gbuffer_color2 = uvec4(0); // there is no third attachment
+#else // COMPACT_GBUFFER
 	gbuffer_color0 = vec4(fragment.ws_coord, fragment.roughness);
 	gbuffer_color1 = uvec4(
 		packHalf2x16(fragment.baseColor.xy),
@@ -95,6 +103,7 @@ void packGFragment(
 		packHalf2x16(vec2(0.0, 0.0)),
 		fragment.count
 	);
+#endif // COMPACT_GBUFFER
 }
 
 //////////////////////////////////////////////////////
@@ -3,6 +3,7 @@
 //
 // define either OUT_GBUFFER or IN_GBUFFER before including this file,
 // to respectivaly write or read to gbuffer.
+// The layout changes when COMPACT_GBUFFER is defined, see gbuffer-compact.inc.glsl
 
 struct GFragment {
 	vec3 baseColor;
@@ -85,6 +86,10 @@ GFragment LerpGFragment(GFragment ga, GFragment gb, float t) {
 	return g;
 }
 
+#ifdef COMPACT_GBUFFER
+#include "gbuffer-compact.inc.glsl"
+#endif // COMPACT_GBUFFER
+
 void unpackGFragment(
 	in sampler2D gbuffer0,
 	in usampler2D gbuffer1,
@@ -116,6 +121,10 @@ void packGFragment(
 	out uvec4 gbuffer_color1,
 	out uvec4 gbuffer_color2)
 {
+#ifdef COMPACT_GBUFFER
+	packCompactGFragment(fragment, gbuffer_color0, gbuffer_color1);
+	gbuffer_color2 = uvec4(0); // there is no third attachment
+#else // COMPACT_GBUFFER
 	gbuffer_color0 = vec4(fragment.ws_coord, fragment.roughness);
 	gbuffer_color1 = uvec4(
 		packHalf2x16(fragment.baseColor.xy),
@@ -129,6 +138,7 @@ void packGFragment(
 		packHalf2x16(vec2(0.0, 0.0)),
 		fragment.count
 	);
+#endif // COMPACT_GBUFFER
 }
 
 /**
@@ -217,6 +227,23 @@ void autoPackGFragment(in GFragment fragment) {
 /////////////////////////////////////////////////////////////////////
 #ifdef IN_GBUFFER
 
+#ifdef COMPACT_GBUFFER
+
+layout (binding = 0) uniform sampler2D gbuffer0;
+layout (binding = 1) uniform usampler2D gbuffer1;
+uniform sampler2D gbufferDepth;
+uniform mat4 uGBufferInverseViewProjection;
+
+void autoUnpackGFragment(inout GFragment fragment) {
+	unpackCompactGFragment(gbuffer0, gbuffer1, gbufferDepth, uGBufferInverseViewProjection, ivec2(gl_FragCoord.xy), fragment);
+}
+
+void autoUnpackGFragmentWithOffset(inout GFragment fragment, vec2 offset) {
+	unpackCompactGFragment(gbuffer0, gbuffer1, gbufferDepth, uGBufferInverseViewProjection, ivec2(gl_FragCoord.xy - offset), fragment);
+}
+
+#else // COMPACT_GBUFFER
+
 layout (binding = 0) uniform sampler2D gbuffer0;
 layout (binding = 1) uniform usampler2D gbuffer1;
 layout (binding = 2) uniform usampler2D gbuffer2;
@@ -229,6 +256,8 @@ void autoUnpackGFragmentWithOffset(inout GFragment fragment, vec2 offset) {
 	unpackGFragment(gbuffer0, gbuffer1, gbuffer2, ivec2(gl_FragCoord.xy - offset), fragment);
 }
 
+#endif // COMPACT_GBUFFER
+
 #endif // IN_GBUFFER
 
 /////////////////////////////////////////////////////////////////////
@@ -184,6 +184,7 @@ GFragment SampleBillboard(SphericalImpostor impostor, SphericalImpostorHit hit)
 	//vec4 lean2 = vec4(0.0);
 	vec4 baseColor = vec4(0.0);
 	vec2 metallicRoughnes = vec2(impostor.metallic, impostor.roughness);
+#ifndef IMPOSTOR_ALPHA_ONLY // (visibility passes only need coverage)
 	if (normalAlpha.a > 0) {
 		baseColor = texture(impostor.baseColorTexture, uvw);
 		//lean1 = texture(impostor.lean1Texture, uvw);
@@ -192,6 +193,7 @@ GFragment SampleBillboard(SphericalImpostor impostor, SphericalImpostorHit hit)
 			metallicRoughnes = texture(impostor.metallicRoughnessTexture, uvw).xy;
 		}
 	}
+#endif // IMPOSTOR_ALPHA_ONLY
 
 	GFragment g;
 	g.baseColor = baseColor.rgb;
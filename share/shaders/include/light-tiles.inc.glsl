@@ -0,0 +1,22 @@
+//////////////////////////////////////////////////////
+// Screen tiles of light indices, filled by light-culling.comp.glsl
+// Requires light.inc.glsl
+
+// Must match GlDeferredShader.cpp
+#define LIGHT_TILE_SIZE 16
+#define MAX_LIGHTS_PER_TILE 63
+
+// Tile light count telling that more lights than MAX_LIGHTS_PER_TILE overlap
+// the tile, in which case all bounded lights must be evaluated
+#define LIGHT_TILE_OVERFLOW 0xFFFFFFFFu
+
+// For each tile, a light count followed by MAX_LIGHTS_PER_TILE indices of
+// bounded lights. Unbounded ones are never listed.
+layout (std430, binding = 8) buffer lightTilesSsbo {
+	uint lightTiles[];
+};
+uniform uint uLightTileCountX;
+
+uint lightTileOffset(uvec2 tile) {
+	return (tile.y * uLightTileCountX + tile.x) * (MAX_LIGHTS_PER_TILE + 1);
+}
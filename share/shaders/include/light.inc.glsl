@@ -1,16 +1,39 @@
 //////////////////////////////////////////////////////
 // Light related functions
 
+// Must match LightData in World.h
 struct PointLight {
-	sampler2D shadowMap;
-	sampler2D richShadowMap;
 	vec3 position_ws;
+	float radius; // 0 for unbounded lights
 	vec3 color;
-	int isRich;
-	int hasShadowMap;
+	int shadowMapIndex; // -1 if no shadow map
 	mat4 matrix;
+	int isRich;
 };
 
+// Unbounded lights come first (see World::updateLightBuffer)
+layout (std430, binding = 7) restrict readonly buffer lightsSsbo {
+	PointLight lights[];
+};
+uniform uint uLightCount = 0;
+uniform uint uUnboundedLightCount = 0;
+
+// Must match World::MaxShadowMaps and the texture units in GlDeferredShader.cpp
+#define MAX_SHADOW_MAPS 4
+layout (binding = 16) uniform sampler2D uShadowMaps[MAX_SHADOW_MAPS];
+layout (binding = 20) uniform sampler2D uRichShadowMaps[MAX_SHADOW_MAPS];
+
+/**
+ * Smooth window reaching 0 at light radius, so that culled lights do not
+ * pop. Unbounded lights have no falloff at all.
+ */
+float lightAttenuation(const in PointLight light, vec3 position_ws) {
+	if (light.radius <= 0.0) return 1.0;
+	float d = length(light.position_ws - position_ws) / light.radius;
+	float w = clamp(1.0 - d * d * d * d, 0.0, 1.0);
+	return w * w;
+}
+
 
 float shadowBiasFromNormal(const in PointLight light, const in vec3 normal) {
 	if (light.isRich == 1) {
@@ -21,19 +44,19 @@ float shadowBiasFromNormal(const in PointLight light, const in vec3 normal) {
 }
 
 
-vec4 richLightTest(const in PointLight light, vec3 position_ws, vec3 position_cs, float shadowBias) {
+vec4 richLightTest(const in PointLight light, sampler2D shadowMap, sampler2D richShadowMap, vec3 position_ws, vec3 position_cs, float shadowBias) {
 	vec4 shadowCoord = light.matrix * vec4(position_ws, 1.0);
 	shadowCoord = shadowCoord / shadowCoord.w * 0.5 + 0.5;
 
-	float shadowLimitDepth = texture(light.shadowMap, shadowCoord.xy).r;
+	float shadowLimitDepth = texture(shadowMap, shadowCoord.xy).r;
 	//shadow += d < shadowCoord.z - shadowBias ? 1.0 : 0.0;
 
-	vec2 s = vec2(textureSize(light.richShadowMap, 0));
+	vec2 s = vec2(textureSize(richShadowMap, 0));
 	vec2 roundedShadowCoord = round(shadowCoord.xy * s) / s;
 
 	vec3 shadowLimitTexelCenter = vec3(roundedShadowCoord, shadowLimitDepth);
 
-	vec3 normal = normalize(texture(light.richShadowMap, shadowCoord.xy).xyz);
+	vec3 normal = normalize(texture(richShadowMap, shadowCoord.xy).xyz);
 	if (normal.z > 0) {
 		//normal = -normal;  // point toward camera
 	}
@@ -45,7 +68,7 @@ vec4 richLightTest(const in PointLight light, vec3 position_ws, vec3 position_cs
 	//vec2 dv = (shadowCoord.xy - roundedShadowCoord.xy) * grad;
 	//return vec4(grad * 400.0, 0.0, 1.0);
 
-	float d0 = texture(light.shadowMap, roundedShadowCoord).r;
+	float d0 = texture(shadowMap, roundedShadowCoord).r;
 	float d = d0 + dot(dv, normal.xy);
 
 	//return vec4(normal.xy * 0.5 + 0.5, 0.0, 0.0);
@@ -61,19 +84,19 @@ vec4 richLightTest(const in PointLight light, vec3 position_ws, vec3 position_cs
 }
 
 
-float richShadowAt(const in PointLight light, vec3 position_ws, float shadowBias) {
+float richShadowAt(const in PointLight light, sampler2D shadowMap, sampler2D richShadowMap, vec3 position_ws, float shadowBias) {
 	vec4 shadowCoord = light.matrix * vec4(position_ws, 1.0);
 	shadowCoord = shadowCoord / shadowCoord.w * 0.5 + 0.5;
 
-	float shadowLimitDepth = texture(light.shadowMap, shadowCoord.xy).r;
+	float shadowLimitDepth = texture(shadowMap, shadowCoord.xy).r;
 	//shadow += d < shadowCoord.z - shadowBias ? 1.0 : 0.0;
 
-	vec2 s = vec2(textureSize(light.richShadowMap, 0));
+	vec2 s = vec2(textureSize(richShadowMap, 0));
 	vec2 roundedShadowCoord = round(shadowCoord.xy * s) / s;
 
 	vec3 shadowLimitTexelCenter = vec3(roundedShadowCoord, shadowLimitDepth);
 
-	vec3 normal = normalize(texture(light.richShadowMap, shadowCoord.xy).xyz);
+	vec3 normal = normalize(texture(richShadowMap, shadowCoord.xy).xyz);
 	if (normal.z > 0) {
 		normal = -normal;  // point toward camera
 	}
@@ -84,13 +107,9 @@ float richShadowAt(const in PointLight light, vec3 position_ws, float shadowBias
 }
 
 
-float shadowAt(const in PointLight light, vec3 position_ws, float shadowBias) {
-	if (light.hasShadowMap == 0) {
-		return 0.0;
-	}
-
+float shadowAt(const in PointLight light, sampler2D shadowMap, sampler2D richShadowMap, vec3 position_ws, float shadowBias) {
 	if (light.isRich == 1) {
-		return richShadowAt(light, position_ws, shadowBias);
+		return richShadowAt(light, shadowMap, richShadowMap, position_ws, shadowBias);
 	}
 
 	float shadow = 0.0;
@@ -102,15 +121,30 @@ float shadowAt(const in PointLight light, vec3 position_ws, float shadowBias) {
 	shadowCoord = shadowCoord * 0.5 + 0.5;
 
 	// PCF
-	vec2 texelSize = 1.0 / textureSize(light.shadowMap, 0);
+	vec2 texelSize = 1.0 / textureSize(shadowMap, 0);
 	vec2 dcoord;
 	for(int x = -1; x <= 1; ++x) {
 		for(int y = -1; y <= 1; ++y) {
 			dcoord = vec2(x, y) * texelSize;
-			float d = texture(light.shadowMap, shadowCoord.xy + dcoord).r;
+			float d = texture(shadowMap, shadowCoord.xy + dcoord).r;
 			shadow += d < shadowCoord.z - shadowBias ? 1.0 : 0.0;
 		}
 	}
 
 	return shadow / 9.0;
 }
+
+
+/**
+ * Sampler arrays may only be indexed by dynamically uniform expressions,
+ * which light indices read from culling tiles are not, hence the switch.
+ */
+float shadowAt(const in PointLight light, vec3 position_ws, float shadowBias) {
+	switch (light.shadowMapIndex) {
+	case 0: return shadowAt(light, uShadowMaps[0], uRichShadowMaps[0], position_ws, shadowBias);
+	case 1: return shadowAt(light, uShadowMaps[1], uRichShadowMaps[1], position_ws, shadowBias);
+	case 2: return shadowAt(light, uShadowMaps[2], uRichShadowMaps[2], position_ws, shadowBias);
+	case 3: return shadowAt(light, uShadowMaps[3], uRichShadowMaps[3], position_ws, shadowBias);
+	default: return 0.0;
+	}
+}
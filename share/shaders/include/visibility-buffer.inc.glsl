@@ -0,0 +1,33 @@
+//////////////////////////////////////////////////////
+// Visibility buffer, used by the "visibilityBuffer" option of grain renderers
+//
+// The visibility pass only writes which grain covers each pixel (RG32UI, see
+// Camera::ExtraFramebufferOption::VisibilityDepth) plus depth. Material
+// attributes are then fetched once per visible pixel by a full screen
+// resolve pass that writes the regular g-buffer.
+//   x: element id + 1 (0 means no grain)
+//   y: primitive or view id, meaning depends on the renderer
+
+#ifdef OUT_VISIBILITY
+layout (location = 0) out uvec2 visibility_out;
+
+void packVisibility(uint elementId, uint subId) {
+	visibility_out = uvec2(elementId + 1u, subId);
+}
+#endif // OUT_VISIBILITY
+
+#ifdef IN_VISIBILITY
+uniform usampler2D uVisibilityBuffer;
+uniform sampler2D uVisibilityDepth;
+
+/**
+ * Return false if no grain covers the pixel
+ */
+bool unpackVisibility(ivec2 coords, out uint elementId, out uint subId, out float depth) {
+	uvec2 data = texelFetch(uVisibilityBuffer, coords, 0).xy;
+	elementId = data.x - 1u;
+	subId = data.y;
+	depth = texelFetch(uVisibilityDepth, coords, 0).x;
+	return data.x != 0u;
+}
+#endif // IN_VISIBILITY
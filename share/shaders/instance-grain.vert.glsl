@@ -61,8 +61,8 @@ void main() {
 
     vec3 grainCenter_ws = (modelMatrix * vec4(pointVertexAttributes[animPointId].position.xyz, 1.0)).xyz;
 
+    mat3 ws_from_gs = transpose(mat3(grainMatrix(animPointId, grainCenter_ws)));
     pointId = animPointId%20; // WTF?
-    mat3 ws_from_gs = transpose(mat3(randomGrainMatrix(int(pointId), grainCenter_ws)));
     
     vec3 vertexPosition = position;
 	vec4 p = vec4(ws_from_gs * vertexPosition * uGrainRadius * uGrainMeshScale + grainCenter_ws, 1.0);
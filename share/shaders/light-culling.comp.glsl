@@ -0,0 +1,113 @@
+#version 450 core
+#include "sys:defines"
+
+// Tiled light culling for the deferred shader: each work group computes the
+// depth bounds of one screen tile and lists the lights whose sphere of
+// influence intersects it. Unbounded lights (radius 0) are not listed, the
+// deferred shader always evaluates them.
+
+#include "include/light.inc.glsl"
+#include "include/light-tiles.inc.glsl"
+#include "include/uniform/camera.inc.glsl"
+
+layout (local_size_x = LIGHT_TILE_SIZE, local_size_y = LIGHT_TILE_SIZE, local_size_z = 1) in;
+
+uniform sampler2D uDepth;
+
+shared uint sMinDepth;
+shared uint sMaxDepth;
+shared uint sLightCount;
+shared uint sLightIndices[MAX_LIGHTS_PER_TILE];
+shared vec3 sTileMin_cs;
+shared vec3 sTileMax_cs;
+
+const uint cGroupSize = LIGHT_TILE_SIZE * LIGHT_TILE_SIZE;
+
+bool intersectsTile(const in PointLight light) {
+	vec3 center_cs = (viewMatrix * vec4(light.position_ws, 1.0)).xyz;
+	vec3 closest = clamp(center_cs, sTileMin_cs, sTileMax_cs);
+	vec3 d = closest - center_cs;
+	return dot(d, d) <= light.radius * light.radius;
+}
+
+void main() {
+	if (gl_LocalInvocationIndex == 0) {
+		sMinDepth = 0xFFFFFFFFu;
+		sMaxDepth = 0u;
+		sLightCount = 0u;
+	}
+	barrier();
+
+	// 1. Depth bounds, ignoring background (depth is positive so that its
+	// bits compare like the float values)
+	ivec2 pixel = ivec2(gl_GlobalInvocationID.xy);
+	if (all(lessThan(pixel, ivec2(resolution)))) {
+		float depth = texelFetch(uDepth, pixel, 0).r;
+		if (depth < 1.0) {
+			atomicMin(sMinDepth, floatBitsToUint(depth));
+			atomicMax(sMaxDepth, floatBitsToUint(depth));
+		}
+	}
+	barrier();
+
+	if (sMinDepth > sMaxDepth) {
+		// only background in this tile, no light evaluated
+		if (gl_LocalInvocationIndex == 0) {
+			lightTiles[lightTileOffset(gl_WorkGroupID.xy)] = 0u;
+		}
+		return;
+	}
+
+	// 2. Camera space bounding box of the tile
+	if (gl_LocalInvocationIndex == 0) {
+		mat4 inverseProjectionMatrix = inverse(projectionMatrix);
+		vec2 ndcMin = vec2(gl_WorkGroupID.xy * LIGHT_TILE_SIZE) / resolution * 2.0 - 1.0;
+		vec2 ndcMax = vec2((gl_WorkGroupID.xy + 1) * LIGHT_TILE_SIZE) / resolution * 2.0 - 1.0;
+		vec2 depthRange = vec2(uintBitsToFloat(sMinDepth), uintBitsToFloat(sMaxDepth)) * 2.0 - 1.0;
+		vec3 bbMin = vec3(1e30);
+		vec3 bbMax = vec3(-1e30);
+		for (int i = 0; i < 8; ++i) {
+			vec4 corner_ndc = vec4(
+				(i & 1) == 0 ? ndcMin.x : ndcMax.x,
+				(i & 2) == 0 ? ndcMin.y : ndcMax.y,
+				(i & 4) == 0 ? depthRange.x : depthRange.y,
+				1.0
+			);
+			vec4 corner_cs = inverseProjectionMatrix * corner_ndc;
+			corner_cs /= corner_cs.w;
+			bbMin = min(bbMin, corner_cs.xyz);
+			bbMax = max(bbMax, corner_cs.xyz);
+		}
+		sTileMin_cs = bbMin;
+		sTileMax_cs = bbMax;
+	}
+	barrier();
+
+	// 3. Cull lights
+	for (uint i = uUnboundedLightCount + gl_LocalInvocationIndex; i < uLightCount; i += cGroupSize) {
+		if (intersectsTile(lights[i])) {
+			uint slot = atomicAdd(sLightCount, 1u);
+			if (slot < MAX_LIGHTS_PER_TILE) {
+				sLightIndices[slot] = i;
+			}
+		}
+	}
+	barrier();
+
+	// 4. Write tile
+	uint offset = lightTileOffset(gl_WorkGroupID.xy);
+	if (sLightCount > uint(MAX_LIGHTS_PER_TILE)) {
+		// Rather slow than wrong
+		if (gl_LocalInvocationIndex == 0) {
+			lightTiles[offset] = LIGHT_TILE_OVERFLOW;
+		}
+		return;
+	}
+	uint count = sLightCount;
+	if (gl_LocalInvocationIndex == 0) {
+		lightTiles[offset] = count;
+	}
+	for (uint i = gl_LocalInvocationIndex; i < count; i += cGroupSize) {
+		lightTiles[offset + 1 + i] = sLightIndices[i];
+	}
+}
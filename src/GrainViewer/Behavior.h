@@ -109,6 +109,13 @@ public:
 	 */
 	virtual void reloadShaders() {}
 
+	/**
+	 * Called after scene load to submit the shader variants this behavior
+	 * may need (see ShaderPool::WarmUpShaderVariant) so that they do not get
+	 * compiled in the middle of a frame the first time an option changes.
+	 */
+	virtual void warmUpShaders() {}
+
 private:
 	friend class IBehaviorHolder;
 	void setParent(const std::shared_ptr<IBehaviorHolder> & parent) { m_parent = parent; }
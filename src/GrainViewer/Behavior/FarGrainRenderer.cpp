@@ -49,6 +49,9 @@
 
 #include <magic_enum.hpp>
 
+#include <algorithm>
+#include <cmath>
+
 const std::vector<std::string> FarGrainRenderer::s_shaderVariantDefines = {
 	"SHELL_CULLING",
 	"PASS_DEPTH",
@@ -56,8 +59,16 @@ const std::vector<std::string> FarGrainRenderer::s_shaderVariantDefines = {
 	"PASS_BLIT_TO_MAIN_FBO",
 	"NO_DISCARD_IN_PASS_EPSILON_DEPTH",
 	"PSEUDO_LEAN",
+	"COMPUTE_SPLATTING",
+	"TEMPORAL_REPROJECTION",
+	"DEPTH_ONLY_POINTS",
+	"DEPTH_ONLY_SPHERES",
 };
 
+// Must match grain/far-grain-splat.*.glsl
+constexpr GLuint SplatLocalSize = 128;
+constexpr size_t SplatChannelCount = 8;
+
 //-----------------------------------------------------------------------------
 // Behavior implementation
 
@@ -77,6 +88,7 @@ void FarGrainRenderer::start()
 	m_transform = getComponent<TransformBehavior>();
 	m_grain = getComponent<GrainBehavior>();
 	m_pointData = BehaviorRegistry::getPointCloudDataComponent(*this, PointCloudSplitter::RenderModel::Point);
+	m_splitter = getComponent<PointCloudSplitter>();
 
 	if (!m_colormapTextureName.empty()) {
 		m_colormapTexture = ResourceManager::loadTexture(m_colormapTextureName);
@@ -86,11 +98,16 @@ void FarGrainRenderer::start()
 void FarGrainRenderer::update(float time, int frame)
 {
 	m_time = time;
+	m_frame = frame;
 }
 
 void FarGrainRenderer::render(const Camera& camera, const World& world, RenderType target) const
 {
-	ScopedTimer timer((target == RenderType::ShadowMap ? "FarGrainRenderer_shadowmap" : "FarGrainRenderer"));
+	const char* timerName = "FarGrainRenderer";
+	if (target == RenderType::ShadowMap) timerName = "FarGrainRenderer_shadowmap";
+	else if (currentRenderMode() == RenderModeComputeSplatting) timerName = "FarGrainRenderer_splatting";
+	else if (useTemporalReprojection()) timerName = "FarGrainRenderer_temporal";
+	ScopedTimer timer(timerName);
 
 	// Sanity checks
 	auto pointData = m_pointData.lock();
@@ -101,7 +118,14 @@ void FarGrainRenderer::render(const Camera& camera, const World& world, RenderTy
 		renderToShadowMap(*pointData, camera, world);
 		break;
 	case RenderType::Default:
-		renderToGBuffer(*pointData, camera, world);
+		// Any main view frame not going through the temporal path leaves the
+		// history stale (e.g. splatting frames of benchmarkRenderModes)
+		if (!useTemporalReprojection()) m_hasHistory = false;
+		if (currentRenderMode() == RenderModeComputeSplatting) {
+			renderToGBufferSplatting(*pointData, camera, world);
+		} else {
+			renderToGBuffer(*pointData, camera, world);
+		}
 		break;
 	default:
 		ERR_LOG << "Unsupported render target: " << magic_enum::enum_name(target);
@@ -125,6 +149,7 @@ void FarGrainRenderer::draw(const IPointCloudData& pointData) const
 	} else {
 		glDrawArrays(GL_POINTS, pointData.pointOffset(), pointData.pointCount());
 	}
+	GlobalTimer::CountDrawCall(pointData.pointCount());
 	glBindVertexArray(0);
 }
 
@@ -135,6 +160,10 @@ void FarGrainRenderer::renderToGBuffer(const IPointCloudData& pointData, const C
 	glEnable(GL_PROGRAM_POINT_SIZE);
 
 	const auto& props = properties();
+	bool temporal = useTemporalReprojection();
+	GLuint subsetCount = static_cast<GLuint>(temporalSubsetCount());
+	GLuint subsetIndex = m_temporalFrame % subsetCount; // (frame count may not advance when animation is paused)
+	if (temporal) ++m_temporalFrame;
 	
 	std::shared_ptr<Framebuffer> fbo;
 	if (props.useShellCulling) {
@@ -155,16 +184,15 @@ void FarGrainRenderer::renderToGBuffer(const IPointCloudData& pointData, const C
 
 	// 1. Render depth buffer with an offset of epsilon
 	if (props.useShellCulling) {
-		ShaderVariantFlagSet flags = ShaderPassEpsilonDepth | ShaderOptionShellCulling;
-		if (props.noDiscard) flags |= ShaderOptionNoDiscard;
-		if (props.pseudoLean) flags |= ShaderOptionPseudoLean;
-		ShaderProgram& shader = *getShader(flags);
+		ShaderProgram& shader = *getShader(epsilonDepthPassFlags(props));
 
 		glDepthMask(GL_TRUE);
 		glEnable(GL_DEPTH_TEST);
 		glDisable(GL_BLEND);
 
 		setCommonUniforms(shader, camera);
+		shader.setUniform("uTemporalSubsetCount", subsetCount);
+		shader.setUniform("uTemporalSubsetIndex", subsetIndex);
 
 		shader.use();
 		draw(pointData);
@@ -179,11 +207,7 @@ void FarGrainRenderer::renderToGBuffer(const IPointCloudData& pointData, const C
 
 	// 3. Render points cumulatively
 	{
-		ShaderVariantFlagSet flags = 0;
-		if (props.noDiscard) flags |= ShaderOptionNoDiscard;
-		if (props.pseudoLean) flags |= ShaderOptionPseudoLean;
-		if (props.useShellCulling) flags |= ShaderOptionShellCulling;
-		ShaderProgram& shader = *getShader(flags);
+		ShaderProgram& shader = *getShader(mainPassFlags(props));
 
 		if (props.useShellCulling) {
 			glDepthMask(GL_FALSE);
@@ -198,10 +222,12 @@ void FarGrainRenderer::renderToGBuffer(const IPointCloudData& pointData, const C
 		}
 
 		GLint o = setCommonUniforms(shader, camera);
+		shader.setUniform("uTemporalSubsetCount", subsetCount);
+		shader.setUniform("uTemporalSubsetIndex", subsetIndex);
 
 		if (auto grain = m_grain.lock()) {
 			for (size_t k = 0; k < grain->atlases().size(); ++k) {
-				o = grain->atlases()[k].setUniforms(shader, MAKE_STR("uImpostor[" << k << "]."), o);
+				o = grain->atlases()[k].setUniforms(shader, UniformName("uImpostor")[static_cast<int>(k)], o);
 			}
 		}
 
@@ -217,10 +243,7 @@ void FarGrainRenderer::renderToGBuffer(const IPointCloudData& pointData, const C
 
 	// 4. Blit extra fbo to gbuffer
 	if (props.useShellCulling) {
-		ShaderVariantFlagSet flags = ShaderPassBlitToMainFbo | ShaderOptionShellCulling;
-		if (props.noDiscard) flags |= ShaderOptionNoDiscard;
-		if (props.pseudoLean) flags |= ShaderOptionPseudoLean;
-		ShaderProgram& shader = *getShader(flags);
+		ShaderProgram& shader = *getShader(blitPassFlags(props, temporal));
 
 		scoppedFramebufferOverride.restore();
 		
@@ -235,7 +258,7 @@ void FarGrainRenderer::renderToGBuffer(const IPointCloudData& pointData, const C
 		GLint o = 0;
 		for (int i = 0; i < fbo->colorTextureCount(); ++i) {
 			glBindTextureUnit(static_cast<GLuint>(o), fbo->colorTexture(i));
-			shader.setUniform(MAKE_STR("lgbuffer" << i), o);
+			shader.setUniform(UniformName("lgbuffer") + i, o);
 			++o;
 		}
 		glBindTextureUnit(static_cast<GLuint>(o), fbo->depthTexture());
@@ -245,19 +268,97 @@ void FarGrainRenderer::renderToGBuffer(const IPointCloudData& pointData, const C
 		// Bind depth buffer for reading
 		bindDepthTexture(shader, o++);
 
+		if (temporal) {
+			bindTemporalHistory(shader, camera, o);
+			o += 2;
+		}
+
 		shader.use();
 		PostEffect::DrawWithDepthTest();
+		GlobalTimer::CountDrawCall();
+
+		if (temporal) {
+			glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT | GL_SHADER_IMAGE_ACCESS_BARRIER_BIT);
+			m_historyIndex = 1 - m_historyIndex;
+			m_hasHistory = true;
+			m_previousViewProjectionMatrix = camera.projectionMatrix() * camera.viewMatrix();
+		}
+	}
+}
+
+void FarGrainRenderer::renderToGBufferSplatting(const IPointCloudData& pointData, const Camera& camera, const World& world) const
+{
+	const auto& props = properties();
+
+	// 0. (Re)allocate and clear splatting buffers
+	glm::ivec2 res = glm::ivec2(camera.resolution());
+	size_t pixelCount = static_cast<size_t>(std::max(res.x, 1)) * static_cast<size_t>(std::max(res.y, 1));
+	if (!m_splatDepth || m_splatPixelCount != pixelCount) {
+		m_splatPixelCount = pixelCount;
+		m_splatDepth = std::make_unique<GlBuffer>(GL_SHADER_STORAGE_BUFFER);
+		m_splatDepth->addBlock<GLuint>(pixelCount);
+		m_splatDepth->alloc();
+		m_splatDepth->finalize();
+		m_splatAccumulation = std::make_unique<GlBuffer>(GL_SHADER_STORAGE_BUFFER);
+		m_splatAccumulation->addBlock<GLint>(SplatChannelCount * pixelCount);
+		m_splatAccumulation->alloc();
+		m_splatAccumulation->finalize();
+	}
+	GLuint emptyDepth = 0xFFFFFFFF;
+	GLint zero = 0;
+	glClearNamedBufferData(m_splatDepth->name(), GL_R32UI, GL_RED_INTEGER, GL_UNSIGNED_INT, &emptyDepth);
+	glClearNamedBufferData(m_splatAccumulation->name(), GL_R32I, GL_RED_INTEGER, GL_INT, &zero);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+	pointData.vbo().bindSsbo(0);
+	if (auto ebo = pointData.ebo()) {
+		ebo->bindSsbo(1);
+	}
+	m_splatDepth->bindSsbo(2);
+	m_splatAccumulation->bindSsbo(3);
+	GLuint groups = (static_cast<GLuint>(pointData.pointCount()) + SplatLocalSize - 1) / SplatLocalSize;
+
+	// 1. Splat depth with an offset of epsilon, then 2. accumulate attributes
+	for (bool depthPass : { true, false }) {
+		if (groups == 0) break;
+		const ShaderProgram& shader = *getSplatShader(depthPass);
+		if (!shader.isValid()) return;
+
+		GLint o = setCommonUniforms(shader, camera);
+		if (auto grain = m_grain.lock()) {
+			for (size_t k = 0; k < grain->atlases().size(); ++k) {
+				o = grain->atlases()[k].setUniforms(shader, UniformName("uImpostor")[static_cast<int>(k)], o);
+			}
+		}
+		shader.setUniform("uUsePointElements", pointData.ebo() != nullptr);
+		shader.setUniform("uElementOffset", static_cast<GLuint>(pointData.pointOffset()));
+		shader.setUniform("uElementCount", static_cast<GLuint>(pointData.pointCount()));
+
+		shader.use();
+		glDispatchCompute(groups, 1, 1);
+		GlobalTimer::CountDrawCall(pointData.pointCount());
+		glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	}
+
+	// 3. Resolve buffers into the gbuffer, like the blit pass of the point mode
+	{
+		ShaderProgram& shader = *getShader(splatBlitPassFlags(props));
+
+		glDepthMask(GL_TRUE);
+		glEnable(GL_DEPTH_TEST);
+		glDisable(GL_BLEND);
+
+		setCommonUniforms(shader, camera);
+
+		shader.use();
+		PostEffect::DrawWithDepthTest();
+		GlobalTimer::CountDrawCall();
 	}
 }
 
 void FarGrainRenderer::renderToShadowMap(const IPointCloudData& pointData, const Camera& camera, const World& world) const
 {
-	const Properties& props = properties();
-	ShaderVariantFlagSet flags = ShaderPassDepth;
-	if (props.noDiscard) flags |= ShaderOptionNoDiscard;
-	if (props.pseudoLean) flags |= ShaderOptionPseudoLean;
-	if (props.useShellCulling) flags |= ShaderOptionShellCulling;
-	ShaderProgram& shader = *getShader(flags);
+	ShaderProgram& shader = *getShader(shadowPassFlags(properties()));
 
 	glEnable(GL_PROGRAM_POINT_SIZE);
 	glDepthMask(GL_TRUE);
@@ -294,7 +395,12 @@ GLint FarGrainRenderer::setCommonUniforms(const ShaderProgram & shader, const Ca
 	}
 	
 	shader.setUniform("uTime", m_time);
-	
+	shader.setUniform("uTemporalSubsetCount", 1u);
+	shader.setUniform("uTemporalSubsetIndex", 0u);
+	if (auto pointData = m_pointData.lock()) {
+		bindGrainOrientations(shader, *pointData);
+	}
+
 	if (m_colormapTexture) {
 		m_colormapTexture->bind(o);
 		shader.setUniform("uColormapTexture", o);
@@ -321,18 +427,202 @@ std::shared_ptr<ShaderProgram> FarGrainRenderer::getShader(ShaderVariantFlagSet
 	}
 
 	if (!m_shaders[flags]) {
-		// Lazy loading of shader variants
-		int nFlags = ilog2(_ShaderVariantFlagsCount);
-		std::string variantName = m_shaderName + "_ShaderVariantFlags_" + bitname(flags, nFlags);
-		std::vector<std::string> defines;
-		for (int f = 0; f < nFlags; ++f) {
-			if ((flags & (1 << f)) != 0) {
-				defines.push_back(s_shaderVariantDefines[f]);
+		// Lazy loading of shader variants (usually already warmed up)
+		m_shaders[flags] = ShaderPool::GetShaderVariant(variantName(flags), m_shaderName, variantDefines(flags));
+	}
+	return m_shaders[flags];
+}
+
+std::shared_ptr<ShaderProgram> FarGrainRenderer::getSplatShader(bool depthPass) const
+{
+	int index = depthPass ? 1 : 0;
+	if (!m_splatShaders[index]) {
+		m_splatShaders[index] = ShaderPool::GetShaderVariant(splatShaderVariantName(depthPass), m_splatShaderName, splatShaderDefines(depthPass));
+	}
+	return m_splatShaders[index];
+}
+
+std::string FarGrainRenderer::splatShaderVariantName(bool depthPass) const
+{
+	return m_splatShaderName + (depthPass ? "_SplatPassDepth" : "_SplatPassAccumulate");
+}
+
+std::vector<std::string> FarGrainRenderer::splatShaderDefines(bool depthPass) const
+{
+	// Compute shader does not inherit the defines of the FarGrain shader
+	// (e.g. procedural color) so we forward them
+	const auto& baseDefines = getShader(0)->getDefines();
+	std::vector<std::string> defines(baseDefines.begin(), baseDefines.end());
+	defines.push_back(depthPass ? "SPLAT_PASS_DEPTH" : "SPLAT_PASS_ACCUMULATE");
+	return defines;
+}
+
+void FarGrainRenderer::warmUpShaders()
+{
+	auto warmUp = [this](ShaderVariantFlagSet flags) {
+		ShaderPool::WarmUpShaderVariant(variantName(flags), m_shaderName, variantDefines(flags));
+	};
+	forEachNeighbourProperties(properties(), [&](const Properties& props) {
+		for (int frame : { 0, 1 }) { // benchmarkRenderModes alternates every frame
+			RenderMode mode = renderModeAtFrame(props, frame);
+			if (mode == RenderModeComputeSplatting) {
+				for (bool depthPass : { true, false }) {
+					ShaderPool::WarmUpShaderVariant(splatShaderVariantName(depthPass), m_splatShaderName, splatShaderDefines(depthPass));
+				}
+				warmUp(splatBlitPassFlags(props));
+			}
+			else {
+				if (props.useShellCulling) {
+					warmUp(epsilonDepthPassFlags(props));
+					warmUp(blitPassFlags(props, useTemporalReprojection(props, mode)));
+				}
+				warmUp(mainPassFlags(props));
 			}
 		}
-		DEBUG_LOG << "loading variant " << variantName;
-		ShaderPool::AddShaderVariant(variantName, m_shaderName, defines);
-		m_shaders[flags] = ShaderPool::GetShader(variantName);
+		warmUp(shadowPassFlags(props));
+	});
+}
+
+FarGrainRenderer::ShaderVariantFlagSet FarGrainRenderer::epsilonDepthPassFlags(const Properties& props)
+{
+	ShaderVariantFlagSet flags = ShaderPassEpsilonDepth | ShaderOptionShellCulling;
+	if (props.noDiscard) flags |= ShaderOptionNoDiscard;
+	if (props.pseudoLean) flags |= ShaderOptionPseudoLean;
+	return flags;
+}
+
+FarGrainRenderer::ShaderVariantFlagSet FarGrainRenderer::mainPassFlags(const Properties& props)
+{
+	ShaderVariantFlagSet flags = 0;
+	if (props.noDiscard) flags |= ShaderOptionNoDiscard;
+	if (props.pseudoLean) flags |= ShaderOptionPseudoLean;
+	if (props.useShellCulling) flags |= ShaderOptionShellCulling;
+	return flags;
+}
+
+FarGrainRenderer::ShaderVariantFlagSet FarGrainRenderer::blitPassFlags(const Properties& props, bool temporal)
+{
+	ShaderVariantFlagSet flags = ShaderPassBlitToMainFbo | ShaderOptionShellCulling;
+	if (props.noDiscard) flags |= ShaderOptionNoDiscard;
+	if (props.pseudoLean) flags |= ShaderOptionPseudoLean;
+	if (temporal) flags |= ShaderOptionTemporalReprojection;
+	return flags;
+}
+
+FarGrainRenderer::ShaderVariantFlagSet FarGrainRenderer::splatBlitPassFlags(const Properties& props)
+{
+	ShaderVariantFlagSet flags = ShaderPassBlitToMainFbo | ShaderOptionShellCulling | ShaderOptionComputeSplatting;
+	if (props.noDiscard) flags |= ShaderOptionNoDiscard;
+	return flags;
+}
+
+FarGrainRenderer::ShaderVariantFlagSet FarGrainRenderer::shadowPassFlags(const Properties& props) const
+{
+	ShaderVariantFlagSet flags = ShaderPassDepth;
+	if (props.noDiscard) flags |= ShaderOptionNoDiscard;
+	if (props.pseudoLean) flags |= ShaderOptionPseudoLean;
+	if (props.useShellCulling) flags |= ShaderOptionShellCulling;
+	if (auto splitter = m_splitter.lock()) {
+		// Cheap casters, the splitter sent every grain to this renderer
+		switch (splitter->properties().shadowCasterModel) {
+		case PointCloudSplitter::ShadowCasterModel::DepthPoints:
+			flags = ShaderPassDepth | ShaderOptionDepthOnlyPoints;
+			break;
+		case PointCloudSplitter::ShadowCasterModel::Spheres:
+			flags = ShaderPassDepth | ShaderOptionDepthOnlySpheres;
+			break;
+		default:
+			break;
+		}
 	}
-	return m_shaders[flags];
+	return flags;
+}
+
+std::vector<std::string> FarGrainRenderer::variantDefines(ShaderVariantFlagSet flags)
+{
+	int nFlags = ilog2(_ShaderVariantFlagsCount);
+	std::vector<std::string> defines;
+	for (int f = 0; f < nFlags; ++f) {
+		if ((flags & (1 << f)) != 0) {
+			defines.push_back(s_shaderVariantDefines[f]);
+		}
+	}
+	return defines;
+}
+
+std::string FarGrainRenderer::variantName(ShaderVariantFlagSet flags) const
+{
+	return m_shaderName + "_ShaderVariantFlags_" + bitname(flags, ilog2(_ShaderVariantFlagsCount));
+}
+
+bool FarGrainRenderer::useTemporalReprojection() const
+{
+	return useTemporalReprojection(properties(), currentRenderMode());
+}
+
+bool FarGrainRenderer::useTemporalReprojection(const Properties& props, RenderMode mode)
+{
+	return props.temporalReprojection
+		&& mode == RenderModePoints
+		&& props.useShellCulling
+		&& !props.pseudoLean;
+}
+
+int FarGrainRenderer::temporalSubsetCount() const
+{
+	if (!useTemporalReprojection()) return 1;
+	float fraction = std::max(properties().temporalSubsetFraction, 0.01f);
+	return std::max(1, static_cast<int>(std::round(1.0f / fraction)));
+}
+
+void FarGrainRenderer::bindTemporalHistory(const ShaderProgram& shader, const Camera& camera, GLint textureUnit) const
+{
+	GLsizei width = static_cast<GLsizei>(camera.resolution().x);
+	GLsizei height = static_cast<GLsizei>(camera.resolution().y);
+	if (!m_history[0][0] || m_history[0][0]->width() != width || m_history[0][0]->height() != height) {
+		for (auto& history : m_history) {
+			for (auto& tex : history) {
+				tex = std::make_unique<GlTexture>(GL_TEXTURE_2D);
+				tex->storage(1, GL_RGBA32F, width, height);
+				glTextureParameteri(tex->raw(), GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+				glTextureParameteri(tex->raw(), GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+			}
+		}
+		m_hasHistory = false;
+	}
+
+	const auto& read = m_history[m_historyIndex];
+	const auto& write = m_history[1 - m_historyIndex];
+	for (int i = 0; i < 2; ++i) {
+		read[i]->bind(textureUnit + i);
+		shader.setUniform(UniformName("uHistory") + i, textureUnit + i);
+		glBindImageTexture(static_cast<GLuint>(i), write[i]->raw(), 0, GL_FALSE, 0, GL_WRITE_ONLY, GL_RGBA32F);
+	}
+
+	glm::mat4 viewProjectionMatrix = camera.projectionMatrix() * camera.viewMatrix();
+	shader.setUniform("uHasHistory", m_hasHistory);
+	shader.setUniform("uViewProjectionMatrix", viewProjectionMatrix);
+	shader.setUniform("uInverseViewProjectionMatrix", glm::inverse(viewProjectionMatrix));
+	shader.setUniform("uPreviousViewProjectionMatrix", m_previousViewProjectionMatrix);
+	shader.setUniform("uInversePreviousViewProjectionMatrix", glm::inverse(m_previousViewProjectionMatrix));
+	// weight of the current frame
+	shader.setUniform("uTemporalSubsetFraction", 1.0f / static_cast<float>(temporalSubsetCount()));
+}
+
+FarGrainRenderer::RenderMode FarGrainRenderer::currentRenderMode() const
+{
+	return renderModeAtFrame(properties(), m_frame);
+}
+
+FarGrainRenderer::RenderMode FarGrainRenderer::renderModeAtFrame(const Properties& props, int frame)
+{
+	RenderMode mode = props.renderMode;
+	if (props.benchmarkRenderModes) {
+		mode = frame % 2 == 0 ? RenderModePoints : RenderModeComputeSplatting;
+	}
+	// Splatting only implements the shell culling path
+	if (!props.useShellCulling || props.pseudoLean) {
+		mode = RenderModePoints;
+	}
+	return mode;
 }
@@ -39,9 +39,11 @@
 
 class TransformBehavior;
 class GrainBehavior;
+class PointCloudSplitter;
 class ShaderProgram;
 class IPointCloudData;
 class GlTexture;
+class GlBuffer;
 
 /**
  * A grain renderer focused on furthest grains, that are subpixelic.
@@ -54,6 +56,7 @@ public:
 	void start() override;
 	void update(float time, int frame) override;
 	void render(const Camera & camera, const World & world, RenderType target) const override;
+	void warmUpShaders() override;
 
 public:
 	// Public properties
@@ -67,6 +70,10 @@ public:
 		WeightModeNone = -1,
 		WeightModeLinear = 0,
 	};
+	enum RenderMode {
+		RenderModePoints, // rasterize GL_POINTS in an extra fbo
+		RenderModeComputeSplatting, // splat grains in buffers using compute shaders (requires shell culling, no pseudo lean)
+	};
 	struct Properties {
 		float radius = 0.007f;
 		float epsilonFactor = 10.0f; // multiplied by radius
@@ -77,6 +84,14 @@ public:
 		bool useEarlyDepthTest = true;
 		bool noDiscard = false; // in eps (some artefacts on edges or with low shell depth, but faster)
 		bool pseudoLean = false;
+		RenderMode renderMode = RenderModePoints;
+		bool benchmarkRenderModes = false; // alternate render modes every frame, to compare timers
+
+		// Reproject previous frame and only re-splat a subset of the grains
+		// (only in RenderModePoints, with shell culling and no pseudo lean)
+		bool temporalReprojection = false;
+		float temporalSubsetFraction = 0.25f; // rounded to 1/n
+		float maxReprojectionMotion = 8.0f; // in pixels, history is rejected beyond
 
 		bool useBbox = false; // if true, remove all points out of the supplied bounding box
 		glm::vec3 bboxMin;
@@ -100,7 +115,11 @@ private:
 		ShaderPassBlitToMainFbo = 1 << 3,
 		ShaderOptionNoDiscard = 1 << 4,
 		ShaderOptionPseudoLean = 1 << 5,
-		_ShaderVariantFlagsCount = 1 << 6,
+		ShaderOptionComputeSplatting = 1 << 6,
+		ShaderOptionTemporalReprojection = 1 << 7,
+		ShaderOptionDepthOnlyPoints = 1 << 8,
+		ShaderOptionDepthOnlySpheres = 1 << 9,
+		_ShaderVariantFlagsCount = 1 << 10,
 	};
 	typedef int ShaderVariantFlagSet;
 	static const std::vector<std::string> s_shaderVariantDefines;
@@ -108,14 +127,34 @@ private:
 private:
 	void draw(const IPointCloudData& pointData) const;
 	void renderToGBuffer(const IPointCloudData& pointData, const Camera& camera, const World& world) const;
+	void renderToGBufferSplatting(const IPointCloudData& pointData, const Camera& camera, const World& world) const;
 	void renderToShadowMap(const IPointCloudData& pointData, const Camera& camera, const World& world) const;
 	glm::mat4 modelMatrix() const;
 	GLint setCommonUniforms(const ShaderProgram & shader, const Camera & camera, GLint nextTextureUnit = 0) const;
 	void bindDepthTexture(ShaderProgram & shader, GLuint textureUnit = 7) const;
 	std::shared_ptr<ShaderProgram> getShader(ShaderVariantFlagSet flags = 0) const;
+	std::shared_ptr<ShaderProgram> getSplatShader(bool depthPass) const;
+	std::string splatShaderVariantName(bool depthPass) const;
+	std::vector<std::string> splatShaderDefines(bool depthPass) const;
+	RenderMode currentRenderMode() const;
+	bool useTemporalReprojection() const;
+	static RenderMode renderModeAtFrame(const Properties& props, int frame);
+	static bool useTemporalReprojection(const Properties& props, RenderMode mode);
+
+	// Variant flags of each pass, shared by render functions and warmUpShaders()
+	static ShaderVariantFlagSet epsilonDepthPassFlags(const Properties& props);
+	static ShaderVariantFlagSet mainPassFlags(const Properties& props);
+	static ShaderVariantFlagSet blitPassFlags(const Properties& props, bool temporal);
+	static ShaderVariantFlagSet splatBlitPassFlags(const Properties& props);
+	ShaderVariantFlagSet shadowPassFlags(const Properties& props) const;
+	static std::vector<std::string> variantDefines(ShaderVariantFlagSet flags);
+	std::string variantName(ShaderVariantFlagSet flags) const;
+	int temporalSubsetCount() const;
+	void bindTemporalHistory(const ShaderProgram& shader, const Camera& camera, GLint textureUnit) const;
 
 public:
 	std::string m_shaderName = "FarGrain";
+	std::string m_splatShaderName = "FarGrainSplat";
 	std::string m_colormapTextureName = "";
 	Properties m_properties;
 
@@ -124,11 +163,27 @@ public:
 	std::weak_ptr<TransformBehavior> m_transform;
 	std::weak_ptr<GrainBehavior> m_grain;
 	std::weak_ptr<IPointCloudData> m_pointData;
+	std::weak_ptr<PointCloudSplitter> m_splitter; // for shadow caster model
 	std::unique_ptr<GlTexture> m_colormapTexture;
 
 	std::shared_ptr<Framebuffer> m_depthFbo;
 
+	// Compute splatting
+	mutable std::shared_ptr<ShaderProgram> m_splatShaders[2]; // accumulation, depth
+	mutable std::unique_ptr<GlBuffer> m_splatDepth;
+	mutable std::unique_ptr<GlBuffer> m_splatAccumulation;
+	mutable size_t m_splatPixelCount = 0;
+
+	// Temporal reprojection, ping-pong history of resolved fragments
+	// m_history[i][0] = (baseColor, depth), m_history[i][1] = (normal, roughness)
+	mutable std::unique_ptr<GlTexture> m_history[2][2];
+	mutable int m_historyIndex = 0; // index of the history to read from
+	mutable bool m_hasHistory = false;
+	mutable GLuint m_temporalFrame = 0; // counts rendered frames, to rotate subsets
+	mutable glm::mat4 m_previousViewProjectionMatrix;
+
 	float m_time;
+	int m_frame = 0;
 };
 
 using namespace ReflectionAttributes;
@@ -142,6 +197,11 @@ REFL_FIELD(shellDepthFalloff)
 REFL_FIELD(useEarlyDepthTest)
 REFL_FIELD(noDiscard)
 REFL_FIELD(pseudoLean)
+REFL_FIELD(renderMode)
+REFL_FIELD(benchmarkRenderModes)
+REFL_FIELD(temporalReprojection)
+REFL_FIELD(temporalSubsetFraction, Range(0.01f, 1.0f))
+REFL_FIELD(maxReprojectionMotion, Range(0.0f, 64.0f))
 REFL_FIELD(useBbox)
 REFL_FIELD(bboxMin, Range(-1.0f, 1.0f))
 REFL_FIELD(bboxMax, Range(-1.0f, 1.0f))
@@ -40,6 +40,8 @@
 #include "utils/jsonutils.h"
 #include "utils/behaviorutils.h"
 
+#include <algorithm>
+
 //-----------------------------------------------------------------------------
 
 const std::vector<std::string> ImpostorGrainRenderer::s_shaderVariantDefines = {
@@ -49,7 +51,36 @@ const std::vector<std::string> ImpostorGrainRenderer::s_shaderVariantDefines = {
 	"NO_INTERPOLATION",
 	"PRECOMPUTE_IMPOSTOR_VIEW_MATRICES",
 	"PRECOMPUTE_IN_VERTEX",
+	"VERTEX_PULLING",
+	"VERTEX_PULLING_QUADS",
+	"PRECOMPUTED_VIEW_SELECTION",
+	"PASS_VISIBILITY",
+	"PASS_RESOLVE_VISIBILITY",
+};
+
+// Matches grain/impostor-view-selection.comp.glsl
+struct ImpostorViewSelection {
+	glm::uvec4 i;
+	glm::vec4 alpha;
 };
+constexpr GLuint ViewSelectionLocalSize = 128;
+
+// Rough size of a pixel of the framebuffers written by this renderer, depth included
+static GLuint64 bytesPerPixel(const Camera& camera, Camera::ExtraFramebufferOption option)
+{
+	constexpr GLuint64 depthBytes = 4;
+	bool compact = camera.gbufferLayout() == Camera::GBufferLayout::Compact;
+	switch (option) {
+	case Camera::ExtraFramebufferOption::GBufferDepth:
+		return (compact ? 12 : 48) + depthBytes;
+	case Camera::ExtraFramebufferOption::LinearGBufferDepth:
+		return (compact ? 16 : 32) + depthBytes;
+	case Camera::ExtraFramebufferOption::VisibilityDepth:
+		return 8 + depthBytes;
+	default:
+		return depthBytes;
+	}
+}
 
 bool ImpostorGrainRenderer::deserialize(const rapidjson::Value & json)
 {
@@ -93,24 +124,59 @@ void ImpostorGrainRenderer::render(const Camera& camera, const World& world, Ren
 
 	glEnable(GL_PROGRAM_POINT_SIZE);
 
+	bool visibility = props.visibilityBuffer && target != RenderType::ShadowMap;
+	bool noDiscard = props.noDiscard && !visibility;
+	bool countFragments = props.countFragments && target != RenderType::ShadowMap;
+	if (countFragments) {
+		// Skip counting this pass rather than waiting for the previous one
+		countFragments = gatherFragmentCounters();
+	}
+	if (countFragments) {
+		if (m_fragmentQueries[0] == 0) {
+			glCreateQueries(GL_SAMPLES_PASSED, 2, m_fragmentQueries);
+		}
+	}
+
 	std::shared_ptr<Framebuffer> fbo;
-	if (props.noDiscard && target != RenderType::ShadowMap) {
+	Camera::ExtraFramebufferOption fboOption = Camera::ExtraFramebufferOption::GBufferDepth; // main fbo
+	if (visibility) {
+		// Only grain ids are written in the main draw call, material
+		// attributes are fetched when resolving onto the main framebuffer
+		fboOption = Camera::ExtraFramebufferOption::VisibilityDepth;
+	}
+	else if (noDiscard && target != RenderType::ShadowMap) {
 		// If not using discards in main draw call, we render in a separate
 		// framebuffer and only then blit it onto the main framebuffer
-		fbo = camera.getExtraFramebuffer(Camera::ExtraFramebufferOption::LinearGBufferDepth);
+		fboOption = Camera::ExtraFramebufferOption::LinearGBufferDepth;
+	}
+	if (fboOption != Camera::ExtraFramebufferOption::GBufferDepth) {
+		fbo = camera.getExtraFramebuffer(fboOption);
 		fbo->bind();
 	}
 
 	// 1. Clear depth
-	if (fbo) {
+	if (visibility) {
+		constexpr GLuint noGrain[] = { 0, 0, 0, 0 };
+		glClearBufferuiv(GL_COLOR, 0, noGrain);
+		glClear(GL_DEPTH_BUFFER_BIT);
+	}
+	else if (fbo) {
 		glClearColor(0.0f, 0.0f, 0.0f, 0.0f);
 		glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 	}
 
+	if (countFragments) {
+		m_pendingBytesPerFragment = bytesPerPixel(camera, fboOption);
+		m_pendingBytesPerResolvedPixel = bytesPerPixel(camera, Camera::ExtraFramebufferOption::GBufferDepth);
+		m_fragmentQueriesHaveResolve = fbo != nullptr;
+		m_fragmentQueriesPending = true;
+		glBeginQuery(GL_SAMPLES_PASSED, m_fragmentQueries[0]);
+	}
+
 	// 2. Main drawing, cumulativly if there is an extra fbo
 	{
 		glDepthMask(GL_TRUE);
-		if (fbo) {
+		if (fbo && !visibility) {
 			glDepthFunc(GL_ALWAYS);
 			glEnable(GL_BLEND);
 			glBlendFunc(GL_ONE, GL_ONE);
@@ -121,12 +187,10 @@ void ImpostorGrainRenderer::render(const Camera& camera, const World& world, Ren
 		}
 
 		// Get shader
-		ShaderVariantFlagSet flags = 0;
-		if (target == RenderType::ShadowMap) flags |= ShaderPassShadow;
-		if (props.noDiscard) flags |= ShaderOptionNoDiscard;
-		if (props.precomputeViewMatrices) flags |= ShaderOptionPrecomputeViewMatrices;
-		if (props.precomputeInVertex) flags |= ShaderOptionPrecomputeInVertex;
-		if (props.interpolationMode == InterpolationMode::None) flags |= ShaderOptionNoInterpolation;
+		ShaderVariantFlagSet flags = mainPassFlags(props, target);
+		if ((flags & ShaderOptionPrecomputedViewSelection) != 0) {
+			computeViewSelection(*pointData, camera);
+		}
 		const ShaderProgram& shader = *getShader(flags);
 
 		setCommonUniforms(shader, camera);
@@ -140,7 +204,11 @@ void ImpostorGrainRenderer::render(const Camera& camera, const World& world, Ren
 		}
 	}
 
-	// 3. Blit auxilliary fbo to main fbo
+	if (countFragments) {
+		glEndQuery(GL_SAMPLES_PASSED);
+	}
+
+	// 3. Blit auxilliary fbo to main fbo (or resolve visibility buffer)
 	if (fbo) {
 		scoppedFramebufferOverride.restore();
 
@@ -150,33 +218,70 @@ void ImpostorGrainRenderer::render(const Camera& camera, const World& world, Ren
 		glDisable(GL_BLEND);
 
 		// Get shader
-		ShaderVariantFlagSet flags = ShaderPassBlitToMainFbo;
-		if (target == RenderType::ShadowMap) flags |= ShaderPassShadow;
-		if (props.noDiscard) flags |= ShaderOptionNoDiscard;
-		if (props.precomputeViewMatrices) flags |= ShaderOptionPrecomputeViewMatrices;
-		if (props.precomputeInVertex) flags |= ShaderOptionPrecomputeInVertex;
-		if (props.interpolationMode == InterpolationMode::None) flags |= ShaderOptionNoInterpolation;
-		const ShaderProgram& shader = *getShader(flags);
+		const ShaderProgram& shader = *getShader(blitPassFlags(props, target));
 
 		// Set uniforms
+		GLint o = 0;
+		if (visibility) {
+			o = setCommonUniforms(shader, camera);
+			bindPointBuffers(*pointData, shader);
+		}
 
 		// Bind secondary FBO textures
 		glTextureBarrier();
-		GLint o = 0;
-		for (int i = 0; i < fbo->colorTextureCount(); ++i) {
-			glBindTextureUnit(static_cast<GLuint>(o), fbo->colorTexture(i));
-			shader.setUniform(MAKE_STR("lgbuffer" << i), o);
+		if (visibility) {
+			glBindTextureUnit(static_cast<GLuint>(o), fbo->colorTexture(0));
+			shader.setUniform("uVisibilityBuffer", o);
+			++o;
+			glBindTextureUnit(static_cast<GLuint>(o), fbo->depthTexture());
+			shader.setUniform("uVisibilityDepth", o);
+			++o;
+		}
+		else {
+			for (int i = 0; i < fbo->colorTextureCount(); ++i) {
+				glBindTextureUnit(static_cast<GLuint>(o), fbo->colorTexture(i));
+				shader.setUniform(UniformName("lgbuffer") + i, o);
+				++o;
+			}
+			glBindTextureUnit(static_cast<GLuint>(o), fbo->depthTexture());
+			shader.setUniform("uFboDepthTexture", o);
 			++o;
 		}
-		glBindTextureUnit(static_cast<GLuint>(o), fbo->depthTexture());
-		shader.setUniform("uFboDepthTexture", o);
-		++o;
 
+		if (countFragments) glBeginQuery(GL_SAMPLES_PASSED, m_fragmentQueries[1]);
 		shader.use();
 		PostEffect::DrawWithDepthTest();
+		GlobalTimer::CountDrawCall();
+		if (countFragments) glEndQuery(GL_SAMPLES_PASSED);
 	}
 }
 
+void ImpostorGrainRenderer::onDestroy()
+{
+	if (m_fragmentQueries[0] != 0) {
+		glDeleteQueries(2, m_fragmentQueries);
+	}
+}
+
+void ImpostorGrainRenderer::warmUpShaders()
+{
+	auto warmUp = [](const std::string& baseName, ShaderVariantFlagSet flags) {
+		ShaderPool::WarmUpShaderVariant(variantName(baseName, flags), baseName, variantDefines(flags));
+	};
+	forEachNeighbourProperties(properties(), [&](const Properties& props) {
+		for (RenderType target : { RenderType::Default, RenderType::ShadowMap }) {
+			ShaderVariantFlagSet flags = mainPassFlags(props, target);
+			warmUp(m_shaderName, flags);
+			if ((flags & ShaderOptionPrecomputedViewSelection) != 0) {
+				warmUp(m_viewSelectionShaderName, viewSelectionFlags(props));
+			}
+			if (ShaderVariantFlagSet blitFlags = blitPassFlags(props, target)) {
+				warmUp(m_shaderName, blitFlags);
+			}
+		}
+	});
+}
+
 
 //-----------------------------------------------------------------------------
 
@@ -185,19 +290,61 @@ void ImpostorGrainRenderer::draw(const IPointCloudData& pointData, const ShaderP
 	// Draw call
 	shader.use();
 	glBindVertexArray(pointData.vao());
+	bindPointBuffers(pointData, shader);
+	if (properties().expansionMode == ExpansionMode::VertexPullingQuads) {
+		if (m_viewSelection) m_viewSelection->bindSsbo(5);
+		glDrawArrays(GL_TRIANGLES, 6 * pointData.pointOffset(), 6 * pointData.pointCount());
+	}
+	else {
+		glDrawArrays(GL_POINTS, pointData.pointOffset(), pointData.pointCount());
+	}
+	GlobalTimer::CountDrawCall(pointData.pointCount());
+	glBindVertexArray(0);
+}
+
+void ImpostorGrainRenderer::bindPointBuffers(const IPointCloudData& pointData, const ShaderProgram& shader) const
+{
+	pointData.vbo().bindSsbo(0);
 	if (auto ebo = pointData.ebo()) {
-		pointData.vbo().bindSsbo(0);
 		ebo->bindSsbo(1);
 		shader.setUniform("uUsePointElements", true);
 	}
 	else {
 		shader.setUniform("uUsePointElements", false);
 	}
-	glDrawArrays(GL_POINTS, pointData.pointOffset(), pointData.pointCount());
-	glBindVertexArray(0);
 }
 
-void ImpostorGrainRenderer::setCommonUniforms(const ShaderProgram& shader, const Camera& camera) const
+void ImpostorGrainRenderer::computeViewSelection(const IPointCloudData& pointData, const Camera& camera) const
+{
+	// Indexed by element id, so that the vertex shader does not need to know about the offset
+	size_t elementCount = static_cast<size_t>(pointData.pointOffset()) + static_cast<size_t>(pointData.pointCount());
+	if (!m_viewSelection || m_viewSelectionCapacity < elementCount) {
+		m_viewSelectionCapacity = std::max(elementCount, static_cast<size_t>(1));
+		m_viewSelection = std::make_unique<GlBuffer>(GL_SHADER_STORAGE_BUFFER);
+		m_viewSelection->addBlock<ImpostorViewSelection>(m_viewSelectionCapacity);
+		m_viewSelection->alloc();
+		m_viewSelection->finalize();
+	}
+	if (pointData.pointCount() == 0) return;
+
+	const ShaderProgram& shader = *getViewSelectionShader(viewSelectionFlags(properties()));
+	if (!shader.isValid()) return;
+
+	setCommonUniforms(shader, camera);
+	shader.setUniform("uElementOffset", static_cast<GLuint>(pointData.pointOffset()));
+	shader.setUniform("uElementCount", static_cast<GLuint>(pointData.pointCount()));
+
+	bindPointBuffers(pointData, shader);
+	m_viewSelection->bindSsbo(5);
+
+	shader.use();
+	GLuint groups = (static_cast<GLuint>(pointData.pointCount()) + ViewSelectionLocalSize - 1) / ViewSelectionLocalSize;
+	glDispatchCompute(groups, 1, 1);
+	GlobalTimer::CountDrawCall(pointData.pointCount());
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+}
+
+GLint ImpostorGrainRenderer::setCommonUniforms(const ShaderProgram& shader, const Camera& camera) const
 {
 	const Properties& props = properties();
 
@@ -216,6 +363,7 @@ void ImpostorGrainRenderer::setCommonUniforms(const ShaderProgram& shader, const
 	shader.setUniform("uPointCount", static_cast<GLuint>(pointData->pointCount()));
 	shader.setUniform("uFrameCount", static_cast<GLuint>(pointData->frameCount()));
 	shader.setUniform("uTime", static_cast<GLfloat>(m_time));
+	bindGrainOrientations(shader, *pointData);
 
 	GLint o = 0;
 
@@ -226,7 +374,7 @@ void ImpostorGrainRenderer::setCommonUniforms(const ShaderProgram& shader, const
 
 	if (auto grain = m_grain.lock()) {
 		for (size_t k = 0; k < grain->atlases().size(); ++k) {
-			o = grain->atlases()[k].setUniforms(shader, MAKE_STR("uImpostor[" << k << "]."), o);
+			o = grain->atlases()[k].setUniforms(shader, UniformName("uImpostor")[static_cast<int>(k)], o);
 		}
 	}
 
@@ -244,6 +392,33 @@ void ImpostorGrainRenderer::setCommonUniforms(const ShaderProgram& shader, const
 			shader.setUniform("uUseOcclusionMap", true);
 		}
 	}
+
+	return o;
+}
+
+bool ImpostorGrainRenderer::gatherFragmentCounters() const
+{
+	if (!m_fragmentQueriesPending) return true;
+
+	// Never stall, the previous counters are kept until results are ready
+	GLuint available = GL_FALSE;
+	glGetQueryObjectuiv(m_fragmentQueries[0], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (available && m_fragmentQueriesHaveResolve) {
+		glGetQueryObjectuiv(m_fragmentQueries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+	}
+	if (!available) return false;
+	m_fragmentQueriesPending = false;
+
+	FragmentCounters& counters = m_fragmentCounters;
+	glGetQueryObjectui64v(m_fragmentQueries[0], GL_QUERY_RESULT, &counters.grainFragments);
+	counters.resolvedPixels = 0;
+	if (m_fragmentQueriesHaveResolve) {
+		glGetQueryObjectui64v(m_fragmentQueries[1], GL_QUERY_RESULT, &counters.resolvedPixels);
+	}
+	counters.bytesWritten =
+		counters.grainFragments * m_pendingBytesPerFragment
+		+ counters.resolvedPixels * m_pendingBytesPerResolvedPixel;
+	return true;
 }
 
 void ImpostorGrainRenderer::precomputeViewMatrices()
@@ -282,24 +457,92 @@ glm::mat4 ImpostorGrainRenderer::modelMatrix() const
 
 std::shared_ptr<ShaderProgram> ImpostorGrainRenderer::getShader(ShaderVariantFlagSet flags) const
 {
-	constexpr int nFlags = static_cast<int>(magic_enum::enum_count<ShaderVariantFlag>());
+	// (not using magic_enum::enum_count because flag values exceed its default range)
+	const int nFlags = static_cast<int>(s_shaderVariantDefines.size());
 	if (m_shaders.empty()) {
 		m_shaders.resize(1 << nFlags);
 	}
 
 	if (!m_shaders[flags]) {
-		// Lazy loading of shader variants
-		std::string variantName = m_shaderName + "_ShaderVariantFlags_" + bitname(flags, nFlags);
-		std::vector<std::string> defines;
-		for (int f = 0; f < nFlags; ++f) {
-			if ((flags & (1 << f)) != 0) {
-				defines.push_back(s_shaderVariantDefines[f]);
-			}
-		}
-		DEBUG_LOG << "loading variant " << variantName;
-		ShaderPool::AddShaderVariant(variantName, m_shaderName, defines);
-		m_shaders[flags] = ShaderPool::GetShader(variantName);
+		// Lazy loading of shader variants (usually already warmed up)
+		m_shaders[flags] = ShaderPool::GetShaderVariant(variantName(m_shaderName, flags), m_shaderName, variantDefines(flags));
 	}
 	return m_shaders[flags];
 }
 
+std::shared_ptr<ShaderProgram> ImpostorGrainRenderer::getViewSelectionShader(ShaderVariantFlagSet flags) const
+{
+	const int nFlags = static_cast<int>(s_shaderVariantDefines.size());
+	if (m_viewSelectionShaders.empty()) {
+		m_viewSelectionShaders.resize(1 << nFlags);
+	}
+
+	if (!m_viewSelectionShaders[flags]) {
+		m_viewSelectionShaders[flags] = ShaderPool::GetShaderVariant(variantName(m_viewSelectionShaderName, flags), m_viewSelectionShaderName, variantDefines(flags));
+	}
+	return m_viewSelectionShaders[flags];
+}
+
+ImpostorGrainRenderer::ShaderVariantFlagSet ImpostorGrainRenderer::mainPassFlags(const Properties& props, RenderType target)
+{
+	bool visibility = props.visibilityBuffer && target != RenderType::ShadowMap;
+	ShaderVariantFlagSet flags = 0;
+	if (target == RenderType::ShadowMap) flags |= ShaderPassShadow;
+	if (visibility) flags |= ShaderPassVisibility;
+	if (props.noDiscard && !visibility) flags |= ShaderOptionNoDiscard;
+	if (props.precomputeViewMatrices) flags |= ShaderOptionPrecomputeViewMatrices;
+	if (props.precomputeInVertex) flags |= ShaderOptionPrecomputeInVertex;
+	if (props.interpolationMode == InterpolationMode::None) flags |= ShaderOptionNoInterpolation;
+	if (props.expansionMode != ExpansionMode::GeometryShader) flags |= ShaderOptionVertexPulling;
+	if (props.expansionMode == ExpansionMode::VertexPullingQuads) {
+		flags |= ShaderOptionVertexPullingQuads;
+		if (props.precomputeInVertex) flags |= ShaderOptionPrecomputedViewSelection;
+	}
+	return flags;
+}
+
+ImpostorGrainRenderer::ShaderVariantFlagSet ImpostorGrainRenderer::blitPassFlags(const Properties& props, RenderType target)
+{
+	// Must match the choice of extra framebuffer in render()
+	bool visibility = props.visibilityBuffer && target != RenderType::ShadowMap;
+	bool noDiscard = props.noDiscard && !visibility;
+	if (!visibility && !(noDiscard && target != RenderType::ShadowMap)) return 0;
+
+	// (the resolve reloads grains per pixel so it cannot use PRECOMPUTE_IN_VERTEX)
+	ShaderVariantFlagSet flags = visibility ? ShaderPassResolveVisibility : ShaderPassBlitToMainFbo;
+	if (target == RenderType::ShadowMap) flags |= ShaderPassShadow;
+	if (noDiscard) flags |= ShaderOptionNoDiscard;
+	if (props.precomputeViewMatrices) flags |= ShaderOptionPrecomputeViewMatrices;
+	if (props.precomputeInVertex && !visibility) flags |= ShaderOptionPrecomputeInVertex;
+	if (props.interpolationMode == InterpolationMode::None) flags |= ShaderOptionNoInterpolation;
+	return flags;
+}
+
+ImpostorGrainRenderer::ShaderVariantFlagSet ImpostorGrainRenderer::viewSelectionFlags(const Properties& props)
+{
+	ShaderVariantFlagSet flags = 0;
+	if (props.precomputeViewMatrices) flags |= ShaderOptionPrecomputeViewMatrices;
+	if (props.interpolationMode == InterpolationMode::None) flags |= ShaderOptionNoInterpolation;
+	return flags;
+}
+
+std::vector<std::string> ImpostorGrainRenderer::variantDefines(ShaderVariantFlagSet flags)
+{
+	const int nFlags = static_cast<int>(s_shaderVariantDefines.size());
+	std::vector<std::string> defines;
+	for (int f = 0; f < nFlags; ++f) {
+		if ((flags & (1 << f)) != 0) {
+			defines.push_back(s_shaderVariantDefines[f]);
+		}
+	}
+	if ((flags & ShaderOptionVertexPulling) != 0) {
+		defines.push_back("NO_GEOMETRY_SHADER");
+	}
+	return defines;
+}
+
+std::string ImpostorGrainRenderer::variantName(const std::string& baseName, ShaderVariantFlagSet flags)
+{
+	return baseName + "_ShaderVariantFlags_" + bitname(flags, static_cast<int>(s_shaderVariantDefines.size()));
+}
+
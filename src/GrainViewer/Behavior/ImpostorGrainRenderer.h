@@ -54,6 +54,8 @@ public:
 	void start() override;
 	void update(float time, int frame) override;
 	void render(const Camera& camera, const World& world, RenderType target) const override;
+	void onDestroy() override;
+	void warmUpShaders() override;
 
 public:
 	// Properties (serialized and displayed in UI)
@@ -72,6 +74,12 @@ public:
 		Sphere,
 		Mixed
 	};
+	// How points are turned into fragments
+	enum class ExpansionMode {
+		GeometryShader, // original path, the geometry shader emits one point sprite
+		VertexPullingPoints, // no geometry shader, one point sprite per vertex
+		VertexPullingQuads, // no geometry shader, 6 vertices per grain (no point size limit)
+	};
 	struct Properties {
 		float grainScale = 1.0f;
 		DebugShape debugShape = DebugShape::None;
@@ -83,10 +91,26 @@ public:
 		bool prerenderSurface = true;
 		bool firstPassOnly = false; // when using prerenderSurface, only draw the surface
 		float hitSphereCorrectionFactor = 0.65f;
+		ExpansionMode expansionMode = ExpansionMode::GeometryShader;
+		bool visibilityBuffer = false; // write only grain ids, then shade visible pixels in a full screen resolve (ignores noDiscard)
+		bool countFragments = false; // overdraw and bandwidth counters, see fragmentCounters()
 	};
 	Properties & properties() { return m_properties; }
 	const Properties& properties() const { return m_properties; }
 
+	/**
+	 * Read back from occlusion queries without stalling, when countFragments
+	 * is on, so they lag at least one frame behind.
+	 * Bytes are a rough estimate of color and depth writes (blending and
+	 * texture reads are not accounted for).
+	 */
+	struct FragmentCounters {
+		GLuint64 grainFragments = 0; // fragments that passed depth test in the grain pass(es)
+		GLuint64 resolvedPixels = 0; // pixels written by the blit or resolve pass, 0 if none
+		GLuint64 bytesWritten = 0;
+	};
+	const FragmentCounters& fragmentCounters() const { return m_fragmentCounters; }
+
 private:
 	// When adding flag, don't forget to add the corresponding define in the
 	// definition of s_shaderVariantDefines in cpp file.
@@ -98,22 +122,43 @@ private:
 		ShaderOptionNoInterpolation = 1 << 3,
 		ShaderOptionPrecomputeViewMatrices = 1 << 4,
 		ShaderOptionPrecomputeInVertex = 1 << 5,
+		ShaderOptionVertexPulling = 1 << 6,
+		ShaderOptionVertexPullingQuads = 1 << 7,
+		ShaderOptionPrecomputedViewSelection = 1 << 8,
+		ShaderPassVisibility = 1 << 9,
+		ShaderPassResolveVisibility = 1 << 10,
 	};
 	typedef int ShaderVariantFlagSet;
 	static const std::vector<std::string> s_shaderVariantDefines;
 
 private:
 	void draw(const IPointCloudData& pointData, const ShaderProgram& shader) const;
-	void setCommonUniforms(const ShaderProgram& shader, const Camera& camera) const;
+	void bindPointBuffers(const IPointCloudData& pointData, const ShaderProgram& shader) const;
+	// Pre-pass of VertexPullingQuads expansion, fills m_viewSelection
+	void computeViewSelection(const IPointCloudData& pointData, const Camera& camera) const;
+	// Return the next free texture unit
+	GLint setCommonUniforms(const ShaderProgram& shader, const Camera& camera) const;
+	// Return false if the previous queries are still in flight
+	bool gatherFragmentCounters() const;
 	void precomputeViewMatrices();
 	glm::mat4 modelMatrix() const;
 	std::shared_ptr<ShaderProgram> getShader(ShaderVariantFlagSet flags) const;
+	std::shared_ptr<ShaderProgram> getViewSelectionShader(ShaderVariantFlagSet flags) const;
+
+	// Variant flags of each pass, shared by render() and warmUpShaders()
+	static ShaderVariantFlagSet mainPassFlags(const Properties& props, RenderType target);
+	static ShaderVariantFlagSet blitPassFlags(const Properties& props, RenderType target); // 0 if there is no blit/resolve pass
+	static ShaderVariantFlagSet viewSelectionFlags(const Properties& props);
+	static std::vector<std::string> variantDefines(ShaderVariantFlagSet flags);
+	static std::string variantName(const std::string& baseName, ShaderVariantFlagSet flags);
 
 private:
 	Properties m_properties;
 
 	std::string m_shaderName = "ImpostorGrain";
 	mutable std::vector<std::shared_ptr<ShaderProgram>> m_shaders;
+	std::string m_viewSelectionShaderName = "ImpostorGrainViewSelection";
+	mutable std::vector<std::shared_ptr<ShaderProgram>> m_viewSelectionShaders;
 
 	std::weak_ptr<TransformBehavior> m_transform;
 	std::weak_ptr<GrainBehavior> m_grain;
@@ -122,6 +167,16 @@ private:
 
 	std::unique_ptr<GlTexture> m_colormapTexture;
 	std::unique_ptr<GlBuffer> m_precomputedViewMatrices;
+	mutable std::unique_ptr<GlBuffer> m_viewSelection; // per element, reallocated when growing
+	mutable size_t m_viewSelectionCapacity = 0;
+
+	// GL_SAMPLES_PASSED queries for grain and blit/resolve passes
+	mutable GLuint m_fragmentQueries[2] = { 0, 0 };
+	mutable bool m_fragmentQueriesPending = false;
+	mutable bool m_fragmentQueriesHaveResolve = false;
+	mutable GLuint64 m_pendingBytesPerFragment = 0;
+	mutable GLuint64 m_pendingBytesPerResolvedPixel = 0;
+	mutable FragmentCounters m_fragmentCounters;
 
 	float m_time;
 };
@@ -137,6 +192,9 @@ REFL_FIELD(precomputeInVertex)
 REFL_FIELD(prerenderSurface)
 REFL_FIELD(firstPassOnly)
 REFL_FIELD(hitSphereCorrectionFactor)
+REFL_FIELD(expansionMode)
+REFL_FIELD(visibilityBuffer)
+REFL_FIELD(countFragments)
 REFL_END
 
 registerBehaviorType(ImpostorGrainRenderer)
@@ -93,6 +93,7 @@ void InstanceGrainRenderer::render(const Camera& camera, const World& world, Ren
 	shader.setUniform("uPointCount", static_cast<GLuint>(pointData->pointCount()));
 	shader.setUniform("uFrameCount", static_cast<GLuint>(pointData->frameCount()));
 	shader.setUniform("uTime", static_cast<GLfloat>(m_time));
+	bindGrainOrientations(shader, *pointData);
 
 	GLint o = 0;
 	if (m_colormapTexture) {
@@ -103,7 +104,7 @@ void InstanceGrainRenderer::render(const Camera& camera, const World& world, Ren
 	int n = static_cast<int>(std::max(mesh->materials().size(), m_materials.size()));
 	for (int i = 0; i < n; ++i) {
 		const StandardMaterial& mat = i < m_materials.size() ? m_materials[i] : mesh->materials()[i];
-		o = mat.setUniforms(*m_shader, MAKE_STR("uMaterial[" << i << "]."), o);
+		o = mat.setUniforms(*m_shader, UniformName("uMaterial")[i], o);
 	}
 
 	shader.use();
@@ -117,7 +118,12 @@ void InstanceGrainRenderer::render(const Camera& camera, const World& world, Ren
 	else {
 		shader.setUniform("uUsePointElements", false);
 	}
-	glDrawArraysInstancedBaseInstance(GL_TRIANGLES, 0, mesh->pointCount(), pointData->pointCount(), pointData->pointOffset());
+	if (mesh->isIndexed()) {
+		glDrawElementsInstancedBaseInstance(GL_TRIANGLES, mesh->indexCount(), GL_UNSIGNED_INT, nullptr, pointData->pointCount(), pointData->pointOffset());
+	} else {
+		glDrawArraysInstancedBaseInstance(GL_TRIANGLES, 0, mesh->pointCount(), pointData->pointCount(), pointData->pointOffset());
+	}
+	GlobalTimer::CountDrawCall(pointData->pointCount());
 
 	glBindVertexArray(0);
 }
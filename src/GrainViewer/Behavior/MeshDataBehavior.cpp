@@ -33,10 +33,12 @@
 #include "ResourceManager.h"
 #include "utils/fileutils.h"
 #include "utils/jsonutils.h"
+#include "utils/meshutils.h"
 #include "Logger.h"
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
 #include <filesystem>
 namespace fs = std::filesystem;
 
@@ -68,6 +70,9 @@ bool MeshDataBehavior::deserialize(const rapidjson::Value & json)
 
 	jrOption(json, "computeBoundingSphere", m_computeBoundingSphere, m_computeBoundingSphere);
 	jrOption(json, "offset", m_offset, m_offset);
+	jrOption(json, "indexed", m_indexed, m_indexed);
+	jrOption(json, "optimize", m_optimize, m_optimize);
+	jrOption(json, "compressAttributes", m_compressAttributes, m_compressAttributes);
 
 	return true;
 }
@@ -78,34 +83,24 @@ void MeshDataBehavior::start()
 
 	m_mesh = std::make_unique<Mesh>(m_filename);
 	m_vertexBuffer = std::make_unique<GlBuffer>(GL_ARRAY_BUFFER);
+	glCreateVertexArrays(1, &m_vao);
 
 	// 2. Move data from Mesh object to GlBuffer (in VRAM)
 
-	m_pointCount = 0;
-	for (auto s : m_mesh->shapes()) {
-		m_pointCount += static_cast<GLsizei>(s.mesh.indices.size());
+	if (m_indexed) {
+		buildIndexedBuffers();
+	} else {
+		buildUnindexedBuffers();
 	}
 
-	// Build VBO
-	m_vertexBuffer->addBlock<PointAttributes>(m_pointCount);
-	m_vertexBuffer->addBlockAttribute(0, 3);  // position
-	m_vertexBuffer->addBlockAttribute(0, 3);  // normal
-	m_vertexBuffer->addBlockAttribute(0, 2);  // uv
-	m_vertexBuffer->addBlockAttribute(0, 1);  // materialId
-	m_vertexBuffer->addBlockAttribute(0, 3);  // tangent
-	m_vertexBuffer->alloc();
-
-	BufferFiller filler(*m_mesh);
-	filler.setGlobalOffset(m_offset);
-	m_vertexBuffer->fillBlock<PointAttributes>(0, [filler](PointAttributes* attr, size_t count) { filler.fill(attr, count); });
-	//m_vertexBuffer->fillBlock(0, filler.fill);
-
 	// Build VAO
-	glCreateVertexArrays(1, &m_vao);
 	glBindVertexArray(m_vao);
 	m_vertexBuffer->bind();
 	m_vertexBuffer->enableAttributes(m_vao);
 	glBindVertexArray(0);
+	if (m_elementBuffer) {
+		glVertexArrayElementBuffer(m_vao, m_elementBuffer->name());
+	}
 
 	m_vertexBuffer->finalize();
 
@@ -130,6 +125,94 @@ void MeshDataBehavior::onDestroy()
 	glDeleteVertexArrays(1, &m_vao);
 }
 
+///////////////////////////////////////////////////////////////////////////////
+// Private methods
+///////////////////////////////////////////////////////////////////////////////
+
+void MeshDataBehavior::buildUnindexedBuffers()
+{
+	m_pointCount = 0;
+	for (auto s : m_mesh->shapes()) {
+		m_pointCount += static_cast<GLsizei>(s.mesh.indices.size());
+	}
+	m_vertexInvocations = static_cast<size_t>(m_pointCount);
+
+	m_vertexBuffer->addBlock<PointAttributes>(m_pointCount);
+	m_vertexBuffer->addBlockAttribute(0, 3);  // position
+	m_vertexBuffer->addBlockAttribute(0, 3);  // normal
+	m_vertexBuffer->addBlockAttribute(0, 2);  // uv
+	m_vertexBuffer->addBlockAttributeUint(0, 1);  // materialId
+	m_vertexBuffer->addBlockAttribute(0, 3);  // tangent
+	m_vertexBuffer->alloc();
+
+	BufferFiller filler(*m_mesh);
+	filler.setGlobalOffset(m_offset);
+	m_vertexBuffer->fillBlock<PointAttributes>(0, [filler](PointAttributes* attr, size_t count) { filler.fill(attr, count); });
+	//m_vertexBuffer->fillBlock(0, filler.fill);
+}
+
+void MeshDataBehavior::buildIndexedBuffers()
+{
+	// 1. Build triangle soup as in the unindexed case, then weld it
+	size_t soupSize = 0;
+	for (auto s : m_mesh->shapes()) {
+		soupSize += s.mesh.indices.size();
+	}
+	std::vector<PointAttributes> soup(soupSize);
+	BufferFiller filler(*m_mesh);
+	filler.setGlobalOffset(m_offset);
+	filler.fill(soup.data(), soup.size());
+
+	std::vector<PointAttributes> vertices;
+	std::vector<GLuint> indices;
+	deduplicateVertices(soup, vertices, indices);
+	soup.clear();
+	soup.shrink_to_fit();
+
+	size_t invocationsBefore = simulateVertexInvocations(indices, vertices.size());
+
+	// 2. Reorder for post-transform cache and overdraw
+	if (m_optimize) {
+		optimizeVertexCache(indices, vertices.size());
+		optimizeOverdraw(indices, vertices);
+		optimizeVertexFetch(indices, vertices);
+	}
+
+	m_pointCount = static_cast<GLsizei>(vertices.size());
+	m_indexCount = static_cast<GLsizei>(indices.size());
+	m_vertexInvocations = simulateVertexInvocations(indices, vertices.size());
+
+	float triangleCount = static_cast<float>(std::max<size_t>(1, indices.size() / 3));
+	LOG << "Mesh " << m_filename << ": "
+		<< soupSize << " -> " << vertices.size() << " vertices, "
+		<< "vertex invocations per instance: " << soupSize << " -> " << m_vertexInvocations
+		<< " (" << (100 - 100 * m_vertexInvocations / std::max<size_t>(1, soupSize)) << "% less, "
+		<< "ACMR " << (invocationsBefore / triangleCount) << " -> " << (m_vertexInvocations / triangleCount) << ")";
+
+	// 3. Upload
+	if (m_compressAttributes) {
+		std::vector<CompressedPointAttributes> compressed;
+		compressPointAttributes(vertices, compressed);
+		m_vertexBuffer->importBlock(compressed);
+		m_vertexBuffer->addBlockAttribute(0, 3);  // position
+		m_vertexBuffer->addBlockAttribute(0, 4, GL_SHORT, GL_TRUE);  // normal
+		m_vertexBuffer->addBlockAttribute(0, 2, GL_HALF_FLOAT, GL_FALSE);  // uv
+		m_vertexBuffer->addBlockAttributeUint(0, 1);  // materialId
+		m_vertexBuffer->addBlockAttribute(0, 4, GL_SHORT, GL_TRUE);  // tangent
+	} else {
+		m_vertexBuffer->importBlock(vertices);
+		m_vertexBuffer->addBlockAttribute(0, 3);  // position
+		m_vertexBuffer->addBlockAttribute(0, 3);  // normal
+		m_vertexBuffer->addBlockAttribute(0, 2);  // uv
+		m_vertexBuffer->addBlockAttributeUint(0, 1);  // materialId
+		m_vertexBuffer->addBlockAttribute(0, 3);  // tangent
+	}
+
+	m_elementBuffer = std::make_unique<GlBuffer>(GL_ELEMENT_ARRAY_BUFFER);
+	m_elementBuffer->importBlock(indices);
+	m_elementBuffer->finalize();
+}
+
 void MeshDataBehavior::computeBoundingSphere()
 {
 	// This is an approximation, but reasonable enough.
@@ -41,13 +41,20 @@
 #include <memory>
 
 /**
- * Load mesh from OBJ file to video memory
+ * Load mesh from OBJ file to video memory.
+ * By default the mesh is indexed, with vertices deduplicated and reordered
+ * for the post-transform cache. Use indexCount() and draw with elements when
+ * isIndexed() is true, otherwise draw pointCount() vertices with arrays.
  */
 class MeshDataBehavior : public Behavior {
 public:
 	// Accessors
 	GLsizei pointCount() const;
 	GLuint vao() const;
+	bool isIndexed() const { return m_indexed; }
+	GLsizei indexCount() const { return m_indexCount; }
+	// Estimated number of vertex shader invocations for one draw (or instance)
+	size_t vertexInvocations() const { return m_vertexInvocations; }
 	const std::vector<StandardMaterial>& materials() const { return m_materials; }
 
 	// Available only if m_computeBoundingSphere was true upon start
@@ -69,6 +76,10 @@ private:
 	// this take into account a potential TransformBehavior attached to the object
 	void computeBoundingSphere();
 
+	// Fill m_vertexBuffer (and m_elementBuffer if indexed) from m_mesh
+	void buildUnindexedBuffers();
+	void buildIndexedBuffers();
+
 private:
 	std::string m_filename = "";
 	std::unique_ptr<Mesh> m_mesh;
@@ -78,8 +89,15 @@ private:
 	float m_boundingSphereRadius;
 	glm::vec3 m_offset = glm::vec3(0);
 
+	bool m_indexed = true;
+	bool m_optimize = true; // vertex cache and overdraw, when indexed
+	bool m_compressAttributes = false;
+
 	GLsizei m_pointCount;
+	GLsizei m_indexCount = 0;
+	size_t m_vertexInvocations = 0;
 	std::unique_ptr<GlBuffer> m_vertexBuffer;
+	std::unique_ptr<GlBuffer> m_elementBuffer;
 	GLuint m_vao;
 	std::vector<StandardMaterial> m_materials;
 };
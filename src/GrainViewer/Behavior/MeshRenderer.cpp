@@ -34,6 +34,7 @@
 #include "ShaderPool.h"
 #include "TransformBehavior.h"
 #include "GlTexture.h"
+#include "GlobalTimer.h"
 
 #include "utils/jsonutils.h"
 #include "utils/strutils.h"
@@ -61,6 +62,8 @@ void MeshRenderer::start()
 
 void MeshRenderer::render(const Camera& camera, const World& world, RenderType target) const
 {
+	ScopedTimer timer((target == RenderType::ShadowMap ? "MeshRenderer_shadowmap" : "MeshRenderer"));
+
 	if (!m_shader->isValid()) return;
 
 	if (auto mesh = m_meshData.lock()) {
@@ -75,13 +78,18 @@ void MeshRenderer::render(const Camera& camera, const World& world, RenderType t
 		int n = static_cast<int>(std::max(mesh->materials().size(), m_materials.size()));
 		for (int i = 0 ; i < n ; ++i) {
 			const StandardMaterial& mat = i < m_materials.size() ? m_materials[i] : mesh->materials()[i];
-			o = mat.setUniforms(*m_shader, MAKE_STR("uMaterial[" << i << "]."), o);
+			o = mat.setUniforms(*m_shader, UniformName("uMaterial")[i], o);
 		}
 
 		autoSetUniforms(*m_shader, properties());
 
 		glBindVertexArray(mesh->vao());
-		glDrawArrays(GL_TRIANGLES, 0, mesh->pointCount());
+		if (mesh->isIndexed()) {
+			glDrawElements(GL_TRIANGLES, mesh->indexCount(), GL_UNSIGNED_INT, nullptr);
+		} else {
+			glDrawArrays(GL_TRIANGLES, 0, mesh->pointCount());
+		}
+		GlobalTimer::CountDrawCall();
 		glBindVertexArray(0);
 	}
 }
@@ -32,8 +32,11 @@
 #include "ResourceManager.h"
 
 #include "utils/strutils.h"
+#include "utils/jsonutils.h"
 #include "Logger.h"
 
+#include <glm/gtc/packing.hpp>
+
 //-----------------------------------------------------------------------------
 // Accessors
 
@@ -62,6 +65,11 @@ const GlBuffer & PointCloudDataBehavior::vbo() const
 	return *m_pointBuffer;
 }
 
+const GlBuffer* PointCloudDataBehavior::orientations() const
+{
+	return m_orientationBuffer.get();
+}
+
 //-----------------------------------------------------------------------------
 // Behavior Implementation
 
@@ -100,6 +108,10 @@ bool PointCloudDataBehavior::deserialize(const rapidjson::Value & json)
 
 	m_filename = ResourceManager::resolveResourcePath(m_filename);
 
+	if (jrOption(json, "orientations", m_orientationFilename, m_orientationFilename)) {
+		m_orientationFilename = ResourceManager::resolveResourcePath(m_orientationFilename);
+	}
+
 	return true;
 }
 
@@ -116,16 +128,26 @@ void PointCloudDataBehavior::start()
 	if (m_useBbox) {
 		PointCloud fullPointCloud;
 		fullPointCloud.load(m_filename);
+		if (!m_orientationFilename.empty()) {
+			fullPointCloud.loadOrientationsBin(m_orientationFilename);
+		}
 
 		if (fullPointCloud.frameCount() > 1) {
 			WARN_LOG << "Using bbox with animated point cloud has undefined behavior";
 		}
 
 		pointCloud.data().resize(128);
+		if (fullPointCloud.hasOrientations()) {
+			pointCloud.orientations().resize(128);
+		}
 		int k = 0;
-		for (const auto & p : fullPointCloud.data()) {
+		for (size_t i = 0; i < fullPointCloud.data().size(); ++i) {
+			const auto & p = fullPointCloud.data()[i];
 			if (k >= pointCloud.data().size()) {
 				pointCloud.data().resize(2 * pointCloud.data().size());
+				if (fullPointCloud.hasOrientations()) {
+					pointCloud.orientations().resize(pointCloud.data().size());
+				}
 			}
 
 			if (p.x >= m_bboxMin.x && p.x <= m_bboxMax.x
@@ -133,12 +155,18 @@ void PointCloudDataBehavior::start()
 				&& p.z >= m_bboxMin.z && p.z <= m_bboxMax.z)
 			{
 				pointCloud.data()[k] = p;
+				if (fullPointCloud.hasOrientations()) {
+					pointCloud.orientations()[k] = fullPointCloud.orientations()[i];
+				}
 				++k;
 			}
 		}
 	}
 	else {
 		pointCloud.load(m_filename);
+		if (!m_orientationFilename.empty()) {
+			pointCloud.loadOrientationsBin(m_orientationFilename);
+		}
 	}
 	m_frameCount = static_cast<GLsizei>(pointCloud.frameCount());
 	m_pointCount = static_cast<GLsizei>(pointCloud.data().size());
@@ -162,6 +190,22 @@ void PointCloudDataBehavior::start()
 	glBindVertexArray(0);
 
 	m_pointBuffer->finalize(); // This buffer will never be mapped on CPU
+
+	// 4. Orientations, packed as snorm16x4 quaternions (8 bytes per point and frame)
+	if (pointCloud.hasOrientations()) {
+		m_orientationBuffer = std::make_unique<GlBuffer>(GL_SHADER_STORAGE_BUFFER);
+		m_orientationBuffer->addBlock<glm::uvec2>(m_pointCount);
+		m_orientationBuffer->alloc();
+		m_orientationBuffer->fillBlock<glm::uvec2>(0, [&pointCloud](glm::uvec2 *data, size_t _) {
+			glm::uvec2 *v = data;
+			for (const auto & q : pointCloud.orientations()) {
+				glm::uint64 packed = glm::packSnorm4x16(glm::normalize(q));
+				v->x = static_cast<glm::uint>(packed);
+				v->y = static_cast<glm::uint>(packed >> 32); v++;
+			}
+		});
+		m_orientationBuffer->finalize();
+	}
 }
 
 void PointCloudDataBehavior::onDestroy()
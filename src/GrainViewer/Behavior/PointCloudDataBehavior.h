@@ -51,6 +51,7 @@ public:
 	GLsizei frameCount() const override;
 	GLuint vao() const override;
 	const GlBuffer & vbo() const override;
+	const GlBuffer* orientations() const override;
 
 	const GlBuffer& data() const;
 
@@ -62,6 +63,7 @@ public:
 
 private:
 	std::string m_filename = "";
+	std::string m_orientationFilename = ""; // optional
 	bool m_useBbox = false; // if true, remove all points out of the supplied bbox
 	glm::vec3 m_bboxMin;
 	glm::vec3 m_bboxMax;
@@ -69,6 +71,7 @@ private:
 	GLsizei m_pointCount;
 	GLsizei m_frameCount;
 	std::unique_ptr<GlBuffer> m_pointBuffer;
+	std::unique_ptr<GlBuffer> m_orientationBuffer;
 	GLuint m_vao;
 };
 
@@ -42,11 +42,17 @@
 
 #include <magic_enum.hpp>
 
+#include <algorithm>
 #include <filesystem>
 namespace fs = std::filesystem;
 
 //-----------------------------------------------------------------------------
 
+PointCloudSplitter::~PointCloudSplitter()
+{
+	StatsSink::CloseTable(m_statsTable);
+}
+
 bool PointCloudSplitter::deserialize(const rapidjson::Value& json)
 {
 	jrOption(json, "shader", m_shaderName, m_shaderName);
@@ -130,6 +136,7 @@ void PointCloudSplitter::onPreRender(const Camera& camera, const World& world, R
 			glBindVertexArray(pointData->vao());
 			pointData->vbo().bindSsbo(1);
 			glDrawArrays(GL_POINTS, 0, m_elementCount);
+			GlobalTimer::CountDrawCall(m_elementCount);
 			glBindVertexArray(0);
 
 			glTextureBarrier();
@@ -158,6 +165,7 @@ void PointCloudSplitter::onPreRender(const Camera& camera, const World& world, R
 			glBindVertexArray(pointData->vao());
 			pointData->vbo().bindSsbo(1);
 			glDrawArrays(GL_POINTS, 0, m_elementCount);
+			GlobalTimer::CountDrawCall(m_elementCount);
 			glBindVertexArray(0);
 
 			glTextureBarrier();
@@ -193,13 +201,14 @@ void PointCloudSplitter::onPreRender(const Camera& camera, const World& world, R
 		constexpr int STEP_OFFSET = static_cast<int>(StepShaderVariant::STEP_OFFSET);
 		for (int i = static_cast<int>(firstStep); i <= static_cast<int>(lastStep); ++i) {
 			const ShaderProgram& shader = *getShader(props.renderTypeCaching, i);
-			setCommonUniforms(shader, camera);
+			setCommonUniforms(shader, camera, target);
 			if (props.enableOcclusionCulling) {
 				glBindTextureUnit(0, occlusionCullingFbo->colorTexture(0));
 				shader.setUniform("uOcclusionMap", 0);
 			}
 			shader.use();
 			glDispatchCompute(i == STEP_RESET || i == STEP_OFFSET ? 1 : static_cast<GLuint>(m_xWorkGroups), 1, 1);
+			GlobalTimer::CountDrawCall();
 			glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
 		}
 
@@ -251,6 +260,13 @@ GLint PointCloudSplitter::pointOffset(RenderModel model) const
 	return static_cast<GLint>(m_counters[static_cast<int>(model)].offset);
 }
 
+const GlBuffer* PointCloudSplitter::orientations(RenderModel model) const
+{
+	auto pointData = m_pointData.lock();
+	assert(pointData);
+	return pointData->orientations();
+}
+
 //-----------------------------------------------------------------------------
 
 glm::mat4 PointCloudSplitter::modelMatrix() const {
@@ -262,7 +278,7 @@ glm::mat4 PointCloudSplitter::modelMatrix() const {
 	}
 }
 
-void PointCloudSplitter::setCommonUniforms(const ShaderProgram& shader, const Camera& camera) const
+void PointCloudSplitter::setCommonUniforms(const ShaderProgram& shader, const Camera& camera, RenderType target) const
 {
 	glm::mat4 viewModelMatrix = camera.viewMatrix() * modelMatrix();
 	shader.bindUniformBlock("Camera", camera.ubo());
@@ -280,6 +296,21 @@ void PointCloudSplitter::setCommonUniforms(const ShaderProgram& shader, const Ca
 	shader.setUniform("uRenderModelCount", static_cast<GLuint>(magic_enum::enum_count<RenderModel>()));
 	shader.setUniform("uFrameCount", static_cast<GLuint>(m_pointData.lock()->frameCount()));
 	shader.setUniform("uTime", m_time);
+
+	if (target == RenderType::ShadowMap) {
+		// Override main view LoD limits
+		const auto& props = properties();
+		float instanceLimit = 0.0f;
+		float impostorLimit = 0.0f;
+		if (props.shadowCasterModel == ShadowCasterModel::Default) {
+			glm::vec2 res = camera.resolution();
+			float scale = std::max(res.x, res.y) / std::max(props.shadowReferenceResolution, 1.0f);
+			instanceLimit = props.shadowInstanceLimit * scale;
+			impostorLimit = props.shadowImpostorLimit * scale;
+		}
+		shader.setUniform("uInstanceLimit", instanceLimit);
+		shader.setUniform("uImpostorLimit", impostorLimit);
+	}
 }
 
 std::shared_ptr<ShaderProgram> PointCloudSplitter::getShader(RenderTypeCaching renderType, int step) const
@@ -300,41 +331,58 @@ std::shared_ptr<ShaderProgram> PointCloudSplitter::getShader(RenderTypeShaderVar
 	int index = i1 + n1 * i2;
 
 	if (!m_shaders[index]) {
-		// Lazy loading of shader variants
-		std::string variantName = m_shaderName + "_RenderType" + std::to_string(i1) + "_Step" + std::to_string(i2);
+		// Lazy loading of shader variants (usually already warmed up)
+		m_shaders[index] = ShaderPool::GetShaderVariant(variantName(renderType, step), m_shaderName, variantDefines(renderType, step));
+	}
+	return m_shaders[index];
+}
 
-		std::vector<std::string> defines;
-		defines.push_back(std::string(magic_enum::enum_name(renderType)));
-		defines.push_back(std::string(magic_enum::enum_name(step)));
+std::string PointCloudSplitter::variantName(RenderTypeShaderVariant renderType, StepShaderVariant step) const
+{
+	return m_shaderName + "_RenderType" + std::to_string(static_cast<int>(renderType)) + "_Step" + std::to_string(static_cast<int>(step));
+}
 
-		std::map<std::string, std::string> snippets;
-		snippets["settings"] = "#define LOCAL_SIZE_X " + std::to_string(m_local_size_x);
+std::vector<std::string> PointCloudSplitter::variantDefines(RenderTypeShaderVariant renderType, StepShaderVariant step)
+{
+	return {
+		std::string(magic_enum::enum_name(renderType)),
+		std::string(magic_enum::enum_name(step))
+	};
+}
 
-		DEBUG_LOG << "loading variant " << variantName;
-		ShaderPool::AddShaderVariant(variantName, m_shaderName, defines);
-		m_shaders[index] = ShaderPool::GetShader(variantName);
+void PointCloudSplitter::warmUpShaders()
+{
+	// Same steps as in onPreRender(). renderTypeCaching is not exposed in the
+	// UI so only the current one is reachable.
+	const Properties& props = properties();
+	StepShaderVariant firstStep = StepShaderVariant::STEP_RESET;
+	if (props.renderTypeCaching == RenderTypeCaching::Precompute) {
+		firstStep = StepShaderVariant::STEP_PRECOMPUTE;
+	}
+	auto renderType = static_cast<RenderTypeShaderVariant>(props.renderTypeCaching);
+	for (int i = static_cast<int>(firstStep); i <= static_cast<int>(lastValue<StepShaderVariant>()); ++i) {
+		auto step = static_cast<StepShaderVariant>(i);
+		ShaderPool::WarmUpShaderVariant(variantName(renderType, step), m_shaderName, variantDefines(renderType, step));
 	}
-	return m_shaders[index];
 }
 
 void PointCloudSplitter::initStats()
 {
 	m_outputStats = ResourceManager::resolveResourcePath(m_outputStats);
 	fs::create_directories(fs::path(m_outputStats).parent_path());
-	m_outputStatsFile.open(m_outputStats);
-	m_outputStatsFile << "frame;instanceCount;impostorCount;pointCount;noneCount\n";
-	m_statFrame = 0;
+	StatsSink::CloseTable(m_statsTable);
+	m_statsTable = StatsSink::AddTable(m_outputStats);
+	// Consecutive columns, in RenderModel order
+	for (const char* name : { "instanceCount", "impostorCount", "pointCount", "noneCount" }) {
+		StatsSink::AddColumn(m_statsTable, name);
+	}
 }
 
 void PointCloudSplitter::writeStats()
 {
-	if (!m_outputStatsFile.is_open()) return;
-	m_outputStatsFile << m_statFrame << ";";
-
-	m_outputStatsFile << m_counters[static_cast<int>(RenderModel::Instance)].count << ";";
-	m_outputStatsFile << m_counters[static_cast<int>(RenderModel::Impostor)].count << ";";
-	m_outputStatsFile << m_counters[static_cast<int>(RenderModel::Point)].count << ";";
-	m_outputStatsFile << m_counters[static_cast<int>(RenderModel::None)].count << "\n";
-
-	++m_statFrame;
+	if (m_statsTable < 0) return;
+	StatsSink::Record(m_statsTable, 0, m_counters[static_cast<int>(RenderModel::Instance)].count);
+	StatsSink::Record(m_statsTable, 1, m_counters[static_cast<int>(RenderModel::Impostor)].count);
+	StatsSink::Record(m_statsTable, 2, m_counters[static_cast<int>(RenderModel::Point)].count);
+	StatsSink::Record(m_statsTable, 3, m_counters[static_cast<int>(RenderModel::None)].count);
 }
@@ -34,11 +34,11 @@
 #include "Behavior.h"
 #include "GlBuffer.h"
 #include "IPointCloudData.h"
+#include "StatsSink.h"
 #include "utils/ReflectionAttributes.h"
 
 #include <refl.hpp>
 
-#include <fstream>
 #include <memory>
 #include <vector>
 
@@ -54,11 +54,14 @@ class GrainBehavior;
  */
 class PointCloudSplitter : public Behavior {
 public:
+	~PointCloudSplitter();
+
 	// Behavior implementation
 	bool deserialize(const rapidjson::Value & json) override;
 	void start() override;
 	void update(float time, int frame) override;
 	void onPreRender(const Camera& camera, const World& world, RenderType target) override;
+	void warmUpShaders() override;
 
 public:
 	enum class RenderTypeCaching {
@@ -66,6 +69,11 @@ public:
 		Cache, // Faster, but by max 1%...
 		Precompute, // Not recommended
 	};
+	enum class ShadowCasterModel {
+		Default, // same models as the main view, but with shadow LoD limits
+		DepthPoints, // everything goes to the point model and is rendered as depth-only discs
+		Spheres, // same, but discs get the depth of a sphere
+	};
 	struct Properties {
 		RenderTypeCaching renderTypeCaching = RenderTypeCaching::Cache;
 		bool enableOcclusionCulling = true;
@@ -77,6 +85,12 @@ public:
 		glm::vec3 bboxMin;
 		glm::vec3 bboxMax;
 		float occluderMapSpriteScale = 0.2f;
+		// Shadow pass, limits are given for a shadow map of shadowReferenceResolution
+		// and scaled with the actual resolution so that cost tracks shadow map size
+		ShadowCasterModel shadowCasterModel = ShadowCasterModel::Default;
+		float shadowInstanceLimit = 0.3f;
+		float shadowImpostorLimit = 3.0f;
+		float shadowReferenceResolution = 1024.0f;
 	};
 	enum class RenderModel {
 		Instance = 0,
@@ -102,10 +116,11 @@ public:
 	const GlBuffer& vbo(RenderModel model) const;
 	std::shared_ptr<GlBuffer> ebo(RenderModel model) const;
 	GLint pointOffset(RenderModel model) const;
+	const GlBuffer* orientations(RenderModel model) const;
 
 private:
 	glm::mat4 modelMatrix() const;
-	void setCommonUniforms(const ShaderProgram& shader, const Camera& camera) const;
+	void setCommonUniforms(const ShaderProgram& shader, const Camera& camera, RenderType target = RenderType::Default) const;
 
 	// These must match defines in the shader (magic_enum reflexion is used to set defines)
 	// the first one mirrors RenderTypeCaching (which is for diaplay)
@@ -124,6 +139,8 @@ private:
 	typedef int ShaderVariantFlagSet;
 	std::shared_ptr<ShaderProgram> getShader(RenderTypeCaching renderType, int step) const; // for convenience
 	std::shared_ptr<ShaderProgram> getShader(RenderTypeShaderVariant renderType, StepShaderVariant step) const;
+	std::string variantName(RenderTypeShaderVariant renderType, StepShaderVariant step) const;
+	static std::vector<std::string> variantDefines(RenderTypeShaderVariant renderType, StepShaderVariant step);
 
 	void initStats();
 	void writeStats();
@@ -156,8 +173,7 @@ private:
 
 	// stats
 	std::string m_outputStats;
-	std::ofstream m_outputStatsFile;
-	int m_statFrame = 0;
+	StatsSink::TableId m_statsTable = -1;
 };
 
 #define _ ReflectionAttributes::
@@ -172,6 +188,10 @@ REFL_FIELD(useBbox)
 REFL_FIELD(bboxMin, _ Range(-1, 1))
 REFL_FIELD(bboxMax, _ Range(-1, 1))
 REFL_FIELD(occluderMapSpriteScale)
+REFL_FIELD(shadowCasterModel)
+REFL_FIELD(shadowInstanceLimit, _ Range(0.0f, 3.0f))
+REFL_FIELD(shadowImpostorLimit, _ Range(0.0f, 20.0f))
+REFL_FIELD(shadowReferenceResolution, _ Range(256.0f, 8192.0f))
 REFL_END
 #undef _
 
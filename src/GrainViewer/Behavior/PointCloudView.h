@@ -49,6 +49,7 @@ public:
 	const GlBuffer& vbo() const override { return m_splitter.vbo(m_model); }
 	std::shared_ptr<GlBuffer> ebo() const override { return m_splitter.ebo(m_model); }
 	GLint pointOffset() const override { return m_splitter.pointOffset(m_model); }
+	const GlBuffer* orientations() const override { return m_splitter.orientations(m_model); }
 
 private:
 	const PointCloudSplitter& m_splitter;
@@ -443,6 +443,7 @@ std::shared_ptr<Framebuffer> Camera::getExtraFramebuffer(ExtraFramebufferOption
 		int width = static_cast<int>(m_uniforms.resolution.x);
 		int height = static_cast<int>(m_uniforms.resolution.y);
 		std::vector<ColorLayerInfo> colorLayerInfos;
+		bool compact = m_gbufferLayout == GBufferLayout::Compact;
 		using Opt = ExtraFramebufferOption;
 		switch (option)
 		{
@@ -450,28 +451,51 @@ std::shared_ptr<Framebuffer> Camera::getExtraFramebuffer(ExtraFramebufferOption
 			colorLayerInfos = std::vector<ColorLayerInfo>{ { GL_RGBA32F,  GL_COLOR_ATTACHMENT0 } };
 			break;
 		case Opt::TwoRgba32fDepth:
-		case Opt::LinearGBufferDepth:
 			colorLayerInfos = std::vector<ColorLayerInfo>{
 				{ GL_RGBA32F,  GL_COLOR_ATTACHMENT0 },
 				{ GL_RGBA32F,  GL_COLOR_ATTACHMENT1 }
 			};
 			break;
+		case Opt::LinearGBufferDepth:
+		{
+			// Linear g-buffers accumulate weighted values, half floats are enough
+			GLenum format = compact ? GL_RGBA16F : GL_RGBA32F;
+			colorLayerInfos = std::vector<ColorLayerInfo>{
+				{ format,  GL_COLOR_ATTACHMENT0 },
+				{ format,  GL_COLOR_ATTACHMENT1 }
+			};
+			break;
+		}
 		case Opt::LeanLinearGBufferDepth:
+		{
+			GLenum format = compact ? GL_RGBA16F : GL_RGBA32F;
 			colorLayerInfos = std::vector<ColorLayerInfo>{
-				{ GL_RGBA32F,  GL_COLOR_ATTACHMENT0 },
-				{ GL_RGBA32F,  GL_COLOR_ATTACHMENT1 },
-				{ GL_RGBA32F,  GL_COLOR_ATTACHMENT2 }
+				{ format,  GL_COLOR_ATTACHMENT0 },
+				{ format,  GL_COLOR_ATTACHMENT1 },
+				{ format,  GL_COLOR_ATTACHMENT2 }
 			};
 			break;
+		}
 		case Opt::Depth:
 			colorLayerInfos = std::vector<ColorLayerInfo>{};
 			break;
 		case Opt::GBufferDepth:
-			colorLayerInfos = std::vector<ColorLayerInfo>{
-				{ GL_RGBA32F,  GL_COLOR_ATTACHMENT0 },
-				{ GL_RGBA32UI,  GL_COLOR_ATTACHMENT1 },
-				{ GL_RGBA32UI,  GL_COLOR_ATTACHMENT2 }
-			};
+			if (compact) {
+				// see gbuffer-compact.inc.glsl
+				colorLayerInfos = std::vector<ColorLayerInfo>{
+					{ GL_RGBA8,  GL_COLOR_ATTACHMENT0 },
+					{ GL_RGBA16UI,  GL_COLOR_ATTACHMENT1 }
+				};
+			} else {
+				colorLayerInfos = std::vector<ColorLayerInfo>{
+					{ GL_RGBA32F,  GL_COLOR_ATTACHMENT0 },
+					{ GL_RGBA32UI,  GL_COLOR_ATTACHMENT1 },
+					{ GL_RGBA32UI,  GL_COLOR_ATTACHMENT2 }
+				};
+			}
+			break;
+		case Opt::VisibilityDepth:
+			colorLayerInfos = std::vector<ColorLayerInfo>{ { GL_RG32UI,  GL_COLOR_ATTACHMENT0 } };
 			break;
 		}
 		fbo = std::make_shared<Framebuffer>(width, height, colorLayerInfos);
@@ -483,3 +507,13 @@ void Camera::releaseExtraFramebuffer(std::shared_ptr<Framebuffer>) const
 {
 	// TODO: release mutexes
 }
+
+void Camera::setGBufferLayout(GBufferLayout layout)
+{
+	if (layout == m_gbufferLayout) return;
+	m_gbufferLayout = layout;
+	using Opt = ExtraFramebufferOption;
+	for (Opt option : { Opt::GBufferDepth, Opt::LinearGBufferDepth, Opt::LeanLinearGBufferDepth }) {
+		m_extraFramebuffers[static_cast<int>(option)].reset();
+	}
+}
@@ -67,8 +67,18 @@ public:
 		GBufferDepth = 3, // attachements to hold a g-buffer (see gbuffer.inc.glsl plus a depth buffer
 		LinearGBufferDepth = 4, // same with linear g-buffer
 		LeanLinearGBufferDepth = 5, // same with linear g-buffer + (pseudo) lean maps
+		VisibilityDepth = 6, // packed grain/primitive ids only (see visibility-buffer.inc.glsl)
 		_Count,
 	};
+	/**
+	 * Storage used by the G-buffer options of ExtraFramebufferOption.
+	 * Compact must be matched by the COMPACT_GBUFFER define in shaders
+	 * (see gbuffer-compact.inc.glsl).
+	 */
+	enum class GBufferLayout {
+		Standard, // full float positions, 48 bytes per pixel
+		Compact, // 12 bytes per pixel, half float linear g-buffers
+	};
 
 public:
 	Camera();
@@ -140,6 +150,12 @@ public:
 	std::shared_ptr<Framebuffer> getExtraFramebuffer(ExtraFramebufferOption option = ExtraFramebufferOption::Rgba32fDepth) const;
 	void releaseExtraFramebuffer(std::shared_ptr<Framebuffer>) const;
 
+	/**
+	 * Changing the layout drops already allocated g-buffers
+	 */
+	void setGBufferLayout(GBufferLayout layout);
+	GBufferLayout gbufferLayout() const { return m_gbufferLayout; }
+
 	/**
 	 * Bounding circle of the projected sphere (which is an ellipsis).
 	 * xy is the center, z is the radius, all in pixels
@@ -231,6 +247,7 @@ protected:
 	std::shared_ptr<Framebuffer> m_targetFramebuffer;
 
 	mutable std::vector<std::shared_ptr<Framebuffer>> m_extraFramebuffers; // lazy initialized
+	GBufferLayout m_gbufferLayout = GBufferLayout::Standard;
 
 	OutputSettings m_outputSettings;
 	ProjectionType m_projectionType;
@@ -33,22 +33,36 @@ GlBuffer::~GlBuffer() {
 	free();
 }
 
-void GlBuffer::addBlockAttribute(size_t blockId, GLint size, GLuint divisor) {
-	Block & b = m_blocks[blockId];
-	BlockAttribute attr{ size, GL_FLOAT, divisor, 0 };
-	if (!b.attributes.empty()) {
-		BlockAttribute prevAttr = b.attributes.back();
-		attr.byteOffset = prevAttr.byteOffset + prevAttr.size * sizeof(GLfloat);
+namespace {
+GLsizei typeSize(GLenum type) {
+	switch (type) {
+	case GL_BYTE:
+	case GL_UNSIGNED_BYTE:
+		return 1;
+	case GL_SHORT:
+	case GL_UNSIGNED_SHORT:
+	case GL_HALF_FLOAT:
+		return 2;
+	default:
+		return 4;
 	}
-	b.attributes.push_back(attr);
+}
+} // namespace
+
+void GlBuffer::addBlockAttribute(size_t blockId, GLint size, GLuint divisor) {
+	addBlockAttribute(blockId, size, GL_FLOAT, GL_FALSE, divisor);
 }
 
 void GlBuffer::addBlockAttributeUint(size_t blockId, GLint size, GLuint divisor) {
+	addBlockAttribute(blockId, size, GL_UNSIGNED_INT, GL_FALSE, divisor);
+}
+
+void GlBuffer::addBlockAttribute(size_t blockId, GLint size, GLenum type, GLboolean normalized, GLuint divisor) {
 	Block & b = m_blocks[blockId];
-	BlockAttribute attr{ size, GL_UNSIGNED_INT, divisor, 0 };
+	BlockAttribute attr{ size, type, divisor, 0, normalized };
 	if (!b.attributes.empty()) {
 		BlockAttribute prevAttr = b.attributes.back();
-		attr.byteOffset = prevAttr.byteOffset + prevAttr.size * sizeof(GLuint);
+		attr.byteOffset = prevAttr.byteOffset + prevAttr.size * typeSize(prevAttr.type);
 	}
 	b.attributes.push_back(attr);
 }
@@ -87,7 +101,11 @@ void GlBuffer::enableAttributes(GLuint vao) {
 			glVertexArrayBindingDivisor(vao, bindingindex, attr.divisor);
 			glEnableVertexArrayAttrib(vao, id);
 			glVertexArrayAttribBinding(vao, id, bindingindex);
-			glVertexArrayAttribFormat(vao, id, attr.size, attr.type, GL_FALSE, 0);
+			if (attr.type == GL_FLOAT || attr.type == GL_HALF_FLOAT || attr.normalized) {
+				glVertexArrayAttribFormat(vao, id, attr.size, attr.type, attr.normalized, 0);
+			} else {
+				glVertexArrayAttribIFormat(vao, id, attr.size, attr.type, 0);
+			}
 			//*/
 			++id;
 		}
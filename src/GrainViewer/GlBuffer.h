@@ -98,6 +98,8 @@ public:
 
 	void addBlockAttribute(size_t blockId, GLint size, GLuint divisor = 0);
 	void addBlockAttributeUint(size_t blockId, GLint size, GLuint divisor = 0);
+	/// Generic version, e.g. for compressed attributes (GL_SHORT normalized, GL_HALF_FLOAT, etc.)
+	void addBlockAttribute(size_t blockId, GLint size, GLenum type, GLboolean normalized, GLuint divisor = 0);
 
 	/// Allocate buffer
 	void alloc();
@@ -163,6 +165,7 @@ private:
 		GLenum type = GL_ARRAY_BUFFER;
 		GLuint divisor = 1;
 		GLsizei byteOffset = 0;
+		GLboolean normalized = GL_FALSE;
 	};
 
 	struct Block {
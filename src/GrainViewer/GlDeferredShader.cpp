@@ -37,10 +37,19 @@
 #include "utils/jsonutils.h"
 #include "utils/behaviorutils.h"
 #include "Framebuffer.h"
+#include "ShaderPool.h"
 
 #include <vector>
 #include <sstream>
 
+// Must match include/light.inc.glsl and include/light-tiles.inc.glsl
+constexpr GLuint LightsSsboBinding = 7;
+constexpr GLuint LightTilesSsboBinding = 8;
+constexpr GLuint LightTileSize = 16;
+constexpr GLuint MaxLightsPerTile = 63;
+constexpr GLuint ShadowMapUnit = 16;
+constexpr GLuint RichShadowMapUnit = ShadowMapUnit + World::MaxShadowMaps;
+
 float GlDeferredShader::Properties::ShadowMapBias() const
 {
 	return shadowMapBiasBase * static_cast<float>(pow(10, shadowMapBiasExponent));
@@ -51,10 +60,14 @@ GlDeferredShader::GlDeferredShader()
 	, m_debugShader("deferred-shader")
 {
 	glCreateVertexArrays(1, &m_vao);
+	ShaderPool::Watch(&m_shader);
+	ShaderPool::Watch(&m_debugShader);
 }
 
 GlDeferredShader::~GlDeferredShader()
 {
+	ShaderPool::Unwatch(&m_shader);
+	ShaderPool::Unwatch(&m_debugShader);
 	glDeleteVertexArrays(1, &m_vao);
 }
 
@@ -77,6 +90,20 @@ bool GlDeferredShader::deserialize(const rapidjson::Value & json)
 		m_colormap->setWrapMode(GL_CLAMP_TO_EDGE);
 	}
 
+	std::string gbufferLayout;
+	if (jrOption(json, "gbufferLayout", gbufferLayout)) {
+		auto layout = magic_enum::enum_cast<Camera::GBufferLayout>(gbufferLayout);
+		if (layout.has_value()) {
+			m_gbufferLayout = layout.value();
+		} else {
+			ERR_LOG << "Invalid value '" << gbufferLayout << "' for parameter 'gbufferLayout'";
+		}
+	}
+	if (m_gbufferLayout == Camera::GBufferLayout::Compact) {
+		m_shader.define("COMPACT_GBUFFER");
+		m_debugShader.define("COMPACT_GBUFFER");
+	}
+
 	autoDeserialize(json, m_properties);
 
 	return true;
@@ -110,6 +137,9 @@ void GlDeferredShader::render(const Camera & camera, const World & world, Render
 	glDisable(GL_DEPTH_TEST);
 	glDisable(GL_BLEND);
 
+	// Culling uses its own shader, so run it before binding anything for the deferred pass
+	bool lightCulling = m_properties.lightCulling && cullLights(camera, world, fbo->depthTexture());
+
 	const ShaderProgram& shader = properties().debugVectors ? m_debugShader : m_shader;
 
 	shader.bindUniformBlock("Camera", camera.ubo());
@@ -118,38 +148,44 @@ void GlDeferredShader::render(const Camera & camera, const World & world, Render
 
 	GLint o = 0;
 	for (int i = 0; i < fbo->colorTextureCount(); ++i) {
-		shader.setUniform(MAKE_STR("gbuffer" << i), o);
+		shader.setUniform(UniformName("gbuffer") + i, o);
 		glBindTextureUnit(static_cast<GLuint>(o), fbo->colorTexture(i));
 		++o;
 	}
 
 	shader.setUniform("in_depth", o);
 	glBindTextureUnit(static_cast<GLuint>(o), fbo->depthTexture());
+	if (m_gbufferLayout == Camera::GBufferLayout::Compact) {
+		// positions are reconstructed from depth
+		shader.setUniform("gbufferDepth", o);
+		shader.setUniform("uGBufferInverseViewProjection", glm::inverse(camera.projectionMatrix() * camera.viewMatrix()));
+	}
 	++o;
 
-	// TODO: Use UBO, move to World
+	// Lights themselves are in an SSBO maintained by World, only shadow maps
+	// need to be bound here.
 	auto lights = world.lights();
 	for (size_t k = 0; k < lights.size(); ++k) {
-		std::string prefix = MAKE_STR("light[" << k << "].");
-		shader.setUniform(prefix + "position_ws", lights[k]->position());
-		shader.setUniform(prefix + "color", lights[k]->color());
-		shader.setUniform(prefix + "matrix", lights[k]->shadowMap().camera().projectionMatrix() * lights[k]->shadowMap().camera().viewMatrix());
-		shader.setUniform(prefix + "isRich", lights[k]->isRich() ? 1 : 0);
-		shader.setUniform(prefix + "hasShadowMap", lights[k]->hasShadowMap() ? 1 : 0);
-		shader.setUniform(prefix + "shadowMap", o);
-		glBindTextureUnit(static_cast<GLuint>(o), lights[k]->shadowMap().depthTexture());
-		++o;
+		int index = world.shadowMapIndex(k);
+		if (index < 0) continue;
+		glBindTextureUnit(ShadowMapUnit + static_cast<GLuint>(index), lights[k]->shadowMap().depthTexture());
 		if (lights[k]->isRich()) {
-			shader.setUniform(prefix + "richShadowMap", o);
-			glBindTextureUnit(static_cast<GLuint>(o), lights[k]->shadowMap().colorTexture(0));
-			++o;
+			glBindTextureUnit(RichShadowMapUnit + static_cast<GLuint>(index), lights[k]->shadowMap().colorTexture(0));
 		}
 	}
+	world.bindLightBuffer(LightsSsboBinding);
+	shader.setUniform("uLightCount", world.lightCount());
+	shader.setUniform("uUnboundedLightCount", world.unboundedLightCount());
+	if (lightCulling) {
+		m_lightTiles->bindSsbo(LightTilesSsboBinding);
+		shader.setUniform("uLightTileCountX", (static_cast<GLuint>(camera.resolution().x) + LightTileSize - 1) / LightTileSize);
+	}
 
 	shader.setUniform("uIsShadowMapEnabled", world.isShadowMapEnabled());
 
 	autoSetUniforms(shader, m_properties);
 	shader.setUniform("uShadowMapBias", m_properties.ShadowMapBias());
+	shader.setUniform("uLightCulling", lightCulling);
 
 	shader.setUniform("uHasColormap", static_cast<bool>(m_colormap));
 	if (m_colormap) {
@@ -163,3 +199,35 @@ void GlDeferredShader::render(const Camera & camera, const World & world, Render
 	glDrawArrays(GL_POINTS, 0, 1);
 	glBindVertexArray(0);
 }
+
+bool GlDeferredShader::cullLights(const Camera& camera, const World& world, GLuint depthTexture) const
+{
+	GLuint tileCountX = (static_cast<GLuint>(camera.resolution().x) + LightTileSize - 1) / LightTileSize;
+	GLuint tileCountY = (static_cast<GLuint>(camera.resolution().y) + LightTileSize - 1) / LightTileSize;
+	size_t tileCount = static_cast<size_t>(tileCountX) * static_cast<size_t>(tileCountY);
+
+	if (!m_lightTiles || m_lightTilesCapacity < tileCount) {
+		m_lightTilesCapacity = tileCount;
+		m_lightTiles = std::make_unique<GlBuffer>(GL_SHADER_STORAGE_BUFFER);
+		m_lightTiles->addBlock<GLuint>(m_lightTilesCapacity * (MaxLightsPerTile + 1));
+		m_lightTiles->alloc();
+		m_lightTiles->finalize();
+	}
+
+	const ShaderProgram& shader = *ShaderPool::GetShader("LightCulling");
+	if (!shader.isValid()) return false;
+
+	shader.bindUniformBlock("Camera", camera.ubo());
+	shader.setUniform("uLightCount", world.lightCount());
+	shader.setUniform("uUnboundedLightCount", world.unboundedLightCount());
+	shader.setUniform("uLightTileCountX", tileCountX);
+	shader.setUniform("uDepth", 0);
+	glBindTextureUnit(0, depthTexture);
+	world.bindLightBuffer(LightsSsboBinding);
+	m_lightTiles->bindSsbo(LightTilesSsboBinding);
+
+	shader.use();
+	glDispatchCompute(tileCountX, tileCountY, 1);
+	glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+	return true;
+}
@@ -33,6 +33,7 @@
 #include "Framebuffer.h"
 #include "Camera.h"
 #include "World.h"
+#include "GlBuffer.h"
 #include "RenderType.h"
 #include "utils/ReflectionAttributes.h"
 
@@ -69,6 +70,7 @@ public:
 		float debugVectorsGrid = 20.0f;
 		float shadowMapBiasBase = 0.1f;
 		int shadowMapBiasExponent = -5;
+		bool lightCulling = true; // tiled light culling, only matters for lights with a radius
 
 		float ShadowMapBias() const;
 	};
@@ -93,12 +95,25 @@ public:
 
 	void setBlitOffset(GLint x, GLint y) { m_blitOffset = glm::vec2(static_cast<float>(x), static_cast<float>(y)); }
 
+	// Set from the scene file only, since it affects all shaders and cameras
+	Camera::GBufferLayout gbufferLayout() const { return m_gbufferLayout; }
+
+private:
+	/**
+	 * Fill m_lightTiles with the list of lights affecting each screen tile.
+	 * Return false if culling could not be run.
+	 */
+	bool cullLights(const Camera& camera, const World& world, GLuint depthTexture) const;
+
 private:
 	Properties m_properties;
 	ShaderProgram m_shader, m_debugShader;
 	GLuint m_vao;
 	std::unique_ptr<GlTexture> m_colormap; // colormap used as ramp for outputting debug images
 	glm::vec2 m_blitOffset = glm::vec2(0.0f); // offset when writing to output framebuffer
+	Camera::GBufferLayout m_gbufferLayout = Camera::GBufferLayout::Standard;
+	mutable std::unique_ptr<GlBuffer> m_lightTiles; // written by light culling
+	mutable size_t m_lightTilesCapacity = 0; // in number of tiles
 };
 
 #define _ ReflectionAttributes::
@@ -112,5 +127,6 @@ REFL_FIELD(debugVectorsScale, _ Range(0, 2))
 REFL_FIELD(debugVectorsGrid, _ Range(0, 40))
 REFL_FIELD(shadowMapBiasBase)
 REFL_FIELD(shadowMapBiasExponent, _ Range(-8, 2))
+REFL_FIELD(lightCulling)
 REFL_END
 #undef _
@@ -32,10 +32,30 @@
 #include "ResourceManager.h"
 #include "utils/jsonutils.h"
 #include "utils/behaviorutils.h"
+#include "utils/strutils.h"
 
+#include <algorithm>
+#include <cmath>
 #include <filesystem>
 namespace fs = std::filesystem;
 
+// Query targets of GL_ARB_pipeline_statistics_query (core in 4.6), except for
+// GL_PRIMITIVES_GENERATED which is core in 4.5. GL_GEOMETRY_SHADER_INVOCATIONS
+// exists in 4.5 but only as a program parameter, not as a query target.
+constexpr GLenum VertexShaderInvocations = 0x82F0;
+constexpr GLenum FragmentShaderInvocations = 0x82F4;
+constexpr GLenum ComputeShaderInvocations = 0x82F5;
+
+// In Counter order, starting at FirstQueryCounter
+static const GLenum counterQueryTargets[] = {
+	GL_PRIMITIVES_GENERATED,
+	VertexShaderInvocations,
+	GL_GEOMETRY_SHADER_INVOCATIONS,
+	FragmentShaderInvocations,
+	ComputeShaderInvocations,
+};
+static_assert(sizeof(counterQueryTargets) / sizeof(GLenum) == GlobalTimer::QueryCounterCount);
+
 int GlobalTimer::StatsUi::s_counter = 0;
 
 GlobalTimer::StatsUi::StatsUi() {
@@ -57,13 +77,63 @@ GlobalTimer::Timer::Timer()
 }
 
 GlobalTimer::Timer::~Timer()
+{
+	glDeleteQueries(2, queries);
+	// (unused entries are 0, which glDeleteQueries ignores)
+	glDeleteQueries(QueryCounterCount, statisticsQueries);
+}
+
+GlobalTimer::FrameQueries::FrameQueries()
+{
+	glCreateQueries(GL_TIMESTAMP, 2, queries);
+	stoppedTimers.reserve(64);
+}
+
+GlobalTimer::FrameQueries::~FrameQueries()
 {
 	glDeleteQueries(2, queries);
 }
 
 //-----------------------------------------------------------------------------
 
+void GlobalTimer::Histogram::addSample(double duration) noexcept
+{
+	int bucket = 0;
+	if (duration > MinDuration) {
+		bucket = static_cast<int>(std::log2(duration / MinDuration) * BucketsPerOctave);
+		bucket = std::min(bucket, BucketCount - 1);
+	}
+	++buckets[bucket];
+	++sampleCount;
+	max = std::max(max, duration);
+}
+
+double GlobalTimer::Histogram::percentile(double p) const noexcept
+{
+	if (sampleCount == 0) return 0.0;
+	uint32_t rank = static_cast<uint32_t>(std::ceil(p * sampleCount));
+	uint32_t cumulated = 0;
+	for (int i = 0; i < BucketCount; ++i) {
+		cumulated += buckets[i];
+		if (cumulated >= rank && cumulated > 0) {
+			double upperBound = MinDuration * std::exp2(static_cast<double>(i + 1) / BucketsPerOctave);
+			return std::min(upperBound, max);
+		}
+	}
+	return max;
+}
+
+void GlobalTimer::Histogram::reset() noexcept
+{
+	buckets.fill(0);
+	sampleCount = 0;
+	max = 0.0;
+}
+
+//-----------------------------------------------------------------------------
+
 std::shared_ptr<GlobalTimer> GlobalTimer::s_instance;
+const std::string GlobalTimer::s_frameTraceName = "Frame";
 
 void GlobalTimer::Stats::reset() noexcept
 {
@@ -72,25 +142,55 @@ void GlobalTimer::Stats::reset() noexcept
 	cumulatedFrameOffset = 0.0;
 	cumulatedGpuTime = 0.0;
 	cumulatedGpuFrameOffset = 0.0;
+	gpuSampleCount = 0;
+	histogram.reset();
+	gpuHistogram.reset();
+	hasCounters = false;
+	hasQueryCounters = false;
+}
+
+//-----------------------------------------------------------------------------
+
+const char* GlobalTimer::CounterName(int counter) noexcept
+{
+	static const char* names[] = {
+		"drawCalls",
+		"points",
+		"primitivesGenerated",
+		"vertexShaderInvocations",
+		"geometryShaderInvocations",
+		"fragmentShaderInvocations",
+		"computeShaderInvocations",
+	};
+	return counter >= 0 && counter < CounterCount ? names[counter] : "";
 }
 
 //-----------------------------------------------------------------------------
 
 GlobalTimer::GlobalTimer()
-{}
+{
+	m_supportedQueryCounters[PrimitivesGenerated - FirstQueryCounter] = true;
+
+	GLint extensionCount = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+	for (GLint i = 0; i < extensionCount; ++i) {
+		std::string extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i)));
+		if (extension == "GL_ARB_pipeline_statistics_query") {
+			m_supportedQueryCounters.fill(true);
+			break;
+		}
+	}
+}
 
 GlobalTimer::~GlobalTimer()
 {
-	gatherQueries();
+	writePercentiles();
 
-	if (!m_pool.empty()) {
+	if (!m_runningTimers.empty()) {
 		WARN_LOG << "Program terminates but some timers are still running";
 	}
-
-	while (!m_pool.empty()) {
-		auto it = m_pool.begin();
-		delete *it;
-		m_pool.erase(it);
+	if (m_droppedFrames > 0) {
+		DEBUG_LOG << "GPU timer queries of " << m_droppedFrames << " frames were not available in time";
 	}
 }
 
@@ -102,15 +202,37 @@ bool GlobalTimer::deserialize(const rapidjson::Value& json)
 		initStats();
 	}
 
+	if (jrOption(json, "traceFile", m_traceFile)) {
+		m_traceFile = ResourceManager::resolveResourcePath(m_traceFile);
+	}
+	int captureFrames = 0;
+	if (jrOption(json, "captureFrames", captureFrames) && captureFrames > 0) {
+		captureTrace(captureFrames);
+	}
+
 	return true;
 }
 
 GlobalTimer::TimerHandle GlobalTimer::start(const std::string& message) noexcept
 {
-	Timer *timer = new Timer();
-	m_pool.insert(timer);
+	// Timers are recycled, so allocation only happens during the first frames
+	if (m_freeTimers.empty()) {
+		m_timers.push_back(std::make_unique<Timer>());
+		m_freeTimers.push_back(m_timers.back().get());
+	}
+	Timer* timer = m_freeTimers.back();
+	m_freeTimers.pop_back();
+	timer->running = true;
+	timer->parent = m_runningTimers.empty() ? nullptr : m_runningTimers.back();
+	m_runningTimers.push_back(timer);
 	timer->message = message;
+	timer->drawCalls = 0;
+	timer->points = 0;
 	glQueryCounter(timer->queries[0], GL_TIMESTAMP);
+	timer->pipelineStatistics = properties().pipelineStatistics && !m_pipelineStatisticsTimer;
+	if (timer->pipelineStatistics) {
+		beginPipelineStatistics(*timer);
+	}
 	timer->startTime = std::chrono::high_resolution_clock::now();
 	return static_cast<void*>(timer);
 }
@@ -125,48 +247,121 @@ void GlobalTimer::stop(TimerHandle handle) noexcept
 {
 	auto endTime = std::chrono::high_resolution_clock::now();
 	Timer* timer = static_cast<Timer*>(handle);
-	glQueryCounter(timer->queries[1], GL_TIMESTAMP);
-	if (m_pool.count(timer) == 0) {
+	if (!timer || !timer->running) {
 		WARN_LOG << "Invalid TimerHandle";
 		return;
 	}
-	m_pool.erase(timer);
-	m_stopped.insert(timer);
+	if (timer->pipelineStatistics) {
+		endPipelineStatistics(*timer);
+	}
+	glQueryCounter(timer->queries[1], GL_TIMESTAMP);
+	timer->running = false;
+	m_runningTimers.erase(std::find(m_runningTimers.begin(), m_runningTimers.end(), timer));
+	m_frames[m_currentFrame].stoppedTimers.push_back(timer);
 
-	Stats& stats = m_stats[timer->message];
+	auto it = m_stats.find(timer->message);
+	if (it == m_stats.end()) {
+		it = m_stats.insert({ timer->message, Stats() }).first;
+	}
+	Stats& stats = it->second;
+	if (timer->parent && timer->parent->running && stats.parent != timer->parent->message) {
+		stats.parent = timer->parent->message;
+	}
 	stats.sampleCount++;
 	stats.lastTime = milliseconds(endTime - timer->startTime);
-	stats.lastFrameOffset = milliseconds(timer->startTime - m_frameTimer.startTime);
+	stats.lastFrameOffset = milliseconds(timer->startTime - m_frameStartTime);
 	addSample(stats.cumulatedTime, stats.lastTime, stats.sampleCount);
 	addSample(stats.cumulatedFrameOffset, stats.lastFrameOffset, stats.sampleCount);
+	stats.histogram.addSample(stats.lastTime);
+	recordStats(it->first, stats, false, StatsSink::CurrentFrame());
+	if (timer->drawCalls > 0) {
+		stats.hasCounters = true;
+		stats.lastCounters[DrawCalls] = timer->drawCalls;
+		stats.lastCounters[Points] = timer->points;
+		recordCounters(it->first, stats, DrawCalls, FirstQueryCounter, StatsSink::CurrentFrame());
+	}
+
+	if (isTracedFrame(m_frameNumber)) {
+		m_traceEvents.push_back({ &it->first, traceMicroseconds(timer->startTime), stats.lastTime * 1e3, m_frameNumber, false });
+	}
+}
+
+void GlobalTimer::countDrawCall(GLsizei pointCount) noexcept
+{
+	for (Timer* timer : m_runningTimers) {
+		++timer->drawCalls;
+		timer->points += static_cast<GLuint64>(pointCount);
+	}
 }
 
 void GlobalTimer::startFrame() noexcept
 {
-	glQueryCounter(m_frameTimer.queries[0], GL_TIMESTAMP);
-	m_frameTimer.startTime = std::chrono::high_resolution_clock::now();
+	FrameQueries& frame = m_frames[m_currentFrame];
+	if (frame.pending) {
+		// The GPU is more than FrameLatency frames late, rather drop these
+		// samples than wait for it
+		releaseTimers(frame);
+		frame.pending = false;
+		++m_droppedFrames;
+	}
+	glQueryCounter(frame.queries[0], GL_TIMESTAMP);
+	frame.frameNumber = m_frameNumber;
+	frame.statsFrame = StatsSink::CurrentFrame();
+	m_frameStartTime = std::chrono::high_resolution_clock::now();
 }
 
 void GlobalTimer::stopFrame() noexcept
 {
 	auto endTime = std::chrono::high_resolution_clock::now();
-	glQueryCounter(m_frameTimer.queries[1], GL_TIMESTAMP);
+	FrameQueries& frame = m_frames[m_currentFrame];
+	glQueryCounter(frame.queries[1], GL_TIMESTAMP);
+	frame.pending = true;
+	m_currentFrame = (m_currentFrame + 1) % FrameLatency;
+
 	m_frameStats.sampleCount++;
-	m_frameStats.lastTime = milliseconds(endTime - m_frameTimer.startTime);
+	m_frameStats.lastTime = milliseconds(endTime - m_frameStartTime);
 	addSample(m_frameStats.cumulatedTime, m_frameStats.lastTime, m_frameStats.sampleCount);
+	m_frameStats.histogram.addSample(m_frameStats.lastTime);
+	recordStats(s_frameTraceName, m_frameStats, false, StatsSink::CurrentFrame());
+
+	if (isTracedFrame(m_frameNumber)) {
+		m_traceEvents.push_back({ &s_frameTraceName, traceMicroseconds(m_frameStartTime), m_frameStats.lastTime * 1e3, m_frameNumber, false });
+	}
+	++m_frameNumber;
 
 	gatherQueries();
-	writeStats();
+
+	// Wait for GPU intervals of the last captured frame (or for it to be dropped)
+	if (isCapturingTrace() && m_frameNumber > m_traceLastFrame) {
+		bool waitingGpu = std::any_of(m_frames.begin(), m_frames.end(), [this](const FrameQueries& f) {
+			return f.pending && isTracedFrame(f.frameNumber);
+		});
+		if (!waitingGpu) writeTrace();
+	}
 }
 
 void GlobalTimer::resetAllStats() noexcept
 {
+	writePercentiles();
+	m_percentileWindowStart = StatsSink::CurrentFrame();
 	m_frameStats.reset();
 	for (auto& s : m_stats) {
 		s.second.reset();
 	}
 }
 
+void GlobalTimer::resetPercentiles() noexcept
+{
+	writePercentiles();
+	m_percentileWindowStart = StatsSink::CurrentFrame();
+	m_frameStats.histogram.reset();
+	m_frameStats.gpuHistogram.reset();
+	for (auto& s : m_stats) {
+		s.second.histogram.reset();
+		s.second.gpuHistogram.reset();
+	}
+}
+
 void GlobalTimer::addSample(double& accumulator, double dt, int sampleCount) noexcept
 {
 	double decay = properties().decay;
@@ -184,78 +379,252 @@ void GlobalTimer::addSample(double& accumulator, double dt, int sampleCount) noe
 
 void GlobalTimer::gatherQueries() noexcept
 {
+	// From oldest to newest, stopping at the first one that is not ready
+	// since queries complete in order.
+	for (int k = 0; k < FrameLatency; ++k) {
+		FrameQueries& frame = m_frames[(m_currentFrame + k) % FrameLatency];
+		if (!frame.pending) continue;
+		if (!readFrameQueries(frame)) break;
+		releaseTimers(frame);
+		frame.pending = false;
+	}
+}
+
+bool GlobalTimer::readFrameQueries(FrameQueries& frame) noexcept
+{
+	// Timers of the frame were stopped before its end, so their results are
+	// available as soon as the frame end query is.
+	GLuint available = GL_FALSE;
+	glGetQueryObjectuiv(frame.queries[1], GL_QUERY_RESULT_AVAILABLE, &available);
+	if (!available) return false;
+	// Other query types are not ordered with timestamps
+	for (Timer* timer : frame.stoppedTimers) {
+		if (!timer->pipelineStatistics) continue;
+		for (int i = 0; i < QueryCounterCount; ++i) {
+			if (!m_supportedQueryCounters[i]) continue;
+			glGetQueryObjectuiv(timer->statisticsQueries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+			if (!available) return false;
+		}
+	}
+
 	GLuint64 frameStartNs, frameEndNs;
-	glGetQueryObjectui64v(m_frameTimer.queries[0], GL_QUERY_RESULT, &frameStartNs);
-	glGetQueryObjectui64v(m_frameTimer.queries[1], GL_QUERY_RESULT, &frameEndNs);
+	glGetQueryObjectui64v(frame.queries[0], GL_QUERY_RESULT, &frameStartNs);
+	glGetQueryObjectui64v(frame.queries[1], GL_QUERY_RESULT, &frameEndNs);
 
+	m_frameStats.gpuSampleCount++;
 	m_frameStats.lastGpuTime = static_cast<double>(frameEndNs - frameStartNs) * 1e-6;
-	addSample(m_frameStats.cumulatedGpuTime, m_frameStats.lastGpuTime, m_frameStats.sampleCount);
-	
-	while (!m_stopped.empty()) {
-		auto it = m_stopped.begin();
-		Timer* timer = *it;
-		m_stopped.erase(it);
+	addSample(m_frameStats.cumulatedGpuTime, m_frameStats.lastGpuTime, m_frameStats.gpuSampleCount);
+	m_frameStats.gpuHistogram.addSample(m_frameStats.lastGpuTime);
+	recordStats(s_frameTraceName, m_frameStats, true, frame.statsFrame);
+	bool traced = isTracedFrame(frame.frameNumber);
+	if (traced) {
+		m_traceEvents.push_back({ &s_frameTraceName, traceMicroseconds(frameStartNs), m_frameStats.lastGpuTime * 1e3, frame.frameNumber, true });
+	}
 
+	for (Timer* timer : frame.stoppedTimers) {
 		GLuint64 startNs, endNs;
 		glGetQueryObjectui64v(timer->queries[0], GL_QUERY_RESULT, &startNs);
 		glGetQueryObjectui64v(timer->queries[1], GL_QUERY_RESULT, &endNs);
 
-		Stats& stats = m_stats[timer->message];
+		auto it = m_stats.find(timer->message);
+		Stats& stats = it->second; // (added in stop())
+		stats.gpuSampleCount++;
 		stats.lastGpuTime = static_cast<double>(endNs - startNs) * 1e-6;
 		stats.lastGpuFrameOffset = static_cast<double>(startNs - frameStartNs) * 1e-6;
-		addSample(stats.cumulatedGpuTime, stats.lastGpuTime, stats.sampleCount);
-		addSample(stats.cumulatedGpuFrameOffset, stats.lastGpuFrameOffset, stats.sampleCount);
+		addSample(stats.cumulatedGpuTime, stats.lastGpuTime, stats.gpuSampleCount);
+		stats.gpuHistogram.addSample(stats.lastGpuTime);
+		addSample(stats.cumulatedGpuFrameOffset, stats.lastGpuFrameOffset, stats.gpuSampleCount);
+		recordStats(it->first, stats, true, frame.statsFrame);
+
+		if (timer->pipelineStatistics) {
+			for (int i = 0; i < QueryCounterCount; ++i) {
+				GLuint64 value = 0;
+				if (m_supportedQueryCounters[i]) {
+					glGetQueryObjectui64v(timer->statisticsQueries[i], GL_QUERY_RESULT, &value);
+				}
+				stats.lastCounters[FirstQueryCounter + i] = value;
+			}
+			stats.hasQueryCounters = true;
+			recordCounters(it->first, stats, FirstQueryCounter, CounterCount, frame.statsFrame);
+		}
+		if (traced) {
+			m_traceEvents.push_back({ &it->first, traceMicroseconds(startNs), stats.lastGpuTime * 1e3, frame.frameNumber, true });
+		}
+	}
+	return true;
+}
+
+void GlobalTimer::beginPipelineStatistics(Timer& timer) noexcept
+{
+	for (int i = 0; i < QueryCounterCount; ++i) {
+		if (!m_supportedQueryCounters[i]) continue;
+		if (timer.statisticsQueries[i] == 0) {
+			glCreateQueries(counterQueryTargets[i], 1, &timer.statisticsQueries[i]);
+		}
+		glBeginQuery(counterQueryTargets[i], timer.statisticsQueries[i]);
+	}
+	m_pipelineStatisticsTimer = &timer;
+}
+
+void GlobalTimer::endPipelineStatistics(Timer& timer) noexcept
+{
+	for (int i = 0; i < QueryCounterCount; ++i) {
+		if (m_supportedQueryCounters[i]) {
+			glEndQuery(counterQueryTargets[i]);
+		}
+	}
+	m_pipelineStatisticsTimer = nullptr;
+}
+
+void GlobalTimer::releaseTimers(FrameQueries& frame) noexcept
+{
+	m_freeTimers.insert(m_freeTimers.end(), frame.stoppedTimers.begin(), frame.stoppedTimers.end());
+	frame.stoppedTimers.clear();
+}
+
+void GlobalTimer::captureTrace(int frameCount) noexcept
+{
+	if (isCapturingTrace()) {
+		WARN_LOG << "A trace is already being captured";
+		return;
+	}
 
-		delete timer;
+	// Calibrate the offset between GPU timestamps and CPU clock, reading the
+	// GPU one in between two CPU readings
+	auto before = std::chrono::high_resolution_clock::now();
+	glGetInteger64v(GL_TIMESTAMP, &m_traceGpuOrigin);
+	auto after = std::chrono::high_resolution_clock::now();
+	m_traceCpuOrigin = before + (after - before) / 2;
+
+	m_traceFirstFrame = m_frameNumber + 1; // first full frame
+	m_traceLastFrame = m_traceFirstFrame + std::max(frameCount, 1) - 1;
+	m_traceEvents.clear();
+	m_traceEvents.reserve(static_cast<size_t>(2 * (m_stats.size() + 1) * frameCount));
+	LOG << "Capturing a trace of " << frameCount << " frames...";
+}
+
+double GlobalTimer::traceMicroseconds(std::chrono::high_resolution_clock::time_point t) const noexcept
+{
+	return std::chrono::duration<double, std::micro>(t - m_traceCpuOrigin).count();
+}
+
+double GlobalTimer::traceMicroseconds(GLuint64 gpuNanoseconds) const noexcept
+{
+	return static_cast<double>(static_cast<GLint64>(gpuNanoseconds) - m_traceGpuOrigin) * 1e-3;
+}
+
+void GlobalTimer::writeTrace() noexcept
+{
+	std::string filename = m_traceFile.empty() ? ResourceManager::resolveResourcePath("trace.json") : m_traceFile;
+	fs::create_directories(fs::path(filename).parent_path());
+	std::ofstream out(filename);
+	if (!out.is_open()) {
+		ERR_LOG << "Could not write trace file: " << filename;
+	}
+	else {
+		out << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n";
+		out << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 1, \"args\": {\"name\": \"CPU\"}},\n";
+		out << "{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": 2, \"args\": {\"name\": \"GPU\"}}";
+		for (const auto& e : m_traceEvents) {
+			out
+				<< ",\n{\"name\": \"" << escapeJsonString(*e.name) << "\", "
+				<< "\"cat\": \"" << (e.gpu ? "gpu" : "cpu") << "\", "
+				<< "\"ph\": \"X\", \"pid\": 1, \"tid\": " << (e.gpu ? 2 : 1) << ", "
+				<< "\"ts\": " << e.start << ", \"dur\": " << e.duration << ", "
+				<< "\"args\": {\"frame\": " << e.frameNumber;
+			auto it = m_stats.find(*e.name);
+			if (it != m_stats.end() && !it->second.parent.empty()) {
+				out << ", \"parent\": \"" << escapeJsonString(it->second.parent) << "\"";
+			}
+			out << "}}";
+		}
+		out << "\n]}\n";
+		LOG << "Trace of " << (m_traceLastFrame - m_traceFirstFrame + 1) << " frames written to " << filename;
 	}
+
+	m_traceFirstFrame = -1;
+	m_traceLastFrame = -1;
+	m_traceEvents.clear();
 }
 
 void GlobalTimer::initStats() noexcept
 {
 	m_outputStats = ResourceManager::resolveResourcePath(m_outputStats);
 	fs::create_directories(fs::path(m_outputStats).parent_path());
-	m_outputStatsFile.open(m_outputStats);
-	m_outputStatsFile << "frame;raw counters(json);smoothed counters(json)\n";
-	m_statFrame = 0;
+
+	// Columns are added as timers show up (see recordStats)
+	StatsSink::CloseTable(m_statsTable);
+	m_statsTable = StatsSink::AddTable(m_outputStats);
+	m_frameStats.statsColumn = -1;
+	for (auto& s : m_stats) {
+		s.second.statsColumn = -1;
+		s.second.countersColumn = -1;
+	}
+
+	// Percentiles are written at the end of each window (see resetPercentiles)
+	fs::path percentilesPath = fs::path(m_outputStats);
+	percentilesPath.replace_extension(".percentiles.csv");
+	m_outputPercentilesFile.open(percentilesPath);
+	m_outputPercentilesFile << "window;first frame;last frame;timer;samples;p50;p95;p99;max;gpu samples;gpu p50;gpu p95;gpu p99;gpu max\n";
+	m_percentileWindow = 0;
+	m_percentileWindowStart = StatsSink::CurrentFrame();
+}
+
+void GlobalTimer::writePercentiles() noexcept
+{
+	if (!m_outputPercentilesFile.is_open() || m_frameStats.histogram.sampleCount == 0) return;
+
+	auto writeRow = [this](const std::string& name, const Stats& stats) {
+		const Histogram& h = stats.histogram;
+		const Histogram& g = stats.gpuHistogram;
+		m_outputPercentilesFile
+			<< m_percentileWindow << ";" << m_percentileWindowStart << ";" << (StatsSink::CurrentFrame() - 1) << ";" << name << ";"
+			<< h.sampleCount << ";" << h.percentile(0.5) << ";" << h.percentile(0.95) << ";" << h.percentile(0.99) << ";" << h.max << ";"
+			<< g.sampleCount << ";" << g.percentile(0.5) << ";" << g.percentile(0.95) << ";" << g.percentile(0.99) << ";" << g.max << "\n";
+	};
+	writeRow("Frame", m_frameStats);
+	for (const auto& s : m_stats) {
+		writeRow(s.first, s.second);
+	}
+	m_outputPercentilesFile.flush();
+	++m_percentileWindow;
 }
 
-void GlobalTimer::writeStats() noexcept
+void GlobalTimer::recordStats(const std::string& name, Stats& stats, bool gpu, int statsFrame) noexcept
 {
-	if (!m_outputStatsFile.is_open()) return;
+	if (m_statsTable < 0) return;
+
+	if (stats.statsColumn < 0) {
+		// Raw values, then smoothed ones, CPU then GPU
+		stats.statsColumn = StatsSink::AddColumn(m_statsTable, name + ".time");
+		StatsSink::AddColumn(m_statsTable, name + ".frameOffset");
+		StatsSink::AddColumn(m_statsTable, name + ".smoothedTime");
+		StatsSink::AddColumn(m_statsTable, name + ".smoothedFrameOffset");
+		StatsSink::AddColumn(m_statsTable, name + ".gpuTime");
+		StatsSink::AddColumn(m_statsTable, name + ".gpuFrameOffset");
+		StatsSink::AddColumn(m_statsTable, name + ".smoothedGpuTime");
+		StatsSink::AddColumn(m_statsTable, name + ".smoothedGpuFrameOffset");
+	}
 
-	m_outputStatsFile << m_statFrame << ";";
+	int col = stats.statsColumn + (gpu ? 4 : 0);
+	StatsSink::Record(m_statsTable, col + 0, statsFrame, gpu ? stats.lastGpuTime : stats.lastTime);
+	StatsSink::Record(m_statsTable, col + 1, statsFrame, gpu ? stats.lastGpuFrameOffset : stats.lastFrameOffset);
+	StatsSink::Record(m_statsTable, col + 2, statsFrame, gpu ? stats.cumulatedGpuTime : stats.cumulatedTime);
+	StatsSink::Record(m_statsTable, col + 3, statsFrame, gpu ? stats.cumulatedGpuFrameOffset : stats.cumulatedFrameOffset);
+}
 
-	m_outputStatsFile
-		<< "{\"Frame\": {"
-		<< "\"time\": " << m_frameStats.lastTime << ", "
-		<< "\"frameOffset\": " << m_frameStats.lastFrameOffset << ", "
-		<< "\"gpuTime\": " << m_frameStats.lastGpuTime << ", "
-		<< "\"gpuFrameOffset\": " << m_frameStats.lastGpuFrameOffset << "}";
-	for (const auto& s : m_stats) {
-		m_outputStatsFile
-			<< ", \"" << s.first << "\": {"
-			<< "\"time\": " << s.second.lastTime << ", "
-			<< "\"frameOffset\": " << s.second.lastFrameOffset << ", "
-			<< "\"gpuTime\": " << s.second.lastGpuTime << ", "
-			<< "\"gpuFrameOffset\": " << s.second.lastGpuFrameOffset << "}";
-	}
-	m_outputStatsFile << "};";
-
-	m_outputStatsFile
-		<< "{\"Frame\": {"
-		<< "\"time\": " << m_frameStats.cumulatedTime << ", "
-		<< "\"frameOffset\": " << m_frameStats.cumulatedFrameOffset << ", "
-		<< "\"gpuTime\": " << m_frameStats.cumulatedGpuTime << ", "
-		<< "\"gpuFrameOffset\": " << m_frameStats.cumulatedGpuFrameOffset << "}";
-	for (const auto& s : m_stats) {
-		m_outputStatsFile
-			<< ", \"" << s.first << "\": {"
-			<< "\"time\": " << s.second.cumulatedTime << ", "
-			<< "\"frameOffset\": " << s.second.cumulatedFrameOffset << ", "
-			<< "\"gpuTime\": " << s.second.cumulatedGpuTime << ", "
-			<< "\"gpuFrameOffset\": " << s.second.cumulatedGpuFrameOffset << "}";
+void GlobalTimer::recordCounters(const std::string& name, Stats& stats, int first, int last, int statsFrame) noexcept
+{
+	if (m_statsTable < 0) return;
+
+	if (stats.countersColumn < 0) {
+		stats.countersColumn = StatsSink::AddColumn(m_statsTable, name + "." + CounterName(0));
+		for (int i = 1; i < CounterCount; ++i) {
+			StatsSink::AddColumn(m_statsTable, name + "." + CounterName(i));
+		}
 	}
-	m_outputStatsFile << "}\n";
 
-	++m_statFrame;
+	for (int i = first; i < last; ++i) {
+		StatsSink::Record(m_statsTable, stats.countersColumn + i, statsFrame, static_cast<double>(stats.lastCounters[i]));
+	}
 }
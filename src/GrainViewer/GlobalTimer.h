@@ -31,6 +31,9 @@
 
 #include <OpenGL>
 
+#include "StatsSink.h"
+#include "utils/ReflectionAttributes.h"
+
 #include <rapidjson/document.h>
 #include <glm/glm.hpp>
 #include <refl.hpp>
@@ -41,14 +44,41 @@
 #include <map>
 #include <memory>
 #include <fstream>
+#include <vector>
+#include <array>
+#include <cstdint>
 
 /**
  * Global timer is used as a singleton to record render timings using both CPU
  * side timings and GPU timer queries.
+ * GPU queries are read back a few frames later, once their results are
+ * available, so that profiling does not stall the pipeline. GPU stats hence
+ * lag behind CPU ones by up to FrameLatency frames.
+ * Timers started while another one is running are nested in it, and a few
+ * frames can be captured as a trace to look at individual intervals.
+ * Timers also count the work done in between start and stop (see Counter).
  */
 class GlobalTimer {
 public:
     typedef void* TimerHandle;
+    /**
+     * Work done by a timed pass. Draw calls and points are counted on the CPU
+     * by renderers (see CountDrawCall), the others are pipeline statistics
+     * queries, read back asynchronously along with GPU timers.
+     */
+    enum Counter {
+        DrawCalls,
+        Points,
+        PrimitivesGenerated,
+        VertexShaderInvocations,
+        GeometryShaderInvocations,
+        FragmentShaderInvocations,
+        ComputeShaderInvocations,
+        CounterCount,
+    };
+    static constexpr int FirstQueryCounter = PrimitivesGenerated;
+    static constexpr int QueryCounterCount = CounterCount - FirstQueryCounter;
+    static const char* CounterName(int counter) noexcept;
     struct StatsUi {
         bool visible = true;
         glm::vec3 color = glm::vec3(0.0);
@@ -57,18 +87,50 @@ public:
     private:
         static int s_counter;
     };
+    /**
+     * Log scale histogram of durations, from 1us to about 16s with 8 buckets
+     * per octave (so about 9% precision), to get percentiles without keeping
+     * samples around. Averages hide the frames that stutter, these do not.
+     */
+    struct Histogram {
+        static constexpr int BucketsPerOctave = 8;
+        static constexpr int BucketCount = 24 * BucketsPerOctave;
+        static constexpr double MinDuration = 1e-3; // in ms
+
+        std::array<uint32_t, BucketCount> buckets = {};
+        uint32_t sampleCount = 0;
+        double max = 0.0;
+
+        void addSample(double duration) noexcept;
+        // Upper bound of the bucket containing the p-th quantile, p in [0,1]
+        double percentile(double p) const noexcept;
+        void reset() noexcept;
+    };
     struct Stats {
         int sampleCount = 0;
         double cumulatedTime = 0.0;
         double cumulatedFrameOffset = 0.0; // time within a frame at which the timer started
         double cumulatedGpuTime = 0.0;
         double cumulatedGpuFrameOffset = 0.0;
+        int gpuSampleCount = 0; // GPU samples arrive later and may be dropped
+        std::string parent; // enclosing timer, empty if directly in the frame
+
+        // since last reset of either all stats or percentiles
+        Histogram histogram;
+        Histogram gpuHistogram;
 
         // for stats recording
         double lastTime = 0.0;
         double lastFrameOffset = 0.0;
         double lastGpuTime = 0.0;
         double lastGpuFrameOffset = 0.0;
+        int statsColumn = -1; // first of its columns in the StatsSink table
+
+        // work counters of the last sample, only valid if hasCounters (resp. hasQueryCounters)
+        std::array<GLuint64, CounterCount> lastCounters = {};
+        bool hasCounters = false;
+        bool hasQueryCounters = false;
+        int countersColumn = -1;
 
         // for UI -- not reset by reset()
         mutable StatsUi ui;
@@ -83,11 +145,15 @@ public:
     static void Stop(TimerHandle handle) noexcept { GetInstance()->stop(handle); }
     static void StartFrame() noexcept { return GetInstance()->startFrame(); }
     static void StopFrame() noexcept { GetInstance()->stopFrame(); }
+    static void CaptureTrace(int frameCount) noexcept { GetInstance()->captureTrace(frameCount); }
+    static void CountDrawCall(GLsizei pointCount = 0) noexcept { GetInstance()->countDrawCall(pointCount); }
 
 public:
     struct Properties {
         bool showDiagram = false;
         float decay = 0.05f;
+        int traceFrameCount = 10; // frames captured by the "Capture trace" button and T key
+        bool pipelineStatistics = false; // query GPU work counters of top level timers
     };
     Properties& properties() { return m_properties; }
     const Properties& properties() const { return m_properties; }
@@ -104,15 +170,39 @@ public:
     void stop(TimerHandle handle) noexcept;
     void startFrame() noexcept;
     void stopFrame() noexcept;
+    /**
+     * Count a draw call (or compute dispatch) in all running timers, along
+     * with the number of points (grains) it processes if relevant.
+     */
+    void countDrawCall(GLsizei pointCount) noexcept;
     const std::map<std::string, Stats>& stats() const noexcept { return m_stats; }
     void resetAllStats() noexcept;
+    // Start a new window for percentiles, writing the previous one to the stats output
+    void resetPercentiles() noexcept;
     const Stats& frameStats() const noexcept { return m_frameStats; }
 
+    /**
+     * Record all CPU and GPU intervals of the next frameCount frames, and
+     * write them to the trace file as Chrome trace events once the GPU ones
+     * are read back. Open it in chrome://tracing or ui.perfetto.dev.
+     */
+    void captureTrace(int frameCount) noexcept;
+    bool isCapturingTrace() const noexcept { return m_traceLastFrame >= 0; }
+
+    // Number of frames of which GPU queries can be in flight
+    static constexpr int FrameLatency = 4;
+
 private:
     struct Timer {
         std::chrono::high_resolution_clock::time_point startTime;
         std::string message;
         GLuint queries[2]; // GPU timer queries for begin and end
+        bool running = false;
+        Timer* parent = nullptr; // still running when this one stops, if properly nested
+        GLuint64 drawCalls = 0;
+        GLuint64 points = 0;
+        GLuint statisticsQueries[QueryCounterCount] = {}; // lazily created
+        bool pipelineStatistics = false; // statisticsQueries were issued
 
         Timer();
         ~Timer();
@@ -120,32 +210,87 @@ private:
         Timer & operator=(const Timer&) = delete;
     };
 
+    // Queries issued during a frame, read back together once available
+    struct FrameQueries {
+        GLuint queries[2]; // frame begin and end
+        std::vector<Timer*> stoppedTimers;
+        bool pending = false; // waiting for read back
+        int frameNumber = 0;
+        int statsFrame = 0; // StatsSink frame, may differ from frameNumber
+
+        FrameQueries();
+        ~FrameQueries();
+        FrameQueries(const FrameQueries&) = delete;
+        FrameQueries & operator=(const FrameQueries&) = delete;
+    };
+
     // sampleCount must have been incremented first
     void addSample(double& accumulator, double dt, int sampleCount) noexcept;
     void gatherQueries() noexcept;
+    bool readFrameQueries(FrameQueries& frame) noexcept; // return false if not available yet
+    void beginPipelineStatistics(Timer& timer) noexcept;
+    void endPipelineStatistics(Timer& timer) noexcept;
+    void releaseTimers(FrameQueries& frame) noexcept;
+    bool isTracedFrame(int frameNumber) const noexcept { return frameNumber >= m_traceFirstFrame && frameNumber <= m_traceLastFrame; }
+    double traceMicroseconds(std::chrono::high_resolution_clock::time_point t) const noexcept;
+    double traceMicroseconds(GLuint64 gpuNanoseconds) const noexcept;
+    void writeTrace() noexcept;
     void initStats() noexcept;
-    void writeStats() noexcept;
+    // Send last values of stats to the stats sink, gpu ones being late
+    void recordStats(const std::string& name, Stats& stats, bool gpu, int statsFrame) noexcept;
+    // Same for counters from first to last (excluded)
+    void recordCounters(const std::string& name, Stats& stats, int first, int last, int statsFrame) noexcept;
+    void writePercentiles() noexcept;
 
 private:
     static std::shared_ptr<GlobalTimer> s_instance;
 
 private:
     Properties m_properties;
-    Timer m_frameTimer; // special timer global to the frame
+    std::chrono::high_resolution_clock::time_point m_frameStartTime;
     Stats m_frameStats;
-    std::set<Timer*> m_pool; // running timers
-    std::set<Timer*> m_stopped; // stopped timers of which queries are waiting to get read back
+    std::array<FrameQueries, FrameLatency> m_frames; // ring buffer
+    int m_currentFrame = 0; // in m_frames
+    int m_droppedFrames = 0; // overwritten before their queries were available
+    std::vector<std::unique_ptr<Timer>> m_timers; // all timers ever allocated
+    std::vector<Timer*> m_freeTimers; // neither running nor waiting for read back
+    std::vector<Timer*> m_runningTimers; // in start order
+    // Queries of a given type cannot nest, so only one timer at a time gets them
+    Timer* m_pipelineStatisticsTimer = nullptr;
+    std::array<bool, QueryCounterCount> m_supportedQueryCounters = {};
+    int m_frameNumber = 0;
     std::map<std::string, Stats> m_stats; // cumulated statistics
 
     // stats
     std::string m_outputStats;
-    std::ofstream m_outputStatsFile;
-    int m_statFrame = 0;
+    StatsSink::TableId m_statsTable = -1;
+    std::ofstream m_outputPercentilesFile;
+    int m_percentileWindow = 0;
+    int m_percentileWindowStart = 0; // first frame of the window
+
+    // trace capture
+    struct TraceEvent {
+        const std::string* name; // key of m_stats, or s_frameTraceName
+        double start; // in microseconds since m_traceCpuOrigin
+        double duration;
+        int frameNumber;
+        bool gpu;
+    };
+    std::string m_traceFile;
+    int m_traceFirstFrame = -1;
+    int m_traceLastFrame = -1;
+    std::vector<TraceEvent> m_traceEvents;
+    // GPU and CPU clocks measured at the same time
+    std::chrono::high_resolution_clock::time_point m_traceCpuOrigin;
+    GLint64 m_traceGpuOrigin = 0;
+    static const std::string s_frameTraceName;
 };
 
 REFL_TYPE(GlobalTimer::Properties)
 REFL_FIELD(showDiagram)
 REFL_FIELD(decay)
+REFL_FIELD(traceFrameCount, ReflectionAttributes::Range(1, 120))
+REFL_FIELD(pipelineStatistics)
 REFL_END
 
 class ScopedTimer {
@@ -44,4 +44,5 @@ public:
 	virtual const GlBuffer& vbo() const = 0;
 	virtual std::shared_ptr<GlBuffer> ebo() const { return nullptr; } // if null, then regular array is used as element buffer
 	virtual GLint pointOffset() const { return 0; } // offset in the ebo
+	virtual const GlBuffer* orientations() const { return nullptr; } // optional per point quaternions (snorm16x4), indexed like vbo
 };
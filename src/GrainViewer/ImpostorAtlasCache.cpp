@@ -0,0 +1,153 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+
+#include "ImpostorAtlasCache.h"
+#include "Logger.h"
+#include "ResourceManager.h"
+#include "ShaderPool.h"
+#include "ShaderPreprocessor.h"
+#include "utils/strutils.h"
+#include "utils/Hasher.h"
+
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr uint32_t CacheVersion = 2; // bump whenever the bake or the entry format changes
+
+bool readFile(const fs::path& path, std::string& content) {
+	std::ifstream in(path, std::ios::binary);
+	if (!in.is_open()) return false;
+	std::ostringstream ss;
+	ss << in.rdbuf();
+	content = ss.str();
+	return true;
+}
+
+// Missing dependencies are hashed by name so that the key changes when they appear
+void hashDependency(Hasher& hasher, const fs::path& path) {
+	std::string content;
+	if (readFile(path, content)) {
+		hasher.addString(content);
+	} else {
+		WARN_LOG << "Could not read impostor bake dependency " << path;
+		hasher.addString("missing:" + path.string());
+	}
+}
+
+// Texture statements of mtl files, in which the filename is the last token
+bool isMtlTextureStatement(const std::string& keyword) {
+	return startsWith(keyword, "map_") || keyword == "bump" || keyword == "norm" || keyword == "disp" || keyword == "refl";
+}
+
+void hashMtl(Hasher& hasher, const fs::path& mtlPath, const fs::path& textureRoot) {
+	std::string content;
+	if (!readFile(mtlPath, content)) {
+		WARN_LOG << "Could not read impostor bake dependency " << mtlPath;
+		hasher.addString("missing:" + mtlPath.string());
+		return;
+	}
+	hasher.addString(content);
+
+	std::istringstream ss(content);
+	std::string line;
+	while (std::getline(ss, line)) {
+		std::istringstream tokens(line);
+		std::string keyword, token, texname;
+		tokens >> keyword;
+		if (!isMtlTextureStatement(keyword)) continue;
+		while (tokens >> token) texname = token;
+		if (!texname.empty()) {
+			hashDependency(hasher, textureRoot / texname);
+		}
+	}
+}
+
+// Hash preprocessed sources, so that includes are taken into account
+void hashShader(Hasher& hasher, const std::string& shaderName) {
+	auto shader = ShaderPool::GetShader(shaderName);
+	if (!shader) return;
+	std::vector<std::string> defines(shader->getDefines().begin(), shader->getDefines().end());
+	for (const auto& path : ResourceManager::allShaderFullPaths(shader->shaderName())) {
+		if (!fs::is_regular_file(path)) continue;
+		ShaderPreprocessor preprocessor;
+		if (!preprocessor.load(path, defines)) continue;
+		std::vector<GLchar> source;
+		preprocessor.source(source);
+		hasher.add(source.data(), source.size());
+	}
+}
+
+} // namespace
+
+bool ImpostorAtlasCache::ComputeKey(Key& key, const std::string& meshFilename, int angularDefinition, int spatialDefinition)
+{
+	Hasher hasher;
+	hasher.addValue(CacheVersion);
+	hasher.addValue(angularDefinition);
+	hasher.addValue(spatialDefinition);
+
+	// Mesh, and the materials it references
+	std::string obj;
+	if (!readFile(meshFilename, obj)) {
+		ERR_LOG << "Could not read mesh file " << meshFilename;
+		return false;
+	}
+	hasher.addString(obj);
+
+	fs::path textureRoot = fs::absolute(meshFilename).parent_path(); // same as MeshDataBehavior
+	std::istringstream ss(obj);
+	std::string line;
+	while (std::getline(ss, line)) {
+		if (!startsWith(line, "mtllib")) continue;
+		std::istringstream tokens(line.substr(6));
+		std::string mtlName;
+		while (tokens >> mtlName) {
+			hashMtl(hasher, textureRoot / mtlName, textureRoot);
+		}
+	}
+
+	hashShader(hasher, "BakeImpostorAtlas");
+	hashShader(hasher, "BakeImpostorAtlas_Blit");
+
+	key = hasher.value();
+	return true;
+}
+
+std::string ImpostorAtlasCache::EntryPath(const std::string& directory, Key key)
+{
+	std::ostringstream ss;
+	ss << std::hex << std::setw(16) << std::setfill('0') << key << ".gvatlas";
+	return (fs::path(directory) / ss.str()).string();
+}
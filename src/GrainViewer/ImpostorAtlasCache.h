@@ -0,0 +1,57 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+/**
+ * Disk cache for baked impostor atlases, so that scenes with "bake": true do
+ * not re-render all the views at each startup. Entries are addressed by a
+ * hash of everything the bake depends on (obj file, its mtl files and
+ * textures, angular/spatial definitions and bake shader sources). Entries
+ * are atlas files (see ImpostorAtlasFile) holding the RGBA8 atlases with
+ * their full alpha-weighted mip chain, and the key in their header.
+ */
+class ImpostorAtlasCache {
+public:
+	typedef uint64_t Key;
+
+	/**
+	 * Compute the key of a bake. Return false if the mesh file cannot be read.
+	 */
+	static bool ComputeKey(Key & key, const std::string & meshFilename, int angularDefinition, int spatialDefinition);
+
+	/**
+	 * Path of the cache entry for a given key in a given cache directory
+	 */
+	static std::string EntryPath(const std::string & directory, Key key);
+};
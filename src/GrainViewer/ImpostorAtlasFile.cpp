@@ -0,0 +1,287 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+
+#include "ImpostorAtlasFile.h"
+#include "GlTexture.h"
+#include "Logger.h"
+#include "utils/MappedFile.h"
+#include "utils/textureCompression.h"
+
+#include <algorithm>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr char Magic[8] = { 'G', 'V', 'A', 'T', 'L', 'A', 'S', '\0' };
+constexpr uint32_t Version = 1;
+constexpr int MaxLevels = 16;
+constexpr int MaxNameLength = 32;
+constexpr uint64_t DataAlignment = 256;
+
+struct FileHeader {
+	char magic[8];
+	uint32_t version;
+	uint32_t textureCount;
+	uint64_t key;
+	uint64_t reserved;
+};
+static_assert(sizeof(FileHeader) == 32, "Atlas file header must not be padded");
+
+struct LevelRange {
+	uint64_t offset; // from the beginning of the file
+	uint64_t size;
+};
+
+struct TextureHeader {
+	char name[MaxNameLength]; // zero terminated
+	uint32_t internalFormat;
+	int32_t width;
+	int32_t height;
+	int32_t depth;
+	int32_t levels;
+	uint32_t reserved;
+	LevelRange levelRanges[MaxLevels];
+};
+static_assert(sizeof(TextureHeader) == 56 + MaxLevels * sizeof(LevelRange), "Atlas texture header must not be padded");
+
+uint64_t alignOffset(uint64_t offset) {
+	return (offset + DataAlignment - 1) / DataAlignment * DataAlignment;
+}
+
+// Size of a whole mip level, i.e. all layers
+size_t levelSize(GLenum internalFormat, int width, int height, int depth, int level) {
+	int w = std::max(width >> level, 1);
+	int h = std::max(height >> level, 1);
+	if (internalFormat == GL_RGBA8) {
+		return 4 * static_cast<size_t>(w) * static_cast<size_t>(h) * static_cast<size_t>(depth);
+	} else {
+		return compressedImageSize(internalFormat, w, h) * static_cast<size_t>(depth);
+	}
+}
+
+bool readHeader(const MappedFile& file, const std::string& filename, FileHeader& header) {
+	if (!file.isValid()) {
+		ERR_LOG << "Could not open atlas file " << filename;
+		return false;
+	}
+	if (file.size() < sizeof(FileHeader)) {
+		ERR_LOG << "Invalid atlas file " << filename << " (truncated header)";
+		return false;
+	}
+	std::memcpy(&header, file.data(), sizeof(FileHeader));
+	if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0) {
+		ERR_LOG << "Invalid atlas file " << filename << " (wrong magic number)";
+		return false;
+	}
+	if (header.version != Version) {
+		ERR_LOG << "Unsupported atlas file version " << header.version << " in " << filename << " (expected " << Version << ")";
+		return false;
+	}
+	return true;
+}
+
+} // namespace
+
+bool ImpostorAtlasFile::IsSupportedFormat(GLenum internalFormat)
+{
+	return internalFormat == GL_RGBA8 || isSupportedCompressedFormat(internalFormat);
+}
+
+bool ImpostorAtlasFile::Save(const std::string& filename, const TextureList& textures, uint64_t key)
+{
+	// 1. Build headers
+	FileHeader fileHeader;
+	std::memcpy(fileHeader.magic, Magic, sizeof(Magic));
+	fileHeader.version = Version;
+	fileHeader.textureCount = static_cast<uint32_t>(textures.size());
+	fileHeader.key = key;
+	fileHeader.reserved = 0;
+
+	std::vector<TextureHeader> textureHeaders(textures.size());
+	uint64_t offset = sizeof(FileHeader) + textures.size() * sizeof(TextureHeader);
+	for (size_t i = 0; i < textures.size(); ++i) {
+		const std::string& name = textures[i].first;
+		const GlTexture& texture = *textures[i].second;
+		TextureHeader& header = textureHeaders[i];
+		std::memset(&header, 0, sizeof(TextureHeader));
+
+		GLint internalFormat = 0;
+		glGetTextureLevelParameteriv(texture.raw(), 0, GL_TEXTURE_INTERNAL_FORMAT, &internalFormat);
+		if (texture.target() != GL_TEXTURE_2D_ARRAY || !IsSupportedFormat(static_cast<GLenum>(internalFormat))) {
+			ERR_LOG << "Texture '" << name << "' cannot be stored in an atlas file (only RGBA8, BC5 and BC7 texture arrays are supported)";
+			return false;
+		}
+		if (name.size() >= MaxNameLength || texture.levels() > MaxLevels) {
+			ERR_LOG << "Texture '" << name << "' cannot be stored in an atlas file (name too long or too many levels)";
+			return false;
+		}
+
+		std::memcpy(header.name, name.c_str(), name.size());
+		header.internalFormat = static_cast<uint32_t>(internalFormat);
+		header.width = texture.width();
+		header.height = texture.height();
+		header.depth = texture.depth();
+		header.levels = texture.levels();
+		for (int level = 0; level < header.levels; ++level) {
+			offset = alignOffset(offset);
+			header.levelRanges[level].offset = offset;
+			header.levelRanges[level].size = levelSize(header.internalFormat, header.width, header.height, header.depth, level);
+			offset += header.levelRanges[level].size;
+		}
+	}
+
+	// 2. Write, to a temporary file first so that an interrupted save never leaves a truncated atlas
+	fs::path path(filename);
+	if (path.has_parent_path()) {
+		fs::create_directories(path.parent_path());
+	}
+	std::string tmpFilename = filename + ".tmp";
+	{
+		std::ofstream out(tmpFilename, std::ios::binary);
+		if (!out.is_open()) {
+			ERR_LOG << "Could not open atlas file " << tmpFilename << " for writing";
+			return false;
+		}
+
+		out.write(reinterpret_cast<const char*>(&fileHeader), sizeof(FileHeader));
+		out.write(reinterpret_cast<const char*>(textureHeaders.data()), textureHeaders.size() * sizeof(TextureHeader));
+
+		std::vector<uint8_t> data;
+		const char zeros[DataAlignment] = { 0 };
+		for (size_t i = 0; i < textures.size(); ++i) {
+			const GlTexture& texture = *textures[i].second;
+			const TextureHeader& header = textureHeaders[i];
+			for (int level = 0; level < header.levels; ++level) {
+				const LevelRange& range = header.levelRanges[level];
+				out.write(zeros, range.offset - static_cast<uint64_t>(out.tellp()));
+				data.resize(range.size);
+				if (header.internalFormat == GL_RGBA8) {
+					glGetTextureImage(texture.raw(), level, GL_RGBA, GL_UNSIGNED_BYTE, static_cast<GLsizei>(data.size()), data.data());
+				} else {
+					glGetCompressedTextureImage(texture.raw(), level, static_cast<GLsizei>(data.size()), data.data());
+				}
+				out.write(reinterpret_cast<const char*>(data.data()), data.size());
+			}
+		}
+
+		if (!out) {
+			ERR_LOG << "Could not write atlas file " << tmpFilename;
+			return false;
+		}
+	}
+
+	// rename() does not replace an existing file on Windows, so remove it first
+	std::error_code err;
+	fs::remove(filename, err);
+	fs::rename(tmpFilename, filename, err);
+	if (err) {
+		ERR_LOG << "Could not write atlas file " << filename << ": " << err.message();
+		fs::remove(tmpFilename, err);
+		return false;
+	}
+
+	LOG << "Saved " << textures.size() << " atlas textures to " << filename << " (" << (offset >> 10) << " kB)";
+	return true;
+}
+
+bool ImpostorAtlasFile::Load(const std::string& filename, TextureMap& textures)
+{
+	MappedFile file(filename);
+	FileHeader fileHeader;
+	if (!readHeader(file, filename, fileHeader)) {
+		return false;
+	}
+
+	uint64_t headersEnd = sizeof(FileHeader) + static_cast<uint64_t>(fileHeader.textureCount) * sizeof(TextureHeader);
+	if (file.size() < headersEnd) {
+		ERR_LOG << "Invalid atlas file " << filename << " (truncated header)";
+		return false;
+	}
+
+	// Check everything before creating any texture
+	std::vector<TextureHeader> textureHeaders(fileHeader.textureCount);
+	std::memcpy(textureHeaders.data(), file.data() + sizeof(FileHeader), textureHeaders.size() * sizeof(TextureHeader));
+	for (TextureHeader& header : textureHeaders) {
+		header.name[MaxNameLength - 1] = '\0';
+		bool valid =
+			IsSupportedFormat(static_cast<GLenum>(header.internalFormat))
+			&& header.width > 0 && header.height > 0 && header.depth > 0
+			&& header.levels > 0 && header.levels <= MaxLevels;
+		for (int level = 0; valid && level < header.levels; ++level) {
+			const LevelRange& range = header.levelRanges[level];
+			valid = range.size == levelSize(header.internalFormat, header.width, header.height, header.depth, level)
+				&& range.offset >= headersEnd && range.offset <= file.size() && range.size <= file.size() - range.offset;
+		}
+		if (!valid) {
+			ERR_LOG << "Invalid atlas file " << filename << " (corrupted texture '" << header.name << "')";
+			return false;
+		}
+	}
+
+	// Upload, one call per level
+	for (const TextureHeader& header : textureHeaders) {
+		GLenum internalFormat = static_cast<GLenum>(header.internalFormat);
+		auto texture = std::make_unique<GlTexture>(GL_TEXTURE_2D_ARRAY);
+		texture->setWrapMode(GL_CLAMP_TO_EDGE);
+		texture->storage(header.levels, internalFormat, header.width, header.height, header.depth);
+		for (int level = 0; level < header.levels; ++level) {
+			const LevelRange& range = header.levelRanges[level];
+			GLsizei width = std::max(header.width >> level, 1);
+			GLsizei height = std::max(header.height >> level, 1);
+			const uint8_t* data = file.data() + range.offset;
+			if (internalFormat == GL_RGBA8) {
+				texture->subImage(level, 0, 0, 0, width, height, header.depth, GL_RGBA, GL_UNSIGNED_BYTE, data);
+			} else {
+				texture->compressedSubImage(level, 0, 0, 0, width, height, header.depth, internalFormat, static_cast<GLsizei>(range.size), data);
+			}
+		}
+		textures[header.name] = std::move(texture);
+	}
+
+	DEBUG_LOG << "Loaded " << textureHeaders.size() << " atlas textures from " << filename;
+	return true;
+}
+
+bool ImpostorAtlasFile::ReadKey(const std::string& filename, uint64_t& key)
+{
+	std::ifstream in(filename, std::ios::binary);
+	FileHeader header;
+	if (!in.is_open() || !in.read(reinterpret_cast<char*>(&header), sizeof(FileHeader))) {
+		return false;
+	}
+	if (std::memcmp(header.magic, Magic, sizeof(Magic)) != 0 || header.version != Version) {
+		return false;
+	}
+	key = header.key;
+	return true;
+}
@@ -0,0 +1,83 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+
+#pragma once
+
+#include <OpenGL>
+
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+class GlTexture;
+
+/**
+ * Single file container for impostor atlases, as an alternative to
+ * directories of one image per view. It holds several named texture arrays
+ * with all their mip levels precomputed, either RGBA8 or block compressed
+ * (BC7/BC5, see utils/textureCompression.h).
+ *
+ * Layout (little endian, no padding between fields):
+ *   FileHeader
+ *   TextureHeader[textureCount]
+ *   level data, each level of each texture starting on a DataAlignment boundary
+ * Levels are stored exactly as glTextureSubImage3D/glCompressedTextureSubImage3D
+ * expect them, so that a memory mapped file is uploaded with one call per level.
+ */
+class ImpostorAtlasFile {
+public:
+	typedef std::map<std::string, std::unique_ptr<GlTexture>> TextureMap;
+	typedef std::vector<std::pair<std::string, const GlTexture*>> TextureList;
+
+	/**
+	 * Write texture arrays to a file. The key is an arbitrary value stored in
+	 * the header, used by ImpostorAtlasCache to check entries.
+	 */
+	static bool Save(const std::string & filename, const TextureList & textures, uint64_t key = 0);
+
+	/**
+	 * Load all textures of a file. Existing entries of 'textures' with the
+	 * same names are replaced.
+	 */
+	static bool Load(const std::string & filename, TextureMap & textures);
+
+	/**
+	 * Only read the key stored in the header
+	 */
+	static bool ReadKey(const std::string & filename, uint64_t & key);
+
+	/**
+	 * Tell whether a texture format can be stored in the container
+	 */
+	static bool IsSupportedFormat(GLenum internalFormat);
+};
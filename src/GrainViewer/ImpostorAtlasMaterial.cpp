@@ -28,6 +28,8 @@
  */
 
 #include "ImpostorAtlasMaterial.h"
+#include "ImpostorAtlasCache.h"
+#include "ImpostorAtlasFile.h"
 #include "ShaderProgram.h"
 #include "utils/jsonutils.h"
 #include "utils/fileutils.h"
@@ -48,6 +50,9 @@ bool ImpostorAtlasMaterial::deserialize(const rapidjson::Value& json)
 	bool roughnessOverriden = jrOption(json, "roughness", roughness, roughness);
 
 	jrOption(json, "bake", bake, bake);
+	jrOption(json, "compress", compress, compress);
+	jrOption(json, "compressionMinPsnr", compressionMinPsnr, compressionMinPsnr);
+	std::string atlas;
 	if (bake) {
 		std::string filename;
 		if (!jrOption(json, "filename", filename, filename)) {
@@ -58,26 +63,32 @@ bool ImpostorAtlasMaterial::deserialize(const rapidjson::Value& json)
 		jrOption(json, "spatialDefinition", spatialDefinition, spatialDefinition);
 		viewCount = static_cast<GLuint>(sqrt(angularDefinition / 2));
 		angularDefinition = static_cast<int>(2 * viewCount * viewCount);
-
-		DEBUG_LOG << "Loading object '" << filename << "' for backing...";
-		MeshDataBehavior mesh;
-		{
-			using namespace rapidjson;
-			Document d(kObjectType);
-			Value meshOpt(kObjectType);
-
-			Value filenameValue;
-			filenameValue.SetString(filename.c_str(), d.GetAllocator());
-			meshOpt.AddMember("filename", filenameValue, d.GetAllocator());
-
-			Value boundingValue;
-			boundingValue.SetBool(true);
-			meshOpt.AddMember("computeBoundingSphere", boundingValue, d.GetAllocator());
-
-			mesh.deserialize(meshOpt);
+		jrOption(json, "cache", cache, cache);
+		jrOption(json, "cacheDirectory", cacheDirectory, cacheDirectory);
+
+		if (!cache || !loadCachedMaps(filename)) {
+			DEBUG_LOG << "Loading object '" << filename << "' for backing...";
+			MeshDataBehavior mesh;
+			{
+				using namespace rapidjson;
+				Document d(kObjectType);
+				Value meshOpt(kObjectType);
+
+				Value filenameValue;
+				filenameValue.SetString(filename.c_str(), d.GetAllocator());
+				meshOpt.AddMember("filename", filenameValue, d.GetAllocator());
+
+				Value boundingValue;
+				boundingValue.SetBool(true);
+				meshOpt.AddMember("computeBoundingSphere", boundingValue, d.GetAllocator());
+
+				mesh.deserialize(meshOpt);
+			}
+			mesh.start();
+			bakeMaps(mesh, mesh.boundingSphereRadius(), mesh.boundingSphereCenter());
+			mipmapMaps();
+			saveCachedMaps();
 		}
-		mesh.start();
-		bakeMaps(mesh, mesh.boundingSphereRadius(), mesh.boundingSphereCenter());
 
 		bool save = false;
 		jrOption(json, "save", save, save);
@@ -93,6 +104,12 @@ bool ImpostorAtlasMaterial::deserialize(const rapidjson::Value& json)
 #undef writeAtlas
 		}
 	}
+	else if (jrOption(json, "atlas", atlas)) {
+		// Single file atlas, already mipmapped
+		if (!loadAtlasFile(ResourceManager::resolveResourcePath(atlas))) {
+			return false;
+		}
+	}
 	else {
 #define readAtlas(name) \
 		std::string name; \
@@ -103,22 +120,29 @@ bool ImpostorAtlasMaterial::deserialize(const rapidjson::Value& json)
 		readAtlas(baseColor);
 		readAtlas(metallicRoughness);
 #undef readAtlas
+		mipmapMaps();
 	}
 
+	if (!normalAlphaTexture) {
+		ERR_LOG << "Impostor atlas has no normalAlpha map";
+		return false;
+	}
 	GLuint n = normalAlphaTexture->depth();
 	viewCount = static_cast<GLuint>(sqrt(n / 2));
 
-	if (baseColorTexture && normalAlphaTexture) {
-		Filtering::MipMapUsingAlpha(*baseColorTexture, *normalAlphaTexture);
+	if (compress) {
+		compressMaps();
 	}
-	if (metallicRoughnessTexture && normalAlphaTexture) {
-		Filtering::MipMapUsingAlpha(*metallicRoughnessTexture, *normalAlphaTexture);
+
+	std::string saveAtlas;
+	if (jrOption(json, "saveAtlas", saveAtlas)) {
+		ImpostorAtlasFile::Save(ResourceManager::resolveResourcePath(saveAtlas), atlasTextures());
 	}
 
 	return true;
 }
 
-GLint ImpostorAtlasMaterial::setUniforms(const ShaderProgram& shader, const std::string& prefix, GLint nextTextureUnit) const
+GLint ImpostorAtlasMaterial::setUniforms(const ShaderProgram& shader, const UniformName& prefix, GLint nextTextureUnit) const
 {
 	GLint o = nextTextureUnit;
 
@@ -146,6 +170,84 @@ GLint ImpostorAtlasMaterial::setUniforms(const ShaderProgram& shader, const std:
 }
 
 
+void ImpostorAtlasMaterial::mipmapMaps()
+{
+	if (baseColorTexture && normalAlphaTexture) {
+		Filtering::MipMapUsingAlpha(*baseColorTexture, *normalAlphaTexture);
+	}
+	if (metallicRoughnessTexture && normalAlphaTexture) {
+		Filtering::MipMapUsingAlpha(*metallicRoughnessTexture, *normalAlphaTexture);
+	}
+}
+
+bool ImpostorAtlasMaterial::loadCachedMaps(const std::string& meshFilename)
+{
+	m_cacheEntry.clear();
+	std::string fullMeshFilename = ResourceManager::resolveResourcePath(meshFilename);
+	if (!ImpostorAtlasCache::ComputeKey(m_cacheKey, fullMeshFilename, angularDefinition, spatialDefinition)) {
+		return false;
+	}
+	m_cacheEntry = ImpostorAtlasCache::EntryPath(ResourceManager::resolveResourcePath(cacheDirectory), m_cacheKey);
+
+	ImpostorAtlasCache::Key storedKey;
+	if (!ImpostorAtlasFile::ReadKey(m_cacheEntry, storedKey) || storedKey != m_cacheKey || !loadAtlasFile(m_cacheEntry)) {
+		LOG << "Impostor atlas cache miss for '" << meshFilename << "', baking (entry: " << m_cacheEntry << ")";
+		return false;
+	}
+
+	LOG << "Impostor atlas cache hit for '" << meshFilename << "', skipping bake (entry: " << m_cacheEntry << ")";
+	return true;
+}
+
+void ImpostorAtlasMaterial::saveCachedMaps() const
+{
+	if (m_cacheEntry.empty()) return;
+	if (ImpostorAtlasFile::Save(m_cacheEntry, atlasTextures(), m_cacheKey)) {
+		LOG << "Stored baked impostor atlas in cache (entry: " << m_cacheEntry << ")";
+	}
+}
+
+bool ImpostorAtlasMaterial::loadAtlasFile(const std::string& filename)
+{
+	ImpostorAtlasFile::TextureMap textures;
+	if (!ImpostorAtlasFile::Load(filename, textures)) {
+		return false;
+	}
+	normalAlphaTexture = std::move(textures["normalAlpha"]);
+	baseColorTexture = std::move(textures["baseColor"]);
+	metallicRoughnessTexture = std::move(textures["metallicRoughness"]);
+	return true;
+}
+
+ImpostorAtlasFile::TextureList ImpostorAtlasMaterial::atlasTextures() const
+{
+	ImpostorAtlasFile::TextureList textures;
+	if (normalAlphaTexture) textures.push_back({ "normalAlpha", normalAlphaTexture.get() });
+	if (baseColorTexture) textures.push_back({ "baseColor", baseColorTexture.get() });
+	if (metallicRoughnessTexture) textures.push_back({ "metallicRoughness", metallicRoughnessTexture.get() });
+	return textures;
+}
+
+void ImpostorAtlasMaterial::compressMaps()
+{
+	// metallicRoughness only uses two channels
+	struct { std::unique_ptr<GlTexture>& texture; GLenum format; bool normals; const char* name; } maps[] = {
+		{ normalAlphaTexture, GL_COMPRESSED_RGBA_BPTC_UNORM, true, "normalAlpha" },
+		{ baseColorTexture, GL_COMPRESSED_RGBA_BPTC_UNORM, false, "baseColor" },
+		{ metallicRoughnessTexture, GL_COMPRESSED_RG_RGTC2, false, "metallicRoughness" },
+	};
+	for (auto& map : maps) {
+		if (!map.texture) continue;
+		GLint isCompressed = GL_FALSE;
+		glGetTextureLevelParameteriv(map.texture->raw(), 0, GL_TEXTURE_COMPRESSED, &isCompressed);
+		if (isCompressed) continue; // e.g. loaded from a compressed atlas file
+		LOG << "Compressing " << map.name << " atlas...";
+		if (auto compressed = ResourceManager::compressTexture(*map.texture, map.format, map.normals, compressionMinPsnr)) {
+			map.texture = std::move(compressed);
+		}
+	}
+}
+
 static std::unique_ptr<GlTexture> initTexture(GLsizei width, GLsizei depth, GLsizei levels, GLenum internalformat = GL_RGBA8)
 {
 	auto texture = std::make_unique<GlTexture>(GL_TEXTURE_2D_ARRAY);
@@ -205,7 +307,7 @@ void ImpostorAtlasMaterial::bakeMaps(const MeshDataBehavior & mesh, float scale,
 	int n = static_cast<int>(mesh.materials().size());
 	for (int i = 0; i < n; ++i) {
 		const StandardMaterial& mat = mesh.materials()[i];
-		o = mat.setUniforms(shader, MAKE_STR("uMaterial[" << i << "]."), o);
+		o = mat.setUniforms(shader, UniformName("uMaterial")[i], o);
 	}
 
 	blitShader.setUniform("uMultiplier", 1.0f / static_cast<float>(msaa * msaa));
@@ -232,7 +334,11 @@ void ImpostorAtlasMaterial::bakeMaps(const MeshDataBehavior & mesh, float scale,
 			glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
 
 			glBindVertexArray(mesh.vao());
-			glDrawArraysInstanced(GL_TRIANGLES, 0, mesh.pointCount(), angularDefinition);
+			if (mesh.isIndexed()) {
+				glDrawElementsInstanced(GL_TRIANGLES, mesh.indexCount(), GL_UNSIGNED_INT, nullptr, angularDefinition);
+			} else {
+				glDrawArraysInstanced(GL_TRIANGLES, 0, mesh.pointCount(), angularDefinition);
+			}
 			glBindVertexArray(0);
 
 			fbo.bind();
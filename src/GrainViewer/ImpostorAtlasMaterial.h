@@ -31,6 +31,9 @@
 
 #include <OpenGL>
 #include "GlTexture.h"
+#include "ImpostorAtlasCache.h"
+#include "ImpostorAtlasFile.h"
+#include "UniformName.h"
 
 #include <glm/glm.hpp>
 #include <rapidjson/document.h>
@@ -60,10 +63,30 @@ struct ImpostorAtlasMaterial
 	// in this case, the following options are used:
 	int angularDefinition = 128; // rounded to the closest number such that 2n�
 	int spatialDefinition = 128; // number of pixels on each dimension of a precomputed view
+	// Baked (and mipmapped) atlases are stored in cacheDirectory, and loaded
+	// back instead of baking if none of the bake inputs changed.
+	bool cache = true;
+	std::string cacheDirectory = "Impostors/cache";
+
+	// If 'compress' is true, atlases are block compressed on CPU after mipmapping
+	// (BC7 for normalAlpha and baseColor, BC5 for metallicRoughness), unless
+	// the PSNR of the compressed maps falls below compressionMinPsnr.
+	bool compress = false;
+	float compressionMinPsnr = 35.0f;
 
 	bool deserialize(const rapidjson::Value& json);
-	GLint setUniforms(const ShaderProgram& shader, const std::string& prefix, GLint nextTextureUnit) const;
+	GLint setUniforms(const ShaderProgram& shader, const UniformName& prefix, GLint nextTextureUnit) const;
 
 private:
 	void bakeMaps(const MeshDataBehavior& mesh, float radius, glm::vec3 center);
+	void mipmapMaps();
+	bool loadCachedMaps(const std::string& meshFilename);
+	void saveCachedMaps() const;
+	bool loadAtlasFile(const std::string& filename);
+	ImpostorAtlasFile::TextureList atlasTextures() const;
+	void compressMaps();
+
+private:
+	std::string m_cacheEntry; // empty if the cache is not used
+	ImpostorAtlasCache::Key m_cacheKey = 0;
 };
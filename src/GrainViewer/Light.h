@@ -48,6 +48,13 @@ public:
 	inline const glm::vec3 & color() const { return m_lightColor; }
 	inline glm::vec3 & color() { return m_lightColor; }
 
+	/**
+	 * Distance beyond which the light has no effect, used for light culling.
+	 * 0 means unbounded (no falloff at all).
+	 */
+	inline float radius() const { return m_radius; }
+	inline void setRadius(float radius) { m_radius = radius; }
+
 	inline bool isRich() const { return m_isRich; }
 
 	inline bool hasShadowMap() const { return m_hasShadowMap; }
@@ -62,6 +69,7 @@ protected:
 	glm::vec3 m_lightPosition;
 	glm::vec3 m_lookAt;
 	glm::vec3 m_lightColor;
+	float m_radius = 0.0f;
 	std::unique_ptr<ShadowMap> m_shadowMap;
 	bool m_isRich;
 	bool m_hasShadowMap;
@@ -93,6 +93,37 @@ bool PointCloud::loadBin(const std::string & filename) {
 	return true;
 }
 
+bool PointCloud::loadOrientationsBin(const std::string & filename) {
+	std::ifstream in(filename, std::ios::binary);
+	if (!in.is_open()) {
+		ERR_LOG << filename << " is not a valid file.";
+		return false;
+	}
+
+	float header[2];
+	if (!in.read(reinterpret_cast<char*>(header), 2 * sizeof(float))) {
+		ERR_LOG << "Could not read orientation buffer from file: " << filename;
+		return false;
+	}
+	size_t point_count = static_cast<size_t>(header[0]);
+	size_t frame_count = static_cast<size_t>(header[1]);
+	size_t size = point_count * frame_count;
+	if (size != m_data.size()) {
+		ERR_LOG << "Orientation count (" << size << ") does not match point count (" << m_data.size() << ") in file: " << filename;
+		return false;
+	}
+
+	m_orientations.resize(size);
+	if (!in.read(reinterpret_cast<char*>(m_orientations.data()), size * sizeof(float) * 4)) {
+		ERR_LOG << "Could not read orientation buffer from file: " << filename;
+		m_orientations.clear();
+		return false;
+	}
+
+	LOG << "Loaded " << size << " orientations from " << filename;
+	return true;
+}
+
 #define READ(in, value) in.read(reinterpret_cast<char*>(&(value)), sizeof(value) / sizeof(char))
 
 bool PointCloud::loadMomentRaw(const std::string & filename, float threshold)
@@ -57,11 +57,19 @@ public:
 
 	bool saveBin(const std::string & filename);
 
+	// Load per point orientations, as quaternions (x, y, z, w), from a file
+	// with the same ad-hoc layout as the Bin codec. Must match point count.
+	bool loadOrientationsBin(const std::string & filename);
+
 	size_t frameCount() const { return m_frame_count; }
 	const std::vector<glm::vec3> & data() const { return m_data; }
 	std::vector<glm::vec3> & data() { return m_data; }
+	bool hasOrientations() const { return !m_orientations.empty(); }
+	const std::vector<glm::vec4> & orientations() const { return m_orientations; }
+	std::vector<glm::vec4> & orientations() { return m_orientations; }
 
 private:
 	std::vector<glm::vec3> m_data;
+	std::vector<glm::vec4> m_orientations;
 	size_t m_frame_count = 1;
 };
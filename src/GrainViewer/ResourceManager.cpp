@@ -33,6 +33,8 @@
 #include "EnvironmentVariables.h"
 #include "utils/strutils.h"
 #include "utils/fileutils.h"
+#include "utils/textureCompression.h"
+#include "utils/ThreadPool.h"
 #include "GlTexture.h"
 #include "Logger.h"
 
@@ -41,7 +43,9 @@
 #include <stb_image_write.h>
 #include <tinyexr.h>
 
+#include <chrono>
 #include <cmath>
+#include <cstring>
 #include <fstream>
 #include <algorithm>
 #include <filesystem>
@@ -141,6 +145,8 @@ std::unique_ptr<GlTexture> ResourceManager::loadTexture(const std::string & file
 }
 
 std::unique_ptr<GlTexture> ResourceManager::loadTextureStack(const string & textureDirectory, int levels) {
+	using clock = std::chrono::high_resolution_clock;
+	auto startTime = clock::now();
 	vector<fs::path> textureFilenames;
 
 	std::string fullTextureDirectory = ResourceManager::resolveResourcePath(textureDirectory);
@@ -194,17 +200,110 @@ std::unique_ptr<GlTexture> ResourceManager::loadTextureStack(const string & text
 	tex->storage(levels, GL_RGBA8, width, height, stackSize);
 
 	// Read all layers
-	for (size_t i = 0; i < textureFilenames.size(); ++i) {
-		if (!ResourceManager::loadTextureSubData(*tex, textureFilenames[i], static_cast<GLint>(i), width, height)) {
-			return nullptr;
+	bool hasExr = any_of(textureFilenames.begin(), textureFilenames.end(), [](const fs::path& p) { return p.extension() == ".exr"; });
+	double decodeTime = 0;
+	size_t threadCount = 1;
+	if (hasExr) {
+		// (EXR stacks are rare, keep them sequential)
+		for (size_t i = 0; i < textureFilenames.size(); ++i) {
+			if (!ResourceManager::loadTextureSubData(*tex, textureFilenames[i], static_cast<GLint>(i), width, height)) {
+				return nullptr;
+			}
+		}
+	}
+	else {
+		// Decode all layers concurrently into a single staging buffer, then upload it at once
+		size_t layerSize = 4 * static_cast<size_t>(width) * static_cast<size_t>(height);
+		vector<unsigned char> staging(layerSize * textureFilenames.size());
+		vector<string> errors(textureFilenames.size());
+		auto decodeStartTime = clock::now();
+		ThreadPool& pool = ThreadPool::Shared();
+		threadCount = pool.threadCount();
+		pool.parallelFor(textureFilenames.size(), [&](size_t i) {
+			decodeImageSOIL(textureFilenames[i], width, height, staging.data() + i * layerSize, errors[i]);
+		});
+		decodeTime = std::chrono::duration<double, std::milli>(clock::now() - decodeStartTime).count();
+
+		for (size_t i = 0; i < errors.size(); ++i) {
+			if (!errors[i].empty()) {
+				ERR_LOG << "Could not load slice #" << (i + 1) << " of texture stack: " << errors[i];
+				return nullptr;
+			}
 		}
+		tex->subImage(0, 0, 0, 0, width, height, stackSize, GL_RGBA, GL_UNSIGNED_BYTE, staging.data());
 	}
 
 	tex->generateMipmap();
 
+	double totalTime = std::chrono::duration<double, std::milli>(clock::now() - startTime).count();
+	if (hasExr) {
+		LOG << "Loaded texture stack " << textureDirectory << " (" << stackSize << " layers) in " << totalTime << " ms";
+	} else {
+		LOG << "Loaded texture stack " << textureDirectory << " (" << stackSize << " layers) in " << totalTime << " ms"
+			<< " (decoding: " << decodeTime << " ms on " << threadCount << " threads)";
+	}
+
 	return tex;
 }
 
+std::unique_ptr<GlTexture> ResourceManager::compressTexture(const GlTexture & texture, GLenum compressedFormat, bool normals, double minPsnr) {
+	if (!isSupportedCompressedFormat(compressedFormat)) {
+		ERR_LOG << "Unsupported compressed texture format: " << compressedFormat;
+		return nullptr;
+	}
+
+	if (texture.target() != GL_TEXTURE_2D_ARRAY) {
+		ERR_LOG << "Only texture arrays can be compressed";
+		return nullptr;
+	}
+
+	GLsizei depth = texture.depth();
+	auto compressed = std::make_unique<GlTexture>(GL_TEXTURE_2D_ARRAY);
+	compressed->setWrapMode(GL_CLAMP_TO_EDGE);
+	compressed->storage(texture.levels(), compressedFormat, texture.width(), texture.height(), depth);
+
+	glPixelStorei(GL_PACK_ALIGNMENT, 1);
+	size_t uncompressedSize = 0, compressedSize = 0;
+	std::vector<uint8_t> pixels, blocks, decoded;
+	for (GLint level = 0; level < texture.levels(); ++level) {
+		int width = std::max(texture.width() >> level, 1);
+		int height = std::max(texture.height() >> level, 1);
+		size_t layerPixelsSize = 4 * static_cast<size_t>(width) * height;
+		size_t layerBlocksSize = compressedImageSize(compressedFormat, width, height);
+		pixels.resize(layerPixelsSize * depth);
+		blocks.resize(layerBlocksSize * depth);
+		glGetTextureImage(texture.raw(), level, GL_RGBA, GL_UNSIGNED_BYTE, static_cast<GLsizei>(pixels.size()), pixels.data());
+
+		for (GLsizei layer = 0; layer < depth; ++layer) {
+			compressImage(compressedFormat, pixels.data() + layer * layerPixelsSize, width, height, blocks.data() + layer * layerBlocksSize);
+		}
+
+		// Image diff check, on the first level only (layers are contiguous, so they are compared as one tall image)
+		if (level == 0) {
+			decoded.resize(pixels.size());
+			for (GLsizei layer = 0; layer < depth; ++layer) {
+				decompressImage(compressedFormat, blocks.data() + layer * layerBlocksSize, width, height, decoded.data() + layer * layerPixelsSize);
+			}
+			int channels = compressedFormat == GL_COMPRESSED_RG_RGTC2 ? 2 : 4;
+			ImageDiff diff = diffImages(pixels.data(), decoded.data(), width, height * depth, channels, normals);
+			LOG << "Compression error: PSNR = " << diff.psnr << " dB, max error = " << diff.maxError;
+			if (normals) {
+				LOG << "Compression normal error: mean = " << diff.meanNormalAngle << " deg, max = " << diff.maxNormalAngle << " deg";
+			}
+			if (diff.psnr < minPsnr) {
+				WARN_LOG << "Compression PSNR is lower than the threshold of " << minPsnr << " dB, compression is skipped";
+				return nullptr;
+			}
+		}
+
+		compressed->compressedSubImage(level, 0, 0, 0, width, height, depth, compressedFormat, static_cast<GLsizei>(blocks.size()), blocks.data());
+		uncompressedSize += pixels.size();
+		compressedSize += blocks.size();
+	}
+
+	LOG << "Compressed texture from " << (uncompressedSize >> 10) << " kB to " << (compressedSize >> 10) << " kB";
+	return compressed;
+}
 
 bool ResourceManager::imageDimensions(const fs::path & filepath, int & width, int & height, Rotation rotation) {
 	if (filepath.extension() == ".exr") {
@@ -586,15 +685,13 @@ std::unique_ptr<GlTexture> ResourceManager::loadTextureTinyExr(const fs::path &
 }
 
 bool ResourceManager::imageDimensionsSOIL(const fs::path & filepath, int & width, int & height, Rotation rotation) {
-	unsigned char *image = NULL;
+	// Only read the header
 	int channels;
-	image = stbi_load(filepath.string().c_str(), &width, &height, &channels, 0);
-	if (NULL == image) {
-		WARN_LOG << "Unable to load texture file: '" << filepath << "' with stb_image: " << stbi_failure_reason();
+	if (!stbi_info(filepath.string().c_str(), &width, &height, &channels)) {
+		WARN_LOG << "Unable to read texture file header: '" << filepath << "' with stb_image: " << stbi_failure_reason();
 		return false;
 	}
 	else {
-		stbi_image_free(image);
 		if (rotation == ROTATION0 || rotation == ROTATION270) {
 			int tmp = width;
 			width = height;
@@ -627,6 +724,28 @@ bool ResourceManager::imageDimensionsTinyExr(const fs::path & filepath, int & wi
 }
 
 
+bool ResourceManager::decodeImageSOIL(const fs::path & filepath, GLsizei width, GLsizei height, unsigned char *pixels, std::string & error) {
+	int imageWidth = 0, imageHeight = 0, channels;
+	unsigned char *image = stbi_load(filepath.string().c_str(), &imageWidth, &imageHeight, &channels, 4);
+	if (NULL == image) {
+		// (stb_image's failure reason is a global, it may come from another thread)
+		error = MAKE_STR("Unable to load texture file: " << filepath << " with stb_image: " << stbi_failure_reason());
+		return false;
+	}
+
+	if (imageWidth != width || imageHeight != height) {
+		error = MAKE_STR("texture array slices must all have the same dimensions, "
+			<< filepath << " has dimensions " << imageWidth << "x" << imageHeight
+			<< " but " << width << "x" << height << " was expected");
+		stbi_image_free(image);
+		return false;
+	}
+
+	memcpy(pixels, image, 4 * static_cast<size_t>(width) * static_cast<size_t>(height));
+	stbi_image_free(image);
+	return true;
+}
+
 bool ResourceManager::loadTextureSubDataSOIL(GlTexture & texture, const fs::path & filepath, GLint zoffset, GLsizei width, GLsizei height, Rotation rotation) {
 	int imageWidth = 0, imageHeight = 0, channels;
 	unsigned char *image = stbi_load(filepath.string().c_str(), &imageWidth, &imageHeight, &channels, 4);
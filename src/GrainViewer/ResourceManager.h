@@ -90,6 +90,16 @@ public:
 	 */
 	static std::unique_ptr<GlTexture> loadTextureStack(const std::string & textureDirectory, int levels = 0);
 
+	/**
+	 * Build a block compressed copy of a RGBA8 texture array (typically a stack
+	 * loaded by loadTextureStack and already mipmapped), encoded on CPU.
+	 * Level 0 is decoded back and compared to the original. If its PSNR is
+	 * lower than minPsnr (in dB), nullptr is returned and the caller should
+	 * keep the uncompressed texture. Set 'normals' to log angular error.
+	 * Supported formats are listed in utils/textureCompression.h
+	 */
+	static std::unique_ptr<GlTexture> compressTexture(const GlTexture & texture, GLenum compressedFormat, bool normals = false, double minPsnr = 0.0);
+
 	/**
 	 * Get the width and height of an image
 	 */
@@ -123,6 +133,11 @@ private:
 	static bool imageDimensionsSOIL(const fs::path & filepath, int & width, int & height, Rotation rotation = ROTATION0);
 	static bool imageDimensionsTinyExr(const fs::path & filepath, int & width, int & height, Rotation rotation = ROTATION0);
 
+	/**
+	 * Decode an image into a tightly packed RGBA8 buffer of the expected size.
+	 * Does not touch OpenGL nor log, so that it can be called from worker threads.
+	 */
+	static bool decodeImageSOIL(const fs::path & filepath, GLsizei width, GLsizei height, unsigned char *pixels, std::string & error);
 	static bool loadTextureSubDataSOIL(GlTexture & texture, const fs::path & filepath, GLint zoffset, GLsizei refWidth, GLsizei refHeight, Rotation rotation = ROTATION0);
 	static bool loadTextureSubDataTinyExr(GlTexture & texture, const fs::path & filepath, GLint zoffset, GLsizei refWidth, GLsizei refHeight, Rotation rotation = ROTATION0);
 
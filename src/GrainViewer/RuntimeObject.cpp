@@ -53,6 +53,14 @@ void RuntimeObject::reloadShaders()
 	}
 }
 
+void RuntimeObject::warmUpShaders()
+{
+	// (disabled behaviors too, they can be enabled from the UI)
+	forEachBehavior {
+		b->warmUpShaders();
+	}
+}
+
 void RuntimeObject::update(float time, int frame)
 {
 	forEachBehavior {
@@ -48,6 +48,7 @@ public:
 
 	void start();
 	void reloadShaders();
+	void warmUpShaders();
 	void update(float time, int frame);
 	void render(const Camera & camera, const World & world, RenderType target) const;
 	void onPreRender(const Camera& camera, const World& world, RenderType target);
@@ -106,6 +106,9 @@ void Scene::update(float time) {
 
 	m_world->update(m_time);
 
+	ShaderPool::PollWarmUp();
+	ShaderPool::PollHotReload();
+
 	for (auto obj : m_objects) {
 		obj->update(m_time, m_frameIndex);
 	}
@@ -177,6 +180,8 @@ void Scene::clear()
 	m_deferredShader = std::make_shared<GlDeferredShader>();
 	m_animationManager->clear();
 	m_frameIndex = -1;
+	StatsSink::CloseTable(m_statsTable);
+	m_statsTable = -1;
 }
 
 std::shared_ptr<Camera> Scene::viewportCamera() const
@@ -313,31 +318,35 @@ void Scene::renderCamera(const Camera& camera) const
 
 void Scene::measureStats()
 {
-	if (m_statsCountColors.empty() || !m_outputStatsFile.is_open()) return;
-	std::vector<int> counters(m_statsCountColors.size());
+	if (m_statsCountColors.empty() || m_statsTable < 0) return;
+	StatsSink::Record(m_statsTable, 0, m_frameIndex);
+	int colorCount = static_cast<int>(m_statsCountColors.size());
+	if (!StatsSink::CanRecordDeferred(colorCount)) return; // writer is late, skip the copy
+
 	std::vector<uint8_t> intColors;
 	for (const auto &c : m_statsCountColors) {
 		intColors.push_back(static_cast<uint8_t>(c.x * 255.0f));
 		intColors.push_back(static_cast<uint8_t>(c.y * 255.0f));
 		intColors.push_back(static_cast<uint8_t>(c.z * 255.0f));
 	}
-	size_t n = m_pixels.size() / 3;
-	size_t p = m_statsCountColors.size();
-	for (size_t i = 0; i < n; ++i) {
+
+	// Counting is done on the stats writer thread, on a copy of the pixels
+	StatsSink::RecordDeferred(m_statsTable, 1, colorCount, [pixels = m_pixels, intColors](double* counters) {
+		size_t n = pixels.size() / 3;
+		size_t p = intColors.size() / 3;
 		for (size_t k = 0; k < p; ++k) {
-			if (intColors[3 * k + 0] == m_pixels[3 * i + 0]
-				&& intColors[3 * k + 1] == m_pixels[3 * i + 1]
-				&& intColors[3 * k + 2] == m_pixels[3 * i + 2]) {
-				++counters[k];
+			counters[k] = 0;
+		}
+		for (size_t i = 0; i < n; ++i) {
+			for (size_t k = 0; k < p; ++k) {
+				if (intColors[3 * k + 0] == pixels[3 * i + 0]
+					&& intColors[3 * k + 1] == pixels[3 * i + 1]
+					&& intColors[3 * k + 2] == pixels[3 * i + 2]) {
+					++counters[k];
+				}
 			}
 		}
-	}
-
-	m_outputStatsFile << m_frameIndex;
-	for (const auto &c : counters) {
-		m_outputStatsFile << ";" << c;
-	}
-	m_outputStatsFile << "\n";
+	});
 }
 
 size_t Scene::getOutputPixelCount(const Camera& camera) const
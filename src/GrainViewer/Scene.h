@@ -34,13 +34,13 @@
 #include "Camera.h"
 #include "TurntableCamera.h"
 #include "Framebuffer.h"
+#include "StatsSink.h"
 
 #include <refl.hpp>
 
 #include <memory>
 #include <vector>
 #include <string>
-#include <fstream>
 #include <sstream>
 
 class World;
@@ -137,7 +137,7 @@ private:
 	// Post render stats
 	std::string m_outputStats; // path to stats file
 	std::vector<glm::vec3> m_statsCountColors; // colors to count pixels in render
-	std::ofstream m_outputStatsFile;
+	StatsSink::TableId m_statsTable = -1; // columns are the scene frame, then one per color
 
 	// Not really related to the scene, save window resolution
 	int m_width;
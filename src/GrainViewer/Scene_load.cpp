@@ -42,6 +42,8 @@
 #include "utils/behaviorutils.h"
 #include "Scene.h"
 #include "ShaderPool.h"
+#include "ShaderProgramCache.h"
+#include "ShaderPreprocessor.h"
 #include "EnvironmentVariables.h"
 #include "BehaviorRegistry.h"
 #include "Behavior.h"
@@ -86,14 +88,35 @@ bool Scene::load(const std::string & filename)
 
 	rapidjson::Value& root = d["augen"];
 
-	if (root.HasMember("shaders")) {
-		if (!ShaderPool::Deserialize(root["shaders"])) {
+	// Deferred shader goes first because its G-buffer layout affects all shaders
+	if (root.HasMember("deferredShader")) {
+		if (!m_deferredShader->deserialize(root["deferredShader"])) {
 			return false;
 		}
 	}
+	std::set<std::string> globalDefines;
+	if (m_deferredShader->gbufferLayout() == Camera::GBufferLayout::Compact) {
+		globalDefines.insert("COMPACT_GBUFFER");
+	}
+	ShaderProgram::SetGlobalDefines(globalDefines);
 
-	if (root.HasMember("deferredShader")) {
-		if (!m_deferredShader->deserialize(root["deferredShader"])) {
+	// Program binary cache must be set up before loading shaders as well
+	if (root.HasMember("scene")) {
+		const auto& scene = root["scene"];
+		bool shaderCache = ShaderProgramCache::IsEnabled();
+		jrOption(scene, "shaderCache", shaderCache, shaderCache);
+		ShaderProgramCache::SetEnabled(shaderCache);
+		std::string shaderCacheDirectory;
+		if (jrOption(scene, "shaderCacheDirectory", shaderCacheDirectory)) {
+			ShaderProgramCache::SetDirectory(ResourceManager::resolveResourcePath(shaderCacheDirectory));
+		}
+		bool shaderHotReload = ShaderPool::IsHotReloadEnabled();
+		jrOption(scene, "shaderHotReload", shaderHotReload, shaderHotReload);
+		ShaderPool::SetHotReload(shaderHotReload);
+	}
+
+	if (root.HasMember("shaders")) {
+		if (!ShaderPool::Deserialize(root["shaders"])) {
 			return false;
 		}
 	}
@@ -120,6 +143,9 @@ bool Scene::load(const std::string & filename)
 		m_cameras.push_back(std::make_shared<TurntableCamera>());
 		m_viewportCameraIndex = 0;
 	}
+	for (auto& camera : m_cameras) {
+		camera->setGBufferLayout(m_deferredShader->gbufferLayout());
+	}
 
 	if (root.HasMember("objects")) {
 		auto& objects = root["objects"];
@@ -226,17 +252,34 @@ bool Scene::load(const std::string & filename)
 
 	reloadShaders();
 
+	// Variants are then finished in the background, see Scene::update()
+	for (auto obj : m_objects) {
+		obj->warmUpShaders();
+	}
+
 	// Start color output stats
 	if (!m_outputStats.empty()) {
 		fs::create_directories(fs::path(m_outputStats).parent_path());
-		m_outputStatsFile.open(m_outputStats);
-		m_outputStatsFile << "frame";
+		m_statsTable = StatsSink::AddTable(m_outputStats);
+		StatsSink::AddColumn(m_statsTable, "sceneFrame");
 		for (const auto &c : m_statsCountColors) {
-			m_outputStatsFile << ";<" << c.x << "," << c.y << "," << c.z << ">";
+			std::ostringstream name;
+			name << "<" << c.x << "," << c.y << "," << c.z << ">";
+			StatsSink::AddColumn(m_statsTable, name.str());
 		}
-		m_outputStatsFile << "\n";
 	}
 
+	if (ShaderProgramCache::IsEnabled()) {
+		const auto& stats = ShaderProgramCache::GetStats();
+		LOG << "Program binary cache: " << stats.hits << " hits, " << stats.misses << " misses, saved " << stats.savedMilliseconds << " ms";
+	}
+
+	const auto& preprocessorStats = ShaderPreprocessor::GetStats();
+	LOG << "Shader preprocessing: " << preprocessorStats.milliseconds << " ms, "
+		<< preprocessorStats.parsedFiles << " files parsed, "
+		<< preprocessorStats.cachedFiles << " from include cache, "
+		<< preprocessorStats.skippedIncludes << " skipped by include guards";
+
 	DEBUG_LOG << "Loading done.";
 
 	return true;
@@ -60,6 +60,11 @@ bool Shader::load(const std::string &filename, const std::vector<std::string> &
 		return false;
 	}
 
+	load(preprocessor);
+	return true;
+}
+
+void Shader::load(const ShaderPreprocessor & preprocessor) {
 	std::vector<GLchar> buf;
 	preprocessor.source(buf);
 	const GLchar *source = &buf[0];
@@ -68,8 +73,6 @@ bool Shader::load(const std::string &filename, const std::vector<std::string> &
 #ifndef NDEBUG
 	m_preprocessor = preprocessor;
 #endif
-
-	return true;
 }
 
 
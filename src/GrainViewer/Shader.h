@@ -43,6 +43,8 @@
 #include <map>
 #include <memory>
 
+class ShaderPreprocessor;
+
 /**
  * Utility class providing an OO API to OpenGL shaders
  */
@@ -57,6 +59,11 @@ public:
      */
     bool load(const std::string &filename, const std::vector<std::string> & defines = {}, const std::map<std::string, std::string> & snippets = {});
 
+    /**
+     * Use an already preprocessed source (e.g. to hash it before compiling)
+     */
+    void load(const ShaderPreprocessor & preprocessor);
+
     /**
      * Compile the shader
      */
@@ -31,6 +31,10 @@
 #include "ShaderPool.h"
 
 #include <sstream>
+#include <algorithm>
+#include <unordered_map>
+#include <filesystem>
+namespace fs = std::filesystem;
 
 #undef GetObject
 
@@ -73,11 +77,57 @@ std::shared_ptr<ShaderProgram> ShaderPool::GetShader(const std::string & shaderN
 	return s_instance.getShader(shaderName);
 }
 
+std::shared_ptr<ShaderProgram> ShaderPool::GetShaderVariant(
+	const std::string& shaderName,
+	const std::string& baseShaderName,
+	const std::vector<std::string>& defines)
+{
+	return s_instance.getShaderVariant(shaderName, baseShaderName, defines);
+}
+
+void ShaderPool::WarmUpShaderVariant(
+	const std::string& shaderName,
+	const std::string& baseShaderName,
+	const std::vector<std::string>& defines)
+{
+	s_instance.warmUpShaderVariant(shaderName, baseShaderName, defines);
+}
+
+bool ShaderPool::PollWarmUp()
+{
+	return s_instance.pollWarmUp();
+}
+
 void ShaderPool::ReloadShaders()
 {
 	s_instance.reloadShaders();
 }
 
+void ShaderPool::PollHotReload(bool force)
+{
+	s_instance.pollHotReload(force);
+}
+
+void ShaderPool::SetHotReload(bool enabled)
+{
+	s_instance.m_hotReload = enabled;
+}
+
+bool ShaderPool::IsHotReloadEnabled()
+{
+	return s_instance.m_hotReload;
+}
+
+void ShaderPool::Watch(ShaderProgram* program)
+{
+	s_instance.watch(program);
+}
+
+void ShaderPool::Unwatch(ShaderProgram* program)
+{
+	s_instance.unwatch(program);
+}
+
 bool ShaderPool::Deserialize(const rapidjson::Value & json)
 {
 	return s_instance.deserialize(json);
@@ -97,6 +147,18 @@ ShaderPool::ShaderPool()
 		"PrefixSum",
 		{ "prefix-sum", ShaderProgram::ComputeShader, {} }
 	});
+	m_defaultShaders.insert({
+		"ImpostorGrainViewSelection",
+		{ "grain/impostor-view-selection", ShaderProgram::ComputeShader, {} }
+	});
+	m_defaultShaders.insert({
+		"FarGrainSplat",
+		{ "grain/far-grain-splat", ShaderProgram::ComputeShader, {} }
+	});
+	m_defaultShaders.insert({
+		"LightCulling",
+		{ "light-culling", ShaderProgram::ComputeShader, {} }
+	});
 	m_defaultShaders.insert({
 		"LightGizmo",
 		{ "light-gizmo", ShaderProgram::RenderShader,{} }
@@ -191,7 +253,13 @@ void ShaderPool::addShaderVariant(
 std::shared_ptr<ShaderProgram> ShaderPool::getShader(const std::string & shaderName)
 {
 	if (m_shaders.count(shaderName) > 0) {
-		return m_shaders.at(shaderName);
+		const auto& shader = m_shaders.at(shaderName);
+		if (shader->isLoading()) {
+			// Still being warmed up, wait for it
+			shader->finishLoading();
+			m_pendingShaders.erase(std::remove(m_pendingShaders.begin(), m_pendingShaders.end(), shaderName), m_pendingShaders.end());
+		}
+		return shader;
 	} else if (m_defaultShaders.count(shaderName) > 0) {
 		auto& info = m_defaultShaders[shaderName];
 		addShader(shaderName, info.baseFile, info.type, info.defines);
@@ -201,6 +269,95 @@ std::shared_ptr<ShaderProgram> ShaderPool::getShader(const std::string & shaderN
 	}
 }
 
+std::shared_ptr<ShaderProgram> ShaderPool::getShaderVariant(
+	const std::string& shaderName,
+	const std::string& baseShaderName,
+	const std::vector<std::string>& defines)
+{
+	if (m_shaders.count(shaderName) == 0) {
+		if (m_warmUpPolled) {
+			WARN_LOG << "Shader variant '" << shaderName << "' was not warmed up, compiling it now";
+		}
+		addShaderVariant(shaderName, baseShaderName, defines);
+	}
+	return getShader(shaderName);
+}
+
+void ShaderPool::warmUpShaderVariant(
+	const std::string& shaderName,
+	const std::string& baseShaderName,
+	const std::vector<std::string>& defines)
+{
+	if (m_shaders.count(shaderName) > 0) return;
+
+	auto baseShader = getShader(baseShaderName);
+	if (!baseShader) {
+		WARN_LOG << "Cannot warm up variant of unexistant shader: " << baseShaderName;
+		return;
+	}
+
+	bool alreadyDefined = true;
+	for (const auto& def : defines) {
+		if (baseShader->getDefines().count(def) == 0) {
+			alreadyDefined = false;
+			break;
+		}
+	}
+	if (alreadyDefined) {
+		m_shaders[shaderName] = baseShader;
+		return;
+	}
+
+	auto shader = std::make_shared<ShaderProgram>(baseShader->shaderName());
+	shader->copy(*baseShader);
+	for (const auto& def : defines) {
+		if (baseShader->getDefines().count(def) == 0) {
+			shader->define(def);
+		}
+	}
+
+	if (m_pendingShaders.empty()) {
+		m_warmUpStartTime = std::chrono::high_resolution_clock::now();
+		m_warmUpCount = 0;
+	}
+	shader->startLoading();
+	m_shaders[shaderName] = shader;
+	if (shader->isLoading()) { // (not the case when found in the binary cache)
+		m_pendingShaders.push_back(shaderName);
+	}
+	++m_warmUpCount;
+}
+
+bool ShaderPool::pollWarmUp()
+{
+	m_warmUpPolled = true;
+	if (m_pendingShaders.empty()) return true;
+
+	// Without driver side parallel compilation, finishing is what actually
+	// compiles, so only do one per frame to spread the cost.
+	bool parallel = ShaderProgram::HasParallelCompilation();
+	std::vector<std::string> stillPending;
+	bool finishedOne = false;
+	for (const auto& name : m_pendingShaders) {
+		const auto& shader = m_shaders.at(name);
+		if ((parallel || !finishedOne) && shader->isLoadingDone()) {
+			shader->finishLoading();
+			finishedOne = true;
+		}
+		else {
+			stillPending.push_back(name);
+		}
+	}
+	m_pendingShaders = stillPending;
+
+	if (m_pendingShaders.empty()) {
+		double ms = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - m_warmUpStartTime).count();
+		LOG << "Shader warm up done: " << m_warmUpCount << " variants in " << ms << " ms";
+		return true;
+	}
+	return false;
+}
+
 void ShaderPool::reloadShaders()
 {
 	LOG << "Reloading shaders...";
@@ -208,6 +365,102 @@ void ShaderPool::reloadShaders()
 	{
 		e.second->load();
 	}
+	m_pendingShaders.clear();
+	m_hotReloads.clear();
+}
+
+/**
+ * Tell whether a file listed in the dependencies of a program changed since
+ * it was built. Modification times are looked up once per check in
+ * writeTimes, since most files are shared by many programs.
+ */
+static bool hasChangedDependencies(
+	const ShaderProgram& program,
+	std::unordered_map<std::string, fs::file_time_type>& writeTimes)
+{
+	for (const auto& dep : program.dependencies()) {
+		auto it = writeTimes.find(dep.first);
+		if (it == writeTimes.end()) {
+			std::error_code err;
+			fs::file_time_type t = fs::last_write_time(dep.first, err);
+			if (err) t = fs::file_time_type::min();
+			it = writeTimes.insert({ dep.first, t }).first;
+		}
+		if (it->second != dep.second) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void ShaderPool::pollHotReload(bool force)
+{
+	finishHotReloads();
+
+	auto now = std::chrono::high_resolution_clock::now();
+	if (!force && (!m_hotReload || now - m_lastHotReloadCheck < HotReloadInterval)) return;
+	m_lastHotReloadCheck = now;
+
+	// Aliased variants share the same program, so list each one once
+	std::set<ShaderProgram*> programs(m_watchedPrograms.begin(), m_watchedPrograms.end());
+	for (const auto& e : m_shaders) {
+		programs.insert(e.second.get());
+	}
+
+	std::unordered_map<std::string, fs::file_time_type> writeTimes;
+	int count = 0;
+	for (ShaderProgram* target : programs) {
+		if (target->isLoading()) continue; // still warming up
+		bool alreadyReloading = std::any_of(m_hotReloads.begin(), m_hotReloads.end(), [target](const HotReload& r) { return r.target == target; });
+		if (alreadyReloading || !hasChangedDependencies(*target, writeTimes)) continue;
+
+		auto program = std::make_unique<ShaderProgram>(target->shaderName());
+		program->copy(*target);
+		program->startLoading();
+		m_hotReloads.push_back({ target, std::move(program) });
+		++count;
+	}
+
+	if (count > 0) {
+		LOG << "Shader sources changed, recompiling " << count << " programs...";
+	}
+	else if (force) {
+		LOG << "No shader source changed since last build";
+	}
+}
+
+void ShaderPool::finishHotReloads()
+{
+	std::vector<HotReload> stillPending;
+	for (auto& reload : m_hotReloads) {
+		if (!reload.program->isLoadingDone()) {
+			stillPending.push_back(std::move(reload));
+			continue;
+		}
+
+		reload.program->finishLoading();
+		if (reload.program->isValid()) {
+			reload.target->swapProgram(*reload.program);
+			DEBUG_LOG << "Reloaded shader program " << reload.target->shaderName();
+		}
+		else {
+			ERR_LOG << "Could not reload shader program " << reload.target->shaderName() << ", keeping the previous version";
+			// Wait for the next change before trying again
+			reload.target->setDependencies(reload.program->dependencies());
+		}
+	}
+	m_hotReloads = std::move(stillPending);
+}
+
+void ShaderPool::watch(ShaderProgram* program)
+{
+	m_watchedPrograms.push_back(program);
+}
+
+void ShaderPool::unwatch(ShaderProgram* program)
+{
+	m_watchedPrograms.erase(std::remove(m_watchedPrograms.begin(), m_watchedPrograms.end(), program), m_watchedPrograms.end());
+	m_hotReloads.erase(std::remove_if(m_hotReloads.begin(), m_hotReloads.end(), [program](const HotReload& r) { return r.target == program; }), m_hotReloads.end());
 }
 
 bool ShaderPool::deserialize(const rapidjson::Value & json)
@@ -279,5 +532,12 @@ bool ShaderPool::deserialize(const rapidjson::Value & json)
 
 void ShaderPool::clear()
 {
+	// Pending hot reloads of watched programs survive, they are not in the pool
+	auto isPooled = [this](const HotReload& r) {
+		return std::find(m_watchedPrograms.begin(), m_watchedPrograms.end(), r.target) == m_watchedPrograms.end();
+	};
+	m_hotReloads.erase(std::remove_if(m_hotReloads.begin(), m_hotReloads.end(), isPooled), m_hotReloads.end());
 	m_shaders.clear();
+	m_pendingShaders.clear();
+	m_warmUpPolled = false;
 }
@@ -36,6 +36,8 @@
 #include <map>
 #include <string>
 #include <memory>
+#include <vector>
+#include <chrono>
 
 class ShaderPool {
 public:
@@ -68,8 +70,55 @@ public:
 	 */
 	static std::shared_ptr<ShaderProgram> GetShader(const std::string & shaderName);
 
+	/**
+	 * Get a variant, adding it first if it does not exist yet. This is what
+	 * renderers call at draw time, and it warns if the variant had not been
+	 * warmed up beforehand because compiling it stalls the frame.
+	 */
+	static std::shared_ptr<ShaderProgram> GetShaderVariant(
+		const std::string& shaderName,
+		const std::string& baseShaderName,
+		const std::vector<std::string>& defines);
+
+	/**
+	 * Submit a variant for compilation without waiting for it. With parallel
+	 * shader compilation, the driver compiles it in the background while
+	 * PollWarmUp() is called every frame. Accessing it with GetShader()
+	 * before it is done just blocks until it is.
+	 */
+	static void WarmUpShaderVariant(
+		const std::string& shaderName,
+		const std::string& baseShaderName,
+		const std::vector<std::string>& defines);
+
+	/**
+	 * Finish the warmed up variants that are ready, without blocking.
+	 * Return true once there is nothing left pending.
+	 */
+	static bool PollWarmUp();
+
 	static void ReloadShaders();
 
+	/**
+	 * Hot reload: recompile the programs of which a source file, or any
+	 * file it includes transitively, changed on disk since they were built.
+	 * Recompilation happens in the background (when the driver supports
+	 * parallel compilation) and the new program is swapped in place once it
+	 * linked successfully, otherwise the previous one is kept.
+	 * Call this every frame. Files are only checked every HotReloadInterval
+	 * unless force is true, and only when hot reload is enabled.
+	 */
+	static void PollHotReload(bool force = false);
+	static void SetHotReload(bool enabled);
+	static bool IsHotReloadEnabled();
+
+	/**
+	 * Also hot reload a program that does not live in the pool, like the
+	 * deferred shader ones. It must be unwatched before being destroyed.
+	 */
+	static void Watch(ShaderProgram* program);
+	static void Unwatch(ShaderProgram* program);
+
 	/**
 	 * Load shaders from JSON file
 	 */
@@ -100,7 +149,23 @@ private:
 
 	std::shared_ptr<ShaderProgram> getShader(const std::string & shaderName);
 
+	std::shared_ptr<ShaderProgram> getShaderVariant(
+		const std::string& shaderName,
+		const std::string& baseShaderName,
+		const std::vector<std::string>& defines);
+
+	void warmUpShaderVariant(
+		const std::string& shaderName,
+		const std::string& baseShaderName,
+		const std::vector<std::string>& defines);
+
+	bool pollWarmUp();
+
 	void reloadShaders();
+	void pollHotReload(bool force);
+	void finishHotReloads();
+	void watch(ShaderProgram* program);
+	void unwatch(ShaderProgram* program);
 	bool deserialize(const rapidjson::Value & json);
 	void clear();
 
@@ -115,4 +180,21 @@ private:
 	static ShaderPool s_instance;
 	std::map<std::string, std::shared_ptr<ShaderProgram>> m_shaders;
 	std::map<std::string, ShaderInfo> m_defaultShaders;
+
+	// Warm up
+	std::vector<std::string> m_pendingShaders;
+	int m_warmUpCount = 0;
+	bool m_warmUpPolled = false; // variants added after this are reported
+	std::chrono::high_resolution_clock::time_point m_warmUpStartTime;
+
+	// Hot reload
+	struct HotReload {
+		ShaderProgram* target; // in m_shaders or m_watchedPrograms
+		std::unique_ptr<ShaderProgram> program; // being recompiled
+	};
+	bool m_hotReload = true;
+	std::vector<ShaderProgram*> m_watchedPrograms;
+	std::vector<HotReload> m_hotReloads;
+	std::chrono::high_resolution_clock::time_point m_lastHotReloadCheck;
+	static constexpr std::chrono::milliseconds HotReloadInterval = std::chrono::milliseconds(500);
 };
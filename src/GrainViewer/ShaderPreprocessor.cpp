@@ -33,27 +33,49 @@
 #include "utils/fileutils.h"
 
 #include <fstream>
+#include <sstream>
 #include <map>
+#include <chrono>
+#include <filesystem>
+namespace fs = std::filesystem;
 
 using namespace std;
 
 constexpr const char* BEGIN_INCLUDE_TOKEN = "// _AUGEN_BEGIN_INCLUDE";
 constexpr const char* END_INCLUDE_TOKEN = "// _AUGEN_END_INCLUDE";
 
+/**
+ * A source file split into verbatim text and #include directives:
+ * chunks[0] includes[0] chunks[1] includes[1] ... chunks[n]
+ */
+struct ShaderPreprocessor::ParsedFile {
+	struct Include {
+		string filename; // full path, or "sys:..." for generated includes
+		size_t line;
+		bool conditional; // within an #if block, not counting the include guard
+	};
+	vector<string> chunks;
+	vector<Include> includes;
+	string includeGuard; // empty if the file has no include guard
+	fs::file_time_type lastWriteTime;
+};
+
+unordered_map<string, shared_ptr<const ShaderPreprocessor::ParsedFile>> ShaderPreprocessor::s_cache;
+ShaderPreprocessor::Stats ShaderPreprocessor::s_stats;
+
 bool ShaderPreprocessor::load(const string & filename, const vector<string> & defines, const std::map<std::string, std::string> & snippets) {
-	return loadShaderSourceAux(filename, defines, snippets, m_lines);
+	auto startTime = chrono::high_resolution_clock::now();
+	m_source.clear();
+	m_dependencies.clear();
+	set<string> includedGuards;
+	bool ok = loadAux(filename, defines, snippets, includedGuards);
+	m_loadingTime = chrono::duration<double, milli>(chrono::high_resolution_clock::now() - startTime).count();
+	s_stats.milliseconds += m_loadingTime;
+	return ok;
 }
 
 void ShaderPreprocessor::source(vector<GLchar> & buf) const {
-	size_t length = 0;
-	for (string s : m_lines) {
-		length += s.size() + 1;
-		buf.reserve(length);
-		for (char& c : s) {
-			buf.push_back(c);
-		}
-		buf.push_back('\n');
-	}
+	buf.insert(buf.end(), m_source.begin(), m_source.end());
 	buf.push_back(0);
 }
 
@@ -63,7 +85,9 @@ void ShaderPreprocessor::logTraceback(size_t line) const {
 	string filename = "";
 	vector<pair<string, size_t>> stack;
 	size_t ignore = 0;
-	for (auto l : m_lines) {
+	istringstream lines(m_source);
+	string l;
+	while (getline(lines, l)) {
 		if (startsWith(l, BEGIN_INCLUDE_TOKEN)) {
 			// Stack context
 			stack.push_back(make_pair(filename, localOffset));
@@ -99,66 +123,210 @@ void ShaderPreprocessor::logTraceback(size_t line) const {
 	}
 }
 
+shared_ptr<const ShaderPreprocessor::ParsedFile> ShaderPreprocessor::getParsedFile(const string & filename) {
+	error_code err;
+	fs::file_time_type lastWriteTime = fs::last_write_time(filename, err);
+	if (err) {
+		WARN_LOG << "Unable to open file: " << filename;
+		return nullptr;
+	}
+
+	auto it = s_cache.find(filename);
+	if (it != s_cache.end() && it->second->lastWriteTime == lastWriteTime) {
+		++s_stats.cachedFiles;
+		return it->second;
+	}
+
+	shared_ptr<ParsedFile> file = parseFile(filename);
+	if (!file) {
+		// (not cached so that it gets parsed again once fixed)
+		s_cache.erase(filename);
+		return nullptr;
+	}
+	file->lastWriteTime = lastWriteTime;
+	s_cache[filename] = file;
+	++s_stats.parsedFiles;
+	return file;
+}
+
+namespace {
+
+// Line without trailing \r nor leading whitespace, for directive parsing
+string directiveLine(const string & line) {
+	string l = line;
+	ltrim(l);
+	if (!l.empty() && l.back() == '\r') l.pop_back();
+	return l;
+}
+
+// Return the macro of an "#ifndef X/#define X ... #endif" guard that wraps
+// the whole file, or an empty string. Comments, blank lines and #pragma
+// may come before it.
+string detectIncludeGuard(const vector<string> & lines) {
+	auto isSignificant = [](const string & l) {
+		return !l.empty() && !startsWith(l, "//");
+	};
+
+	vector<string> significant;
+	for (const auto & line : lines) {
+		string l = directiveLine(line);
+		if (isSignificant(l)) significant.push_back(l);
+	}
+
+	size_t first = 0;
+	while (first < significant.size() && startsWith(significant[first], "#pragma")) ++first;
+	if (significant.size() < first + 3) return "";
+
+	istringstream ifndef(significant[first]);
+	istringstream define(significant[first + 1]);
+	string ifndefKeyword, ifndefMacro, defineKeyword, defineMacro;
+	ifndef >> ifndefKeyword >> ifndefMacro;
+	define >> defineKeyword >> defineMacro;
+	if (ifndefKeyword != "#ifndef" || defineKeyword != "#define" || ifndefMacro.empty() || ifndefMacro != defineMacro) {
+		return "";
+	}
+
+	// The #endif closing the guard must be the last line
+	int depth = 1;
+	for (size_t i = first + 2; i < significant.size(); ++i) {
+		const string & l = significant[i];
+		if (startsWith(l, "#if")) {
+			++depth;
+		}
+		else if (startsWith(l, "#endif")) {
+			--depth;
+			if (depth == 0) {
+				return i == significant.size() - 1 ? ifndefMacro : "";
+			}
+		}
+	}
+	return "";
+}
+
+} // namespace
 
 // Note: no include loop check is done, beware of infinite loops
-bool ShaderPreprocessor::loadShaderSourceAux(const string & filename, const vector<string> & defines, const std::map<std::string, std::string> & snippets, vector<string> & lines_accumulator) {
+shared_ptr<ShaderPreprocessor::ParsedFile> ShaderPreprocessor::parseFile(const string & filename) {
 	static const string includeKeywordLower = "#include";
+	static const string systemPrefix = "sys:";
+
+	ifstream in(filename);
+	if (!in.is_open()) {
+		WARN_LOG << "Unable to open file: " << filename;
+		return nullptr;
+	}
+	string content((istreambuf_iterator<char>(in)), istreambuf_iterator<char>());
+	if (!content.empty() && content.back() != '\n') {
+		content.push_back('\n');
+	}
+
+	auto file = make_shared<ParsedFile>();
+	vector<string> lines;
+	string chunk;
+	size_t i = 0;
+	size_t lineStart = 0;
+	int ifDepth = 0;
+	vector<int> includeIfDepths;
+	while (lineStart < content.size()) {
+		size_t lineEnd = content.find('\n', lineStart);
+		string line = content.substr(lineStart, lineEnd - lineStart);
+		++i;
+
+		string directive = directiveLine(line);
+		if (startsWith(directive, "#if")) {
+			++ifDepth;
+		}
+		else if (startsWith(directive, "#endif")) {
+			--ifDepth;
+		}
+
+		// Poor man's #include directive parser
+		// (lower casing only lines that look like a directive)
+		if (!line.empty() && line[0] == '#' && startsWith(toLower(line), includeKeywordLower)) {
+			string includeFilename = directiveLine(line).substr(includeKeywordLower.size());
+			trim(includeFilename);
+			if (includeFilename.size() < 2 || includeFilename[0] != '"' || includeFilename[includeFilename.size() - 1] != '"') {
+				ERR_LOG << "Syntax error in #include directive at line " << i << " in file " << filename;
+				ERR_LOG << "  filename is expected to be enclosed in double quotes (\")";
+				return nullptr;
+			}
+			includeFilename = includeFilename.substr(1, includeFilename.size() - 2);
+			if (!startsWith(includeFilename, systemPrefix)) {
+				includeFilename = joinPath(baseDir(filename), includeFilename);
+			}
+			file->chunks.push_back(move(chunk));
+			chunk.clear();
+			file->includes.push_back({ includeFilename, i, false });
+			includeIfDepths.push_back(ifDepth);
+		}
+		else {
+			chunk.append(content, lineStart, lineEnd - lineStart + 1);
+		}
+		lines.push_back(move(line));
+		lineStart = lineEnd + 1;
+	}
+	file->chunks.push_back(move(chunk));
+	file->includeGuard = detectIncludeGuard(lines);
+	int guardDepth = file->includeGuard.empty() ? 0 : 1;
+	for (size_t k = 0; k < file->includes.size(); ++k) {
+		file->includes[k].conditional = includeIfDepths[k] > guardDepth;
+	}
+	return file;
+}
+
+bool ShaderPreprocessor::loadAux(const string & filename, const vector<string> & defines, const std::map<std::string, std::string> & snippets, set<string> & includedGuards, bool conditional) {
 	static const string defineKeywordLower = "#define";
 	static const string systemPrefix = "sys:";
 	static const string sysDefinesFilename = "defines";
 
 	string shortName = shortFileName(filename);
 	if (startsWith(shortName, systemPrefix)) {
-		lines_accumulator.push_back(string() + BEGIN_INCLUDE_TOKEN + " " + shortName);
+		m_source += string() + BEGIN_INCLUDE_TOKEN + " " + shortName + "\n";
 
 		const string key = shortName.substr(systemPrefix.length());
 		if (key == sysDefinesFilename) {
-			for (auto def : defines) {
-				lines_accumulator.push_back(defineKeywordLower + " " + def);
+			for (const auto & def : defines) {
+				m_source += defineKeywordLower + " " + def + "\n";
 			}
 		} else {
 			if (snippets.count(key) > 0) {
-				lines_accumulator.push_back(snippets.at(key));
+				m_source += snippets.at(key) + "\n";
 			}
 		}
 
-		lines_accumulator.push_back(string() + END_INCLUDE_TOKEN + " " + shortName);
+		m_source += string() + END_INCLUDE_TOKEN + " " + shortName + "\n";
 		return true;
 	}
 
-	lines_accumulator.push_back(string() + BEGIN_INCLUDE_TOKEN + " " + filename);
-
-	ifstream in(filename);
-	if (!in.is_open()) {
-		WARN_LOG << "Unable to open file: " << filename;
+	shared_ptr<const ParsedFile> file = getParsedFile(filename);
+	m_dependencies[filename] = file ? file->lastWriteTime : fs::file_time_type::min();
+	if (!file) {
 		return false;
 	}
 
-	string line;
-
-	size_t i = 0;
-	while (getline(in, line)) {
-		++i;
-		// Poor man's #include directive parser
-		if (startsWith(toLower(line), includeKeywordLower)) {
-			string includeFilename = line.substr(includeKeywordLower.size());
-			trim(includeFilename);
-			if (includeFilename[0] != '"' || includeFilename[includeFilename.size() - 1] != '"') {
-				ERR_LOG << "Syntax error in #include directive at line " << i << " in file " << filename;
-				ERR_LOG << "  filename is expected to be enclosed in double quotes (\")";
-				return false;
-			}
-			includeFilename = includeFilename.substr(1, includeFilename.size() - 2);
-			string fullIncludeFilename = joinPath(baseDir(filename), includeFilename);
-			if (!loadShaderSourceAux(fullIncludeFilename, defines, snippets, lines_accumulator)) {
-				ERR_LOG << "Include error at line " << i << " in file " << filename;
-				return false;
-			}
+	// A guarded file can only be skipped if it was pasted outside of any #if
+	// block before, otherwise its guard may not be defined (e.g. included
+	// under a pass define that is not set).
+	if (!file->includeGuard.empty()) {
+		if (includedGuards.count(file->includeGuard) > 0) {
+			++s_stats.skippedIncludes;
+			return true;
 		}
-		else {
-			lines_accumulator.push_back(line);
+		if (!conditional) {
+			includedGuards.insert(file->includeGuard);
+		}
+	}
+
+	m_source += string() + BEGIN_INCLUDE_TOKEN + " " + filename + "\n";
+	for (size_t k = 0; k < file->includes.size(); ++k) {
+		m_source += file->chunks[k];
+		const auto & include = file->includes[k];
+		if (!loadAux(include.filename, defines, snippets, includedGuards, conditional || include.conditional)) {
+			ERR_LOG << "Include error at line " << include.line << " in file " << filename;
+			return false;
 		}
 	}
-	lines_accumulator.push_back(END_INCLUDE_TOKEN);
+	m_source += file->chunks.back();
+	m_source += string() + END_INCLUDE_TOKEN + "\n";
 	return true;
 }
@@ -34,7 +34,18 @@
 #include <string>
 #include <vector>
 #include <map>
+#include <set>
+#include <memory>
+#include <unordered_map>
+#include <filesystem>
 
+/**
+ * Included files are parsed once and kept in memory until their
+ * modification time changes, so that the many variants of a shader do not
+ * read the same files again and again. A file entirely wrapped in an
+ * #ifndef/#define include guard is only inserted once per source, unless
+ * it was first included from within an #if block.
+ */
 class ShaderPreprocessor {
 public:
 	/**
@@ -55,10 +66,39 @@ public:
 	 */
 	void logTraceback(size_t line) const;
 
+	/**
+	 * Time spent in the last call to load(), in milliseconds
+	 */
+	double loadingTime() const { return m_loadingTime; }
+
+	/**
+	 * Files read by the last call to load(), including the ones included
+	 * transitively, with their modification time at that moment. Files that
+	 * could not be read are listed too, with the minimum time.
+	 */
+	const std::map<std::string, std::filesystem::file_time_type>& dependencies() const { return m_dependencies; }
+
+	struct Stats {
+		int parsedFiles = 0; // read from disk
+		int cachedFiles = 0; // found in the include cache
+		int skippedIncludes = 0; // files with an include guard already included unconditionally
+		double milliseconds = 0; // total time spent in load()
+	};
+	static const Stats& GetStats() { return s_stats; }
+
 private:
-	std::vector<std::string> m_lines;
+	struct ParsedFile;
+	static std::shared_ptr<const ParsedFile> getParsedFile(const std::string & filename);
+	static std::shared_ptr<ParsedFile> parseFile(const std::string & filename);
+
+	bool loadAux(const std::string & filename, const std::vector<std::string> & defines, const std::map<std::string, std::string> & snippets, std::set<std::string> & includedGuards, bool conditional = false);
 
 private:
-	static bool loadShaderSourceAux(const std::string & filename, const std::vector<std::string> & defines, const std::map<std::string, std::string> & snippets, std::vector<std::string> & lines_accumulator);
+	std::string m_source;
+	double m_loadingTime = 0;
+	std::map<std::string, std::filesystem::file_time_type> m_dependencies;
+
+	static std::unordered_map<std::string, std::shared_ptr<const ParsedFile>> s_cache;
+	static Stats s_stats;
 };
 
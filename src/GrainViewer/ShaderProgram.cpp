@@ -28,15 +28,26 @@
  */
 
 #include "utils/fileutils.h"
+#include "utils/strutils.h"
 #include "Logger.h"
 #include "ResourceManager.h"
 #include "ShaderProgram.h"
+#include "ShaderProgramCache.h"
+#include "ShaderPreprocessor.h"
 
 #include <glm/gtc/type_ptr.hpp>
 
+#include <algorithm>
+#include <chrono>
 #include <filesystem>
 namespace fs = std::filesystem;
 
+// GL_KHR_parallel_shader_compile and GL_ARB_parallel_shader_compile share their enums
+constexpr GLenum CompletionStatus = 0x91B1;
+
+std::set<std::string> ShaderProgram::s_globalDefines;
+bool ShaderProgram::s_parallelCompilation = false;
+
 ShaderProgram::ShaderProgram(const std::string& shaderName)
 	: m_shaderName(shaderName)
 	, m_type(RenderShader)
@@ -46,49 +57,141 @@ ShaderProgram::ShaderProgram(const std::string& shaderName)
 
 ShaderProgram::~ShaderProgram()
 {
-	if (m_isValid) {
+	if (m_isValid || m_loading) {
 		glDeleteProgram(m_programId);
 	}
 	m_isValid = false;
 }
 
 void ShaderProgram::load() {
+	startLoading();
+	finishLoading();
+}
+
+void ShaderProgram::startLoading() {
+	if (m_isValid || m_loading) {
+		glDeleteProgram(m_programId);
+	}
 	m_programId = glCreateProgram();
+	m_isValid = false;
+	m_loading = false;
+	m_pendingStages.clear();
 
 	std::vector<std::string> defines(m_defines.begin(), m_defines.end());
+	for (const auto& def : s_globalDefines) {
+		if (m_defines.count(def) == 0) defines.push_back(def);
+	}
 
+	// List stages
+	struct Stage {
+		GLenum type;
+		std::string name; // for error messages
+		std::string path;
+	};
+	std::vector<Stage> stages;
 	if (type() == RenderShader) {
-		Shader vertexShader(GL_VERTEX_SHADER);
-		vertexShader.load(ResourceManager::shaderFullPath(m_shaderName, GL_VERTEX_SHADER), defines, m_snippets);
-		vertexShader.compile();
-		vertexShader.check("vertex shader");
-		glAttachShader(m_programId, vertexShader.shaderId());
-
-		Shader geometryShader(GL_GEOMETRY_SHADER);
+		stages.push_back({ GL_VERTEX_SHADER, "vertex shader", ResourceManager::shaderFullPath(m_shaderName, GL_VERTEX_SHADER) });
 		std::string geometryShaderPath = ResourceManager::shaderFullPath(m_shaderName, GL_GEOMETRY_SHADER);
-		if (fs::is_regular_file(geometryShaderPath)) {
-			geometryShader.load(geometryShaderPath, defines, m_snippets);
-			geometryShader.compile();
-			geometryShader.check("geometry shader");
-			glAttachShader(m_programId, geometryShader.shaderId());
+		bool skipGeometryShader = m_defines.count("NO_GEOMETRY_SHADER") > 0;
+		if (fs::is_regular_file(geometryShaderPath) && !skipGeometryShader) {
+			stages.push_back({ GL_GEOMETRY_SHADER, "geometry shader", geometryShaderPath });
 		}
-
-		Shader fragmentShader(GL_FRAGMENT_SHADER);
-		fragmentShader.load(ResourceManager::shaderFullPath(m_shaderName, GL_FRAGMENT_SHADER), defines, m_snippets);
-		fragmentShader.compile();
-		fragmentShader.check("fragment shader");
-		glAttachShader(m_programId, fragmentShader.shaderId());
+		stages.push_back({ GL_FRAGMENT_SHADER, "fragment shader", ResourceManager::shaderFullPath(m_shaderName, GL_FRAGMENT_SHADER) });
 	}
 	else {
-		Shader computeShader(GL_COMPUTE_SHADER);
-		computeShader.load(ResourceManager::shaderFullPath(m_shaderName, GL_COMPUTE_SHADER), defines, m_snippets);
-		computeShader.compile();
-		computeShader.check("compute shader");
-		glAttachShader(m_programId, computeShader.shaderId());
+		stages.push_back({ GL_COMPUTE_SHADER, "compute shader", ResourceManager::shaderFullPath(m_shaderName, GL_COMPUTE_SHADER) });
 	}
 
+	// Preprocess all stages first to look the program up in the binary cache
+	std::vector<ShaderPreprocessor> preprocessors(stages.size());
+	std::vector<std::vector<GLchar>> sources(stages.size());
+	double preprocessingTime = 0;
+	m_dependencies.clear();
+	for (size_t i = 0; i < stages.size(); ++i) {
+		preprocessors[i].load(stages[i].path, defines, m_snippets);
+		preprocessors[i].source(sources[i]);
+		preprocessingTime += preprocessors[i].loadingTime();
+		const auto& deps = preprocessors[i].dependencies();
+		m_dependencies.insert(deps.begin(), deps.end());
+	}
+	std::ostringstream definesDebug;
+	for (size_t i = 0; i < defines.size(); ++i) {
+		definesDebug << (i > 0 ? ", " : "") << defines[i];
+	}
+	DEBUG_LOG << "Preprocessed " << m_shaderName << " [" << definesDebug.str() << "] in " << preprocessingTime << " ms";
+	ShaderProgramCache::Key cacheKey = ShaderProgramCache::ComputeKey(sources, defines, m_snippets);
+	if (ShaderProgramCache::Load(m_programId, cacheKey)) {
+		m_isValid = true;
+		cacheUniformLocations();
+		return;
+	}
+
+	// Status is only checked in finishLoading(), because querying it blocks
+	m_loadingStartTime = std::chrono::high_resolution_clock::now();
+	for (size_t i = 0; i < stages.size(); ++i) {
+		m_pendingStages.push_back({ std::make_unique<Shader>(stages[i].type), stages[i].name });
+		Shader& shader = *m_pendingStages.back().shader;
+		shader.load(preprocessors[i]);
+		shader.compile();
+		glAttachShader(m_programId, shader.shaderId());
+	}
+
+	glProgramParameteri(m_programId, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
 	glLinkProgram(m_programId);
+	m_pendingCacheKey = cacheKey;
+	m_loading = true;
+}
+
+bool ShaderProgram::isLoadingDone() const {
+	if (!m_loading || !s_parallelCompilation) return true;
+	GLint done = GL_FALSE;
+	glGetProgramiv(m_programId, CompletionStatus, &done);
+	return done == GL_TRUE;
+}
+
+void ShaderProgram::finishLoading() {
+	if (!m_loading) return;
+	m_loading = false;
+
+	for (const auto& stage : m_pendingStages) {
+		stage.shader->check(stage.name);
+	}
 	m_isValid = check();
+	m_pendingStages.clear();
+
+	if (m_isValid) {
+		cacheUniformLocations();
+		// (includes the time spent waiting in between when loading asynchronously)
+		double compileMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - m_loadingStartTime).count();
+		ShaderProgramCache::Store(m_programId, m_pendingCacheKey, compileMilliseconds);
+	}
+}
+
+bool ShaderProgram::EnableParallelCompilation(const std::function<void*(const char*)>& getProcAddress) {
+	std::string procName;
+	GLint extensionCount = 0;
+	glGetIntegerv(GL_NUM_EXTENSIONS, &extensionCount);
+	for (GLint i = 0; i < extensionCount && procName.empty(); ++i) {
+		std::string extension = reinterpret_cast<const char*>(glGetStringi(GL_EXTENSIONS, static_cast<GLuint>(i)));
+		if (extension == "GL_KHR_parallel_shader_compile") {
+			procName = "glMaxShaderCompilerThreadsKHR";
+		}
+		else if (extension == "GL_ARB_parallel_shader_compile") {
+			procName = "glMaxShaderCompilerThreadsARB";
+		}
+	}
+	if (procName.empty()) {
+		LOG << "Parallel shader compilation is not supported by the driver";
+		return false;
+	}
+
+	typedef void (APIENTRY *MaxShaderCompilerThreadsProc)(GLuint count);
+	auto maxShaderCompilerThreads = reinterpret_cast<MaxShaderCompilerThreadsProc>(getProcAddress(procName.c_str()));
+	if (!maxShaderCompilerThreads) return false;
+	maxShaderCompilerThreads(0xFFFFFFFF); // let the driver choose
+	s_parallelCompilation = true;
+	LOG << "Parallel shader compilation enabled (" << procName << ")";
+	return true;
 }
 
 bool ShaderProgram::check(const std::string& name) const {
@@ -110,7 +213,7 @@ bool ShaderProgram::check(const std::string& name) const {
 }
 
 
-void ShaderProgram::setUniform(const std::string& name, GLint value) const {
+void ShaderProgram::setUniform(const UniformName& name, GLint value) const {
 	GLint loc = uniformLocation(name);
 	if (loc != GL_INVALID_INDEX) {
 		glProgramUniform1i(m_programId, loc, value);
@@ -122,7 +225,7 @@ void ShaderProgram::setUniform(const std::string& name, GLint value) const {
 		//WARN_LOG << "Uniform does not exist: '" << name << "'";
 	}
 }
-void ShaderProgram::setUniform(const std::string& name, GLuint value) const {
+void ShaderProgram::setUniform(const UniformName& name, GLuint value) const {
 	GLint loc = uniformLocation(name);
 	if (loc != GL_INVALID_INDEX) {
 		glProgramUniform1ui(m_programId, loc, value);
@@ -131,7 +234,7 @@ void ShaderProgram::setUniform(const std::string& name, GLuint value) const {
 		//WARN_LOG << "Uniform does not exist: '" << name << "'";
 	}
 }
-void ShaderProgram::setUniform(const std::string& name, GLfloat value) const {
+void ShaderProgram::setUniform(const UniformName& name, GLfloat value) const {
 	GLint loc = uniformLocation(name);
 	if (loc != GL_INVALID_INDEX) {
 		glProgramUniform1f(m_programId, loc, value);
@@ -140,7 +243,7 @@ void ShaderProgram::setUniform(const std::string& name, GLfloat value) const {
 		//WARN_LOG << "Uniform does not exist: '" << name << "'";
 	}
 }
-void ShaderProgram::setUniform(const std::string& name, const glm::vec2& value) const {
+void ShaderProgram::setUniform(const UniformName& name, const glm::vec2& value) const {
 	GLint loc = uniformLocation(name);
 	if (loc != GL_INVALID_INDEX) {
 		glProgramUniform2f(
@@ -153,7 +256,7 @@ void ShaderProgram::setUniform(const std::string& name, const glm::vec2& value)
 		//WARN_LOG << "Uniform does not exist: '" << name << "'";
 	}
 }
-void ShaderProgram::setUniform(const std::string& name, const glm::vec3& value) const {
+void ShaderProgram::setUniform(const UniformName& name, const glm::vec3& value) const {
 	GLint loc = uniformLocation(name);
 	if (loc != GL_INVALID_INDEX) {
 		glProgramUniform3f(
@@ -167,7 +270,7 @@ void ShaderProgram::setUniform(const std::string& name, const glm::vec3& value)
 		//WARN_LOG << "Uniform does not exist: '" << name << "'";
 	}
 }
-void ShaderProgram::setUniform(const std::string& name, const glm::mat3& value) const {
+void ShaderProgram::setUniform(const UniformName& name, const glm::mat3& value) const {
 	GLint loc = uniformLocation(name);
 	if (loc != GL_INVALID_INDEX) {
 		glProgramUniformMatrix3fv(m_programId, loc, 1, GL_FALSE, glm::value_ptr(value));
@@ -176,7 +279,7 @@ void ShaderProgram::setUniform(const std::string& name, const glm::mat3& value)
 		//WARN_LOG << "Uniform does not exist: '" << name << "'";
 	}
 }
-void ShaderProgram::setUniform(const std::string& name, const glm::mat4& value) const {
+void ShaderProgram::setUniform(const UniformName& name, const glm::mat4& value) const {
 	GLint loc = uniformLocation(name);
 	if (loc != GL_INVALID_INDEX) {
 		glProgramUniformMatrix4fv(m_programId, loc, 1, GL_FALSE, glm::value_ptr(value));
@@ -186,6 +289,40 @@ void ShaderProgram::setUniform(const std::string& name, const glm::mat4& value)
 	}
 }
 
+void ShaderProgram::cacheUniformLocations() {
+	m_uniformLocations.clear();
+
+	GLint count = 0;
+	GLint maxLength = 0;
+	glGetProgramInterfaceiv(m_programId, GL_UNIFORM, GL_ACTIVE_RESOURCES, &count);
+	glGetProgramInterfaceiv(m_programId, GL_UNIFORM, GL_MAX_NAME_LENGTH, &maxLength);
+	std::vector<GLchar> nameBuffer(std::max(maxLength, 1));
+
+	const GLenum props[] = { GL_LOCATION, GL_ARRAY_SIZE };
+	for (GLuint i = 0; i < static_cast<GLuint>(count); ++i) {
+		GLint values[2];
+		glGetProgramResourceiv(m_programId, GL_UNIFORM, i, 2, props, 2, nullptr, values);
+		GLint location = values[0];
+		GLint arraySize = values[1];
+		if (location < 0) continue; // in a uniform block
+
+		GLsizei length = 0;
+		glGetProgramResourceName(m_programId, GL_UNIFORM, i, static_cast<GLsizei>(nameBuffer.size()), &length, nameBuffer.data());
+		std::string name(nameBuffer.data(), length);
+		m_uniformLocations[UniformName(name).hash()] = location;
+
+		// Arrays of basic types are reported as "name[0]" only
+		if (endsWith(name, "[0]")) {
+			std::string baseName = name.substr(0, name.size() - 3);
+			m_uniformLocations[UniformName(baseName).hash()] = location;
+			for (GLint k = 1; k < arraySize; ++k) {
+				std::string elementName = baseName + "[" + std::to_string(k) + "]";
+				m_uniformLocations[UniformName(elementName).hash()] = glGetUniformLocation(m_programId, elementName.c_str());
+			}
+		}
+	}
+}
+
 bool ShaderProgram::bindUniformBlock(const std::string& uniformBlockName, GLuint buffer, GLuint uniformBlockBinding) const {
 	GLuint index = uniformBlockIndex(uniformBlockName);
 	if (index == GL_INVALID_INDEX) {
@@ -220,6 +357,15 @@ std::vector<std::string> ShaderProgram::getUniformList() const {
 	return uniformList;
 }
 
+void ShaderProgram::swapProgram(ShaderProgram& other)
+{
+	other.finishLoading();
+	std::swap(m_programId, other.m_programId);
+	std::swap(m_isValid, other.m_isValid);
+	std::swap(m_uniformLocations, other.m_uniformLocations);
+	std::swap(m_dependencies, other.m_dependencies);
+}
+
 void ShaderProgram::copy(const ShaderProgram & other)
 {
 	m_shaderName = other.m_shaderName;
@@ -30,6 +30,12 @@
 #pragma once
 
 #include "Shader.h"
+#include "UniformName.h"
+
+#include <chrono>
+#include <filesystem>
+#include <functional>
+#include <unordered_map>
 
 /**
  * Utility class providing an OO API to OpenGL shader program
@@ -64,11 +70,39 @@ public:
 
 	inline void setSnippet(const std::string& key, const std::string& value) { m_snippets[key] = value; }
 
+	/**
+	 * Defines added to all shader programs on top of their own ones, for
+	 * scene wide settings like the G-buffer layout. Only taken into account
+	 * by programs loaded afterwards.
+	 */
+	static void SetGlobalDefines(const std::set<std::string>& defines) { s_globalDefines = defines; }
+	static const std::set<std::string>& GlobalDefines() { return s_globalDefines; }
+
 	/**
 	 * Load and check shaders
+	 * If NO_GEOMETRY_SHADER is defined, the geometry stage is skipped even if
+	 * there is a geometry shader file.
 	 */
 	void load();
 
+	/**
+	 * Same as load() split in two, so that the driver can compile in
+	 * background threads in between when parallel compilation is enabled.
+	 * The program is not valid until finishLoading() is called.
+	 * isLoadingDone() tells whether finishLoading() would block.
+	 */
+	void startLoading();
+	bool isLoadingDone() const;
+	void finishLoading();
+	bool isLoading() const { return m_loading; }
+
+	/**
+	 * Enable GL_KHR_parallel_shader_compile (or the ARB one) if available.
+	 * getProcAddress is the loader of the context (e.g. glfwGetProcAddress).
+	 */
+	static bool EnableParallelCompilation(const std::function<void*(const char*)>& getProcAddress);
+	static bool HasParallelCompilation() { return s_parallelCompilation; }
+
 	/**
 	 * Check that the shader program has been successfully compiled
 	 * @param name Name displayed in error message
@@ -80,13 +114,15 @@ public:
 	inline bool isValid() const { return m_isValid; }
 
 	// Some overloading: (add whatever you need)
-	void setUniform(const std::string& name, GLint value) const;
-	void setUniform(const std::string& name, GLuint value) const;
-	void setUniform(const std::string& name, GLfloat value) const;
-	void setUniform(const std::string& name, const glm::vec2& value) const;
-	void setUniform(const std::string& name, const glm::vec3& value) const;
-	void setUniform(const std::string& name, const glm::mat3& value) const;
-	void setUniform(const std::string& name, const glm::mat4& value) const;
+	// Locations are looked up in a cache filled after linking, so prefer
+	// literals or precomputed UniformName over building strings.
+	void setUniform(const UniformName& name, GLint value) const;
+	void setUniform(const UniformName& name, GLuint value) const;
+	void setUniform(const UniformName& name, GLfloat value) const;
+	void setUniform(const UniformName& name, const glm::vec2& value) const;
+	void setUniform(const UniformName& name, const glm::vec3& value) const;
+	void setUniform(const UniformName& name, const glm::mat3& value) const;
+	void setUniform(const UniformName& name, const glm::mat4& value) const;
 
 	bool bindUniformBlock(const std::string& uniformBlockName, GLuint buffer, GLuint uniformBlockBinding = 1) const;
 
@@ -94,6 +130,23 @@ public:
 
 	void copy(const ShaderProgram & other);
 
+	/**
+	 * Shader files this program was last built from, including transitive
+	 * includes, with their modification time at that moment (see startLoading)
+	 */
+	typedef std::map<std::string, std::filesystem::file_time_type> Dependencies;
+	inline const Dependencies& dependencies() const { return m_dependencies; }
+	inline void setDependencies(const Dependencies& dependencies) { m_dependencies = dependencies; }
+
+	/**
+	 * Exchange the compiled program with the one of other, which is done
+	 * loading first. This is how a recompiled program is swapped in place,
+	 * behind the shared pointers held by renderers. The previous program
+	 * then belongs to other and gets deleted with it.
+	 * Uniform values are not transfered, they must be set again.
+	 */
+	void swapProgram(ShaderProgram& other);
+
 	GLuint raw() const { return m_programId; }
 
 private:
@@ -104,8 +157,32 @@ private:
 	GLuint m_programId;
 	bool m_isValid;
 
+	// Between startLoading() and finishLoading()
+	struct PendingStage {
+		std::unique_ptr<Shader> shader;
+		std::string name; // for error messages
+	};
+	bool m_loading = false;
+	std::vector<PendingStage> m_pendingStages;
+	uint64_t m_pendingCacheKey = 0;
+	std::chrono::high_resolution_clock::time_point m_loadingStartTime;
+
+	Dependencies m_dependencies;
+
+	// Active uniforms, by UniformName hash. Arrays of basic types are
+	// listed both as "name", "name[0]" and each "name[i]".
+	std::unordered_map<uint64_t, GLint> m_uniformLocations;
+
+	static std::set<std::string> s_globalDefines;
+	static bool s_parallelCompilation;
+
 private:
-	inline GLint uniformLocation(const std::string& name) const { return m_isValid ? glGetUniformLocation(m_programId, name.c_str()) : GL_INVALID_INDEX; }
+	void cacheUniformLocations();
+	inline GLint uniformLocation(const UniformName& name) const {
+		if (!m_isValid) return GL_INVALID_INDEX;
+		auto it = m_uniformLocations.find(name.hash());
+		return it != m_uniformLocations.end() ? it->second : GL_INVALID_INDEX;
+	}
 	inline GLuint uniformBlockIndex(const std::string& name) const { return m_isValid ? glGetUniformBlockIndex(m_programId, name.c_str()) : GL_INVALID_INDEX; }
 	inline GLuint storageBlockIndex(const std::string& name) const { return m_isValid ? glGetProgramResourceIndex(m_programId, GL_SHADER_STORAGE_BLOCK, name.c_str()) : GL_INVALID_INDEX; }
 };
@@ -0,0 +1,198 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+
+#include "ShaderProgramCache.h"
+#include "Logger.h"
+#include "ResourceManager.h"
+#include "utils/Hasher.h"
+
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iomanip>
+#include <sstream>
+namespace fs = std::filesystem;
+
+namespace {
+
+constexpr uint32_t EntryMagic = 0x42505647; // "GVPB"
+constexpr uint32_t EntryVersion = 1;
+
+struct EntryHeader {
+	uint32_t magic;
+	uint32_t version;
+	ShaderProgramCache::Key key;
+	uint32_t binaryFormat;
+	uint32_t binarySize;
+	double compileMilliseconds;
+};
+
+// Binaries are only valid for the driver that produced them
+void hashDriver(Hasher& hasher) {
+	for (GLenum name : { GL_VENDOR, GL_RENDERER, GL_VERSION }) {
+		const GLubyte* str = glGetString(name);
+		hasher.addString(str ? reinterpret_cast<const char*>(str) : "");
+	}
+}
+
+} // namespace
+
+bool ShaderProgramCache::s_enabled = true;
+std::string ShaderProgramCache::s_directory;
+ShaderProgramCache::Stats ShaderProgramCache::s_stats;
+
+std::string ShaderProgramCache::Directory()
+{
+	if (!s_directory.empty()) return s_directory;
+	return (fs::path(ResourceManager::shareDir()) / "cache" / "programs").string();
+}
+
+ShaderProgramCache::Key ShaderProgramCache::ComputeKey(
+	const std::vector<std::vector<GLchar>>& sources,
+	const std::vector<std::string>& defines,
+	const std::map<std::string, std::string>& snippets)
+{
+	Hasher hasher;
+	hasher.addValue(EntryVersion);
+	hashDriver(hasher);
+	for (const auto& source : sources) {
+		hasher.addValue(source.size());
+		hasher.add(source.data(), source.size());
+	}
+	for (const auto& def : defines) {
+		hasher.addString(def);
+	}
+	for (const auto& s : snippets) {
+		hasher.addString(s.first);
+		hasher.addString(s.second);
+	}
+	return hasher.value();
+}
+
+bool ShaderProgramCache::Load(GLuint program, Key key)
+{
+	if (!s_enabled) return false;
+	auto startTime = std::chrono::high_resolution_clock::now();
+
+	std::ifstream in(EntryPath(key), std::ios::binary);
+	if (!in.is_open()) {
+		++s_stats.misses;
+		return false;
+	}
+
+	EntryHeader header;
+	std::vector<char> binary;
+	bool valid = static_cast<bool>(in.read(reinterpret_cast<char*>(&header), sizeof(header)))
+		&& header.magic == EntryMagic
+		&& header.version == EntryVersion
+		&& header.key == key;
+	if (valid) {
+		binary.resize(header.binarySize);
+		valid = static_cast<bool>(in.read(binary.data(), binary.size()));
+	}
+	if (!valid) {
+		WARN_LOG << "Ignoring invalid program binary cache entry " << EntryPath(key);
+		++s_stats.misses;
+		return false;
+	}
+
+	glProgramBinary(program, static_cast<GLenum>(header.binaryFormat), binary.data(), static_cast<GLsizei>(binary.size()));
+	GLint ok;
+	glGetProgramiv(program, GL_LINK_STATUS, &ok);
+	if (!ok) {
+		// e.g. after a driver update that did not change the version string
+		DEBUG_LOG << "Program binary rejected by driver, compiling again";
+		++s_stats.misses;
+		return false;
+	}
+
+	double loadMilliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+	++s_stats.hits;
+	s_stats.savedMilliseconds += header.compileMilliseconds - loadMilliseconds;
+	return true;
+}
+
+void ShaderProgramCache::Store(GLuint program, Key key, double compileMilliseconds)
+{
+	if (!s_enabled) return;
+
+	GLint length = 0;
+	glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+	if (length <= 0) return; // driver does not support any binary format
+
+	EntryHeader header;
+	header.magic = EntryMagic;
+	header.version = EntryVersion;
+	header.key = key;
+	header.compileMilliseconds = compileMilliseconds;
+
+	std::vector<char> binary(static_cast<size_t>(length));
+	GLenum format;
+	GLsizei actualLength;
+	glGetProgramBinary(program, length, &actualLength, &format, binary.data());
+	header.binaryFormat = static_cast<uint32_t>(format);
+	header.binarySize = static_cast<uint32_t>(actualLength);
+
+	std::error_code err;
+	fs::create_directories(Directory(), err);
+
+	// Write then rename, so that concurrent instances never read partial entries
+	std::string path = EntryPath(key);
+	std::string tmpPath = path + ".tmp";
+	{
+		std::ofstream out(tmpPath, std::ios::binary);
+		if (!out.is_open()) {
+			WARN_LOG << "Could not write program binary cache entry " << path;
+			return;
+		}
+		out.write(reinterpret_cast<const char*>(&header), sizeof(header));
+		out.write(binary.data(), header.binarySize);
+		if (!out) {
+			WARN_LOG << "Could not write program binary cache entry " << path;
+			out.close();
+			fs::remove(tmpPath, err);
+			return;
+		}
+	}
+	// rename() does not replace an existing entry on Windows, e.g. one the driver rejected
+	fs::remove(path, err);
+	fs::rename(tmpPath, path, err);
+	if (err) {
+		WARN_LOG << "Could not write program binary cache entry " << path << ": " << err.message();
+		fs::remove(tmpPath, err);
+	}
+}
+
+std::string ShaderProgramCache::EntryPath(Key key)
+{
+	std::ostringstream ss;
+	ss << std::hex << std::setw(16) << std::setfill('0') << key << ".gvprog";
+	return (fs::path(Directory()) / ss.str()).string();
+}
@@ -0,0 +1,91 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+
+#pragma once
+
+#include <OpenGL>
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <map>
+
+/**
+ * Disk cache of linked program binaries (glGetProgramBinary), so that the
+ * many shader variants are not compiled again at each startup. Entries are
+ * addressed by a hash of the preprocessed sources of all stages, the defines,
+ * the snippets and the driver identification strings. Any failure (missing
+ * entry, binary rejected by the driver) falls back to regular compilation.
+ */
+class ShaderProgramCache {
+public:
+	typedef uint64_t Key;
+	struct Stats {
+		int hits = 0;
+		int misses = 0;
+		double savedMilliseconds = 0.0; // compile time stored in entries minus binary load time
+	};
+
+	static void SetEnabled(bool enabled) { s_enabled = enabled; }
+	static bool IsEnabled() { return s_enabled; }
+
+	/**
+	 * Defaults to cache/programs in the share directory
+	 */
+	static void SetDirectory(const std::string& directory) { s_directory = directory; }
+	static std::string Directory();
+
+	static Key ComputeKey(
+		const std::vector<std::vector<GLchar>>& sources,
+		const std::vector<std::string>& defines,
+		const std::map<std::string, std::string>& snippets);
+
+	/**
+	 * Try to set the program from a cache entry. Return true iff the program
+	 * is then successfully linked.
+	 */
+	static bool Load(GLuint program, Key key);
+
+	/**
+	 * Save a linked program. It must have been linked with
+	 * GL_PROGRAM_BINARY_RETRIEVABLE_HINT set.
+	 */
+	static void Store(GLuint program, Key key, double compileMilliseconds);
+
+	static const Stats& GetStats() { return s_stats; }
+
+private:
+	static std::string EntryPath(Key key);
+
+private:
+	static bool s_enabled;
+	static std::string s_directory;
+	static Stats s_stats;
+};
@@ -85,7 +85,7 @@ void StandardMaterial::fromTinyObj(const tinyobj::material_t& mat, const std::st
 	}
 }
 
-GLuint StandardMaterial::setUniforms(const ShaderProgram& shader, const std::string& prefix, GLuint nextTextureUnit) const
+GLuint StandardMaterial::setUniforms(const ShaderProgram& shader, const UniformName& prefix, GLuint nextTextureUnit) const
 {
 	GLint o = nextTextureUnit;
 
@@ -31,6 +31,7 @@
 
 #include <OpenGL>
 #include "GlTexture.h"
+#include "UniformName.h"
 
 #include <glm/glm.hpp>
 #include <rapidjson/document.h>
@@ -58,5 +59,5 @@ struct StandardMaterial
 	bool deserialize(const rapidjson::Value& json);
 	void fromTinyObj(const tinyobj::material_t & mat, const std::string& textureRoot);
 	// return the next available texture unit
-	GLuint setUniforms(const ShaderProgram& shader, const std::string & prefix, GLuint nextTextureUnit) const;
+	GLuint setUniforms(const ShaderProgram& shader, const UniformName& prefix, GLuint nextTextureUnit) const;
 };
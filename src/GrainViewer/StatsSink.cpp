@@ -0,0 +1,306 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+
+#include "StatsSink.h"
+#include "Logger.h"
+#include "utils/strutils.h"
+
+#include <chrono>
+#include <cmath>
+#include <filesystem>
+#include <fstream>
+#include <limits>
+
+namespace fs = std::filesystem;
+
+constexpr auto WriterPeriod = std::chrono::milliseconds(5);
+
+int StatsSink::s_frame = 0;
+
+StatsSink& StatsSink::Instance()
+{
+	// Never destroyed, Shutdown() must be called explicitly so that the
+	// writer thread is not joined during static destruction.
+	static StatsSink* instance = new StatsSink();
+	return *instance;
+}
+
+StatsSink::StatsSink()
+	: m_ring(RingSize)
+{}
+
+///////////////////////////////////////////////////////////////////////////////
+// Render thread side
+
+StatsSink::TableId StatsSink::AddTable(const std::string& filename)
+{
+	StatsSink& sink = Instance();
+	TableId table;
+	{
+		std::lock_guard<std::mutex> lock(sink.m_tablesMutex);
+		auto t = std::make_unique<Table>();
+		t->filename = filename;
+		t->firstFrame = s_frame;
+		table = static_cast<TableId>(sink.m_tables.size());
+		sink.m_tables.push_back(std::move(t));
+	}
+	sink.start();
+	LOG << "Recording stats to " << filename;
+	return table;
+}
+
+StatsSink::ColumnId StatsSink::AddColumn(TableId table, const std::string& name)
+{
+	StatsSink& sink = Instance();
+	std::lock_guard<std::mutex> lock(sink.m_tablesMutex);
+	if (table < 0 || table >= static_cast<TableId>(sink.m_tables.size())) return -1;
+	auto& names = sink.m_tables[table]->columnNames;
+	names.push_back(name);
+	return static_cast<ColumnId>(names.size() - 1);
+}
+
+void StatsSink::Record(TableId table, ColumnId column, int frame, double value)
+{
+	if (table < 0 || column < 0) return;
+	Instance().push(Entry{ table, column, frame, value });
+}
+
+void StatsSink::RecordDeferred(TableId table, ColumnId firstColumn, int count, std::function<void(double*)> task)
+{
+	if (table < 0 || firstColumn < 0) return;
+	if (!CanRecordDeferred(count)) return;
+	StatsSink& sink = Instance();
+	++sink.m_pendingTasks;
+	std::lock_guard<std::mutex> lock(sink.m_tasksMutex);
+	sink.m_tasks.push_back(DeferredTask{ table, firstColumn, count, s_frame, std::move(task) });
+}
+
+bool StatsSink::CanRecordDeferred(int count)
+{
+	StatsSink& sink = Instance();
+	if (sink.m_pendingTasks.load() >= MaxPendingTasks) {
+		// The writer is late, rather lose these values than pile up tasks
+		sink.m_dropped.fetch_add(count, std::memory_order_relaxed);
+		return false;
+	}
+	return true;
+}
+
+void StatsSink::CloseTable(TableId table)
+{
+	if (table < 0) return;
+	Instance().push(Entry{ table, -1, s_frame, 0.0 });
+}
+
+void StatsSink::Shutdown()
+{
+	StatsSink& sink = Instance();
+	if (!sink.m_running) return;
+	sink.m_running = false;
+	sink.m_writer.join();
+
+	// Drain what is left and export tables that were not closed
+	sink.processEntries();
+	for (auto& table : sink.m_tables) {
+		if (table->open) {
+			sink.exportTable(*table);
+			table->open = false;
+		}
+	}
+
+	if (sink.m_dropped > 0) {
+		WARN_LOG << "Stats sink dropped " << sink.m_dropped << " values (writer thread could not keep up)";
+	}
+}
+
+void StatsSink::start()
+{
+	if (m_running) return;
+	m_running = true;
+	m_writer = std::thread(&StatsSink::writerLoop, this);
+}
+
+void StatsSink::push(const Entry& entry)
+{
+	size_t head = m_head.load(std::memory_order_relaxed);
+	size_t next = (head + 1) % RingSize;
+	if (next == m_tail.load(std::memory_order_acquire)) {
+		// Full, rather lose a value than stall the frame
+		m_dropped.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+	m_ring[head] = entry;
+	m_head.store(next, std::memory_order_release);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Writer thread side
+
+void StatsSink::writerLoop()
+{
+	while (m_running) {
+		processEntries();
+		std::this_thread::sleep_for(WriterPeriod);
+	}
+}
+
+void StatsSink::processEntries()
+{
+	size_t tail = m_tail.load(std::memory_order_relaxed);
+	size_t head = m_head.load(std::memory_order_acquire);
+	while (tail != head) {
+		Entry entry = m_ring[tail];
+		tail = (tail + 1) % RingSize;
+		m_tail.store(tail, std::memory_order_release);
+
+		Table* table;
+		{
+			std::lock_guard<std::mutex> lock(m_tablesMutex);
+			if (entry.table >= static_cast<TableId>(m_tables.size())) continue;
+			table = m_tables[entry.table].get();
+		}
+		if (!table->open) continue;
+
+		if (entry.column == -1) {
+			// Tasks were submitted before the close, so they belong in the file
+			runDeferredTasks();
+			exportTable(*table);
+			table->open = false;
+			table->columns.clear();
+		}
+		else {
+			store(*table, entry.column, entry.frame, entry.value);
+		}
+	}
+	runDeferredTasks();
+}
+
+void StatsSink::runDeferredTasks()
+{
+	std::vector<DeferredTask> tasks;
+	{
+		std::lock_guard<std::mutex> lock(m_tasksMutex);
+		tasks.swap(m_tasks);
+	}
+
+	std::vector<double> values;
+	for (auto& t : tasks) {
+		Table* table;
+		{
+			std::lock_guard<std::mutex> lock(m_tablesMutex);
+			table = m_tables[t.table].get();
+		}
+		if (table->open) {
+			values.assign(t.count, std::numeric_limits<double>::quiet_NaN());
+			t.task(values.data());
+			for (int i = 0; i < t.count; ++i) {
+				store(*table, t.firstColumn + i, t.frame, values[i]);
+			}
+		}
+		t.task = nullptr; // release its data before allowing a new task
+		--m_pendingTasks;
+	}
+}
+
+void StatsSink::store(Table& table, ColumnId column, int frame, double value)
+{
+	int row = frame - table.firstFrame;
+	if (row < 0) return;
+	if (column >= static_cast<ColumnId>(table.columns.size())) {
+		table.columns.resize(column + 1);
+	}
+	auto& values = table.columns[column];
+	if (row >= static_cast<int>(values.size())) {
+		values.resize(row + 1, std::numeric_limits<double>::quiet_NaN());
+	}
+	values[row] = value;
+}
+
+void StatsSink::exportTable(const Table& table)
+{
+	std::vector<std::string> names;
+	{
+		std::lock_guard<std::mutex> lock(m_tablesMutex);
+		names = table.columnNames;
+	}
+
+	size_t rowCount = 0;
+	for (const auto& values : table.columns) {
+		rowCount = std::max(rowCount, values.size());
+	}
+	auto value = [&](size_t col, size_t row) {
+		if (col >= table.columns.size() || row >= table.columns[col].size()) {
+			return std::numeric_limits<double>::quiet_NaN();
+		}
+		return table.columns[col][row];
+	};
+
+	fs::path csvPath = fs::path(table.filename).replace_extension(".csv");
+	std::ofstream csv(csvPath);
+	if (!csv.is_open()) {
+		ERR_LOG << "Could not open stats file: " << csvPath;
+	}
+	else {
+		csv << "frame";
+		for (const auto& name : names) csv << ";" << name;
+		csv << "\n";
+		for (size_t row = 0; row < rowCount; ++row) {
+			csv << (table.firstFrame + row);
+			for (size_t col = 0; col < names.size(); ++col) {
+				csv << ";";
+				double v = value(col, row);
+				if (!std::isnan(v)) csv << v;
+			}
+			csv << "\n";
+		}
+	}
+
+	fs::path jsonPath = fs::path(table.filename).replace_extension(".json");
+	std::ofstream json(jsonPath);
+	if (!json.is_open()) {
+		ERR_LOG << "Could not open stats file: " << jsonPath;
+	}
+	else {
+		json << "{\n\"firstFrame\": " << table.firstFrame << ",\n\"frameCount\": " << rowCount << ",\n\"columns\": {";
+		for (size_t col = 0; col < names.size(); ++col) {
+			json << (col > 0 ? "," : "") << "\n\"" << escapeJsonString(names[col]) << "\": [";
+			for (size_t row = 0; row < rowCount; ++row) {
+				double v = value(col, row);
+				json << (row > 0 ? "," : "");
+				if (std::isnan(v)) json << "null";
+				else json << v;
+			}
+			json << "]";
+		}
+		json << "\n}\n}\n";
+	}
+
+	LOG << "Wrote " << rowCount << " frames of stats to " << csvPath << " and " << jsonPath;
+}
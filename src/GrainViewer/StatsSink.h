@@ -0,0 +1,159 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+/**
+ * Collects per frame statistics (timers, counters) and writes them from a
+ * background thread, so that recording them only costs the render thread
+ * a few stores in a ring buffer.
+ *
+ * Each stats file is a table of which columns are values and rows are
+ * frames. Tables are stored in memory by column and exported when closed,
+ * as CSV (';' separated, as stats used to be) and JSON, next to each other.
+ * All tables share the frame index advanced by NextFrame(), so that values
+ * recorded late (e.g. GPU timings) still end up in the right row.
+ *
+ * Recording must happen from a single thread (the render thread).
+ */
+class StatsSink {
+public:
+	typedef int TableId;
+	typedef int ColumnId;
+
+	/**
+	 * Open a new table. The extension of filename is replaced by .csv and
+	 * .json when exporting it.
+	 */
+	static TableId AddTable(const std::string& filename);
+	static ColumnId AddColumn(TableId table, const std::string& name);
+
+	/**
+	 * Record a value in the current frame, or in a given one. This never
+	 * blocks nor allocates, values are dropped if the writer is late by more
+	 * than the ring buffer.
+	 */
+	static void Record(TableId table, ColumnId column, double value) { Record(table, column, s_frame, value); }
+	static void Record(TableId table, ColumnId column, int frame, double value);
+
+	/**
+	 * Compute count values starting at firstColumn on the writer thread, for
+	 * stats that are expensive to get (e.g. counting pixels). The task must
+	 * own whatever data it reads. At most MaxPendingTasks tasks wait at once,
+	 * further ones are dropped (and their values counted as such).
+	 */
+	static void RecordDeferred(TableId table, ColumnId firstColumn, int count, std::function<void(double*)> task);
+
+	/**
+	 * Whether RecordDeferred would accept a task, so that callers do not copy
+	 * data for nothing. If not, count values are counted as dropped.
+	 */
+	static bool CanRecordDeferred(int count);
+
+	/**
+	 * Export a table and forget it. Values recorded before are not lost.
+	 */
+	static void CloseTable(TableId table);
+
+	static int CurrentFrame() { return s_frame; }
+	static void NextFrame() { ++s_frame; }
+
+	/**
+	 * Close all tables and stop the writer thread. Call before exiting.
+	 */
+	static void Shutdown();
+
+private:
+	struct Entry {
+		TableId table;
+		ColumnId column; // -1 to close the table
+		int frame;
+		double value;
+	};
+
+	struct DeferredTask {
+		TableId table;
+		ColumnId firstColumn;
+		int count;
+		int frame;
+		std::function<void(double*)> task;
+	};
+
+	// Only touched by the writer thread, except names
+	struct Table {
+		std::string filename;
+		std::vector<std::string> columnNames; // guarded by m_tablesMutex
+		int firstFrame = 0;
+		bool open = true;
+		std::vector<std::vector<double>> columns; // NaN where nothing was recorded
+	};
+
+	static constexpr size_t RingSize = 1 << 16;
+	static constexpr int MaxPendingTasks = 4;
+
+private:
+	static StatsSink& Instance();
+	StatsSink();
+
+	void start();
+	void push(const Entry& entry);
+	void writerLoop();
+	void processEntries();
+	void runDeferredTasks();
+	void store(Table& table, ColumnId column, int frame, double value);
+	void exportTable(const Table& table);
+
+private:
+	static int s_frame;
+
+	// Single producer, single consumer ring buffer
+	std::vector<Entry> m_ring;
+	std::atomic<size_t> m_head = 0; // next entry written by the render thread
+	std::atomic<size_t> m_tail = 0; // next entry read by the writer thread
+	std::atomic<int> m_dropped = 0;
+
+	std::mutex m_tablesMutex; // table creation and column names only
+	std::vector<std::unique_ptr<Table>> m_tables;
+
+	std::mutex m_tasksMutex;
+	std::vector<DeferredTask> m_tasks;
+	std::atomic<int> m_pendingTasks = 0; // queued or running
+
+	std::thread m_writer;
+	std::atomic<bool> m_running = false;
+};
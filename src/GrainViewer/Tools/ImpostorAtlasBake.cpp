@@ -0,0 +1,163 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+
+#include "bakeImpostorAtlasCpu.h"
+
+#include "utils/textureCompression.h"
+#include "Logger.h"
+
+#include <stb_image.h>
+
+#include <algorithm>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <filesystem>
+namespace fs = std::filesystem;
+
+/**
+ * Load all images of a texture stack directory, in the order used by
+ * ResourceManager::loadTextureStack, as a single RGBA8 buffer.
+ */
+static bool loadStack(const fs::path& dirname, std::vector<uint8_t>& pixels, int& width, int& height)
+{
+	if (!fs::is_directory(dirname)) {
+		ERR_LOG << "Texture directory does not exist or is not a directory: " << dirname;
+		return false;
+	}
+	std::vector<fs::path> filenames;
+	for (auto& p : fs::directory_iterator(dirname)) {
+		if (p.is_regular_file()) filenames.push_back(p.path());
+	}
+	std::sort(filenames.begin(), filenames.end());
+
+	pixels.clear();
+	width = height = 0;
+	for (const auto& filename : filenames) {
+		int w, h, channels;
+		unsigned char* image = stbi_load(filename.string().c_str(), &w, &h, &channels, 4);
+		if (!image) {
+			ERR_LOG << "Unable to load texture file: '" << filename << "' with stb_image: " << stbi_failure_reason();
+			return false;
+		}
+		if (width == 0) {
+			width = w;
+		}
+		if (w != width) {
+			ERR_LOG << "Inconsistent image size in texture stack: " << filename;
+			stbi_image_free(image);
+			return false;
+		}
+		pixels.insert(pixels.end(), image, image + 4 * static_cast<size_t>(w) * h);
+		height += h;
+		stbi_image_free(image);
+	}
+	return width > 0;
+}
+
+/**
+ * Compare two atlases map by map, e.g. one baked on GPU (saved using the
+ * 'save' option of impostor materials) and one baked by this tool.
+ */
+static bool compareAtlases(const std::string& referenceDirectory, const std::string& testDirectory, double minPsnr)
+{
+	struct Map { const char* name; int channels; bool normals; };
+	const Map maps[] = {
+		{ "normalAlpha", 4, true },
+		{ "baseColor", 3, false },
+		{ "metallicRoughness", 2, false },
+	};
+
+	bool success = true;
+	for (const Map& map : maps) {
+		std::vector<uint8_t> reference, test;
+		int refWidth, refHeight, testWidth, testHeight;
+		if (!loadStack(fs::path(referenceDirectory) / map.name, reference, refWidth, refHeight)
+			|| !loadStack(fs::path(testDirectory) / map.name, test, testWidth, testHeight)) {
+			return false;
+		}
+		if (refWidth != testWidth || refHeight != testHeight) {
+			ERR_LOG << map.name << ": size mismatch ("
+				<< refWidth << "x" << refHeight << " vs " << testWidth << "x" << testHeight << ")";
+			success = false;
+			continue;
+		}
+
+		ImageDiff diff = diffImages(reference.data(), test.data(), refWidth, refHeight, map.channels, map.normals);
+		bool pass = diff.psnr >= minPsnr;
+		success = success && pass;
+		if (map.normals) {
+			LOG << map.name << ": PSNR = " << diff.psnr << " dB, max error = " << diff.maxError
+				<< ", normal angle error mean/max = " << diff.meanNormalAngle << "/" << diff.maxNormalAngle << " deg"
+				<< (pass ? "" : " (FAILED)");
+		} else {
+			LOG << map.name << ": PSNR = " << diff.psnr << " dB, max error = " << diff.maxError
+				<< (pass ? "" : " (FAILED)");
+		}
+	}
+	return success;
+}
+
+/**
+ * Bake impostor atlases on CPU, for build machines without GPU, or compare
+ * two atlases
+ */
+int main(int argc, char *argv[]) {
+	if (argc >= 4 && std::string(argv[1]) == "compare") {
+		double minPsnr = argc >= 5 ? std::atof(argv[4]) : 30.0;
+		bool success = compareAtlases(argv[2], argv[3], minPsnr);
+		return success ? EXIT_SUCCESS : EXIT_FAILURE;
+	}
+
+	if (argc < 3) {
+		ERR_LOG << "Usage: ImpostorAtlasBake <mesh.obj> <outputDirectory> [angularDefinition] [spatialDefinition] [supersampling] [threadCount]";
+		ERR_LOG << "   or: ImpostorAtlasBake compare <referenceDirectory> <testDirectory> [minPsnr]";
+		return EXIT_FAILURE;
+	}
+
+	std::string inputFilename(argv[1]);
+	std::string outputDirectory(argv[2]);
+	CpuBakeOptions options;
+	if (argc >= 4) options.angularDefinition = std::atoi(argv[3]);
+	if (argc >= 5) options.spatialDefinition = std::atoi(argv[4]);
+	if (argc >= 6) options.supersampling = std::atoi(argv[5]);
+	if (argc >= 7) options.threadCount = static_cast<size_t>(std::atoi(argv[6]));
+
+	if (options.angularDefinition < 2 || options.spatialDefinition < 1) {
+		ERR_LOG << "Invalid atlas definition";
+		return EXIT_FAILURE;
+	}
+
+	CpuImpostorAtlas atlas;
+	if (!bakeImpostorAtlasCpu(inputFilename, options, atlas)) {
+		return EXIT_FAILURE;
+	}
+	return saveImpostorAtlasCpu(outputDirectory, atlas) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
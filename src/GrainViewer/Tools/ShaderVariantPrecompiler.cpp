@@ -0,0 +1,472 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+
+#include <OpenGL>
+
+#include "Ui/Window.h"
+#include "ShaderProgram.h"
+#include "ShaderProgramCache.h"
+#include "ShaderPreprocessor.h"
+#include "ResourceManager.h"
+#include "Logger.h"
+#include "utils/strutils.h"
+#include "utils/fileutils.h"
+
+#include <rapidjson/document.h>
+#include <GLFW/glfw3.h>
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <fstream>
+#include <memory>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <filesystem>
+namespace fs = std::filesystem;
+
+#undef GetObject
+
+/**
+ * Defines listed by one #pragma. "opt A B" makes each of A and B an
+ * independent on/off switch, while "variant A B" and "varopt A B" list
+ * exclusive modes, of which none or one is defined.
+ */
+struct VariantGroup {
+	std::vector<std::string> names;
+	bool operator<(const VariantGroup& other) const { return names < other.names; }
+};
+
+/**
+ * Base configuration of a shader program, like the entries of the "shaders"
+ * field of a scene. Variants are enumerated on top of it.
+ */
+struct ProgramConfig {
+	std::string baseFile;
+	ShaderProgram::ShaderProgramType type = ShaderProgram::RenderShader;
+	std::set<std::string> defines;
+	std::map<std::string, std::string> snippets;
+	std::string label; // for the report
+};
+
+struct Report {
+	int variants = 0;
+	int failed = 0;
+	int fromCache = 0;
+	size_t binaryBytes = 0;
+	double milliseconds = 0;
+};
+
+// Compile at most this many programs at once, to bound memory usage
+constexpr size_t BatchSize = 64;
+
+/**
+ * Variants that broke before and are always built, whatever --max-active.
+ */
+static const std::vector<std::pair<std::string, std::set<std::string>>> RegressionVariants = {
+	// random-grains.inc.glsl first included under PASS_RESOLVE_VISIBILITY,
+	// must not be skipped when procedural-color.inc.glsl includes it again
+	{ "impostor-grain", { "PROCEDURAL_BASECOLOR" } },
+	{ "impostor-grain", { "PROCEDURAL_BASECOLOR", "PASS_BLIT_TO_MAIN_FBO" } },
+};
+
+/**
+ * List base names (e.g. "grain/far-grain-splat") of all programs in the shader
+ * directory, i.e. files having a vertex or compute stage.
+ */
+static std::vector<ProgramConfig> listPrograms(const std::string& shaderDir) {
+	std::vector<ProgramConfig> programs;
+	for (const auto& entry : fs::recursive_directory_iterator(shaderDir)) {
+		if (!entry.is_regular_file()) continue;
+		std::string path = fs::relative(entry.path(), shaderDir).generic_string();
+		ProgramConfig config;
+		if (endsWith(path, ".vert.glsl")) {
+			config.baseFile = path.substr(0, path.size() - std::string(".vert.glsl").size());
+		}
+		else if (endsWith(path, ".comp.glsl")) {
+			config.baseFile = path.substr(0, path.size() - std::string(".comp.glsl").size());
+			config.type = ShaderProgram::ComputeShader;
+		}
+		else {
+			continue;
+		}
+		config.label = config.baseFile;
+		programs.push_back(config);
+	}
+	std::sort(programs.begin(), programs.end(), [](const ProgramConfig& a, const ProgramConfig& b) { return a.baseFile < b.baseFile; });
+	return programs;
+}
+
+/**
+ * Read base configurations from the "shaders" field of a scene file, and the
+ * global defines implied by its "deferredShader" field.
+ */
+static bool loadSceneConfigs(const std::string& filename, std::vector<ProgramConfig>& configs, std::set<std::string>& globalDefines) {
+	std::ifstream in(filename);
+	if (!in.is_open()) {
+		ERR_LOG << filename << ": Unable to read";
+		return false;
+	}
+	std::stringstream buffer;
+	buffer << in.rdbuf();
+
+	rapidjson::Document d;
+	if (d.Parse(buffer.str().c_str()).HasParseError() || !d.IsObject() || !d.HasMember("augen")) {
+		ERR_LOG << "Invalid scene file: " << filename;
+		return false;
+	}
+	const rapidjson::Value& root = d["augen"];
+
+	if (root.HasMember("deferredShader") && root["deferredShader"].IsObject()) {
+		const auto& deferred = root["deferredShader"];
+		if (deferred.HasMember("gbufferLayout") && deferred["gbufferLayout"].IsString() && std::string(deferred["gbufferLayout"].GetString()) == "Compact") {
+			globalDefines.insert("COMPACT_GBUFFER");
+		}
+	}
+
+	if (!root.HasMember("shaders") || !root["shaders"].IsObject()) return true;
+	for (const auto& m : root["shaders"].GetObject()) {
+		ProgramConfig config;
+		config.label = m.name.GetString();
+		if (m.value.IsString()) {
+			config.baseFile = m.value.GetString();
+		}
+		else if (m.value.IsObject()) {
+			if (m.value.HasMember("baseFile") && m.value["baseFile"].IsString()) {
+				config.baseFile = m.value["baseFile"].GetString();
+			}
+			if (m.value.HasMember("defines") && m.value["defines"].IsArray()) {
+				for (const auto& def : m.value["defines"].GetArray()) {
+					if (def.IsString()) config.defines.insert(def.GetString());
+				}
+			}
+			if (m.value.HasMember("snippets") && m.value["snippets"].IsObject()) {
+				for (const auto& s : m.value["snippets"].GetObject()) {
+					if (s.value.IsString()) config.snippets[s.name.GetString()] = s.value.GetString();
+				}
+			}
+			if (m.value.HasMember("type") && m.value["type"].IsString() && std::string(m.value["type"].GetString()) == "compute") {
+				config.type = ShaderProgram::ComputeShader;
+			}
+		}
+		if (!config.baseFile.empty()) {
+			configs.push_back(config);
+		}
+	}
+	return true;
+}
+
+/**
+ * Gather the #pragma variant/opt/varopt of all stages of a program and of
+ * the files they include, as well as the snippets they need ("sys:" includes
+ * other than "sys:defines").
+ */
+static void scanProgram(const ProgramConfig& config, std::set<VariantGroup>& groups, std::set<std::string>& snippets) {
+	std::vector<GLenum> stages;
+	if (config.type == ShaderProgram::RenderShader) {
+		stages = { GL_VERTEX_SHADER, GL_GEOMETRY_SHADER, GL_FRAGMENT_SHADER };
+	} else {
+		stages = { GL_COMPUTE_SHADER };
+	}
+
+	std::set<std::string> files;
+	for (GLenum stage : stages) {
+		std::string path = ResourceManager::shaderFullPath(config.baseFile, stage);
+		if (!fs::is_regular_file(path)) continue;
+		ShaderPreprocessor preprocessor;
+		preprocessor.load(path);
+		for (const auto& dep : preprocessor.dependencies()) {
+			files.insert(dep.first);
+		}
+	}
+
+	for (const auto& filename : files) {
+		std::ifstream in(filename);
+		std::string line;
+		while (std::getline(in, line)) {
+			trim(line);
+			if (startsWith(line, "#include \"sys:")) {
+				std::string key = line.substr(std::string("#include \"sys:").size());
+				key = key.substr(0, key.find('"'));
+				if (key != "defines") snippets.insert(key);
+				continue;
+			}
+			if (!startsWith(line, "#pragma")) continue;
+
+			std::istringstream tokens(replaceAll(line.substr(std::string("#pragma").size()), ",", " "));
+			std::string kind, name;
+			tokens >> kind;
+			std::vector<std::string> names;
+			while (tokens >> name) names.push_back(name);
+			if (names.empty()) continue;
+
+			if (kind == "opt") {
+				for (const auto& n : names) groups.insert(VariantGroup{ { n } });
+			}
+			else if (kind == "variant" || kind == "varopt") {
+				groups.insert(VariantGroup{ names });
+			}
+		}
+	}
+}
+
+/**
+ * Enumerate the define sets reachable from base defines, with at most
+ * maxActive groups set at once (or all combinations if maxActive < 0).
+ * Groups already fixed by the base defines are not enumerated.
+ */
+static void enumerateVariants(
+	const std::vector<VariantGroup>& groups,
+	size_t groupIndex,
+	int maxActive,
+	std::set<std::string>& current,
+	std::set<std::set<std::string>>& variants)
+{
+	if (groupIndex == groups.size()) {
+		variants.insert(current);
+		return;
+	}
+	const auto& group = groups[groupIndex];
+	enumerateVariants(groups, groupIndex + 1, maxActive, current, variants);
+	if (maxActive == 0) return;
+	for (const auto& name : group.names) {
+		bool inserted = current.insert(name).second;
+		enumerateVariants(groups, groupIndex + 1, maxActive - 1, current, variants);
+		if (inserted) current.erase(name);
+	}
+}
+
+static std::string definesString(const std::set<std::string>& defines) {
+	std::ostringstream ss;
+	bool first = true;
+	for (const auto& def : defines) {
+		ss << (first ? "" : ", ") << def;
+		first = false;
+	}
+	return ss.str();
+}
+
+static Report compileVariants(const ProgramConfig& config, const std::set<std::set<std::string>>& variants, std::vector<std::string>& failures) {
+	Report report;
+	auto startTime = std::chrono::high_resolution_clock::now();
+	std::vector<std::set<std::string>> list(variants.begin(), variants.end());
+
+	for (size_t batchStart = 0; batchStart < list.size(); batchStart += BatchSize) {
+		size_t batchEnd = std::min(batchStart + BatchSize, list.size());
+
+		// Submit the whole batch before checking any, so that the driver
+		// can compile them in parallel if it supports it
+		std::vector<std::unique_ptr<ShaderProgram>> programs;
+		int hitsBefore = ShaderProgramCache::GetStats().hits;
+		for (size_t i = batchStart; i < batchEnd; ++i) {
+			auto program = std::make_unique<ShaderProgram>(config.baseFile);
+			program->setType(config.type);
+			for (const auto& def : config.defines) program->define(def);
+			for (const auto& def : list[i]) program->define(def);
+			for (const auto& s : config.snippets) program->setSnippet(s.first, s.second);
+			program->startLoading();
+			programs.push_back(std::move(program));
+		}
+		report.fromCache += ShaderProgramCache::GetStats().hits - hitsBefore;
+
+		for (size_t i = batchStart; i < batchEnd; ++i) {
+			auto& program = programs[i - batchStart];
+			program->finishLoading();
+			++report.variants;
+			if (!program->isValid()) {
+				++report.failed;
+				failures.push_back(config.label + " [" + definesString(list[i]) + "]");
+				continue;
+			}
+			GLint binaryLength = 0;
+			glGetProgramiv(program->raw(), GL_PROGRAM_BINARY_LENGTH, &binaryLength);
+			report.binaryBytes += static_cast<size_t>(binaryLength);
+		}
+	}
+
+	report.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - startTime).count();
+	return report;
+}
+
+static void printUsage() {
+	LOG << "Usage: ShaderVariantPrecompiler [options] [shader...]";
+	LOG << "  --scene <file.json>  Compile the shaders of a scene, with their defines and snippets";
+	LOG << "  --define <DEFINE>    Define on top of all variants (repeatable)";
+	LOG << "  --max-active <n>     Max number of options or modes set at once (default 2, -1 for all combinations)";
+	LOG << "  --cache <dir>        Binary cache directory (default: share/cache/programs)";
+	LOG << "  --dry-run            Only list variants";
+	LOG << "Shaders are base names relative to share/shaders (default: all of them).";
+}
+
+/**
+ * Enumerate the variants declared by #pragma variant/opt/varopt in shader
+ * sources, compile them all and fill the program binary cache, so that
+ * broken permutations are found before running the viewer. Returns an error
+ * code if any variant fails to compile or link.
+ * Works with a software context, e.g.:
+ *   LIBGL_ALWAYS_SOFTWARE=1 xvfb-run -a ShaderVariantPrecompiler
+ */
+int main(int argc, char *argv[]) {
+	std::string sceneFilename;
+	std::set<std::string> globalDefines;
+	std::set<std::string> selectedShaders;
+	int maxActive = 2;
+	bool dryRun = false;
+	for (int i = 1; i < argc; ++i) {
+		std::string arg = argv[i];
+		bool hasValue = i + 1 < argc;
+		if (arg == "--scene" && hasValue) {
+			sceneFilename = argv[++i];
+		}
+		else if (arg == "--define" && hasValue) {
+			globalDefines.insert(argv[++i]);
+		}
+		else if (arg == "--max-active" && hasValue) {
+			maxActive = std::atoi(argv[++i]);
+		}
+		else if (arg == "--cache" && hasValue) {
+			ShaderProgramCache::SetDirectory(argv[++i]);
+		}
+		else if (arg == "--dry-run") {
+			dryRun = true;
+		}
+		else if (startsWith(arg, "--")) {
+			printUsage();
+			return EXIT_FAILURE;
+		}
+		else {
+			selectedShaders.insert(arg);
+		}
+	}
+
+	// List base configurations
+	std::string shaderDir = joinPath(ResourceManager::shareDir(), "shaders");
+	std::vector<ProgramConfig> configs;
+	if (!sceneFilename.empty()) {
+		if (!loadSceneConfigs(sceneFilename, configs, globalDefines)) {
+			return EXIT_FAILURE;
+		}
+	}
+	// Programs not used by the scene are compiled with no base define
+	std::set<std::string> configuredFiles;
+	for (const auto& c : configs) configuredFiles.insert(c.baseFile);
+	for (const auto& c : listPrograms(shaderDir)) {
+		if (configuredFiles.count(c.baseFile) == 0) configs.push_back(c);
+	}
+	if (!selectedShaders.empty()) {
+		configs.erase(std::remove_if(configs.begin(), configs.end(), [&](const ProgramConfig& c) {
+			return selectedShaders.count(c.baseFile) == 0 && selectedShaders.count(c.label) == 0;
+		}), configs.end());
+	}
+
+	std::unique_ptr<Window> window;
+	if (!dryRun) {
+		window = std::make_unique<Window>(64, 64, "ShaderVariantPrecompiler");
+		if (!window->isValid()) {
+			return EXIT_FAILURE;
+		}
+		ShaderProgram::EnableParallelCompilation([](const char* name) { return reinterpret_cast<void*>(glfwGetProcAddress(name)); });
+	}
+	ShaderProgram::SetGlobalDefines(globalDefines);
+
+	Report total;
+	std::vector<std::string> failures;
+	int skipped = 0;
+	for (const auto& config : configs) {
+		std::set<VariantGroup> groupSet;
+		std::set<std::string> snippets;
+		scanProgram(config, groupSet, snippets);
+
+		bool missingSnippet = false;
+		for (const auto& key : snippets) {
+			if (config.snippets.count(key) == 0) {
+				WARN_LOG << config.label << ": skipped, needs snippet '" << key << "' (use --scene)";
+				missingSnippet = true;
+			}
+		}
+		if (missingSnippet) {
+			++skipped;
+			continue;
+		}
+
+		// Groups fixed by base defines are not enumerated
+		std::vector<VariantGroup> groups;
+		for (const auto& group : groupSet) {
+			bool fixed = std::any_of(group.names.begin(), group.names.end(), [&](const std::string& n) {
+				return config.defines.count(n) > 0 || globalDefines.count(n) > 0;
+			});
+			if (!fixed) groups.push_back(group);
+		}
+
+		std::set<std::string> current;
+		std::set<std::set<std::string>> variants;
+		enumerateVariants(groups, 0, maxActive, current, variants);
+		for (const auto& v : RegressionVariants) {
+			if (v.first == config.baseFile) variants.insert(v.second);
+		}
+
+		if (dryRun) {
+			LOG << config.label << ": " << variants.size() << " variants";
+			for (const auto& v : variants) {
+				LOG << "  [" << definesString(v) << "]";
+			}
+			total.variants += static_cast<int>(variants.size());
+			continue;
+		}
+
+		Report report = compileVariants(config, variants, failures);
+		LOG << config.label << ": " << report.variants << " variants, "
+			<< report.failed << " failed, "
+			<< report.fromCache << " from cache, "
+			<< (report.binaryBytes / 1024) << " KiB of binaries, "
+			<< report.milliseconds << " ms";
+
+		total.variants += report.variants;
+		total.failed += report.failed;
+		total.fromCache += report.fromCache;
+		total.binaryBytes += report.binaryBytes;
+		total.milliseconds += report.milliseconds;
+	}
+
+	LOG << "Total: " << total.variants << " variants of " << (configs.size() - skipped) << " programs"
+		<< (skipped > 0 ? MAKE_STR(" (" << skipped << " skipped)") : std::string());
+	if (dryRun) return EXIT_SUCCESS;
+
+	LOG << "  " << total.failed << " failed, " << total.fromCache << " from cache, "
+		<< (total.binaryBytes / 1024) << " KiB of binaries in " << ShaderProgramCache::Directory()
+		<< ", " << (total.milliseconds / 1000.0) << " s";
+	for (const auto& f : failures) {
+		ERR_LOG << "Failed: " << f;
+	}
+
+	return total.failed > 0 ? EXIT_FAILURE : EXIT_SUCCESS;
+}
@@ -0,0 +1,142 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+
+#include <OpenGL>
+
+#include "Ui/Window.h"
+#include "ShaderProgram.h"
+#include "Logger.h"
+#include "Behavior/ImpostorGrainRenderer.h"
+#include "utils/behaviorutils.h"
+#include "utils/strutils.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdlib>
+#include <string>
+#include <functional>
+
+// Same as ImpostorAtlasMaterial::setUniforms() and the array size in grain shaders
+static const char* AtlasMaterialUniforms[] = {
+	"viewCount", "baseColor", "metallic", "roughness",
+	"normalAlphaTexture", "baseColorTexture", "hasBaseColorMap",
+	"metallicRoughnessTexture", "hasMetallicRoughnessMap",
+};
+constexpr int AtlasCount = 3;
+
+// What ShaderProgram::setUniform used to do before the location cache
+static void legacySetUniform(GLuint program, const std::string& name, GLint value) {
+	GLint loc = glGetUniformLocation(program, name.c_str());
+	if (loc != -1) glProgramUniform1i(program, loc, value);
+}
+static void legacySetUniform(GLuint program, const std::string& name, GLfloat value) {
+	GLint loc = glGetUniformLocation(program, name.c_str());
+	if (loc != -1) glProgramUniform1f(program, loc, value);
+}
+
+// What autoSetUniforms and material prefixes used to do
+static void legacyUniformSetup(GLuint program, const ImpostorGrainRenderer::Properties& properties) {
+	for_each(refl::reflect(properties).members, [&](auto member) {
+		using type = typename decltype(member)::value_type;
+		std::string name = "u" + std::string(member.name);
+		name[1] = toupper(name[1]);
+		if constexpr (std::is_same_v<type, float>) {
+			legacySetUniform(program, name, member(properties));
+		}
+		else if constexpr (std::is_same_v<type, bool> || std::is_same_v<type, int> || std::is_enum_v<type>) {
+			legacySetUniform(program, name, static_cast<GLint>(member(properties)));
+		}
+	});
+	for (int k = 0; k < AtlasCount; ++k) {
+		std::string prefix = MAKE_STR("uImpostor[" << k << "].");
+		for (const char* uniform : AtlasMaterialUniforms) {
+			legacySetUniform(program, prefix + uniform, 0);
+		}
+	}
+}
+
+static void cachedUniformSetup(const ShaderProgram& shader, const ImpostorGrainRenderer::Properties& properties) {
+	autoSetUniforms(shader, properties);
+	for (int k = 0; k < AtlasCount; ++k) {
+		UniformName prefix = UniformName("uImpostor")[k];
+		for (const char* uniform : AtlasMaterialUniforms) {
+			shader.setUniform(prefix + uniform, 0);
+		}
+	}
+}
+
+// Return microseconds per call
+static double measure(int iterations, const std::function<void()>& f) {
+	f(); // warm up
+	glFinish();
+	auto start = std::chrono::high_resolution_clock::now();
+	for (int i = 0; i < iterations; ++i) {
+		f();
+	}
+	glFinish();
+	auto end = std::chrono::high_resolution_clock::now();
+	return std::chrono::duration<double, std::micro>(end - start).count() / iterations;
+}
+
+/**
+ * Micro-benchmark of the uniform setup that grain renderers run for every
+ * pass of every frame (reflected properties and atlas materials), comparing
+ * ShaderProgram's location cache with per call name building and
+ * glGetUniformLocation.
+ * Usage: UniformSetupBenchmark [iterations]
+ */
+int main(int argc, char *argv[]) {
+	int iterations = 10000;
+	if (argc >= 2) {
+		iterations = std::max(1, std::stoi(argv[1]));
+	}
+
+	auto window = std::make_shared<Window>(64, 64, "UniformSetupBenchmark");
+	if (!window->isValid()) {
+		return EXIT_FAILURE;
+	}
+
+	ShaderProgram shader("impostor-grain");
+	shader.load();
+	if (!shader.isValid()) {
+		ERR_LOG << "Could not load impostor-grain shader";
+		return EXIT_FAILURE;
+	}
+
+	ImpostorGrainRenderer::Properties properties;
+	double legacy = measure(iterations, [&]() { legacyUniformSetup(shader.raw(), properties); });
+	double cached = measure(iterations, [&]() { cachedUniformSetup(shader, properties); });
+
+	LOG << "Uniform setup of one impostor grain pass (" << iterations << " iterations):";
+	LOG << " - building names + glGetUniformLocation: " << legacy << " us";
+	LOG << " - location cache: " << cached << " us (x" << (legacy / cached) << ")";
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,376 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+
+#include "bakeImpostorAtlasCpu.h"
+#include "Mesh.h"
+#include "bufferFillers.h"
+#include "Logger.h"
+#include "utils/fileutils.h"
+#include "utils/strutils.h"
+#include "utils/ThreadPool.h"
+#include "utils/impostor.glsl.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <stb_image.h>
+#include <stb_image_write.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <limits>
+#include <map>
+#include <memory>
+#include <filesystem>
+namespace fs = std::filesystem;
+
+namespace {
+
+struct CpuTexture {
+	int width = 0;
+	int height = 0;
+	std::vector<uint8_t> pixels; // RGBA8
+
+	// Bilinear lookup in GL_REPEAT mode (no mipmaps, supersampling is
+	// expected to take care of minification)
+	glm::vec4 sample(glm::vec2 uv) const {
+		float x = uv.x * width - 0.5f;
+		float y = uv.y * height - 0.5f;
+		float fx = std::floor(x);
+		float fy = std::floor(y);
+		int x0 = static_cast<int>(fx);
+		int y0 = static_cast<int>(fy);
+		auto texel = [this](int i, int j) {
+			i = (i % width + width) % width;
+			j = (j % height + height) % height;
+			const uint8_t* p = &pixels[4 * (static_cast<size_t>(j) * width + i)];
+			return glm::vec4(p[0], p[1], p[2], p[3]) / 255.0f;
+		};
+		return glm::mix(
+			glm::mix(texel(x0, y0), texel(x0 + 1, y0), x - fx),
+			glm::mix(texel(x0, y0 + 1), texel(x0 + 1, y0 + 1), x - fx),
+			y - fy
+		);
+	}
+};
+
+/**
+ * Same as StandardMaterial, without GL textures
+ */
+struct CpuMaterial {
+	glm::vec3 baseColor = glm::vec3(1.0f, 0.5f, 0.0f);
+	float metallic = 0.0f;
+	float roughness = 0.5f;
+	const CpuTexture* baseColorMap = nullptr;
+	const CpuTexture* normalMap = nullptr;
+	const CpuTexture* metallicMap = nullptr;
+	const CpuTexture* roughnessMap = nullptr;
+};
+
+class TextureLoader {
+public:
+	const CpuTexture* load(const std::string& filename) {
+		auto it = m_textures.find(filename);
+		if (it != m_textures.end()) {
+			return it->second.get();
+		}
+		std::unique_ptr<CpuTexture> tex;
+		int channels;
+		int width, height;
+		if (unsigned char* image = stbi_load(filename.c_str(), &width, &height, &channels, 4)) {
+			tex = std::make_unique<CpuTexture>();
+			tex->width = width;
+			tex->height = height;
+			tex->pixels.assign(image, image + 4 * static_cast<size_t>(width) * height);
+			stbi_image_free(image);
+		} else {
+			WARN_LOG << "Unable to load texture file: '" << filename << "' with stb_image: " << stbi_failure_reason();
+		}
+		const CpuTexture* ptr = tex.get();
+		m_textures[filename] = std::move(tex);
+		return ptr;
+	}
+
+private:
+	std::map<std::string, std::unique_ptr<CpuTexture>> m_textures;
+};
+
+// Mirrors StandardMaterial::fromTinyObj
+CpuMaterial materialFromTinyObj(const tinyobj::material_t& mat, const std::string& textureRoot, TextureLoader& loader) {
+	CpuMaterial m;
+	m.baseColor = glm::make_vec3(mat.diffuse);
+	m.roughness = mat.roughness;
+	m.metallic = mat.metallic;
+	auto loadIfAny = [&](const std::string& texname, const CpuTexture*& target) {
+		if (!texname.empty()) target = loader.load(joinPath(textureRoot, texname));
+	};
+	loadIfAny(mat.diffuse_texname, m.baseColorMap);
+	loadIfAny(mat.metallic_texname, m.metallicMap);
+	loadIfAny(mat.reflection_texname, m.metallicMap);
+	loadIfAny(mat.specular_highlight_texname, m.roughnessMap);
+	loadIfAny(mat.roughness_texname, m.roughnessMap);
+	loadIfAny(mat.bump_texname, m.normalMap);
+	loadIfAny(mat.normal_texname, m.normalMap);
+	return m;
+}
+
+struct Fragment {
+	glm::vec3 normal;
+	glm::vec3 baseColor;
+	float metallic;
+	float roughness;
+};
+
+// Port of SampleStandardMaterial (standard-material.inc.glsl), called with
+// the inputs that bake-impostor-atlas.frag.glsl gives it.
+Fragment sampleMaterial(const CpuMaterial& mat, glm::vec3 normal, glm::vec3 tangent, glm::vec2 uv, float normalMapping) {
+	Fragment fragment;
+
+	if (normalMapping > 0 && mat.normalMap && glm::dot(tangent, tangent) > 0) {
+		glm::vec3 normal_ts = glm::vec3(mat.normalMap->sample(uv)) * 2.0f - 1.0f;
+		glm::mat3 TBN(
+			glm::normalize(tangent),
+			glm::normalize(glm::cross(normal, tangent)),
+			glm::normalize(normal)
+		);
+		normal = normal + TBN * normal_ts * normalMapping;
+	}
+	fragment.normal = glm::normalize(normal);
+
+	fragment.baseColor = mat.baseColorMap ? glm::vec3(mat.baseColorMap->sample(uv)) : mat.baseColor;
+	fragment.metallic = mat.metallicMap ? mat.metallicMap->sample(uv).x : mat.metallic;
+	fragment.roughness = mat.roughnessMap ? mat.roughnessMap->sample(uv).x : mat.roughness;
+	return fragment;
+}
+
+inline float edge(glm::vec2 a, glm::vec2 b, glm::vec2 p) {
+	return (b.x - a.x) * (p.y - a.y) - (b.y - a.y) * (p.x - a.x);
+}
+
+inline uint8_t quantize(float x) {
+	return static_cast<uint8_t>(std::round(glm::clamp(x, 0.0f, 1.0f) * 255.0f));
+}
+
+} // namespace
+
+bool bakeImpostorAtlasCpu(const std::string& objFilename, const CpuBakeOptions& options, CpuImpostorAtlas& atlas)
+{
+	using clock = std::chrono::high_resolution_clock;
+	auto startTime = clock::now();
+
+	if (!fs::is_regular_file(objFilename)) {
+		ERR_LOG << "Could not find mesh file: " << objFilename;
+		return false;
+	}
+	Mesh mesh(objFilename);
+
+	// 1. Triangle soup, filled the same way as MeshDataBehavior does
+	size_t soupSize = 0;
+	for (const auto& s : mesh.shapes()) {
+		soupSize += s.mesh.indices.size();
+	}
+	std::vector<PointAttributes> soup(soupSize);
+	BufferFiller::Fill(soup.data(), soup.size(), mesh, glm::vec3(0.0f));
+	size_t triangleCount = soupSize / 3;
+
+	// Bounding sphere, as in MeshDataBehavior::computeBoundingSphere
+	glm::vec3 bbMin(std::numeric_limits<float>::max());
+	glm::vec3 bbMax(-std::numeric_limits<float>::max());
+	for (const auto& v : soup) {
+		bbMin = glm::min(bbMin, glm::make_vec3(v.position));
+		bbMax = glm::max(bbMax, glm::make_vec3(v.position));
+	}
+	glm::vec3 center = (bbMin + bbMax) / 2.0f;
+	float scale = 0.0f;
+	for (const auto& v : soup) {
+		scale = glm::max(scale, glm::length(glm::make_vec3(v.position) - center));
+	}
+	if (triangleCount == 0 || scale <= 0.0f) {
+		ERR_LOG << "Nothing to bake in mesh " << objFilename;
+		return false;
+	}
+
+	// 2. Materials
+	TextureLoader loader;
+	std::string textureRoot = fs::absolute(objFilename).parent_path().string();
+	std::vector<CpuMaterial> materials;
+	for (const auto& mat : mesh.materials()) {
+		materials.push_back(materialFromTinyObj(mat, textureRoot, loader));
+	}
+	CpuMaterial defaultMaterial;
+
+	// 3. Rasterize
+	GLuint viewCount = static_cast<GLuint>(std::sqrt(options.angularDefinition / 2));
+	int width = options.spatialDefinition;
+	int ss = std::max(1, options.supersampling);
+	size_t pixelCount = static_cast<size_t>(width) * width;
+	atlas.width = width;
+	atlas.layerCount = static_cast<int>(2 * viewCount * viewCount);
+	atlas.normalAlpha.assign(4 * pixelCount * atlas.layerCount, 0);
+	atlas.baseColor.assign(4 * pixelCount * atlas.layerCount, 0);
+	atlas.metallicRoughness.assign(4 * pixelCount * atlas.layerCount, 0);
+
+	LOG << "Baking impostor atlas of size " << width << "x" << width << "x" << atlas.layerCount << " on CPU (" << ss << "x" << ss << " samples per pixel)";
+	LOG << "A scale factor of " << scale << " and an offset of (" << center.x << ", " << center.y << ", " << center.z << ") are applied to the object at bake time";
+
+	ThreadPool pool(options.threadCount);
+	pool.parallelFor(static_cast<size_t>(atlas.layerCount), [&](size_t layer) {
+		// Project vertices with the same matrices as bake-impostor-atlas.geo.glsl,
+		// directly in pixel coordinates of the texture (row 0 first). z is the
+		// NDC depth, visible in [-1,1], lower is closer.
+		glm::mat4 viewMatrix = glsl::InverseBakingViewMatrix(static_cast<GLuint>(layer), viewCount);
+		std::vector<glm::vec3> screen(soup.size());
+		for (size_t i = 0; i < soup.size(); ++i) {
+			glm::vec3 p = glm::vec3(viewMatrix * glm::vec4(glm::make_vec3(soup[i].position) - center, 1.0f)) / scale;
+			screen[i] = glm::vec3((p.x + 1.0f) * 0.5f * width, (1.0f - p.y) * 0.5f * width, -p.z);
+		}
+
+		std::vector<float> depth(pixelCount);
+		std::vector<int> triangle(pixelCount);
+		std::vector<glm::vec2> barycentric(pixelCount);
+		std::vector<glm::vec4> normalAlpha(pixelCount, glm::vec4(0.0f));
+		std::vector<glm::vec4> baseColor(pixelCount, glm::vec4(0.0f));
+		std::vector<glm::vec4> metallicRoughness(pixelCount, glm::vec4(0.0f));
+
+		for (int sx = 0; sx < ss; ++sx) {
+			for (int sy = 0; sy < ss; ++sy) {
+				// same sample pattern as the GPU baker
+				glm::vec2 offset(0.0f);
+				if (ss > 1) {
+					offset = glm::vec2(sx, sy) / static_cast<float>(ss - 1) - 0.5f;
+				}
+
+				std::fill(depth.begin(), depth.end(), std::numeric_limits<float>::max());
+				std::fill(triangle.begin(), triangle.end(), -1);
+
+				for (size_t t = 0; t < triangleCount; ++t) {
+					glm::vec3 a = screen[3 * t + 0];
+					glm::vec3 b = screen[3 * t + 1];
+					glm::vec3 c = screen[3 * t + 2];
+					glm::vec2 a2 = glm::vec2(a) + offset;
+					glm::vec2 b2 = glm::vec2(b) + offset;
+					glm::vec2 c2 = glm::vec2(c) + offset;
+					float area = edge(a2, b2, c2);
+					if (area == 0.0f) continue; // no culling, both windings are drawn
+
+					glm::vec2 lo = glm::min(a2, glm::min(b2, c2));
+					glm::vec2 hi = glm::max(a2, glm::max(b2, c2));
+					int i0 = std::max(0, static_cast<int>(std::ceil(lo.x - 0.5f)));
+					int j0 = std::max(0, static_cast<int>(std::ceil(lo.y - 0.5f)));
+					int i1 = std::min(width - 1, static_cast<int>(std::floor(hi.x - 0.5f)));
+					int j1 = std::min(width - 1, static_cast<int>(std::floor(hi.y - 0.5f)));
+
+					for (int j = j0; j <= j1; ++j) {
+						for (int i = i0; i <= i1; ++i) {
+							glm::vec2 p(i + 0.5f, j + 0.5f);
+							float w0 = edge(b2, c2, p) / area;
+							float w1 = edge(c2, a2, p) / area;
+							float w2 = 1.0f - w0 - w1;
+							if (w0 < 0.0f || w1 < 0.0f || w2 < 0.0f) continue;
+							float z = w0 * a.z + w1 * b.z + w2 * c.z;
+							size_t pixel = static_cast<size_t>(j) * width + i;
+							if (z < -1.0f || z > 1.0f || z >= depth[pixel]) continue;
+							depth[pixel] = z;
+							triangle[pixel] = static_cast<int>(t);
+							barycentric[pixel] = glm::vec2(w0, w1);
+						}
+					}
+				}
+
+				// Shade visible samples only
+				for (size_t pixel = 0; pixel < pixelCount; ++pixel) {
+					if (triangle[pixel] < 0) continue;
+					const PointAttributes* v = &soup[3 * static_cast<size_t>(triangle[pixel])];
+					glm::vec3 w(barycentric[pixel], 1.0f - barycentric[pixel].x - barycentric[pixel].y);
+					glm::vec3 normal(0.0f), tangent(0.0f);
+					glm::vec2 uv(0.0f);
+					for (int k = 0; k < 3; ++k) {
+						normal += w[k] * glm::make_vec3(v[k].normal);
+						tangent += w[k] * glm::make_vec3(v[k].tangent);
+						uv += w[k] * glm::vec2(v[k].texcoords[0], 1.0f - v[k].texcoords[1]);
+					}
+					const CpuMaterial& mat = v[0].materialId < materials.size() ? materials[v[0].materialId] : defaultMaterial;
+					Fragment fragment = sampleMaterial(mat, normal, tangent, uv, options.normalMapping);
+
+					normalAlpha[pixel] += glm::vec4(fragment.normal * 0.5f + 0.5f, 1.0f);
+					baseColor[pixel] += glm::vec4(fragment.baseColor, 1.0f);
+					metallicRoughness[pixel] += glm::vec4(fragment.metallic, fragment.roughness, 0.0f, 1.0f);
+				}
+			}
+		}
+
+		float multiplier = 1.0f / static_cast<float>(ss * ss);
+		size_t layerOffset = 4 * pixelCount * layer;
+		for (size_t pixel = 0; pixel < pixelCount; ++pixel) {
+			for (int k = 0; k < 4; ++k) {
+				atlas.normalAlpha[layerOffset + 4 * pixel + k] = quantize(normalAlpha[pixel][k] * multiplier);
+				atlas.baseColor[layerOffset + 4 * pixel + k] = quantize(baseColor[pixel][k] * multiplier);
+				atlas.metallicRoughness[layerOffset + 4 * pixel + k] = quantize(metallicRoughness[pixel][k] * multiplier);
+			}
+		}
+	});
+
+	auto duration = std::chrono::duration_cast<std::chrono::milliseconds>(clock::now() - startTime);
+	LOG << "Baked " << atlas.layerCount << " views of " << triangleCount << " triangles in " << duration.count() << " ms using " << pool.threadCount() << " threads";
+	return true;
+}
+
+bool saveImpostorAtlasCpu(const std::string& outputDirectory, const CpuImpostorAtlas& atlas)
+{
+	struct Map { const char* name; const std::vector<uint8_t>& pixels; };
+	const Map maps[] = {
+		{ "normalAlpha", atlas.normalAlpha },
+		{ "baseColor", atlas.baseColor },
+		{ "metallicRoughness", atlas.metallicRoughness },
+	};
+
+	size_t layerSize = 4 * static_cast<size_t>(atlas.width) * atlas.width;
+	std::atomic<bool> success{ true };
+	for (const Map& map : maps) {
+		fs::path dir = fs::path(outputDirectory) / map.name;
+		std::error_code err;
+		fs::create_directories(dir, err);
+		if (!fs::is_directory(dir)) {
+			ERR_LOG << "Could not create directory " << dir;
+			return false;
+		}
+		ThreadPool::Shared().parallelFor(static_cast<size_t>(atlas.layerCount), [&](size_t layer) {
+			fs::path slicename = dir / string_format("view%04d.png", static_cast<int>(layer));
+			if (!stbi_write_png(slicename.string().c_str(), atlas.width, atlas.width, 4, map.pixels.data() + layerSize * layer, 4 * atlas.width)) {
+				WARN_LOG << "Could not write file '" << slicename << "'";
+				success = false;
+			}
+		});
+	}
+
+	LOG << "Saved impostor atlas to " << outputDirectory;
+	return success;
+}
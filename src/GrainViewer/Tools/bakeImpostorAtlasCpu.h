@@ -0,0 +1,69 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * CPU port of ImpostorAtlasMaterial::bakeMaps, for machines without an
+ * OpenGL 4.5 context. Views are rasterized in parallel and shaded like
+ * bake-impostor-atlas.frag.glsl does.
+ */
+
+struct CpuBakeOptions {
+	int angularDefinition = 128; // rounded like in ImpostorAtlasMaterial, to 2n^2
+	int spatialDefinition = 128;
+	int supersampling = 2; // per axis, the GPU baker uses 2
+	float normalMapping = 10.0f; // uNormalMapping of the bake shader
+	size_t threadCount = 0; // 0 for one per core
+};
+
+/**
+ * RGBA8 maps, layer after layer, in the same row order as the GPU textures
+ */
+struct CpuImpostorAtlas {
+	int width = 0;
+	int layerCount = 0;
+	std::vector<uint8_t> normalAlpha;
+	std::vector<uint8_t> baseColor;
+	std::vector<uint8_t> metallicRoughness;
+};
+
+bool bakeImpostorAtlasCpu(const std::string& objFilename, const CpuBakeOptions& options, CpuImpostorAtlas& atlas);
+
+/**
+ * Write maps as texture stacks that can be loaded back with the
+ * normalAlpha/baseColor/metallicRoughness options of impostor materials.
+ */
+bool saveImpostorAtlasCpu(const std::string& outputDirectory, const CpuImpostorAtlas& atlas);
@@ -34,6 +34,76 @@
 
 #include <imgui.h>
 
+#include <map>
+
+typedef std::map<std::string, GlobalTimer::Stats>::const_iterator StatsIterator;
+
+static void drawPercentiles(const GlobalTimer::Stats& stats)
+{
+	const auto& h = stats.histogram;
+	const auto& g = stats.gpuHistogram;
+	ImGui::TextDisabled("  p50 %.03f / %.03f, p95 %.03f / %.03f", h.percentile(0.5), g.percentile(0.5), h.percentile(0.95), g.percentile(0.95));
+	ImGui::TextDisabled("  p99 %.03f / %.03f, max %.03f / %.03f", h.percentile(0.99), g.percentile(0.99), h.max, g.max);
+}
+
+// e.g. 1.2M, to keep counters on a single line
+static std::string formatCount(GLuint64 count)
+{
+	double c = static_cast<double>(count);
+	if (c >= 1e9) return MAKE_STR(static_cast<float>(c * 1e-9) << "G");
+	if (c >= 1e6) return MAKE_STR(static_cast<float>(c * 1e-6) << "M");
+	if (c >= 1e3) return MAKE_STR(static_cast<float>(c * 1e-3) << "K");
+	return std::to_string(count);
+}
+
+static void drawCounters(const GlobalTimer::Stats& stats)
+{
+	const auto& c = stats.lastCounters;
+	if (stats.hasCounters) {
+		ImGui::TextDisabled("  %s draws, %s points",
+			formatCount(c[GlobalTimer::DrawCalls]).c_str(),
+			formatCount(c[GlobalTimer::Points]).c_str());
+	}
+	if (stats.hasQueryCounters) {
+		ImGui::TextDisabled("  prims %s, vs %s, gs %s",
+			formatCount(c[GlobalTimer::PrimitivesGenerated]).c_str(),
+			formatCount(c[GlobalTimer::VertexShaderInvocations]).c_str(),
+			formatCount(c[GlobalTimer::GeometryShaderInvocations]).c_str());
+		ImGui::TextDisabled("  fs %s, cs %s",
+			formatCount(c[GlobalTimer::FragmentShaderInvocations]).c_str(),
+			formatCount(c[GlobalTimer::ComputeShaderInvocations]).c_str());
+	}
+}
+
+static void drawStats(StatsIterator it, const std::multimap<std::string, StatsIterator>& children)
+{
+	const auto& s = *it;
+	double avg = s.second.cumulatedTime;
+	double avgGpu = s.second.cumulatedGpuTime;
+	ImGui::Checkbox(MAKE_STR(s.first << ":").c_str(), &s.second.ui.visible);
+	{
+		// color tag
+		const ImVec2 p = ImGui::GetCursorScreenPos();
+		glm::vec3 c = s.second.ui.color;
+		ImDrawList* draw_list = ImGui::GetWindowDrawList();
+		float x = p.x, y = p.y - 3;
+		draw_list->AddRectFilled(ImVec2(x, y), ImVec2(x + 20, y + 3), ImColor(c.r, c.g, c.b, 1.0f));
+	}
+	ImGui::Text("  %.05f / %.05f", avg, avgGpu);
+	drawPercentiles(s.second);
+	drawCounters(s.second);
+
+	// Nested timers
+	auto range = children.equal_range(s.first);
+	if (range.first != range.second) {
+		ImGui::Indent();
+		for (auto child = range.first; child != range.second; ++child) {
+			drawStats(child->second, children);
+		}
+		ImGui::Unindent();
+	}
+}
+
 void GlobalTimerDialog::draw()
 {
 	auto cont = m_cont.lock();
@@ -42,27 +112,39 @@ void GlobalTimerDialog::draw()
 		if (ImGui::Button("Reset All")) {
 			cont->resetAllStats();
 		}
+		ImGui::SameLine();
+		if (ImGui::Button("Reset Percentiles")) {
+			cont->resetPercentiles();
+		}
 		int n = cont->frameStats().sampleCount;
 		double avg = cont->frameStats().cumulatedTime;
 		double avgGpu = cont->frameStats().cumulatedGpuTime;
 		ImGui::Text("Frame: %.05f / %.05f", avg, avgGpu);
-		for (auto& s : cont->stats()) {
-			int n = s.second.sampleCount;
-			double avg = s.second.cumulatedTime;
-			double avgGpu = s.second.cumulatedGpuTime;
-			double offset = s.second.cumulatedFrameOffset;
-			ImGui::Checkbox(MAKE_STR(s.first << ":").c_str(), &s.second.ui.visible);
-			{
-				// color tag
-				const ImVec2 p = ImGui::GetCursorScreenPos();
-				glm::vec3 c = s.second.ui.color;
-				ImDrawList* draw_list = ImGui::GetWindowDrawList();
-				float x = p.x, y = p.y - 3;
-				draw_list->AddRectFilled(ImVec2(x, y), ImVec2(x + 20, y + 3), ImColor(c.r, c.g, c.b, 1.0f));
+		drawPercentiles(cont->frameStats());
+
+		// Timers are listed under the one they are nested in
+		const auto& stats = cont->stats();
+		std::multimap<std::string, StatsIterator> children;
+		for (auto it = stats.begin(); it != stats.end(); ++it) {
+			const std::string& parent = it->second.parent;
+			if (!parent.empty() && parent != it->first && stats.count(parent) > 0) {
+				children.insert({ parent, it });
+			}
+		}
+		for (auto it = stats.begin(); it != stats.end(); ++it) {
+			const std::string& parent = it->second.parent;
+			if (parent.empty() || parent == it->first || stats.count(parent) == 0) {
+				drawStats(it, children);
 			}
-			ImGui::Text("  %.05f / %.05f", avg, avgGpu);
 		}
+
 		autoUi(cont->properties());
+		if (cont->isCapturingTrace()) {
+			ImGui::Text("Capturing trace...");
+		}
+		else if (ImGui::Button("Capture trace (T)")) {
+			cont->captureTrace(cont->properties().traceFrameCount);
+		}
 	}
 }
 
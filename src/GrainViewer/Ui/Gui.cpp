@@ -500,9 +500,17 @@ void Gui::onKey(int key, int scancode, int action, int mods) {
 				m_scene->load(m_scene->filename());
 				afterLoading();
 			}
-			else {
+			else if (mods & GLFW_MOD_SHIFT) {
 				m_scene->reloadShaders();
 			}
+			else {
+				// only what changed on disk
+				ShaderPool::PollHotReload(true);
+			}
+			break;
+
+		case GLFW_KEY_T:
+			GlobalTimer::CaptureTrace(GlobalTimer::GetInstance()->properties().traceFrameCount);
 			break;
 
 		case GLFW_KEY_U:
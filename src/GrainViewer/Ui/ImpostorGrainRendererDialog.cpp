@@ -42,6 +42,16 @@ void ImpostorGrainRendererDialog::draw()
 
 			BeginDisable(!enabled);
 			autoUi(cont->properties());
+			if (cont->properties().countFragments) {
+				const auto& counters = cont->fragmentCounters();
+				ImGui::Text("Grain fragments: %llu", static_cast<unsigned long long>(counters.grainFragments));
+				if (counters.resolvedPixels > 0) {
+					ImGui::Text("Resolved pixels: %llu (overdraw x%.2f)",
+						static_cast<unsigned long long>(counters.resolvedPixels),
+						static_cast<double>(counters.grainFragments) / static_cast<double>(counters.resolvedPixels));
+				}
+				ImGui::Text("Framebuffer writes: %.2f MB", static_cast<double>(counters.bytesWritten) * 1e-6);
+			}
 			EndDisable(!enabled);
 		}
 	}
@@ -0,0 +1,100 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+
+#pragma once
+
+#include <cstdint>
+#include <string>
+
+/**
+ * Name of a uniform, reduced to the 64 bit FNV-1a hash that
+ * ShaderProgram's location cache is keyed by. Building one never allocates
+ * and is done at compile time for literals and reflected properties (see
+ * autoSetUniforms). Names can be extended, so that array prefixes like
+ * "uMaterial[0]." are hashed once:
+ *   UniformName("uImpostor")[k] + "viewCount" == UniformName("uImpostor[k].viewCount")
+ */
+class UniformName {
+public:
+	constexpr UniformName(const char* str) : m_hash(Extend(OffsetBasis, str)) {}
+	UniformName(const std::string& str) : m_hash(Extend(OffsetBasis, str.data(), str.size())) {}
+
+	constexpr uint64_t hash() const { return m_hash; }
+
+	// Append a suffix
+	constexpr UniformName operator+(const char* suffix) const { return UniformName(Extend(m_hash, suffix), 0); }
+
+	// Append a decimal number, e.g. "gbuffer" + i
+	constexpr UniformName operator+(int number) const { return UniformName(ExtendNumber(m_hash, number), 0); }
+
+	// Append "[index]."
+	constexpr UniformName operator[](int index) const { return UniformName(Extend(ExtendNumber(Extend(m_hash, "["), index), "]."), 0); }
+
+	constexpr bool operator==(const UniformName& other) const { return m_hash == other.m_hash; }
+	constexpr bool operator!=(const UniformName& other) const { return m_hash != other.m_hash; }
+
+private:
+	constexpr UniformName(uint64_t hash, int) : m_hash(hash) {}
+
+	static constexpr uint64_t OffsetBasis = 0xcbf29ce484222325ull;
+	static constexpr uint64_t Prime = 0x100000001b3ull;
+
+	static constexpr uint64_t Extend(uint64_t hash, const char* str) {
+		for (; *str != '\0'; ++str) {
+			hash = (hash ^ static_cast<uint8_t>(*str)) * Prime;
+		}
+		return hash;
+	}
+	static constexpr uint64_t Extend(uint64_t hash, const char* str, size_t size) {
+		for (size_t i = 0; i < size; ++i) {
+			hash = (hash ^ static_cast<uint8_t>(str[i])) * Prime;
+		}
+		return hash;
+	}
+	static constexpr uint64_t ExtendNumber(uint64_t hash, int number) {
+		if (number < 0) {
+			hash = (hash ^ static_cast<uint8_t>('-')) * Prime;
+			number = -number;
+		}
+		char digits[12] = {};
+		int n = 0;
+		do {
+			digits[n++] = static_cast<char>('0' + number % 10);
+			number /= 10;
+		} while (number > 0);
+		while (n > 0) {
+			hash = (hash ^ static_cast<uint8_t>(digits[--n])) * Prime;
+		}
+		return hash;
+	}
+
+private:
+	uint64_t m_hash;
+};
@@ -41,8 +41,12 @@
 #include "AnimationManager.h"
 
 #include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cstring>
 #include <fstream>
 
+static_assert(sizeof(LightData) == 112, "LightData must match the std430 layout of PointLight in include/light.inc.glsl");
+
 World::World()
 {}
 
@@ -133,12 +137,16 @@ bool World::deserialize(const rapidjson::Value & json, std::shared_ptr<Animation
 			bool isTurning;
 			jrOption(l, "isTurning", isTurning, false);
 
+			float radius;
+			jrOption(l, "radius", radius, 0.0f);
+
 			// Add light
 			auto light =
 				isTurning
 				? std::make_shared<TurningLight>(pos, col, shadowMapSize, isShadowMapRich, hasShadowMap)
 				: std::make_shared<Light>(pos, col, shadowMapSize, isShadowMapRich, hasShadowMap);
 			light->shadowMap().setProjection(shadowMapFov, shadowMapNear, shadowMapFar);
+			light->setRadius(radius);
 
 			if (usePositionBuffer) {
 				std::string path = ResourceManager::resolveResourcePath(p["buffer"].GetString());
@@ -171,6 +179,11 @@ bool World::deserialize(const rapidjson::Value & json, std::shared_ptr<Animation
 
 			m_lights.push_back(light);
 		}
+
+		size_t shadowMapCount = std::count_if(m_lights.begin(), m_lights.end(), [](const auto& light) { return light->hasShadowMap(); });
+		if (shadowMapCount > MaxShadowMaps) {
+			WARN_LOG << "Only the first " << MaxShadowMaps << " lights with a shadow map cast shadows (" << shadowMapCount << " requested)";
+		}
 	}
 
 	return true;
@@ -187,6 +200,7 @@ void World::update(float time)
 	for (auto light : lights()) {
 		light->update(time);
 	}
+	updateLightBuffer();
 }
 
 void World::reloadShaders()
@@ -219,8 +233,9 @@ void World::renderShadowMaps(const std::vector<std::shared_ptr<RuntimeObject>> &
 	if (!isShadowMapEnabled()) {
 		return;
 	}
-	for (const auto& light : m_lights) {
-		if (!light->hasShadowMap()) {
+	for (size_t k = 0; k < m_lights.size(); ++k) {
+		const auto& light = m_lights[k];
+		if (shadowMapIndex(k) < 0) {
 			continue;
 		}
 
@@ -248,12 +263,69 @@ void World::renderShadowMaps(const std::vector<std::shared_ptr<RuntimeObject>> &
 void World::clear()
 {
 	m_lights.clear();
+	m_lightData.clear();
+	m_unboundedLightCount = 0;
+}
+
+void World::bindLightBuffer(GLuint binding) const
+{
+	if (m_lightBuffer) {
+		m_lightBuffer->bindSsbo(binding);
+	}
+}
+
+int World::shadowMapIndex(size_t lightIndex) const
+{
+	return lightIndex < m_lightData.size() ? m_lightData[lightIndex].shadowMapIndex : -1;
 }
 
 ///////////////////////////////////////////////////////////////////////////////
 // Private methods
 ///////////////////////////////////////////////////////////////////////////////
 
+void World::updateLightBuffer()
+{
+	std::vector<LightData> data(m_lights.size());
+	int shadowMapCount = 0;
+	for (size_t k = 0; k < m_lights.size(); ++k) {
+		const Light& light = *m_lights[k];
+		const Camera& shadowCamera = light.shadowMap().camera();
+		LightData& d = data[k];
+		d.position_ws = light.position();
+		d.radius = light.radius();
+		d.color = light.color();
+		d.shadowMapIndex = light.hasShadowMap() && shadowMapCount < MaxShadowMaps ? shadowMapCount++ : -1;
+		d.matrix = shadowCamera.projectionMatrix() * shadowCamera.viewMatrix();
+		d.isRich = light.isRich() ? 1 : 0;
+	}
+
+	// Lights rarely change, only upload when they do
+	if (m_lightBuffer && data.size() == m_lightData.size()
+		&& std::memcmp(data.data(), m_lightData.data(), data.size() * sizeof(LightData)) == 0) {
+		return;
+	}
+	m_lightData = std::move(data);
+
+	if (!m_lightBuffer || m_lightBufferCapacity < m_lightData.size()) {
+		m_lightBufferCapacity = std::max(m_lightData.size(), static_cast<size_t>(1));
+		m_lightBuffer = std::make_unique<GlBuffer>(GL_SHADER_STORAGE_BUFFER);
+		m_lightBuffer->addBlock<LightData>(m_lightBufferCapacity);
+		m_lightBuffer->alloc();
+	}
+	// Unbounded lights first, so that culling and the deferred shader can
+	// handle them apart without an index list. Shadow map indices are stored
+	// in the lights so this order does not matter otherwise.
+	std::vector<LightData> gpuData = m_lightData;
+	auto firstBounded = std::stable_partition(gpuData.begin(), gpuData.end(), [](const LightData& d) { return d.radius <= 0.0f; });
+	m_unboundedLightCount = static_cast<GLuint>(firstBounded - gpuData.begin());
+
+	if (!gpuData.empty()) {
+		m_lightBuffer->fillBlock<LightData>(0, [&gpuData](LightData* dst, size_t size) {
+			memcpy(dst, gpuData.data(), gpuData.size() * sizeof(LightData));
+		});
+	}
+}
+
 void World::initVao() {
 	GLfloat attributes[] = {
 		-1.0f,  1.0f, -1.0f,
@@ -32,7 +32,9 @@
 #include <OpenGL>
 
 #include "Camera.h"
+#include "GlBuffer.h"
 
+#include <glm/glm.hpp>
 #include <rapidjson/document.h>
 
 #include <vector>
@@ -43,11 +45,29 @@ class ShaderProgram;
 class RuntimeObject;
 class AnimationManager;
 
+/**
+ * Light as stored in the lights SSBO, must match PointLight in include/light.inc.glsl
+ */
+struct LightData {
+	glm::vec3 position_ws;
+	GLfloat radius; // 0 for unbounded lights
+	glm::vec3 color;
+	GLint shadowMapIndex; // -1 if the light casts no shadow
+	glm::mat4 matrix; // shadow map view-projection
+	GLint isRich;
+	GLint _pad[3];
+};
+
 /**
  * Contains all lighting information for a render
  */
 class World {
 public:
+	// Shadow maps are bound to fixed texture units in the deferred shader,
+	// so only this many lights can cast shadows. There is no limit on the
+	// number of lights otherwise.
+	static constexpr int MaxShadowMaps = 4;
+
 	World();
 	bool deserialize(const rapidjson::Value & json, std::shared_ptr<AnimationManager> animations);
 	void start();
@@ -59,6 +79,16 @@ public:
 
 	const std::vector<std::shared_ptr<Light>> & lights() const { return m_lights; }
 
+	/**
+	 * Lights SSBO, updated in update() only when some light changed
+	 */
+	void bindLightBuffer(GLuint binding) const;
+	GLuint lightCount() const { return static_cast<GLuint>(m_lightData.size()); }
+	// Lights with no radius, which come first in the SSBO
+	GLuint unboundedLightCount() const { return m_unboundedLightCount; }
+	// Index of the light's shadow map in the deferred shader, or -1
+	int shadowMapIndex(size_t lightIndex) const;
+
 	void clear();
 
 	bool isShadowMapEnabled() const { return m_isShadowMapEnabled; }
@@ -66,6 +96,7 @@ public:
 
 private:
 	void initVao();
+	void updateLightBuffer();
 
 private:
 	std::string m_shaderName = "World";
@@ -74,4 +105,9 @@ private:
 	GLuint m_vbo; // TODO: use GlBuffer here!
 	GLuint m_vao;
 	bool m_isShadowMapEnabled = true;
+
+	std::vector<LightData> m_lightData; // as last uploaded, but in m_lights order
+	GLuint m_unboundedLightCount = 0;
+	std::unique_ptr<GlBuffer> m_lightBuffer;
+	size_t m_lightBufferCapacity = 0;
 };
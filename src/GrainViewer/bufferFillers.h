@@ -41,6 +41,19 @@ struct PointAttributes {
 	GLfloat tangent[3];
 };
 
+/**
+ * Lighter version of PointAttributes (36 bytes instead of 48),
+ * normals and tangents are snorm16 and texcoords are half floats.
+ * The 4th component of normal and tangent is just padding.
+ */
+struct CompressedPointAttributes {
+	GLfloat position[3];
+	GLshort normal[4];
+	GLhalf  texcoords[2];
+	GLuint  materialId;
+	GLshort tangent[4];
+};
+
 struct DrawArraysIndirectCommand  {
 	GLuint  count;
 	GLuint  instanceCount;
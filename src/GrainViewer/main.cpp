@@ -33,6 +33,10 @@
 #include "Ui/Gui.h"
 #include "Scene.h"
 #include "GlobalTimer.h"
+#include "StatsSink.h"
+#include "ShaderProgram.h"
+
+#include <GLFW/glfw3.h>
 
 #include <cstdlib> // for EXIT_FAILURE and EXIT_SUCCESS
 #include <memory>
@@ -57,6 +61,11 @@ int main(int argc, char *argv[]) {
 		return EXIT_FAILURE;
 	}
 
+	// Before any shader gets compiled (see ShaderPool::WarmUpShaderVariant)
+	ShaderProgram::EnableParallelCompilation([](const char* name) {
+		return reinterpret_cast<void*>(glfwGetProcAddress(name));
+	});
+
 	auto gui = std::make_unique<Gui>(window);
 	auto scene = std::make_shared<Scene>();
 
@@ -64,6 +73,7 @@ int main(int argc, char *argv[]) {
 
 	gui->beforeLoading();
 	if (!scene->load(filename)) {
+		StatsSink::Shutdown();
 		return EXIT_FAILURE;
 	}
 	gui->afterLoading();
@@ -77,7 +87,11 @@ int main(int argc, char *argv[]) {
 
 		window->swapBuffers();
 		GlobalTimer::StopFrame();
+		StatsSink::NextFrame();
 	}
 
+	// Export stats files that are still open
+	StatsSink::Shutdown();
+
 	return EXIT_SUCCESS;
 }
@@ -0,0 +1,93 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+
+#include "utils/MappedFile.h"
+
+#ifdef _WIN32
+#include <windows.h>
+#else // _WIN32
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif // _WIN32
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& filename)
+{
+	HANDLE file = CreateFileA(filename.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) return;
+	m_file = file;
+
+	LARGE_INTEGER size;
+	if (!GetFileSizeEx(file, &size) || size.QuadPart == 0) return;
+
+	HANDLE mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+	if (mapping == NULL) return;
+	m_mapping = mapping;
+
+	void* view = MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (view == NULL) return;
+	m_data = static_cast<const uint8_t*>(view);
+	m_size = static_cast<size_t>(size.QuadPart);
+}
+
+MappedFile::~MappedFile()
+{
+	if (m_data) UnmapViewOfFile(m_data);
+	if (m_mapping) CloseHandle(static_cast<HANDLE>(m_mapping));
+	if (m_file) CloseHandle(static_cast<HANDLE>(m_file));
+}
+
+#else // _WIN32
+
+MappedFile::MappedFile(const std::string& filename)
+{
+	int fd = open(filename.c_str(), O_RDONLY);
+	if (fd < 0) return;
+
+	struct stat st;
+	if (fstat(fd, &st) == 0 && st.st_size > 0) {
+		void* view = mmap(nullptr, static_cast<size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+		if (view != MAP_FAILED) {
+			m_data = static_cast<const uint8_t*>(view);
+			m_size = static_cast<size_t>(st.st_size);
+		}
+	}
+	close(fd); // the mapping keeps its own reference to the file
+}
+
+MappedFile::~MappedFile()
+{
+	if (m_data) munmap(const_cast<uint8_t*>(m_data), m_size);
+}
+
+#endif // _WIN32
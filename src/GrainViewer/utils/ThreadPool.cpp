@@ -0,0 +1,119 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+
+#include "utils/ThreadPool.h"
+
+#include <algorithm>
+
+ThreadPool::ThreadPool(size_t threadCount)
+{
+	if (threadCount == 0) {
+		threadCount = std::max<size_t>(std::thread::hardware_concurrency(), 1);
+	}
+	for (size_t i = 1; i < threadCount; ++i) {
+		m_workers.emplace_back(&ThreadPool::workerLoop, this);
+	}
+}
+
+ThreadPool::~ThreadPool()
+{
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_stop = true;
+	}
+	m_wakeUp.notify_all();
+	for (auto& worker : m_workers) {
+		worker.join();
+	}
+}
+
+void ThreadPool::parallelFor(size_t count, const std::function<void(size_t)>& task)
+{
+	if (count == 0) return;
+
+	if (m_workers.empty() || count == 1) {
+		for (size_t i = 0; i < count; ++i) task(i);
+		return;
+	}
+
+	std::lock_guard<std::mutex> jobLock(m_jobMutex);
+	{
+		std::lock_guard<std::mutex> lock(m_mutex);
+		m_task = &task;
+		m_count = count;
+		m_next = 0;
+		m_finishedWorkers = 0;
+		++m_generation;
+	}
+	m_wakeUp.notify_all();
+
+	runTasks();
+
+	// Every worker takes part in every job (even if there is nothing left
+	// to do), so none of them can still hold a reference to this task once
+	// all of them are done.
+	std::unique_lock<std::mutex> lock(m_mutex);
+	m_done.wait(lock, [&] { return m_finishedWorkers == m_workers.size(); });
+	m_task = nullptr;
+}
+
+ThreadPool& ThreadPool::Shared()
+{
+	static ThreadPool s_pool;
+	return s_pool;
+}
+
+void ThreadPool::workerLoop()
+{
+	uint64_t generation = 0;
+	for (;;) {
+		{
+			std::unique_lock<std::mutex> lock(m_mutex);
+			m_wakeUp.wait(lock, [&] { return m_stop || m_generation != generation; });
+			if (m_stop) return;
+			generation = m_generation;
+		}
+
+		runTasks();
+
+		{
+			std::lock_guard<std::mutex> lock(m_mutex);
+			++m_finishedWorkers;
+		}
+		m_done.notify_one();
+	}
+}
+
+void ThreadPool::runTasks()
+{
+	for (size_t i = m_next++; i < m_count; i = m_next++) {
+		(*m_task)(i);
+	}
+}
@@ -0,0 +1,91 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+
+#pragma once
+
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+/**
+ * Minimal fixed size pool of worker threads, used for CPU heavy loading
+ * tasks (e.g. decoding images) that can be split into independent items.
+ * Workers are persistent so that several loads in a row do not pay for
+ * thread creation.
+ */
+class ThreadPool {
+public:
+	/**
+	 * Create a pool of threadCount threads, including the calling thread.
+	 * A threadCount of 0 means one thread per hardware core.
+	 */
+	explicit ThreadPool(size_t threadCount = 0);
+	~ThreadPool();
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	size_t threadCount() const { return m_workers.size() + 1; }
+
+	/**
+	 * Call task(i) for all i in [0, count[ and block until all are done.
+	 * The calling thread takes part in the work. Tasks must not call
+	 * parallelFor on the same pool.
+	 */
+	void parallelFor(size_t count, const std::function<void(size_t)>& task);
+
+	/**
+	 * Pool shared by the whole application, lazily created
+	 */
+	static ThreadPool& Shared();
+
+private:
+	void workerLoop();
+	void runTasks();
+
+private:
+	std::vector<std::thread> m_workers;
+	std::mutex m_jobMutex; // one job at a time
+	std::mutex m_mutex;
+	std::condition_variable m_wakeUp;
+	std::condition_variable m_done;
+
+	// Current job, protected by m_mutex except m_next
+	const std::function<void(size_t)>* m_task = nullptr;
+	size_t m_count = 0;
+	std::atomic<size_t> m_next{ 0 };
+	uint64_t m_generation = 0;
+	size_t m_finishedWorkers = 0;
+	bool m_stop = false;
+};
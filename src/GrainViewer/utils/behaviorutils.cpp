@@ -28,6 +28,10 @@
  */
 
 #include "behaviorutils.h"
+#include "IPointCloudData.h"
+
+// Must match grain/random-grains.inc.glsl
+constexpr GLuint GrainOrientationsSsboBinding = 6;
 
 std::string toDisplayName(const std::string& name) {
 	std::vector<char> chars;
@@ -46,3 +50,12 @@ std::string toDisplayName(const std::string& name) {
 	}
 	return std::string(chars.begin(), chars.end());
 }
+
+void bindGrainOrientations(const ShaderProgram& shader, const IPointCloudData& pointData) {
+	if (const GlBuffer* orientations = pointData.orientations()) {
+		orientations->bindSsbo(GrainOrientationsSsboBinding);
+		shader.setUniform("uUseGrainOrientations", true);
+	} else {
+		shader.setUniform("uUseGrainOrientations", false);
+	}
+}
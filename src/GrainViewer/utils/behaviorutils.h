@@ -43,6 +43,8 @@
 
 #include <string>
 
+class IPointCloudData;
+
 // This file is more reflectutils.h than anything else actually
 
 /**
@@ -89,6 +91,18 @@ void autoDeserialize(const rapidjson::Value& json, T& properties) {
 	});
 }
 
+/**
+ * Transform property name "foo" into uniform name "uFoo", at compile time
+ */
+template<size_t N>
+constexpr refl::util::const_string<N + 1> toUniformName(const refl::util::const_string<N>& propertyName) {
+	refl::util::const_string<N + 1> name = "u" + propertyName;
+	if (name.data[1] >= 'a' && name.data[1] <= 'z') {
+		name.data[1] = static_cast<char>(name.data[1] - 'a' + 'A');
+	}
+	return name;
+}
+
 /**
  * Automatically bind properties using reflection.
  * The type T must have reflection enabled (see refl-cpp)
@@ -98,10 +112,7 @@ void autoSetUniforms(const ShaderProgram& shader, const T& properties) {
 	// Automatically bind properties using reflection
 	for_each(refl::reflect(properties).members, [&](auto member) {
 		using type = typename decltype(member)::value_type;
-		// transform property name "foo" into uniform name "uFoo"
-			// (ideally this transformation should be performed at compile time)
-		std::string name = "u" + std::string(member.name);
-		name[1] = toupper(name[1]);
+		constexpr UniformName name(toUniformName(decltype(member)::name).data);
 		// whatever is supported by setUniform
 		if constexpr (
 			std::is_same_v<type, bool>
@@ -188,7 +199,43 @@ void autoUi(T& properties) {
 	});
 }
 
+/**
+ * Call f on properties, then on each copy that differs by a single bool or
+ * enum property, i.e. what is one click away in the UI. Used to list the
+ * shader variants worth warming up (see Behavior::warmUpShaders).
+ */
+template<typename T, typename F>
+void forEachNeighbourProperties(const T& properties, F f) {
+	f(properties);
+	for_each(refl::reflect(properties).members, [&](auto member) {
+		using type = typename decltype(member)::value_type;
+		if constexpr (refl::descriptor::has_attribute<ReflectionAttributes::HideInDialog>(member)) {
+			// skip
+		}
+		else if constexpr (std::is_same_v<type, bool>) {
+			T neighbour = properties;
+			member(neighbour) = !member(properties);
+			f(neighbour);
+		}
+		else if constexpr (std::is_enum_v<type>) {
+			for (type value : magic_enum::enum_values<type>()) {
+				if (value == member(properties)) continue;
+				T neighbour = properties;
+				member(neighbour) = value;
+				f(neighbour);
+			}
+		}
+	});
+}
+
 // Misc utils (should end up somewhere else)
+
+/**
+ * Bind per grain orientations of a point cloud if it has some, and tell
+ * shaders using grain/random-grains.inc.glsl whether to use them.
+ */
+void bindGrainOrientations(const ShaderProgram& shader, const IPointCloudData& pointData);
+
 template <typename Enum>
 constexpr Enum lastValue() {
 	return magic_enum::enum_value<Enum>(magic_enum::enum_count<Enum>() - 1);
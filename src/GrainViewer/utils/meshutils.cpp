@@ -0,0 +1,385 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+#include "utils/meshutils.h"
+
+#include <glm/glm.hpp>
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/gtc/packing.hpp>
+
+#include <unordered_map>
+#include <algorithm>
+#include <numeric>
+#include <cstring>
+#include <cstddef>
+#include <cmath>
+
+///////////////////////////////////////////////////////////////////////////////
+// Deduplication
+///////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+// Everything but the tangent is used to identify a vertex
+constexpr size_t VertexKeySize = offsetof(PointAttributes, tangent);
+
+struct VertexKeyHash {
+	const std::vector<PointAttributes>* soup;
+	size_t operator()(GLuint i) const {
+		// FNV-1a
+		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&(*soup)[i]);
+		size_t h = 14695981039346656037ULL;
+		for (size_t k = 0; k < VertexKeySize; ++k) {
+			h ^= bytes[k];
+			h *= 1099511628211ULL;
+		}
+		return h;
+	}
+};
+
+struct VertexKeyEqual {
+	const std::vector<PointAttributes>* soup;
+	bool operator()(GLuint a, GLuint b) const {
+		return memcmp(&(*soup)[a], &(*soup)[b], VertexKeySize) == 0;
+	}
+};
+
+} // namespace
+
+void deduplicateVertices(
+	const std::vector<PointAttributes>& soup,
+	std::vector<PointAttributes>& vertices,
+	std::vector<GLuint>& indices)
+{
+	std::unordered_map<GLuint, GLuint, VertexKeyHash, VertexKeyEqual> remap(soup.size(), VertexKeyHash{ &soup }, VertexKeyEqual{ &soup });
+	std::vector<glm::vec3> tangents;
+
+	vertices.clear();
+	indices.resize(soup.size());
+	for (GLuint i = 0; i < static_cast<GLuint>(soup.size()); ++i) {
+		auto it = remap.emplace(i, static_cast<GLuint>(vertices.size()));
+		if (it.second) {
+			vertices.push_back(soup[i]);
+			tangents.push_back(glm::vec3(0.0f));
+		}
+		GLuint v = it.first->second;
+		indices[i] = v;
+
+		glm::vec3 t = glm::make_vec3(soup[i].tangent);
+		if (std::isfinite(t.x) && std::isfinite(t.y) && std::isfinite(t.z)) {
+			tangents[v] += t;
+		}
+	}
+
+	for (size_t v = 0; v < vertices.size(); ++v) {
+		float l = glm::length(tangents[v]);
+		if (l > 1e-8f) {
+			glm::vec3 t = tangents[v] / l;
+			vertices[v].tangent[0] = t.x;
+			vertices[v].tangent[1] = t.y;
+			vertices[v].tangent[2] = t.z;
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Vertex cache optimization
+///////////////////////////////////////////////////////////////////////////////
+
+namespace {
+
+constexpr size_t ForsythCacheSize = 32;
+
+float forsythVertexScore(int cachePosition, GLuint remainingValence)
+{
+	if (remainingValence == 0) return -1.0f;
+
+	float score = 0.0f;
+	if (cachePosition >= 0) {
+		if (cachePosition < 3) {
+			// Vertices of the last triangle get a fixed score, not to favor
+			// using them again right away (which would produce strips)
+			score = 0.75f;
+		}
+		else {
+			float x = 1.0f - static_cast<float>(cachePosition - 3) / static_cast<float>(ForsythCacheSize - 3);
+			score = std::pow(x, 1.5f);
+		}
+	}
+
+	// Bonus for vertices with few remaining triangles, to get rid of them
+	score += 2.0f / std::sqrt(static_cast<float>(remainingValence));
+	return score;
+}
+
+} // namespace
+
+void optimizeVertexCache(std::vector<GLuint>& indices, size_t vertexCount)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0) return;
+
+	// 1. Vertex to triangle adjacency
+	std::vector<GLuint> valence(vertexCount, 0);
+	for (GLuint v : indices) ++valence[v];
+
+	std::vector<size_t> adjacencyOffset(vertexCount + 1, 0);
+	for (size_t v = 0; v < vertexCount; ++v) {
+		adjacencyOffset[v + 1] = adjacencyOffset[v] + valence[v];
+	}
+
+	std::vector<GLuint> adjacency(indices.size());
+	{
+		std::vector<size_t> cursor(adjacencyOffset.begin(), adjacencyOffset.end() - 1);
+		for (size_t i = 0; i < indices.size(); ++i) {
+			adjacency[cursor[indices[i]]++] = static_cast<GLuint>(i / 3);
+		}
+	}
+
+	// 2. Initial scores
+	std::vector<int> cachePosition(vertexCount, -1);
+	std::vector<float> vertexScores(vertexCount);
+	for (size_t v = 0; v < vertexCount; ++v) {
+		vertexScores[v] = forsythVertexScore(-1, valence[v]);
+	}
+
+	std::vector<float> triangleScores(triangleCount);
+	std::vector<bool> emitted(triangleCount, false);
+	size_t best = 0;
+	for (size_t t = 0; t < triangleCount; ++t) {
+		triangleScores[t] =
+			vertexScores[indices[3 * t + 0]] +
+			vertexScores[indices[3 * t + 1]] +
+			vertexScores[indices[3 * t + 2]];
+		if (triangleScores[t] > triangleScores[best]) best = t;
+	}
+
+	// 3. Greedily emit the best scored triangle
+	std::vector<GLuint> output;
+	output.reserve(indices.size());
+	std::vector<GLuint> cache, newCache;
+	cache.reserve(ForsythCacheSize + 3);
+	newCache.reserve(ForsythCacheSize + 3);
+	size_t scanCursor = 0;
+	const size_t none = triangleCount;
+
+	while (best != none) {
+		emitted[best] = true;
+		newCache.clear();
+
+		for (int k = 0; k < 3; ++k) {
+			GLuint v = indices[3 * best + k];
+			output.push_back(v);
+
+			// Remove triangle from the vertex' live adjacency
+			size_t begin = adjacencyOffset[v];
+			size_t end = begin + valence[v];
+			for (size_t j = begin; j < end; ++j) {
+				if (adjacency[j] == best) {
+					std::swap(adjacency[j], adjacency[end - 1]);
+					break;
+				}
+			}
+			--valence[v];
+
+			if (std::find(newCache.begin(), newCache.end(), v) == newCache.end()) {
+				newCache.push_back(v);
+			}
+		}
+		size_t emittedCount = newCache.size();
+		for (GLuint v : cache) {
+			if (std::find(newCache.begin(), newCache.begin() + emittedCount, v) == newCache.begin() + emittedCount) {
+				newCache.push_back(v);
+			}
+		}
+
+		// Update scores of vertices that moved in, along or out of the cache
+		for (size_t i = 0; i < newCache.size(); ++i) {
+			GLuint v = newCache[i];
+			int position = i < ForsythCacheSize ? static_cast<int>(i) : -1;
+			cachePosition[v] = position;
+			float score = forsythVertexScore(position, valence[v]);
+			float delta = score - vertexScores[v];
+			vertexScores[v] = score;
+			for (size_t j = adjacencyOffset[v]; j < adjacencyOffset[v] + valence[v]; ++j) {
+				triangleScores[adjacency[j]] += delta;
+			}
+		}
+		if (newCache.size() > ForsythCacheSize) newCache.resize(ForsythCacheSize);
+		std::swap(cache, newCache);
+
+		// Next triangle is looked for among the ones touching the cache
+		best = none;
+		for (GLuint v : cache) {
+			for (size_t j = adjacencyOffset[v]; j < adjacencyOffset[v] + valence[v]; ++j) {
+				GLuint t = adjacency[j];
+				if (best == none || triangleScores[t] > triangleScores[best]) best = t;
+			}
+		}
+
+		// or anywhere if none is found
+		if (best == none) {
+			while (scanCursor < triangleCount && emitted[scanCursor]) ++scanCursor;
+			if (scanCursor < triangleCount) best = scanCursor;
+		}
+	}
+
+	indices.swap(output);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Overdraw optimization
+///////////////////////////////////////////////////////////////////////////////
+
+void optimizeOverdraw(std::vector<GLuint>& indices, const std::vector<PointAttributes>& vertices, size_t cacheSize)
+{
+	size_t triangleCount = indices.size() / 3;
+	if (triangleCount == 0) return;
+
+	// 1. Split in clusters wherever the simulated cache got flushed, which is
+	// where reordering won't hurt cache efficiency.
+	std::vector<size_t> clusterStarts;
+	{
+		std::vector<size_t> timestamps(vertices.size(), 0);
+		size_t time = cacheSize + 1;
+		for (size_t t = 0; t < triangleCount; ++t) {
+			int misses = 0;
+			for (int k = 0; k < 3; ++k) {
+				GLuint v = indices[3 * t + k];
+				if (time - timestamps[v] > cacheSize) {
+					timestamps[v] = time++;
+					++misses;
+				}
+			}
+			if (misses == 3 || t == 0) clusterStarts.push_back(t);
+		}
+	}
+	clusterStarts.push_back(triangleCount);
+	size_t clusterCount = clusterStarts.size() - 1;
+
+	// 2. Sort clusters by how much they face away from the mesh center
+	auto position = [&](GLuint v) { return glm::make_vec3(vertices[v].position); };
+
+	glm::vec3 meshCenter(0.0f);
+	for (GLuint v : indices) meshCenter += position(v);
+	meshCenter /= static_cast<float>(indices.size());
+
+	std::vector<float> sortKeys(clusterCount);
+	for (size_t c = 0; c < clusterCount; ++c) {
+		glm::vec3 center(0.0f);
+		glm::vec3 normal(0.0f);
+		for (size_t t = clusterStarts[c]; t < clusterStarts[c + 1]; ++t) {
+			glm::vec3 p0 = position(indices[3 * t + 0]);
+			glm::vec3 p1 = position(indices[3 * t + 1]);
+			glm::vec3 p2 = position(indices[3 * t + 2]);
+			center += p0 + p1 + p2;
+			normal += glm::cross(p1 - p0, p2 - p0); // area weighted
+		}
+		center /= static_cast<float>(3 * (clusterStarts[c + 1] - clusterStarts[c]));
+		float l = glm::length(normal);
+		sortKeys[c] = l > 0.0f ? glm::dot(center - meshCenter, normal / l) : 0.0f;
+	}
+
+	std::vector<size_t> order(clusterCount);
+	std::iota(order.begin(), order.end(), 0);
+	std::stable_sort(order.begin(), order.end(), [&sortKeys](size_t a, size_t b) {
+		return sortKeys[a] > sortKeys[b];
+	});
+
+	std::vector<GLuint> output;
+	output.reserve(indices.size());
+	for (size_t c : order) {
+		output.insert(output.end(), indices.begin() + 3 * clusterStarts[c], indices.begin() + 3 * clusterStarts[c + 1]);
+	}
+	indices.swap(output);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Vertex fetch optimization
+///////////////////////////////////////////////////////////////////////////////
+
+void optimizeVertexFetch(std::vector<GLuint>& indices, std::vector<PointAttributes>& vertices)
+{
+	constexpr GLuint unused = static_cast<GLuint>(-1);
+	std::vector<GLuint> remap(vertices.size(), unused);
+	std::vector<PointAttributes> output;
+	output.reserve(vertices.size());
+
+	for (GLuint& v : indices) {
+		if (remap[v] == unused) {
+			remap[v] = static_cast<GLuint>(output.size());
+			output.push_back(vertices[v]);
+		}
+		v = remap[v];
+	}
+
+	// unreferenced vertices are dropped
+	vertices.swap(output);
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Statistics
+///////////////////////////////////////////////////////////////////////////////
+
+size_t simulateVertexInvocations(const std::vector<GLuint>& indices, size_t vertexCount, size_t cacheSize)
+{
+	std::vector<size_t> timestamps(vertexCount, 0);
+	size_t time = cacheSize + 1;
+	size_t invocations = 0;
+	for (GLuint v : indices) {
+		if (time - timestamps[v] > cacheSize) {
+			timestamps[v] = time++;
+			++invocations;
+		}
+	}
+	return invocations;
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// Compression
+///////////////////////////////////////////////////////////////////////////////
+
+void compressPointAttributes(const std::vector<PointAttributes>& vertices, std::vector<CompressedPointAttributes>& compressed)
+{
+	compressed.resize(vertices.size());
+	for (size_t i = 0; i < vertices.size(); ++i) {
+		const PointAttributes& src = vertices[i];
+		CompressedPointAttributes& dst = compressed[i];
+		for (int k = 0; k < 3; ++k) {
+			dst.position[k] = src.position[k];
+			dst.normal[k] = static_cast<GLshort>(glm::packSnorm1x16(src.normal[k]));
+			dst.tangent[k] = static_cast<GLshort>(glm::packSnorm1x16(src.tangent[k]));
+		}
+		dst.normal[3] = 0;
+		dst.tangent[3] = 0;
+		dst.texcoords[0] = static_cast<GLhalf>(glm::packHalf1x16(src.texcoords[0]));
+		dst.texcoords[1] = static_cast<GLhalf>(glm::packHalf1x16(src.texcoords[1]));
+		dst.materialId = src.materialId;
+	}
+}
@@ -0,0 +1,86 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+#pragma once
+
+#include <OpenGL>
+
+#include "bufferFillers.h"
+
+#include <vector>
+#include <cstddef>
+
+/**
+ * Tools to turn a de-indexed triangle soup into a GPU friendly indexed mesh.
+ * Typical use is, in this order:
+ *   deduplicateVertices(soup, vertices, indices);
+ *   optimizeVertexCache(indices, vertices.size());
+ *   optimizeOverdraw(indices, vertices);
+ *   optimizeVertexFetch(indices, vertices);
+ */
+
+// Size of the FIFO cache used to simulate the post-transform cache
+constexpr size_t DefaultVertexCacheSize = 16;
+
+/**
+ * Merge vertices that share the same position, normal, uv and material.
+ * Tangents (which are computed per face by BufferFiller) are averaged.
+ */
+void deduplicateVertices(
+	const std::vector<PointAttributes>& soup,
+	std::vector<PointAttributes>& vertices,
+	std::vector<GLuint>& indices);
+
+/**
+ * Reorder triangles to maximize post-transform cache hits
+ * (Forsyth, "Linear-Speed Vertex Cache Optimisation", 2006).
+ */
+void optimizeVertexCache(std::vector<GLuint>& indices, size_t vertexCount);
+
+/**
+ * Reorder clusters of triangles (as split by the vertex cache optimization)
+ * so that the ones facing outwards are drawn first, to reduce overdraw.
+ */
+void optimizeOverdraw(std::vector<GLuint>& indices, const std::vector<PointAttributes>& vertices, size_t cacheSize = DefaultVertexCacheSize);
+
+/**
+ * Reorder vertices in the order they are first used by the index buffer.
+ */
+void optimizeVertexFetch(std::vector<GLuint>& indices, std::vector<PointAttributes>& vertices);
+
+/**
+ * Number of vertex shader invocations needed to draw the index buffer,
+ * using a FIFO post-transform cache of the given size.
+ */
+size_t simulateVertexInvocations(const std::vector<GLuint>& indices, size_t vertexCount, size_t cacheSize = DefaultVertexCacheSize);
+
+/**
+ * Quantize normal and tangent to snorm16 and uvs to half floats.
+ */
+void compressPointAttributes(const std::vector<PointAttributes>& vertices, std::vector<CompressedPointAttributes>& compressed);
@@ -33,6 +33,7 @@
 #include <algorithm>
 #include <functional>
 #include <cctype>
+#include <cstdio>
 
 // trim from start (in place)
 void ltrim(std::string& s) {
@@ -88,3 +89,28 @@ std::string bitname(int flags, int flagCount)
 	}
 	return text;
 }
+
+std::string escapeJsonString(const std::string& s)
+{
+	std::string escaped;
+	escaped.reserve(s.size());
+	for (char c : s) {
+		switch (c) {
+		case '"': escaped += "\\\""; break;
+		case '\\': escaped += "\\\\"; break;
+		case '\n': escaped += "\\n"; break;
+		case '\r': escaped += "\\r"; break;
+		case '\t': escaped += "\\t"; break;
+		default:
+			if (static_cast<unsigned char>(c) < 0x20) {
+				char code[7];
+				std::snprintf(code, sizeof(code), "\\u%04x", c);
+				escaped += code;
+			}
+			else {
+				escaped += c;
+			}
+		}
+	}
+	return escaped;
+}
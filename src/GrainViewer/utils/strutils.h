@@ -62,6 +62,12 @@ std::string replaceAll(std::string str, const std::string& search, const std::st
 
 std::string bitname(int flags, int flagCount);
 
+/**
+ * Escape quotes, backslashes and control characters so that s can be
+ * written between double quotes in a JSON file
+ */
+std::string escapeJsonString(const std::string& s);
+
 // from https://stackoverflow.com/questions/2342162/stdstring-formatting-like-sprintf
 template<typename ... Args>
 std::string string_format(const std::string& format, Args ... args)
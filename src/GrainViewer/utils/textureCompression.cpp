@@ -0,0 +1,437 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+#include "utils/textureCompression.h"
+
+#include <algorithm>
+#include <cstring>
+#include <cmath>
+
+namespace {
+
+constexpr size_t BlockSize = 16; // bytes per 4x4 block, for both BC5 and BC7
+
+// Fetch a 4x4 block of RGBA8 pixels, clamping at image borders
+void fetchBlock(const uint8_t* rgba, int width, int height, int bx, int by, uint8_t block[16][4]) {
+	for (int j = 0; j < 4; ++j) {
+		for (int i = 0; i < 4; ++i) {
+			int x = std::min(4 * bx + i, width - 1);
+			int y = std::min(4 * by + j, height - 1);
+			std::memcpy(block[4 * j + i], rgba + 4 * (static_cast<size_t>(y) * width + x), 4);
+		}
+	}
+}
+
+void storeBlock(uint8_t* rgba, int width, int height, int bx, int by, const uint8_t block[16][4]) {
+	for (int j = 0; j < 4; ++j) {
+		for (int i = 0; i < 4; ++i) {
+			int x = 4 * bx + i;
+			int y = 4 * by + j;
+			if (x >= width || y >= height) continue;
+			std::memcpy(rgba + 4 * (static_cast<size_t>(y) * width + x), block[4 * j + i], 4);
+		}
+	}
+}
+
+// Blocks are little endian bit streams
+class BitWriter {
+public:
+	explicit BitWriter(uint8_t* data) : m_data(data) { std::memset(m_data, 0, BlockSize); }
+	void write(uint32_t value, int bitCount) {
+		for (int k = 0; k < bitCount; ++k, ++m_offset) {
+			if ((value >> k) & 1) {
+				m_data[m_offset / 8] |= static_cast<uint8_t>(1 << (m_offset % 8));
+			}
+		}
+	}
+private:
+	uint8_t* m_data;
+	int m_offset = 0;
+};
+
+class BitReader {
+public:
+	BitReader(const uint8_t* data, int offset = 0) : m_data(data), m_offset(offset) {}
+	uint32_t read(int bitCount) {
+		uint32_t value = 0;
+		for (int k = 0; k < bitCount; ++k, ++m_offset) {
+			value |= ((m_data[m_offset / 8] >> (m_offset % 8)) & 1) << k;
+		}
+		return value;
+	}
+private:
+	const uint8_t* m_data;
+	int m_offset;
+};
+
+///////////////////////////////////////////////////////////////////////////////
+// BC7, mode 6 only: one subset, RGBA 7 bits endpoints with a p-bit each,
+// and 4 bits indices. It is the most generic mode and handles alpha well.
+
+const int bc7Weights4[16] = { 0, 4, 9, 13, 17, 21, 26, 30, 34, 38, 43, 47, 51, 55, 60, 64 };
+
+uint8_t bc7Interpolate(int e0, int e1, int index) {
+	int w = bc7Weights4[index];
+	return static_cast<uint8_t>(((64 - w) * e0 + w * e1 + 32) >> 6);
+}
+
+// Quantize an endpoint to 7 bits + shared p-bit, returns the 8 bit values
+void bc7QuantizeEndpoint(const float e[4], uint8_t q7[4], int& pbit, uint8_t q8[4]) {
+	float bestError = -1.0f;
+	for (int p = 0; p < 2; ++p) {
+		uint8_t c7[4], c8[4];
+		float error = 0.0f;
+		for (int c = 0; c < 4; ++c) {
+			int v = static_cast<int>(std::round((e[c] - p) * 0.5f));
+			v = std::clamp(v, 0, 127);
+			c7[c] = static_cast<uint8_t>(v);
+			c8[c] = static_cast<uint8_t>((v << 1) | p);
+			float d = e[c] - c8[c];
+			error += d * d;
+		}
+		if (bestError < 0.0f || error < bestError) {
+			bestError = error;
+			pbit = p;
+			std::memcpy(q7, c7, 4);
+			std::memcpy(q8, c8, 4);
+		}
+	}
+}
+
+// Quantize endpoints and select the best index for each pixel, returns the squared error
+int bc7FitIndices(const uint8_t pixels[16][4], const float e0[4], const float e1[4], uint8_t q7[2][4], uint8_t q8[2][4], int pbits[2], int indices[16]) {
+	bc7QuantizeEndpoint(e0, q7[0], pbits[0], q8[0]);
+	bc7QuantizeEndpoint(e1, q7[1], pbits[1], q8[1]);
+
+	int totalError = 0;
+	for (int i = 0; i < 16; ++i) {
+		int bestError = -1;
+		for (int k = 0; k < 16; ++k) {
+			int error = 0;
+			for (int c = 0; c < 4; ++c) {
+				int d = bc7Interpolate(q8[0][c], q8[1][c], k) - pixels[i][c];
+				error += d * d;
+			}
+			if (bestError < 0 || error < bestError) {
+				bestError = error;
+				indices[i] = k;
+			}
+		}
+		totalError += bestError;
+	}
+	return totalError;
+}
+
+void encodeBC7Mode6(const uint8_t pixels[16][4], uint8_t* out) {
+	// Principal axis of the block colors
+	float mean[4] = { 0, 0, 0, 0 };
+	for (int i = 0; i < 16; ++i) {
+		for (int c = 0; c < 4; ++c) mean[c] += pixels[i][c] / 16.0f;
+	}
+	float cov[4][4] = {};
+	float lo[4] = { 255, 255, 255, 255 }, hi[4] = { 0, 0, 0, 0 };
+	for (int i = 0; i < 16; ++i) {
+		for (int a = 0; a < 4; ++a) {
+			lo[a] = std::min(lo[a], static_cast<float>(pixels[i][a]));
+			hi[a] = std::max(hi[a], static_cast<float>(pixels[i][a]));
+			for (int b = 0; b < 4; ++b) {
+				cov[a][b] += (pixels[i][a] - mean[a]) * (pixels[i][b] - mean[b]);
+			}
+		}
+	}
+	float axis[4];
+	for (int c = 0; c < 4; ++c) axis[c] = hi[c] - lo[c];
+	for (int iter = 0; iter < 8; ++iter) {
+		float next[4] = { 0, 0, 0, 0 };
+		float norm = 0.0f;
+		for (int a = 0; a < 4; ++a) {
+			for (int b = 0; b < 4; ++b) next[a] += cov[a][b] * axis[b];
+			norm = std::max(norm, std::abs(next[a]));
+		}
+		if (norm == 0.0f) break;
+		for (int a = 0; a < 4; ++a) axis[a] = next[a] / norm;
+	}
+	float axisSqLength = 0.0f;
+	for (int c = 0; c < 4; ++c) axisSqLength += axis[c] * axis[c];
+
+	float tmin = 0.0f, tmax = 0.0f;
+	if (axisSqLength > 0.0f) {
+		tmin = 1e9f; tmax = -1e9f;
+		for (int i = 0; i < 16; ++i) {
+			float t = 0.0f;
+			for (int c = 0; c < 4; ++c) t += (pixels[i][c] - mean[c]) * axis[c];
+			t /= axisSqLength;
+			tmin = std::min(tmin, t);
+			tmax = std::max(tmax, t);
+		}
+	}
+	float e0[4], e1[4];
+	for (int c = 0; c < 4; ++c) {
+		e0[c] = std::clamp(mean[c] + tmin * axis[c], 0.0f, 255.0f);
+		e1[c] = std::clamp(mean[c] + tmax * axis[c], 0.0f, 255.0f);
+	}
+
+	uint8_t q7[2][4], q8[2][4];
+	int pbits[2];
+	int indices[16];
+	int error = bc7FitIndices(pixels, e0, e1, q7, q8, pbits, indices);
+
+	// Refine endpoints by least squares given the selected indices
+	for (int iter = 0; iter < 2 && error > 0; ++iter) {
+		float aa = 0, ab = 0, bb = 0;
+		float ap[4] = { 0, 0, 0, 0 }, bp[4] = { 0, 0, 0, 0 };
+		for (int i = 0; i < 16; ++i) {
+			float w = bc7Weights4[indices[i]] / 64.0f;
+			aa += (1 - w) * (1 - w);
+			ab += (1 - w) * w;
+			bb += w * w;
+			for (int c = 0; c < 4; ++c) {
+				ap[c] += (1 - w) * pixels[i][c];
+				bp[c] += w * pixels[i][c];
+			}
+		}
+		float det = aa * bb - ab * ab;
+		if (std::abs(det) < 1e-6f) break;
+		float r0[4], r1[4];
+		for (int c = 0; c < 4; ++c) {
+			r0[c] = std::clamp((bb * ap[c] - ab * bp[c]) / det, 0.0f, 255.0f);
+			r1[c] = std::clamp((aa * bp[c] - ab * ap[c]) / det, 0.0f, 255.0f);
+		}
+		uint8_t rq7[2][4], rq8[2][4];
+		int rpbits[2], rindices[16];
+		int refinedError = bc7FitIndices(pixels, r0, r1, rq7, rq8, rpbits, rindices);
+		if (refinedError >= error) break;
+		error = refinedError;
+		std::memcpy(q7, rq7, sizeof(q7));
+		std::memcpy(q8, rq8, sizeof(q8));
+		std::memcpy(pbits, rpbits, sizeof(pbits));
+		std::memcpy(indices, rindices, sizeof(indices));
+	}
+
+	// The msb of the first index is implicitly 0, swap endpoints if needed
+	if (indices[0] & 8) {
+		std::swap(q7[0], q7[1]);
+		std::swap(pbits[0], pbits[1]);
+		for (int i = 0; i < 16; ++i) indices[i] = 15 - indices[i];
+	}
+
+	BitWriter bits(out);
+	bits.write(1 << 6, 7); // mode 6
+	for (int c = 0; c < 4; ++c) {
+		bits.write(q7[0][c], 7);
+		bits.write(q7[1][c], 7);
+	}
+	bits.write(pbits[0], 1);
+	bits.write(pbits[1], 1);
+	bits.write(indices[0], 3);
+	for (int i = 1; i < 16; ++i) bits.write(indices[i], 4);
+}
+
+void decodeBC7(const uint8_t* in, uint8_t pixels[16][4]) {
+	if ((in[0] & 0x7F) != (1 << 6)) {
+		// Other modes are never produced by encodeBC7Mode6
+		std::memset(pixels, 0, 16 * 4);
+		return;
+	}
+	BitReader bits(in, 7);
+	int e[2][4];
+	for (int c = 0; c < 4; ++c) {
+		e[0][c] = bits.read(7) << 1;
+		e[1][c] = bits.read(7) << 1;
+	}
+	int p0 = bits.read(1), p1 = bits.read(1);
+	for (int c = 0; c < 4; ++c) {
+		e[0][c] |= p0;
+		e[1][c] |= p1;
+	}
+	for (int i = 0; i < 16; ++i) {
+		int index = bits.read(i == 0 ? 3 : 4);
+		for (int c = 0; c < 4; ++c) {
+			pixels[i][c] = bc7Interpolate(e[0][c], e[1][c], index);
+		}
+	}
+}
+
+///////////////////////////////////////////////////////////////////////////////
+// BC4 (one channel), two of which make a BC5 block
+
+void bc4Palette(int e0, int e1, uint8_t palette[8]) {
+	palette[0] = static_cast<uint8_t>(e0);
+	palette[1] = static_cast<uint8_t>(e1);
+	if (e0 > e1) {
+		for (int i = 2; i < 8; ++i) {
+			palette[i] = static_cast<uint8_t>(((8 - i) * e0 + (i - 1) * e1 + 3) / 7);
+		}
+	} else {
+		for (int i = 2; i < 6; ++i) {
+			palette[i] = static_cast<uint8_t>(((6 - i) * e0 + (i - 1) * e1 + 2) / 5);
+		}
+		palette[6] = 0;
+		palette[7] = 255;
+	}
+}
+
+void encodeBC4(const uint8_t pixels[16][4], int channel, uint8_t* out) {
+	int lo = 255, hi = 0;
+	for (int i = 0; i < 16; ++i) {
+		lo = std::min(lo, static_cast<int>(pixels[i][channel]));
+		hi = std::max(hi, static_cast<int>(pixels[i][channel]));
+	}
+	uint8_t palette[8];
+	bc4Palette(hi, lo, palette);
+
+	out[0] = static_cast<uint8_t>(hi);
+	out[1] = static_cast<uint8_t>(lo);
+	uint64_t indices = 0;
+	for (int i = 0; i < 16; ++i) {
+		int best = 0;
+		for (int k = 1; k < 8; ++k) {
+			if (std::abs(palette[k] - pixels[i][channel]) < std::abs(palette[best] - pixels[i][channel])) {
+				best = k;
+			}
+		}
+		indices |= static_cast<uint64_t>(best) << (3 * i);
+	}
+	for (int k = 0; k < 6; ++k) {
+		out[2 + k] = static_cast<uint8_t>(indices >> (8 * k));
+	}
+}
+
+void decodeBC4(const uint8_t* in, int channel, uint8_t pixels[16][4]) {
+	uint8_t palette[8];
+	bc4Palette(in[0], in[1], palette);
+	uint64_t indices = 0;
+	for (int k = 0; k < 6; ++k) {
+		indices |= static_cast<uint64_t>(in[2 + k]) << (8 * k);
+	}
+	for (int i = 0; i < 16; ++i) {
+		pixels[i][channel] = palette[(indices >> (3 * i)) & 7];
+	}
+}
+
+} // anonymous namespace
+
+///////////////////////////////////////////////////////////////////////////////
+// Public API
+///////////////////////////////////////////////////////////////////////////////
+
+bool isSupportedCompressedFormat(GLenum internalFormat) {
+	return internalFormat == GL_COMPRESSED_RGBA_BPTC_UNORM || internalFormat == GL_COMPRESSED_RG_RGTC2;
+}
+
+size_t compressedImageSize(GLenum internalFormat, int width, int height) {
+	size_t blockCountX = (static_cast<size_t>(width) + 3) / 4;
+	size_t blockCountY = (static_cast<size_t>(height) + 3) / 4;
+	return blockCountX * blockCountY * BlockSize;
+}
+
+void compressImage(GLenum internalFormat, const uint8_t* rgba, int width, int height, uint8_t* blocks) {
+	int blockCountX = (width + 3) / 4;
+	int blockCountY = (height + 3) / 4;
+	uint8_t pixels[16][4];
+	for (int by = 0; by < blockCountY; ++by) {
+		for (int bx = 0; bx < blockCountX; ++bx) {
+			uint8_t* out = blocks + BlockSize * (static_cast<size_t>(by) * blockCountX + bx);
+			fetchBlock(rgba, width, height, bx, by, pixels);
+			switch (internalFormat) {
+			case GL_COMPRESSED_RGBA_BPTC_UNORM:
+				encodeBC7Mode6(pixels, out);
+				break;
+			case GL_COMPRESSED_RG_RGTC2:
+				encodeBC4(pixels, 0, out);
+				encodeBC4(pixels, 1, out + 8);
+				break;
+			}
+		}
+	}
+}
+
+void decompressImage(GLenum internalFormat, const uint8_t* blocks, int width, int height, uint8_t* rgba) {
+	int blockCountX = (width + 3) / 4;
+	int blockCountY = (height + 3) / 4;
+	uint8_t pixels[16][4];
+	for (int by = 0; by < blockCountY; ++by) {
+		for (int bx = 0; bx < blockCountX; ++bx) {
+			const uint8_t* in = blocks + BlockSize * (static_cast<size_t>(by) * blockCountX + bx);
+			switch (internalFormat) {
+			case GL_COMPRESSED_RGBA_BPTC_UNORM:
+				decodeBC7(in, pixels);
+				break;
+			case GL_COMPRESSED_RG_RGTC2:
+				for (int i = 0; i < 16; ++i) {
+					pixels[i][2] = 0;
+					pixels[i][3] = 255;
+				}
+				decodeBC4(in, 0, pixels);
+				decodeBC4(in + 8, 1, pixels);
+				break;
+			}
+			storeBlock(rgba, width, height, bx, by, pixels);
+		}
+	}
+}
+
+ImageDiff diffImages(const uint8_t* a, const uint8_t* b, int width, int height, int channels, bool normals) {
+	ImageDiff diff;
+	double sqError = 0.0;
+	double angleSum = 0.0;
+	size_t normalCount = 0;
+	size_t pixelCount = static_cast<size_t>(width) * height;
+	for (size_t i = 0; i < pixelCount; ++i) {
+		const uint8_t* pa = a + 4 * i;
+		const uint8_t* pb = b + 4 * i;
+		for (int c = 0; c < channels; ++c) {
+			int d = std::abs(pa[c] - pb[c]);
+			sqError += d * d;
+			diff.maxError = std::max(diff.maxError, d);
+		}
+		if (normals && pa[3] > 0) {
+			float na[3], nb[3];
+			float dotab = 0.0f, la = 0.0f, lb = 0.0f;
+			for (int c = 0; c < 3; ++c) {
+				na[c] = pa[c] / 255.0f * 2.0f - 1.0f;
+				nb[c] = pb[c] / 255.0f * 2.0f - 1.0f;
+				dotab += na[c] * nb[c];
+				la += na[c] * na[c];
+				lb += nb[c] * nb[c];
+			}
+			if (la > 0.0f && lb > 0.0f) {
+				double cosAngle = std::clamp(dotab / std::sqrt(la * lb), -1.0f, 1.0f);
+				double angle = std::acos(cosAngle) * 180.0 / 3.14159265358979;
+				diff.maxNormalAngle = std::max(diff.maxNormalAngle, angle);
+				angleSum += angle;
+				++normalCount;
+			}
+		}
+	}
+	if (normalCount > 0) diff.meanNormalAngle = angleSum / static_cast<double>(normalCount);
+	double mse = sqError / static_cast<double>(pixelCount * channels);
+	diff.psnr = mse > 0.0 ? 10.0 * std::log10(255.0 * 255.0 / mse) : 99.0;
+	return diff;
+}
@@ -0,0 +1,79 @@
+/**
+ * This file is part of GrainViewer, the reference implementation of:
+ *
+ *   Michel, Élie and Boubekeur, Tamy (2020).
+ *   Real Time Multiscale Rendering of Dense Dynamic Stackings,
+ *   Computer Graphics Forum (Proc. Pacific Graphics 2020), 39: 169-179.
+ *   https://doi.org/10.1111/cgf.14135
+ *
+ * Copyright (c) 2017 - 2020 -- Télécom Paris (Élie Michel <elie.michel@telecom-paris.fr>)
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a copy
+ * of this software and associated documentation files (the “Software”), to
+ * deal in the Software without restriction, including without limitation the
+ * rights to use, copy, modify, merge, publish, distribute, sublicense, and/or
+ * sell copies of the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included in
+ * all copies or substantial portions of the Software.
+ *
+ * The Software is provided “as is”, without warranty of any kind, express or
+ * implied, including but not limited to the warranties of merchantability,
+ * fitness for a particular purpose and non-infringement. In no event shall the
+ * authors or copyright holders be liable for any claim, damages or other
+ * liability, whether in an action of contract, tort or otherwise, arising
+ * from, out of or in connection with the software or the use or other dealings
+ * in the Software.
+ */
+
+#pragma once
+
+#include <OpenGL>
+
+#include <vector>
+#include <cstddef>
+#include <cstdint>
+
+/**
+ * CPU encoders for block compressed textures, used to compress impostor
+ * atlases after they have been loaded (or baked) and mipmapped.
+ * Supported formats are:
+ *   GL_COMPRESSED_RGBA_BPTC_UNORM (BC7, only mode 6 is used)
+ *   GL_COMPRESSED_RG_RGTC2 (BC5)
+ * Both use 16 bytes per 4x4 block, i.e. 4 times less than RGBA8.
+ */
+
+bool isSupportedCompressedFormat(GLenum internalFormat);
+
+/**
+ * Size in bytes of one compressed image (one layer of one mip level)
+ */
+size_t compressedImageSize(GLenum internalFormat, int width, int height);
+
+/**
+ * Compress a tightly packed RGBA8 image into blocks.
+ * Edge blocks of images whose size is not a multiple of 4 are padded by
+ * clamping coordinates.
+ */
+void compressImage(GLenum internalFormat, const uint8_t* rgba, int width, int height, uint8_t* blocks);
+
+/**
+ * Decompress blocks back to RGBA8, for quality checks
+ * (missing channels are set to 0, alpha to 255).
+ */
+void decompressImage(GLenum internalFormat, const uint8_t* blocks, int width, int height, uint8_t* rgba);
+
+struct ImageDiff {
+	double psnr = 0.0; // in dB, over the compared channels
+	int maxError = 0; // max absolute difference on any compared channel
+	double meanNormalAngle = 0.0; // in degrees, only if compared as normals
+	double maxNormalAngle = 0.0;
+};
+
+/**
+ * Compare two RGBA8 images on their first 'channels' channels. If
+ * 'normals' is true, rgb is also decoded as n = 2 * c - 1 and the angle
+ * between normals is measured where alpha is not null (in image a).
+ */
+ImageDiff diffImages(const uint8_t* a, const uint8_t* b, int width, int height, int channels, bool normals = false);